@@ -0,0 +1,99 @@
+#ifndef AMU_H
+#define AMU_H
+
+#define IVSWEEP_POINTS 40      // Must match setting in AMU.
+#define AMU_TWI_ADDRESS 0x0F // Must match AMU
+#define AMU_TWI_ADDR_FIRST 0x0F // Discovery window, one AMU per experimental face.
+#define AMU_TWI_ADDR_LAST 0x16
+#define AMU_MAX_DEVICES 6
+#define AMU_SWEEP_TICKS ((3U * BSP_TICKS_PER_SEC + 1U) / 2U + 1U) // 1.5 s sweep, rounded up, +1 as the first tick may be due at once
+#define AMU_READ_RETRIES 2 // Re-reads of a sweep that failed on the bus or its CRC.
+
+#define AMU_REG_CMD 0x00
+#define AMU_REG_DATA_PTR_TIMESTAMP 0xF0
+#define AMU_REG_DATA_PTR_VOLTAGE 0xF1
+#define AMU_REG_DATA_PTR_CURRENT 0xF2
+#define AMU_REG_DATA_PTR_USER_SWEEP 0xF3 // User sweep voltages, float[IVSWEEP_POINTS]. Unconfirmed, see AMU_ADAPTIVE_SWEEP
+#define AMU_REG_DATA_PTR_SWEEP_META 0xF6
+#define AMU_REG_TRANSFER_PTR 0xFE
+
+#define CMD_SWEEP_TRIG_SWEEP 0x0142
+#define CMD_SWEEP_TRIG_ISC 0x0143
+#define CMD_SWEEP_TRIG_VOC 0x0144
+#define CMD_SWEEP_CONF_TYPE 0x0120 // Value in the transfer register. Unconfirmed, see AMU_ADAPTIVE_SWEEP
+
+// Sweep types, as SweepType in sandbox/amu.py.
+#define AMU_SWEEP_TYPE_LINEAR 0
+#define AMU_SWEEP_TYPE_USER1 2
+
+// The adaptive sweep relies on AMU_REG_DATA_PTR_USER_SWEEP and
+// CMD_SWEEP_CONF_TYPE, which are read off sandbox/amu.py and not yet checked
+// against the AMU firmware, so it is only built with -D AMU_ADAPTIVE_SWEEP.
+// amu_sweep_all() never uses either.
+#define AMU_KNEE_POINTS 24 // Points of the adaptive dense pass placed around Vmp.
+
+#define AMU_TWI_TRANSFER_READ 1
+#define AMU_TWI_TRANSFER_WRITE 0
+
+#define CMD_RW_BIT 7
+#define CMD_READ (1 << CMD_RW_BIT)
+#define CMD_WRITE (0 << CMD_RW_BIT)
+
+#define AMU_TRANSFER_REG_SIZE 8 // Largest query<T>() result, sizeof(amu_meas_t)
+
+// Type definitions.
+typedef struct
+{
+  float voc;
+  float isc;
+  float tsensor_start;
+  float tsensor_end;
+  float ff;
+  float eff;
+  float vmax;
+  float imax;
+  float pmax;
+  float adc;
+  uint32_t timestamp;
+  uint32_t crc; // CRC-32 of timestamp[], voltage[] and current[] in that order. Must match AMU.
+} ivsweep_meta_t;
+
+typedef struct
+{
+  float measurement;
+  float temperature;
+} amu_meas_t;
+
+// One complete sweep. Lives in a g_sweepPool block, never on the stack.
+typedef struct
+{
+  uint8_t cell;    // Index into the discovered AMU table.
+  uint8_t address; // TWI address of the AMU.
+  uint32_t bus_us; // TWI time spent reading this sweep back.
+  uint32_t timestamp[IVSWEEP_POINTS];
+  float voltage[IVSWEEP_POINTS];
+  float current[IVSWEEP_POINTS];
+  ivsweep_meta_t meta;
+} ivsweep_t;
+
+// Function prototypes.
+void amu_init();
+uint8_t amu_discover();
+bool amu_sweep_all(QActive *owner);
+#ifdef AMU_ADAPTIVE_SWEEP
+bool amu_sweep_adaptive(QActive *owner);
+#endif
+void amu_on_timeout();
+void amu_on_twi_done(uint32_t par);
+void amu_on_sweep_released();
+bool amu_sweep_crc_ok(const ivsweep_t *sweep);
+void amu_report();
+int amu_wire_transfer(uint8_t address, uint8_t reg, uint8_t *data, size_t len, uint8_t read);
+void measure_voc();
+void measure_isc();
+uint16_t measure_iv_curve(); // Returns an EvtHandle into g_sweepPool.
+void print_iv_curve(const ivsweep_t *sweep);
+int8_t amu_dev_send_command(uint8_t address, uint16_t command); // Both bytes, low first.
+int8_t amu_dev_configure(uint8_t address, uint16_t command, uint8_t value);
+
+#endif
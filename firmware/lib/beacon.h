@@ -0,0 +1,73 @@
+#ifndef BEACON_H
+#define BEACON_H
+
+/* Beacon ------------------------------------------------------------------*/
+/*
+* The beacon is a downlink frame of its own: one LOG_REC_BEACON record
+* (seq BEACON_SEQ, tag LOG_TAG_NONE, time 0), so the ground decodes it as
+* any other frame. Its payload, little-endian, is
+*
+*   u8 version, char callsign[6]                          fixed
+*   u16 battery [cWh], u8 state, u16 commands accepted,
+*   u16 records lost, u16 records unsent, u32 uptime [s],
+*   u16 beacons sent                                      patched
+*
+* Beacon_init() builds the frame and its check (see radio.h) once, in
+* RAM. Beacon_send() then writes only the bytes that changed, in place,
+* and folds their change into the check. The patched fields are the last
+* BEACON_TAIL bytes of the frame, the ones that change most often last,
+* so the check is redone over the few bytes from the first change on;
+* nothing else is serialized or encoded. Under RADIO_AX25 there is no
+* check to keep and the patched frame goes through Radio_begin/write/end.
+*/
+enum {
+    BEACON_VERSION  = 1,
+    BEACON_CALL_LEN = 6,
+    BEACON_HEAD     = 9,                /* LogRecord up to the payload */
+    BEACON_TAIL     = 15,
+    BEACON_PAYLOAD  = 1 + BEACON_CALL_LEN + BEACON_TAIL,
+    BEACON_LEN      = BEACON_HEAD + BEACON_PAYLOAD,
+    BEACON_SEQ      = 0xFFFF,
+    BEACON_PERIOD_S = 30                /* while the radio is on */
+};
+
+/* CubeSat states as the beacon reports them */
+enum {
+    BEACON_ST_LAUNCH,
+    BEACON_ST_LEO,
+    BEACON_ST_CHARGE,
+    BEACON_ST_ACTIVE,
+    BEACON_ST_PAYLOAD,
+    BEACON_ST_DETUMBLE,
+    BEACON_ST_TELEMETRY,
+    BEACON_ST_RADIO,
+    BEACON_ST_TRANSMIT,
+    BEACON_ST_RECEIVE,
+    BEACON_ST_COUNT
+};
+
+typedef struct BeaconFields {
+    uint16_t battery;                   /* [cWh] */
+    uint8_t state;
+    uint16_t commands;
+    uint16_t lost;
+    uint16_t unsent;
+    uint32_t uptime;                    /* [s] */
+} BeaconFields;
+
+typedef struct Beacon {
+    uint8_t frame[BEACON_LEN];
+#ifndef RADIO_AX25
+    uint8_t check[RADIO_CHECK_LEN];
+#endif
+    uint16_t count;
+} Beacon;
+
+void Beacon_init(Beacon * const me);
+
+/* Patches 'f' and the count into the frame and its check, then sends it */
+void Beacon_send(Beacon * const me, BeaconFields const *f);
+
+extern Beacon g_beacon;
+
+#endif /* BEACON_H */
@@ -12,6 +12,7 @@ void BSP_ledOff(void);
 void BSP_ledOn(void);
 
 /* define the event signals used in the application ------------------------*/
+/* keep identical to simulation/qpn-base-sim/lib/bsp.h (queue_stats indexes by signal) */
 enum CubeSatSignals {
     DUMMY_SIG = Q_USER_SIG,
     Q_LEO_SIG,
@@ -19,6 +20,13 @@ enum CubeSatSignals {
     Q_DEORBIT_SIG,
     Q_DETUMBLE_SIG,
     Q_TICK_SIG,
+    Q_PROFILE_SIG,          /* dump the RTC-step profile */
+    Q_PAYLOAD_SIG,          /* payload work request (deferred off-state) */
+    Q_TELEMETRY_SIG,        /* telemetry work request (deferred off-state) */
+    Q_SWEEP_SIG,            /* IV sweep ready, par = EvtHandle in g_sweepPool */
+    Q_TWI_DONE_SIG,         /* TWI transfer finished, par = status | count << 16 */
+    Q_QUERY_SIG,            /* downlink a log query, par = type | tag << 8 | hours << 16 */
+    MAX_SIG                 /* the last signal (keep always last) */
 };
 
 /* active object(s) used in this application -------------------------------*/
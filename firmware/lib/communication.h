@@ -0,0 +1,146 @@
+#ifndef COMMUNICATION_H
+#define COMMUNICATION_H
+
+/* Downlink scheduler ------------------------------------------------------*/
+/*
+* A pass carries pass_s * rate_bps / 8 bytes, i.e. a fixed number of
+* DL_FRAME_AIR-byte frames. Each frame holds DL_FRAME_PAYLOAD bytes of
+* whole telemetry log records, and the scheduler decides which ones.
+*
+* Records answering a ground query (Communication_query()) go first, in
+* time order. The rest of each frame is a 0/1 knapsack over up to
+* DL_CANDIDATES unsent records: half the oldest and half the newest in the
+* log, so neither fresh data nor the backlog is ever out of view. A
+* record's value comes from its type's class (see l_classes in
+* communication.cpp): housekeeping and sweep parameters are worth most when
+* fresh and lose value by the hour, raw sweep parts gain value as they age
+* so the backlog cannot starve. Sweep parts are drawn from the oldest end
+* only and none is taken past one left out, so they go down in log order
+* and a delta sweep never ahead of its key. Sizes are rounded up to
+* DL_UNIT bytes, which keeps the dynamic programme to DL_FRAME_UNITS
+* cells; whatever the rounding leaves is topped up to the byte, and a
+* frame that still has room draws a new candidate set, up to DL_ROUNDS
+* times.
+*
+* A frame goes out as its records back to back, each the first
+* DL_RECORD_OVERHEAD bytes of its LogRecord (little-endian) and then the
+* payload; radio.cpp adds the FEC or the AX.25 framing. The scheduler only
+* decides and hands records to a DownlinkSink, which takes them straight
+* from the record buffer; the Transmit state ticks it once a second and
+* leaves when it runs out of pass or of records.
+*
+* Archives, e.g. a day of sweep parts, come down as a selective-repeat
+* transfer (Downlink_startTransfer()). Chunk i is the log record base + i;
+* a bit per chunk says whether the ground may still be missing it. After
+* any query results, frames carry the flagged chunks in order, round after
+* round while the pass lasts; the first frame of each pass leads with a
+* LOG_REC_XFER status record (seq base, tag id, payload u16 count, u16
+* chunks still flagged). In Receive the ground uplinks which chunks it
+* lacks (Downlink_nack()), and from then on only those go round. Chunks
+* that are not of the transfer's type and tag, or were overwritten, are
+* dropped as found. A lost NACK costs airtime, not the transfer. Once a
+* status with nothing flagged has gone down the transfer is over. Its
+* state is in RAM and lasts across passes; after a reset the ground
+* starts it again.
+*/
+enum {
+    DL_FRAME_PAYLOAD   = 200,           /* record bytes per frame */
+    DL_FRAME_AIR       = RADIO_AIR_BYTES(DL_FRAME_PAYLOAD) + 8, /* + sync and framing */
+    DL_RECORD_OVERHEAD = 9,             /* seq, type, tag, time, len */
+    DL_UNIT            = 8,             /* knapsack size granularity [bytes] */
+    DL_FRAME_UNITS     = DL_FRAME_PAYLOAD / DL_UNIT,
+    DL_FRAME_RECORDS   = DL_FRAME_PAYLOAD / DL_RECORD_OVERHEAD,
+    DL_CANDIDATES      = 16,            /* records weighed at a time */
+    DL_ROUNDS          = 3,             /* candidate sets per frame */
+    DL_PASS_S          = 300,           /* default pass [s] */
+    DL_RATE_BPS        = 9600,          /* default link rate [bit/s] */
+    DL_LISTEN_S        = 10,            /* uplink window after a pass [s] */
+    XFER_CHUNKS_MAX    = 512,           /* records per transfer */
+    XFER_STATUS_LEN    = 4,             /* u16 count, u16 flagged */
+    XFER_SCAN          = 2 * DL_CANDIDATES  /* chunks read per frame */
+};
+
+typedef struct DownlinkFrame {
+    uint8_t n;
+    uint8_t bytes;                      /* payload used, <= DL_FRAME_PAYLOAD */
+    uint16_t value;                     /* sum over the scheduled records */
+    bool status;                        /* leads with the transfer status */
+    uint16_t seq[DL_FRAME_RECORDS];
+} DownlinkFrame;
+
+typedef struct DownlinkSink {
+    void (*begin)(void);                /* of a frame */
+    void (*record)(LogRecord const *rec);
+    void (*end)(void);
+} DownlinkSink;
+
+typedef struct Transfer {
+    uint8_t id;                         /* 0 when there is none */
+    uint8_t type;                       /* LOG_TYPE_ANY matches all */
+    uint8_t tag;                        /* LOG_TAG_NONE matches all */
+    bool announce;                      /* status due in the next frame */
+    uint16_t base;                      /* seq of chunk 0 */
+    uint16_t count;
+    uint16_t flagged;                   /* bits set in 'missing' */
+    uint16_t cursor;                    /* next chunk of this round */
+    uint8_t missing[XFER_CHUNKS_MAX / 8];   /* LSB first */
+} Transfer;
+
+typedef struct Downlink {
+    LogStore *log;
+    DownlinkSink const *sink;
+    uint16_t framesLeft;                /* in this pass */
+    uint16_t airPerTick;                /* link bytes per second */
+    uint16_t credit;                    /* link bytes not yet used */
+    LogQuery query;
+    bool queryHeld;                     /* a query result waits for room */
+    uint16_t heldSeq;
+    uint8_t heldLen;
+    Transfer xfer;
+    /* statistics of the current pass */
+    uint16_t frames;
+    uint16_t records;
+    uint32_t payload;
+} Downlink;
+
+extern Downlink g_downlink;
+
+void Downlink_init(Downlink * const me, LogStore *log, DownlinkSink const *sink);
+void Downlink_beginPass(Downlink * const me, uint16_t pass_s, uint16_t rate_bps);
+
+/* Fills f with the records for the next frame; returns how many, the
+* transfer status included. Nothing is sent or marked, except that query
+* results and transfer chunks are consumed. */
+uint8_t Downlink_planFrame(Downlink * const me, uint32_t now, DownlinkFrame *f);
+
+/* Sends what one second of link time carries; false once the pass budget
+* or the records are used up */
+bool Downlink_tick(Downlink * const me, uint32_t now);
+
+/* Records from..until of 'type' and 'tag' (see LogStore_queryStart())
+* as transfer 'id' (nonzero); the same id again is ignored. A range of
+* more than XFER_CHUNKS_MAX records is cut short; the status says where. */
+void Downlink_startTransfer(Downlink * const me, uint8_t id, uint32_t from,
+                            uint32_t until, uint8_t type, uint8_t tag);
+
+/* The ground lacks chunk first + i where bit i of 'missing' is set, and
+* has the others of those 'bits' chunks */
+void Downlink_nack(Downlink * const me, uint8_t id, uint16_t first,
+                   uint8_t const *missing, uint16_t bits);
+
+/* Scheduling value of a record at mission time 'now' */
+uint16_t Downlink_value(uint8_t type, uint32_t time, uint32_t now);
+
+/* Flight glue: g_downlink on the telemetry log, frames out through radio.cpp */
+void Communication_init(void);
+void Communication_beginPass(void);
+bool Communication_tick(void);
+void Communication_query(uint32_t from, uint32_t until, uint8_t type, uint8_t tag);
+
+/* Handles the uplink frames received so far (see serial_frame.h); good
+* commands are posted to 'ao' */
+void Communication_receive(QActive * const ao);
+
+extern CommandAuth g_commands;
+
+#endif /* COMMUNICATION_H */
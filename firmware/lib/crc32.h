@@ -0,0 +1,19 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+/* CRC-32 (IEEE 802.3, reflected, poly 0xEDB88320) --------------------------*/
+/*
+* On the AVR the CRC runs a nibble at a time from a 16-entry table in flash
+* (64 bytes of PROGMEM, no RAM). Host builds of the same source use
+* slicing-by-8 over eight 256-entry tables built on first use.
+*
+* Chain calls by passing the previous result; start from CRC32_INIT and
+* finish with crc32_final().
+*/
+#define CRC32_INIT 0xFFFFFFFFUL
+
+uint32_t crc32_update(uint32_t crc, uint8_t const *data, uint16_t len);
+
+#define crc32_final(crc_) ((crc_) ^ 0xFFFFFFFFUL)
+
+#endif /* CRC32_H */
@@ -0,0 +1,74 @@
+#ifndef DATACOLLECTION_H
+#define DATACOLLECTION_H
+
+/* Telemetry record log ----------------------------------------------------*/
+/*
+* Sweep parameters and housekeeping are appended to a LogStore on the
+* on-chip EEPROM as they are produced, so they survive resets and wait for
+* the next pass. The radio states downlink the oldest unsent records first.
+* Each EEPROM byte written takes about 3.4 ms (eeprom_update_block() skips
+* unchanged bytes), so an append blocks for up to ~220 ms, and every slot
+* of the 1 KB EEPROM takes one write per lap of the ring. Appends are
+* therefore rationed: a parameter packet for one in DC_PARAMS_EVERY sweeps
+* of each cell, and housekeeping and its summary once an orbit, about six records an orbit
+* with four cells. simulation/log-store-bench
+* works out the wear at that rate.
+*
+* Records are stamped with mission time: seconds of uptime on top of the
+* newest record found at boot, so it keeps counting up across resets (the
+* time spent off is lost). What goes down in a pass, and in which order, is
+* up to the scheduler in communication.cpp.
+*
+* Built with DC_LOG_SWEEPS (for a board with a bigger log than the EEPROM),
+* whole compressed sweeps are kept as well, split over LOG_REC_SWEEP records
+* whose first byte is the part index (high nibble) and part count. Delta
+* sweep packets are useless without their key, a full packet of the same
+* cell logged before them: the downlink sends sweep parts in log order, so
+* a key goes down ahead of its deltas, and a sweep whose key has been
+* overwritten in the log is logged full, as a new key.
+*
+* DataCollection_second() runs once a second: it feeds the battery and the
+* current state into g_orbitStats and, whenever an orbit ends, appends a
+* LOG_REC_ORBIT summary (see orbit_stats.h) and one LogHousekeeping for
+* what the summary does not cover. The two take the place of the
+* per-second battery samples and of a housekeeping record per Telemetry
+* pass.
+*/
+enum {
+    DC_SWEEP_CHUNK = LOG_PAYLOAD_MAX - 1,   /* sweep packet bytes per record */
+    DC_COUNTER_SIZE = 4,                    /* command counter and its complement */
+    DC_SWEEP_PERIOD_S = 60,                 /* a sweep request every minute */
+    DC_PARAMS_EVERY = 96                    /* sweeps of a cell per logged packet */
+};
+
+typedef struct LogHousekeeping {
+    uint32_t uptime_s;
+    float battery_wh;
+    uint16_t stackPeak;                 /* MemStat, bytes */
+    uint16_t lost;                      /* unsent records overwritten */
+    uint16_t extractUs;                 /* IvParams_extract() peak, us */
+} LogHousekeeping;
+
+extern NvmDev const g_nvmEeprom;
+extern LogStore g_telemetryLog;
+
+void DataCollection_init(void);
+void DataCollection_logParams(uint8_t const *pkt, uint8_t len);
+/* Returns the sequence number of the first part */
+uint16_t DataCollection_logSweep(uint8_t const *pkt, uint16_t len);
+
+/* 'state' is the CubeSat state the second was spent in, BEACON_ST_*;
+* 'extractUs' the IvParams_extract() peak so far, for the housekeeping */
+void DataCollection_second(uint8_t state, uint16_t extractUs);
+
+uint32_t DataCollection_now(void);      /* mission time [s] */
+
+/* The last accepted uplink command counter (messages.h), kept at the top
+* of the EEPROM past the log; 0 when it was never written */
+uint16_t DataCollection_loadCounter(void);
+void DataCollection_saveCounter(uint16_t counter);
+
+/* One "Log record ..." text line, for SERIAL_TEXT_OUTPUT builds */
+void DataCollection_printRecord(LogRecord const *rec);
+
+#endif /* DATACOLLECTION_H */
@@ -0,0 +1,30 @@
+#ifndef DEFER_H
+#define DEFER_H
+
+/* Deferred event queue ----------------------------------------------------*/
+/*
+* QP-nano has no QActive_defer()/QActive_recall(). A DeferQueue parks the
+* event an AO is currently processing and posts it back to the AO later,
+* typically on entry to the state that can handle it. When the queue is full
+* the newest event is dropped and counted.
+*/
+enum {
+    DEFER_QUEUE_LEN = 4                 /* events parked per active object */
+};
+
+typedef struct DeferQueue {
+    QEvt buf[DEFER_QUEUE_LEN];
+    uint8_t head;                       /* next slot to write */
+    uint8_t nUsed;
+    uint8_t dropped;                    /* events lost to a full queue */
+} DeferQueue;
+
+void DeferQueue_init(DeferQueue * const me);
+
+/* Parks the current event of 'ao'. Returns false if it had to be dropped */
+bool DeferQueue_defer(DeferQueue * const me, QActive const * const ao);
+
+/* Posts parked events back to 'ao' (FIFO). Returns the number recalled */
+uint8_t DeferQueue_recall(DeferQueue * const me, QActive * const ao);
+
+#endif /* DEFER_H */
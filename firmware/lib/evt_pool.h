@@ -0,0 +1,40 @@
+#ifndef EVT_POOL_H
+#define EVT_POOL_H
+
+/* Fixed-block event pool --------------------------------------------------*/
+/*
+* QP-nano events carry a 4-byte parameter only. Large payloads (IV sweeps,
+* telemetry buffers) live in fixed-size blocks of an EvtPool and travel in
+* Q_PAR() as an EvtHandle. Each block is reference counted: EvtPool_alloc()
+* returns a handle owning one reference, posting the handle hands that
+* reference to the receiver, and the receiver calls EvtPool_unref() when it
+* is done. Call EvtPool_ref() once per additional receiver. Handles carry a
+* generation byte so a stale handle resolves to NULL instead of reused data.
+*/
+enum {
+    EVT_POOL_MAX_BLOCKS = 4
+};
+
+typedef uint16_t EvtHandle;             /* generation << 8 | block index */
+#define EVT_HANDLE_NONE ((EvtHandle)0xFFFFU)
+
+typedef struct EvtPool {
+    uint8_t *storage;
+    uint16_t blockSize;
+    uint8_t nBlocks;
+    uint8_t nFree;
+    uint8_t nMin;                       /* low-water mark of nFree */
+    uint8_t refs[EVT_POOL_MAX_BLOCKS];
+    uint8_t gen[EVT_POOL_MAX_BLOCKS];
+} EvtPool;
+
+void EvtPool_init(EvtPool * const me, void * const storage,
+                  uint16_t poolSize, uint16_t blockSize);
+EvtHandle EvtPool_alloc(EvtPool * const me);
+void *EvtPool_data(EvtPool const * const me, EvtHandle h);
+void EvtPool_ref(EvtPool * const me, EvtHandle h);
+void EvtPool_unref(EvtPool * const me, EvtHandle h);
+
+extern EvtPool g_sweepPool;             /* blocks of ivsweep_t */
+
+#endif /* EVT_POOL_H */
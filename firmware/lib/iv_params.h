@@ -0,0 +1,50 @@
+#ifndef IV_PARAMS_H
+#define IV_PARAMS_H
+
+/* IV curve parameter extraction -------------------------------------------*/
+/*
+* Reduces a 40-point sweep to the cell parameters in integer arithmetic
+* (mV, uA, uW). Isc and Rsh come from a least-squares line through the
+* IV_FIT_POINTS lowest-voltage points, Voc and Rs from the sign change of the
+* current (or a line through the last points when the sweep stops short of
+* Voc). Pmax is the largest sampled V*I. The result is compared with the
+* AMU's own ivsweep_meta_t figures and every disagreement beyond
+* IV_CHECK_TOL_PCT percent sets a bit in 'mismatch'.
+*
+* Cost on the ATmega32u4: about 140 float-to-fixed conversions and a
+* handful of 64-bit divisions, an estimated 65000 cycles (4 ms at 16 MHz),
+* some 200 cycles per byte of the 320-byte V and I arrays. The estimate
+* comes from operation counts, not a measurement; the flight figure is the
+* peak in every housekeeping record (LogHousekeeping.extractUs).
+*/
+enum {
+    IV_FIT_POINTS    = 4,
+    IV_CHECK_TOL_PCT = 5
+};
+
+/* IvParams.mismatch bits */
+#define IV_MISMATCH_VOC   (1U << 0)
+#define IV_MISMATCH_ISC   (1U << 1)
+#define IV_MISMATCH_PMAX  (1U << 2)
+#define IV_MISMATCH_FF    (1U << 3)
+#define IV_NO_VOC         (1U << 7)     /* Voc extrapolated, no sign change */
+
+typedef struct IvParams {
+    int32_t isc_uA;
+    int32_t imp_uA;
+    int32_t pmax_uW;
+    int32_t rs_mohm;                    /* -dV/dI near Voc */
+    int32_t rsh_ohm;                    /* -dV/dI near Isc */
+    int16_t voc_mV;
+    int16_t vmp_mV;
+    uint16_t ff;                        /* fill factor, 1/10000 */
+    uint8_t mismatch;
+} IvParams;
+
+/* Sweeps run from 0 V upwards; the sign of the current is normalized */
+void IvParams_extract(ivsweep_t const *sweep, IvParams *p);
+
+/* Sets and returns p->mismatch; meta is in V, A, W and FF as a fraction */
+uint8_t IvParams_check(IvParams *p, ivsweep_meta_t const *meta);
+
+#endif /* IV_PARAMS_H */
@@ -0,0 +1,137 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+/* Wear-levelled persistent record log -------------------------------------*/
+/*
+* An append-only ring of fixed-size slots on non-volatile memory. Each slot
+* holds one record: a 16-bit sequence number, type, tag (the cell of a
+* sweep), mission time, length, flags and CRC-16 ahead of up to
+* LOG_PAYLOAD_MAX bytes of payload. Appends walk the ring, so every slot is
+* written once per lap and wear is spread over the whole area; the oldest
+* record is overwritten when the ring is full. Slots are a power of two in
+* size so they never straddle a flash page or sector.
+*
+* Nothing but the records is stored. LogStore_init() scans the slots once
+* and rebuilds the RAM state from the newest valid record, so a reset (or a
+* write torn by one, which fails its CRC) costs at most the record being
+* written. After that every lookup is O(1): a sequence number maps straight
+* to its slot, and the oldest unsent record is kept as a cursor.
+*
+* Sending clears LOG_FLAG_UNSENT in place. Only ever clearing bits keeps the
+* same layout valid on flash, where the backend sets eraseSize and the store
+* erases each sector just before its first slot is written.
+*
+* Record times never decrease, so a time range is a run of sequence
+* numbers. A sparse index of LOG_INDEX_SIZE (time, seq) samples, every
+* 'stride'-th record, lives in RAM; the stride doubles whenever the index
+* fills. LogStore_seek() narrows to one stride with the index and binary
+* searches the rest on the medium, so finding the start of a range costs
+* about log2(stride) header reads however long the archive grows. Each
+* entry costs 6 bytes of RAM; the default of 4 suits the 1 KB EEPROM log,
+* and a larger medium can raise it with -D LOG_INDEX_SIZE=n to keep seeks
+* short.
+*/
+#ifndef LOG_INDEX_SIZE
+#define LOG_INDEX_SIZE  4
+#endif
+
+enum {
+    LOG_SLOT_SIZE   = 64,
+    LOG_HEADER_SIZE = 12,
+    LOG_PAYLOAD_MAX = LOG_SLOT_SIZE - LOG_HEADER_SIZE,
+    LOG_MAX_SLOTS   = 16384,            /* keeps int16_t sequence compares valid */
+    LOG_QUERY_SCAN  = 32                /* records examined per LogStore_queryNext() */
+};
+
+#define LOG_FLAG_UNSENT (1U << 0)       /* erased state 1, cleared once sent */
+#define LOG_TAG_NONE    0xFFU
+#define LOG_TYPE_ANY    0U
+
+/* Record types */
+enum {
+    LOG_REC_PARAMS = 1,                 /* sweep_codec parameter packet, tag = cell */
+    LOG_REC_HOUSEKEEPING,               /* LogHousekeeping, see datacollection.h */
+    LOG_REC_SWEEP,                      /* part of a sweep_codec sweep packet, tag = cell */
+    LOG_REC_XFER,                       /* never stored: transfer status, see communication.h */
+    LOG_REC_BEACON,                     /* never stored: the beacon, see beacon.h */
+    LOG_REC_ORBIT                       /* LogOrbit, see orbit_stats.h */
+};
+
+/* Backend: byte-addressed reads and writes; 'erase' only for flash */
+typedef struct NvmDev {
+    void (*read)(uint32_t addr, void *buf, uint16_t len);
+    void (*write)(uint32_t addr, void const *buf, uint16_t len);
+    void (*erase)(uint32_t addr);       /* one eraseSize sector, to 0xFF */
+    uint32_t size;
+    uint16_t eraseSize;                 /* 0 for EEPROM/FRAM; multiple of LOG_SLOT_SIZE */
+} NvmDev;
+
+typedef struct LogRecord {
+    uint16_t seq;
+    uint8_t type;
+    uint8_t tag;
+    uint32_t time;                      /* mission time [s] */
+    uint8_t len;
+    uint8_t flags;                      /* not covered by the CRC */
+    uint16_t crc;                       /* over seq, type, tag, time, len, payload */
+    uint8_t payload[LOG_PAYLOAD_MAX];
+} LogRecord;
+
+typedef struct LogIndexEntry {
+    uint32_t time;
+    uint16_t seq;
+} LogIndexEntry;
+
+typedef struct LogStore {
+    NvmDev const *dev;
+    uint32_t base;
+    uint16_t nSlots;
+    uint16_t head;                      /* slot of the next append */
+    uint16_t count;                     /* valid records, newest at head - 1 */
+    uint16_t nextSeq;
+    uint16_t unsentSeq;                 /* oldest unsent, nextSeq when none */
+    uint16_t lost;                      /* unsent records overwritten */
+    uint32_t lastTime;                  /* time of the newest record */
+    uint16_t stride;                    /* power of two */
+    uint8_t nIndex;
+    LogIndexEntry index[LOG_INDEX_SIZE];    /* seq % stride == 0, oldest first */
+} LogStore;
+
+/* A running time-range query, see LogStore_queryStart() */
+typedef struct LogQuery {
+    uint16_t seq;                       /* next record to examine */
+    uint32_t until;
+    uint8_t type;                       /* LOG_TYPE_ANY matches all */
+    uint8_t tag;                        /* LOG_TAG_NONE matches all */
+    bool done;
+} LogQuery;
+
+void LogStore_init(LogStore * const me, NvmDev const *dev,
+                   uint32_t base, uint32_t size);
+
+/* Returns the sequence number of the new record; an earlier time than the
+* newest record's is raised to it */
+uint16_t LogStore_append(LogStore * const me, uint8_t type, uint8_t tag,
+                         uint32_t time, void const *data, uint8_t len);
+
+/* Copies record 'seq' to rec; false once it has been overwritten */
+bool LogStore_read(LogStore const * const me, uint16_t seq, LogRecord *rec);
+
+/* Sequence number of the oldest unsent record; false when all are sent */
+bool LogStore_oldestUnsent(LogStore const * const me, uint16_t *seq);
+void LogStore_markSent(LogStore * const me, uint16_t seq);
+
+/* First record at or after 'time' (nextSeq when there is none) */
+uint16_t LogStore_seek(LogStore const * const me, uint32_t time);
+
+/* Records of 'type' and 'tag' with from <= time <= until, oldest first.
+* queryNext() examines at most LOG_QUERY_SCAN records per call, so it can
+* return false with q->done still clear. */
+void LogStore_queryStart(LogStore const * const me, LogQuery *q,
+                         uint32_t from, uint32_t until, uint8_t type, uint8_t tag);
+bool LogStore_queryNext(LogStore const * const me, LogQuery *q, LogRecord *rec);
+
+/* Sequence number of the oldest record still stored */
+#define LogStore_oldest(me_) ((uint16_t)((me_)->nextSeq - (me_)->count))
+
+#endif /* LOG_STORE_H */
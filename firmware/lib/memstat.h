@@ -0,0 +1,23 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+/* Stack and RAM watermarks ------------------------------------------------*/
+/*
+* At reset, before main(), everything between the end of .bss and RAMEND is
+* painted with MEMSTAT_PAINT. The stack grows down into that region and the
+* heap (if any) grows up into it, so the bytes still holding the paint are
+* RAM that has never been touched since boot.
+*/
+#define MEMSTAT_PAINT 0xC5
+
+typedef struct MemStat {
+    uint16_t freeNow;       /* bytes between heap top and SP right now */
+    uint16_t neverUsed;     /* painted bytes never touched since reset */
+    uint16_t stackPeak;     /* deepest stack seen, in bytes below RAMEND */
+} MemStat;
+
+/* Scans the painted region, O(free RAM), safe to call from any state */
+void MemStat_get(MemStat * const out);
+void MemStat_report(void);
+
+#endif /* MEMSTAT_H */
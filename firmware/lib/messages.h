@@ -0,0 +1,170 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+/* AX.25 UI frames, HDLC and KISS ------------------------------------------*/
+/*
+* An AX.25 UI frame is a 16-byte header (destination and source address,
+* control 0x03, PID 0xF0 "no layer 3"), up to AX25_INFO_MAX info bytes and
+* the FCS, CRC-16/X.25 sent low byte first. Ax25_header() builds the header
+* once; after that a frame is only ever streamed. Its parts are passed as a
+* list of MsgSegments pointing wherever the bytes already are (the header,
+* then each record's LogRecord prefix and payload), so nothing is copied
+* into a frame buffer and the RAM used to send a frame is the same for one
+* byte of info as for 256.
+*
+* Two encoders take the segments:
+*
+*   - Hdlc_*: the frame as the modem sends it on air: opening flags, the
+*     bits least significant first with a 0 stuffed after every five 1s,
+*     FCS, closing flag. Out come air bytes, first bit in bit 0; NRZI and
+*     any scrambling are left to the modem.
+*   - Kiss_*: the frame as a KISS TNC takes it over a serial line: FEND,
+*     the command byte, the frame without FCS (the TNC adds it) with FEND
+*     and FESC escaped, FEND.
+*
+* Both hold only a few bytes of state and call 'out' for each byte.
+*/
+enum {
+    AX25_ADDR_LEN   = 7,                /* six callsign characters, SSID */
+    AX25_HEADER_LEN = 2 * AX25_ADDR_LEN + 2,
+    AX25_INFO_MAX   = 256,              /* N1 default */
+    AX25_CONTROL_UI = 0x03,
+    AX25_PID_NONE   = 0xF0
+};
+
+#define AX25_FCS_INIT   0xFFFFU
+#define AX25_FCS_GOOD   0xF0B8U         /* residue over info and FCS */
+#define HDLC_FLAG       0x7EU
+
+#define KISS_FEND       0xC0U
+#define KISS_FESC       0xDBU
+#define KISS_TFEND      0xDCU
+#define KISS_TFESC      0xDDU
+#define KISS_DATA       0x00U           /* data frame command, port 0 */
+
+typedef struct MsgSegment {
+    void const *data;
+    uint16_t len;
+} MsgSegment;
+
+/* Header for a UI command frame from src-srcSsid to dest */
+void Ax25_header(uint8_t *hdr, char const *dest, char const *src, uint8_t srcSsid);
+
+/* Running FCS; send Ax25_fcsFinal() of it, low byte first */
+uint16_t Ax25_fcs(uint16_t fcs, void const *data, uint16_t len);
+#define Ax25_fcsFinal(fcs_) ((uint16_t)~(fcs_))
+
+typedef struct Hdlc {
+    void (*out)(uint8_t b);
+    uint16_t fcs;
+    uint8_t acc;                        /* bits not yet out, from bit 0 */
+    uint8_t nBits;
+    uint8_t ones;                       /* 1 bits in a row, for stuffing */
+} Hdlc;
+
+void Hdlc_begin(Hdlc * const me, void (*out)(uint8_t b), uint8_t flags);
+void Hdlc_write(Hdlc * const me, void const *data, uint16_t len);
+void Hdlc_writev(Hdlc * const me, MsgSegment const *seg, uint8_t n);
+void Hdlc_end(Hdlc * const me);         /* FCS, flag, 0 bits to a byte */
+
+typedef struct Kiss {
+    void (*out)(uint8_t b);
+} Kiss;
+
+void Kiss_begin(Kiss * const me, void (*out)(uint8_t b));
+void Kiss_write(Kiss * const me, void const *data, uint16_t len);
+void Kiss_writev(Kiss * const me, MsgSegment const *seg, uint8_t n);
+void Kiss_end(Kiss * const me);
+
+/* Uplink commands ---------------------------------------------------------*/
+/*
+* A command is an SF_COMMAND uplink frame (serial_frame.h):
+*
+*   type  opcode  counter (u16 LE)  args  tag (8 bytes)
+*
+* The tag is SipHash-2-4 under the 128-bit CMD_KEY over everything before
+* it, type included. Command_parse() checks the length, then the tag, then
+* the opcode against a PROGMEM table that gives each command its argument
+* length, a bound on the first argument byte and the QP signal it becomes,
+* and last the counter, which must be ahead of the last accepted one. Up
+* to CMD_ARGS_MAX argument bytes become the event parameter, low byte
+* first. Longer frames are turned away before the tag, so it takes at most
+* CMD_BLOCKS_MAX SipHash compressions whatever arrives, and it is compared
+* without stopping at the first difference. Parsing touches nothing but
+* its arguments; simulation/command-bench fuzzes it on the host.
+*
+* A good command takes its counter only once it is delivered:
+* Command_accept() after the event is posted, Command_reject() with
+* CMD_QUEUE_FULL when it is not, so the ground can send it again. The
+* last accepted counter is kept in the EEPROM next to the log
+* (DataCollection_saveCounter()), so a reset does not open a window for
+* replaying recorded commands.
+*/
+#ifndef CMD_KEY
+#ifdef __AVR__
+#error "CMD_KEY is not defined: pass the 16-byte uplink key with -D CMD_KEY=..."
+#endif
+/* the SipHash reference key, for the host benches only */
+#define CMD_KEY 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, \
+                0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+#endif
+
+enum {
+    CMD_KEY_LEN    = 16,
+    CMD_TAG_LEN    = 8,
+    CMD_HEADER_LEN = 4,                 /* type, opcode, counter */
+    CMD_ARGS_MAX   = 4,                 /* a QParam */
+    CMD_LEN_MIN    = CMD_HEADER_LEN + CMD_TAG_LEN,
+    CMD_LEN_MAX    = CMD_LEN_MIN + CMD_ARGS_MAX,
+    CMD_BLOCKS_MAX = (CMD_LEN_MAX - CMD_TAG_LEN) / 8 + 1
+};
+
+/* Opcodes; the signal each becomes is in messages.cpp */
+enum {
+    CMD_PING,                           /* no event, only counted */
+    CMD_SWEEP,                          /* Q_PAYLOAD_SIG */
+    CMD_TELEMETRY,                      /* Q_TELEMETRY_SIG */
+    CMD_PROFILE,                        /* Q_PROFILE_SIG */
+    CMD_QUERY,                          /* Q_QUERY_SIG: u8 type, u8 tag, u16 hours back */
+    CMD_COUNT
+};
+
+typedef enum CmdResult {
+    CMD_OK,
+    CMD_BAD_LENGTH,                     /* for the frame or the opcode */
+    CMD_BAD_TAG,
+    CMD_BAD_OPCODE,
+    CMD_BAD_ARG,
+    CMD_REPLAYED,
+    CMD_QUEUE_FULL                      /* good, but its event was not posted */
+} CmdResult;
+
+typedef struct CommandAuth {
+    uint16_t counter;                   /* last accepted */
+    uint16_t accepted;
+    uint16_t rejected;
+    uint8_t lastError;                  /* CmdResult of the last rejection */
+} CommandAuth;
+
+typedef struct Command {
+    uint8_t opcode;
+    uint8_t sig;                        /* 0 for none */
+    uint16_t counter;
+    uint32_t par;
+} Command;
+
+/* SipHash-2-4 of 'len' bytes under a 16-byte key, out low byte first */
+void SipHash24(uint8_t *out, uint8_t const *key, void const *data, uint8_t len);
+
+/* Checks a received SF_COMMAND frame (type first) of 'len' bytes and, if
+* it is good, fills cmd; a bad one is counted as rejected */
+CmdResult Command_parse(CommandAuth * const me, uint8_t const *frame, uint8_t len,
+                        Command *cmd);
+
+/* Takes the counter of a good command once it is delivered */
+void Command_accept(CommandAuth * const me, Command const *cmd);
+
+/* Counts a good command that could not be delivered; its counter stays free */
+void Command_reject(CommandAuth * const me, CmdResult r);
+
+#endif /* MESSAGES_H */
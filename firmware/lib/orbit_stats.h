@@ -0,0 +1,75 @@
+#ifndef ORBIT_STATS_H
+#define ORBIT_STATS_H
+
+/* Per-orbit housekeeping statistics ---------------------------------------*/
+/*
+* Samples are folded into a running count, min, max, mean and M2 per
+* channel as they arrive (Welford's update: O(1) time and RAM, and no
+* cancellation in the variance as with a sum of squares), and every
+* second is charged to the CubeSat state it was spent in. When mission
+* time crosses into the next orbit the whole orbit goes to the log as one
+* LogOrbit record and the statistics start over.
+*
+* There is no orbit propagator or sun sensor on board: an orbit is
+* ORBIT_PERIOD_S seconds of mission time, and the sun channel is the Isc
+* of each sweep, which follows the cosine of the sun angle on the cell.
+*
+* Samples are taken in the record's units (cWh, 0.01 C, 0.1 mA), so a
+* summary only rounds them to int16_t.
+*/
+enum {
+    ORBIT_PERIOD_S = 5684,              /* 15.2 orbits a day */
+    ORBIT_STATES   = 10                 /* BEACON_ST_COUNT, see beacon.h */
+};
+
+/* Channels */
+enum {
+    ORBIT_BATTERY,                      /* [cWh], every second */
+    ORBIT_TEMPERATURE,                  /* cell [0.01 C], every sweep */
+    ORBIT_SUN,                          /* cell Isc [0.1 mA], every sweep */
+    ORBIT_CHANNELS
+};
+
+typedef struct Welford {
+    uint16_t n;
+    float mean;
+    float m2;                           /* sum of squared deviations */
+    float min;
+    float max;
+} Welford;
+
+typedef struct OrbitStats {
+    uint32_t orbit;                     /* mission time / ORBIT_PERIOD_S */
+    Welford ch[ORBIT_CHANNELS];
+    uint16_t residency[ORBIT_STATES];   /* [s] */
+} OrbitStats;
+
+/* One channel of the record; sd is the sample standard deviation */
+typedef struct OrbitChannel {
+    uint16_t n;
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+    int16_t sd;
+} OrbitChannel;
+
+/* LOG_REC_ORBIT payload, stamped with the end of the orbit */
+typedef struct LogOrbit {
+    uint16_t orbit;
+    OrbitChannel ch[ORBIT_CHANNELS];
+    uint16_t residency[ORBIT_STATES];
+} LogOrbit;
+
+void OrbitStats_start(OrbitStats * const me, uint32_t now);
+void OrbitStats_add(OrbitStats * const me, uint8_t ch, float x);
+
+/* Charges one second to 'state' (BEACON_ST_*) */
+void OrbitStats_tick(OrbitStats * const me, uint8_t state);
+
+/* True once 'now' lies past the orbit being collected */
+bool OrbitStats_due(OrbitStats const * const me, uint32_t now);
+void OrbitStats_summarize(OrbitStats const * const me, LogOrbit *out);
+
+extern OrbitStats g_orbitStats;
+
+#endif /* ORBIT_STATS_H */
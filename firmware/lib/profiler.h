@@ -0,0 +1,62 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* RTC-step profiler -------------------------------------------------------*/
+/*
+* Times every QHSM_DISPATCH() in QF_run() with the free-running Timer3 and
+* accumulates min/max/mean and a histogram per (state, signal) pair. Build
+* with -D PROFILER_ENABLED (see platformio.ini); otherwise every call below
+* compiles to nothing.
+*
+* A tick is 64 cycles (4 us), so the 16-bit timer covers 262 ms: an EEPROM
+* append (up to ~220 ms) or a 100 ms TWI timeout still reads true. A step
+* that wraps the timer is only counted in 'over' and kept out of min, max,
+* mean and the histogram, which would otherwise read a clipped value.
+*/
+#ifdef PROFILER_ENABLED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    PROFILER_SLOTS         = 12,    /* distinct (state, signal) pairs tracked */
+    PROFILER_BUCKETS       = 8,     /* bucket i holds [4^i, 4^(i+1)) ticks */
+    PROFILER_CYCLES_PER_TICK = 64   /* Timer3 prescaler */
+};
+
+typedef struct ProfilerSlot {
+    QStateHandler state;            /* state active when the event arrived */
+    QSignal  sig;
+    uint16_t count;                 /* steps that fit the timer */
+    uint16_t min;                   /* Timer3 ticks */
+    uint16_t max;
+    uint32_t sum;
+    uint8_t  hist[PROFILER_BUCKETS];
+    uint8_t  over;                  /* steps of 262 ms or more */
+} ProfilerSlot;
+
+void Profiler_init(void);
+void Profiler_begin(QActive const * const a);
+void Profiler_end(void);
+void Profiler_clear(void);
+void Profiler_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define QV_PROFILE_BEGIN(a_) Profiler_begin((a_))
+#define QV_PROFILE_END(a_)   Profiler_end()
+
+#else
+
+#define Profiler_init()      ((void)0)
+#define Profiler_clear()     ((void)0)
+#define Profiler_dump()      ((void)0)
+#define QV_PROFILE_BEGIN(a_) ((void)0)
+#define QV_PROFILE_END(a_)   ((void)0)
+
+#endif /* PROFILER_ENABLED */
+
+#endif /* PROFILER_H */
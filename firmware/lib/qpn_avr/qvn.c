@@ -41,6 +41,13 @@
 #include "qfn_port.h" /* QF-nano port from the port directory */
 #include "qassert.h"  /* embedded systems-friendly assertions */
 
+#ifdef PROFILER_ENABLED
+#include "profiler.h" /* RTC-step profiler hooks (application) */
+#else
+#define QV_PROFILE_BEGIN(a_) ((void)0)
+#define QV_PROFILE_END(a_)   ((void)0)
+#endif /* PROFILER_ENABLED */
+
 Q_DEFINE_THIS_MODULE("qvn")
 
 /* protection against including this source file in a wrong project */
@@ -132,7 +139,9 @@ int_t QF_run(void) {
             --a->tail;
             QF_INT_ENABLE();
 
+            QV_PROFILE_BEGIN(a);
             QHSM_DISPATCH(&a->super); /* dispatch to the HSM (RTC step) */
+            QV_PROFILE_END(a);
 
             QF_INT_DISABLE();
             /* empty queue? */
@@ -0,0 +1,110 @@
+#ifndef RADIO_H
+#define RADIO_H
+
+/* Downlink forward error correction ---------------------------------------*/
+/*
+* Every downlink frame is one Reed-Solomon codeword: the frame bytes as
+* they are, then RS_PARITY parity bytes. The code is CCSDS RS(255,223)
+* (field polynomial 0x187, first root 112, primitive element 11, the
+* conventional basis, as libfec's encode_rs_8), shortened to the frame: a
+* k-byte frame is encoded as if led by 223 - k zero bytes, which changes
+* nothing on the air. Any RS_PARITY / 2 byte errors per frame are
+* corrected on the ground.
+*
+* The encoder is an LFSR over the parity bytes, so frames are encoded
+* while they are written out and never buffered; the log/antilog and
+* generator tables (799 bytes) live in flash. Built with
+* -D RADIO_CONVOLUTIONAL, the codeword also goes through the NASA K=7
+* rate 1/2 convolutional code (171, 133 octal, six zero tail bits); the
+* ground Viterbi-decodes, then corrects the bursts it leaves with RS.
+* On simulation/fec-bench's hard-decision channel, 200-byte frames reach
+* a 1% frame error rate at 9.5 dB Eb/N0 uncoded, 5.8 dB with RS and
+* 4.4 dB with both, for twice the air time.
+*
+* Built with -D RADIO_AX25 instead, a frame is an AX.25 UI frame from
+* AX25_CALLSIGN to AX25_DEST (see messages.h), which any amateur ground
+* station decodes; there is no RS then, and the FCS only detects errors.
+*
+* The radio is not wired up yet: codewords go out on the serial link as
+* SF_CODEWORD frames, AX.25 frames KISS-encapsulated as a TNC takes them.
+* Radio_init() times the encoders and prints the cost in CPU cycles per
+* byte.
+*/
+enum {
+    RS_PARITY   = 32,
+    RS_DATA_MAX = 223
+};
+
+#ifndef AX25_CALLSIGN
+#define AX25_CALLSIGN   "N0CALL"        /* the licensee's, -D AX25_CALLSIGN=\"...\" */
+#endif
+#ifndef AX25_SSID
+#define AX25_SSID       0U
+#endif
+#define AX25_DEST       "CQ"
+
+#if defined(RADIO_AX25) && defined(RADIO_CONVOLUTIONAL)
+#error "RADIO_CONVOLUTIONAL applies to RS codewords, not to AX.25 frames"
+#endif
+
+#if defined(RADIO_AX25)
+/* header, FCS, a flag, and a stuffed bit in 32: twice what random data
+* needs (simulation/ax25-bench) */
+#define RADIO_AIR_BYTES(k_) ((k_) + 19U + ((k_) + 18U) / 32U)
+#define RADIO_FRAME_MAX     AX25_INFO_MAX
+#elif defined(RADIO_CONVOLUTIONAL)
+#define RADIO_AIR_BYTES(k_) (2U * ((k_) + RS_PARITY) + 2U)
+#define RADIO_FRAME_MAX     RS_DATA_MAX
+#else
+#define RADIO_AIR_BYTES(k_) ((k_) + RS_PARITY)
+#define RADIO_FRAME_MAX     RS_DATA_MAX
+#endif
+
+typedef struct RsEncoder {
+    uint8_t parity[RS_PARITY];          /* a ring, starting at 'head' */
+    uint8_t head;
+} RsEncoder;
+
+void Rs_begin(RsEncoder * const me);
+void Rs_update(RsEncoder * const me, uint8_t const *data, uint16_t len);
+void Rs_end(RsEncoder * const me, uint8_t *parity);    /* RS_PARITY bytes */
+
+/* Two coded bytes per input byte; the flush returns the 12 tail bits in
+* the top of a 16-bit word */
+uint16_t Conv_encode(uint8_t *state, uint8_t b);
+uint16_t Conv_flush(uint8_t *state);
+
+void Radio_init(void);
+
+/* One frame of up to RADIO_FRAME_MAX bytes, written in pieces, or
+* gathered from a segment list */
+void Radio_begin(void);
+void Radio_write(void const *data, uint16_t len);
+void Radio_writev(MsgSegment const *seg, uint8_t n);
+void Radio_end(void);
+
+/* A frame sent over and over with a few bytes changed (the beacon) keeps
+* its check, what Radio_end() would add: the RS parity. The check is
+* linear in the frame, so XORing 'delta' into the last n bytes XORs the
+* check of 'delta', taken as an n-byte frame from a zero state, into it;
+* leading zero bytes of 'delta' change nothing and may be left out.
+*
+* There is no kept check under RADIO_AX25: the KISS TNC adds the FCS
+* itself and nothing here sends one, so such frames go through
+* Radio_begin/write/end every time. */
+#ifndef RADIO_AX25
+#define RADIO_CHECK_LEN RS_PARITY
+void Radio_check(uint8_t *check, void const *frame, uint16_t len);
+void Radio_checkDelta(uint8_t *check, uint8_t const *delta, uint16_t n);
+
+/* Sends a frame with its check as is, nothing encoded but the
+* convolutional code and the serial framing */
+void Radio_sendChecked(void const *frame, uint16_t len, uint8_t const *check);
+#endif
+
+/* The next uplink frame (type, then payload) received so far, 0 when there
+* is none yet; *frame stays valid until the next call. The uplink is SLIP
+* on the serial link in every build (see serial_frame.h). */
+uint8_t Radio_receive(uint8_t const **frame);
+
+#endif /* RADIO_H */
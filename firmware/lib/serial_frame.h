@@ -0,0 +1,69 @@
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+/* SLIP-framed binary serial output ----------------------------------------*/
+/*
+* A frame is
+*
+*   END  type  payload...  CRC-16 (LE)  END
+*
+* with END (0xC0) and ESC (0xDB) inside the frame escaped as in RFC 1055.
+* The CRC is crc16_ccitt() over type and payload. Frames are written byte
+* by byte as they are produced, so nothing is buffered and no number is
+* formatted. Debug text may still go out between frames: it never contains
+* END, so the ground decoder (software/src/serial_frames.py) sees it as a
+* chunk that fails the CRC and passes it through as text.
+*
+* Build with -D SERIAL_TEXT_OUTPUT to print the old text dumps instead.
+*
+* The ground sends uplink frames the same way. SerialFrame_receive() takes
+* them a byte at a time and keeps at most SF_RX_MAX bytes of type and
+* payload; longer frames, and any that fail the CRC, are dropped.
+*/
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+/* Frame types; payloads are little-endian, floats IEEE-754 single */
+enum {
+    SF_SWEEP  = 0x10,   /* u8 cell, u8 address, u32 timestamp[], f32 voltage[], f32 current[] */
+    SF_META   = 0x11,   /* u8 cell, u8 address, u32 bus_us, ivsweep_meta_t */
+    SF_MEAS   = 0x12,   /* u8 SF_MEAS_VOC/ISC, f32 measurement, f32 temperature */
+    SF_PACKET = 0x13,   /* a sweep_codec packet, as downlinked */
+    SF_CODEWORD = 0x15, /* a downlink frame as sent on air, see radio.h */
+
+    /* uplink, see communication.h */
+    SF_XFER_START = 0x20, /* u8 id, u32 from, u32 until, u8 type, u8 tag */
+    SF_XFER_NACK  = 0x21, /* u8 id, u16 first chunk, missing chunks' bitmap */
+    SF_COMMAND    = 0x22  /* u8 opcode, u16 counter, args, tag; see messages.h */
+};
+
+enum {
+    SF_RX_MAX = 40
+};
+
+typedef struct SerialRx {
+    uint8_t buf[SF_RX_MAX + 2];         /* type, payload, CRC */
+    uint8_t len;
+    bool esc;
+    bool overrun;
+} SerialRx;
+
+enum {
+    SF_MEAS_VOC,
+    SF_MEAS_ISC
+};
+
+void SerialFrame_begin(uint8_t type);
+void SerialFrame_write(void const *data, uint16_t len);
+void SerialFrame_end(void);
+
+/* begin + write + end for single-part payloads */
+void SerialFrame_send(uint8_t type, void const *data, uint16_t len);
+
+/* Feeds one received byte; once it completes a frame that checks, returns
+* its length (type and payload, in me->buf), else 0 */
+uint8_t SerialFrame_receive(SerialRx * const me, uint8_t b);
+
+#endif /* SERIAL_FRAME_H */
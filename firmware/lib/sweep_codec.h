@@ -0,0 +1,119 @@
+#ifndef SWEEP_CODEC_H
+#define SWEEP_CODEC_H
+
+/* Binary IV-sweep packet --------------------------------------------------*/
+/*
+* Little-endian layout (decoded on the ground by software/src/sweep_codec.py):
+*
+*   u8  type (SWEEP_PKT_TYPE)     u8  version     u8 cell     u8 points
+*   u32 meta.timestamp
+*   u16 Voc [mV]   i16 Isc [0.1 mA]   i16 Tstart [0.01 C]   i16 Tend [0.01 C]
+*   timestamps: zigzag varints, first value, first delta, then 2nd differences
+*   voltage:    same as timestamps, in mV (the axis is a near-uniform ramp)
+*   current:    zigzag varints, first value then 1st differences, in 0.1 mA
+*   u16 CRC-16/CCITT-FALSE over every byte above
+*
+* A 40-point sweep typically encodes to 130..180 bytes.
+*
+* Routine passes can send the extracted parameters instead (SWEEP_PKT_PARAMS,
+* 40 bytes): type, version, cell, mismatch bits, u32 timestamp, then the
+* IvParams fields i16 Voc, i16 Vmp [mV], i32 Isc, i32 Imp [uA], i32 Pmax
+* [uW], u16 FF [1/10000], i32 Rs [mOhm], i32 Rsh [Ohm], i16 Tstart, i16 Tend
+* [0.01 C] and the same CRC-16.
+*
+* Successive sweeps of a cell differ little, so SweepCodec_encodeDelta()
+* sends most of them as a delta (SWEEP_PKT_DELTA) against a reference: the
+* last key of that cell. The current is coded as
+* its residual from the key's (1st differences of it, as the residual is
+* mostly a shift with the irradiance), timestamps and voltage as 2nd
+* differences as before; every value in zigzag form as an order-k
+* Exp-Golomb code, MSB first, with the cheapest k per channel:
+*
+*   u8  type (SWEEP_PKT_DELTA)    u8  version     u8 cell     u8 points
+*   u16 key meta.timestamp (low bits)   u32 meta.timestamp
+*   u16 Voc   i16 Isc   i16 Tstart   i16 Tend                 as above
+*   u8  k timestamps | k voltage << 4   u8 k current | SWEEP_DELTA_UNKEYED
+*   bit stream of the three channels, zero padded to a byte
+*   u16 CRC-16/CCITT-FALSE over every byte above
+*
+* With SWEEP_DELTA_UNKEYED set the current is coded as is, the key
+* timestamp is 0, and the packet decodes on its own. Most of what a delta
+* saves comes from the Exp-Golomb codes rather than from the key (about
+* 57 bytes a sweep unkeyed, 55 keyed, 141 as a full packet), so a key is
+* sent as an unkeyed delta, and as a full packet only when it cannot be.
+*
+* A delta decodes to exactly the values a full packet of the same sweep
+* would carry. It depends on its key alone, never on earlier deltas, and a
+* new key goes out every SWEEP_KEY_INTERVAL sweeps of a cell (or whenever
+* the keyed delta would not be shorter than an unkeyed one), so a lost
+* packet costs at most the deltas up to the next key. References for
+* SWEEP_REF_SLOTS cells are kept in RAM (86 bytes each). With more cells
+* than slots, a cell without one sends unkeyed deltas until some slot's key
+* falls due; that slot then passes to it, so the references rotate over
+* all cells.
+*
+* Where deltas are stored rather than sent, the key must outlive them: the
+* caller notes where it stored each key in the slot's keySeq, and once
+* that copy is gone SweepCodec_dropKey() makes the next packet a new key.
+*/
+#define SWEEP_PKT_TYPE     0x01
+#define SWEEP_PKT_PARAMS   0x02
+#define SWEEP_PKT_DELTA    0x03
+#define SWEEP_PKT_VERSION  1
+#define SWEEP_PKT_MAX      255
+
+#ifndef SWEEP_REF_SLOTS
+#define SWEEP_REF_SLOTS    2
+#endif
+#define SWEEP_KEY_INTERVAL 16       /* deltas between keys of a cell */
+#define SWEEP_DELTA_HEADER 20
+#define SWEEP_DELTA_UNKEYED 0x10    /* in the k current byte */
+
+#define SWEEP_VOLTAGE_SCALE     1e3f    /* V  -> mV */
+#define SWEEP_CURRENT_SCALE     1e4f    /* A  -> 0.1 mA */
+#define SWEEP_TEMPERATURE_SCALE 1e2f    /* C  -> 0.01 C */
+
+typedef struct SweepRef {
+    uint8_t cell;                   /* 0xFF while unused */
+    uint8_t deltas;                 /* sent against this key */
+    uint16_t keyTime;               /* low bits of the key's meta.timestamp */
+    uint16_t keySeq;                /* the caller's: where the key is stored */
+    int16_t current[IVSWEEP_POINTS];    /* key current [0.1 mA] */
+} SweepRef;
+
+typedef struct SweepRefs {
+    bool waiting;                   /* a cell found no slot */
+    SweepRef slot[SWEEP_REF_SLOTS];
+} SweepRefs;
+
+int16_t compress_temperature(float temperature);
+int16_t compress_current(float current);
+int16_t compress_voltage(float voltage);
+
+/* Returns the packet length, or 0 if it does not fit in 'cap' bytes */
+uint16_t SweepCodec_encode(ivsweep_t const *sweep, uint8_t *out, uint16_t cap);
+
+void SweepCodec_initRefs(SweepRefs * const me);
+
+/* The cell's reference, NULL when it has none; takes no slot */
+SweepRef *SweepCodec_refOf(SweepRefs * const me, uint8_t cell);
+
+/* The next packet of the reference's cell is a full one, a new key */
+#define SweepCodec_dropKey(ref_) ((ref_)->deltas = SWEEP_KEY_INTERVAL)
+
+/* A packet that needs no other to decode: a full one or an unkeyed delta */
+#define SweepCodec_isKey(pkt_) (((pkt_)[0] == SWEEP_PKT_TYPE) \
+    || (((pkt_)[0] == SWEEP_PKT_DELTA) && (((pkt_)[19] & SWEEP_DELTA_UNKEYED) != 0U)))
+
+/* A delta packet against the cell's key, or a key (unkeyed delta, else a
+* full packet) that becomes the new one; the packet length, or 0 if it
+* does not fit in 'cap' bytes */
+uint16_t SweepCodec_encodeDelta(SweepRefs * const me, ivsweep_t const *sweep,
+                                uint8_t *out, uint16_t cap);
+
+uint16_t SweepCodec_encodeParams(ivsweep_t const *sweep, IvParams const *p,
+                                 uint8_t *out, uint16_t cap);
+
+uint16_t crc16_ccitt(uint16_t crc, uint8_t const *data, uint16_t len);
+
+#endif /* SWEEP_CODEC_H */
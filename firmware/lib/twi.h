@@ -0,0 +1,66 @@
+#ifndef TWI_H
+#define TWI_H
+
+/* Interrupt-driven TWI (I2C) master ---------------------------------------*/
+/*
+* Replaces the blocking Arduino Wire library. A register read is a single
+* bus transaction (START, SLA+W, reg, REPEATED START, SLA+R, len bytes, STOP)
+* of any length straight into the caller's buffer; there is no 32-byte
+* intermediate buffer. The TWI_vect ISR moves every byte, and on completion
+* posts 'sig' to the owning active object with
+* Q_PAR = TwiStatus | (bytes transferred << 16). TWI_startReadSeq() chains
+* several register reads into one transfer and one completion event.
+*
+* Only one transfer is in flight at a time; TWI_start*() returns false while
+* the bus is busy. The buffer must stay valid until the completion event.
+*
+* A lost interrupt or a slave holding SCL low would leave the bus busy for
+* good, so TWI_tickISR(), called from the system tick, gives every
+* asynchronous transfer TWI_ASYNC_TIMEOUT_TICKS ticks. On expiry the bus
+* is released and the completion event still goes out, with TWI_TIMEOUT.
+*/
+#define TWI_FREQ_HZ 400000UL
+#define TWI_ASYNC_TIMEOUT_TICKS 2U  /* the first tick may be due at once */
+
+/* One register read of a sequence. Consecutive segments of a sequence are
+* joined with repeated STARTs, so the whole sequence is one bus ownership.
+*/
+typedef struct TwiSeg {
+    uint8_t reg;
+    uint8_t *buf;
+    uint16_t len;
+} TwiSeg;
+
+typedef enum {
+    TWI_OK = 0,
+    TWI_NACK_ADDR,          /* no device at the address */
+    TWI_NACK_DATA,          /* device refused a byte */
+    TWI_ARB_LOST,
+    TWI_BUS_ERROR,
+    TWI_TIMEOUT             /* gave up waiting for the TWI_vect ISR */
+} TwiStatus;
+
+void TWI_init(uint32_t freq);
+
+/* Asynchronous: completion is posted to 'owner' (may be NULL) */
+bool TWI_startRead(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len,
+                   QActive * const owner, enum_t sig);
+bool TWI_startReadSeq(uint8_t addr, TwiSeg const *seg, uint8_t nSeg,
+                      QActive * const owner, enum_t sig);
+bool TWI_startWrite(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len, QActive * const owner, enum_t sig);
+bool TWI_isBusy(void);
+uint32_t TWI_lastTransferUs(void);      /* START to STOP of the last transfer */
+void TWI_abort(void);
+void TWI_tickISR(void);                 /* from the system tick ISR only */
+
+/* Synchronous wrappers for init-time and short transfers */
+TwiStatus TWI_probe(uint8_t addr);      /* address only, TWI_OK on ACK */
+TwiStatus TWI_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len);
+TwiStatus TWI_write(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len);
+
+#define TWI_EVT_STATUS(par_) ((TwiStatus)((par_) & 0xFFU))
+#define TWI_EVT_COUNT(par_)  ((uint16_t)((par_) >> 16))
+
+#endif /* TWI_H */
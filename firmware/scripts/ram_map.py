@@ -0,0 +1,54 @@
+"""
+RAM map report for the ATmega32u4 (2.5 KB SRAM).
+
+Adds a `rammap` target: `pio run -t rammap` prints the .data/.bss totals and
+every RAM symbol sorted by size, largest first, so buffers can be sized
+against what is actually left for the stack.
+
+Every build also checks the static RAM after linking: it fails when .data,
+.bss and .noinit together pass `custom_ram_max` (platformio.ini), so the
+stack keeps at least the rest of the SRAM. How much of that the stack
+really takes is the MemStat stack peak in the telemetry report.
+"""
+
+import subprocess
+
+Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+
+RAM_SIZE = 2560
+STATIC_SECTIONS = (".data", ".bss", ".noinit")
+
+
+def check_ram(source, target, env):
+    limit = int(env.GetProjectOption("custom_ram_max", RAM_SIZE))
+    out = subprocess.check_output(
+        [env.subst("$SIZETOOL"), "-A", str(source[0])], universal_newlines=True
+    )
+    used = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in STATIC_SECTIONS:
+            used += int(fields[1])
+    print(
+        "Static RAM: %d of %d bytes allowed, %d left for the stack"
+        % (used, limit, RAM_SIZE - used)
+    )
+    if used > limit:
+        print("Static RAM over custom_ram_max by %d bytes" % (used - limit))
+        return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_ram)  # noqa: F821
+
+env.AddCustomTarget(  # noqa: F821
+    name="rammap",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[
+        "$SIZETOOL -C --mcu=$BOARD_MCU $BUILD_DIR/${PROGNAME}.elf",
+        "avr-nm --size-sort --reverse-sort --print-size --radix=d --demangle "
+        "$BUILD_DIR/${PROGNAME}.elf | grep -i ' [bdv] '",
+    ],
+    title="RAM map",
+    description="Print SRAM usage per symbol",
+)
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "log_store.h"
+#include "messages.h"
+#include "radio.h"
+#include "beacon.h"
+
+/* The record header is the downlink's, see communication.h */
+Q_ASSERT_COMPILE(BEACON_HEAD == offsetof(LogRecord, flags));
+Q_ASSERT_COMPILE((int)BEACON_LEN <= (int)RADIO_FRAME_MAX);
+
+enum {
+    BEACON_AT_TAIL = BEACON_LEN - BEACON_TAIL
+};
+
+Beacon g_beacon;
+
+void Beacon_init(Beacon * const me) {
+    static char const call[] = AX25_CALLSIGN;
+    uint8_t *p = me->frame;
+    uint8_t i;
+
+    memset(me->frame, 0, sizeof(me->frame));
+    p[0] = (uint8_t)BEACON_SEQ;         /* seq; time stays 0 */
+    p[1] = (uint8_t)(BEACON_SEQ >> 8);
+    p[2] = LOG_REC_BEACON;
+    p[3] = LOG_TAG_NONE;
+    p[8] = BEACON_PAYLOAD;
+    p += BEACON_HEAD;
+    *p++ = BEACON_VERSION;
+    for (i = 0U; i < BEACON_CALL_LEN; ++i) {
+        *p++ = (i < sizeof(call) - 1U) ? (uint8_t)call[i] : (uint8_t)' ';
+    }
+#ifndef RADIO_AX25
+    Radio_check(me->check, me->frame, BEACON_LEN);
+#endif
+    me->count = 0U;
+}
+
+/* Writes n bytes of v at tail offset 'at', low first, noting the change
+* in 'delta'; returns the offset after them */
+static uint8_t patch(Beacon * const me, uint8_t *delta, uint8_t at, uint32_t v, uint8_t n) {
+    uint8_t *p = &me->frame[BEACON_AT_TAIL + at];
+
+    while (n-- != 0U) {
+        delta[at++] = (uint8_t)(*p ^ (uint8_t)v);
+        *p++ = (uint8_t)v;
+        v >>= 8;
+    }
+    return at;
+}
+
+void Beacon_send(Beacon * const me, BeaconFields const *f) {
+    uint8_t delta[BEACON_TAIL];
+    uint8_t at;
+
+    ++me->count;
+    at = patch(me, delta, 0U, f->battery, 2U);
+    at = patch(me, delta, at, f->state, 1U);
+    at = patch(me, delta, at, f->commands, 2U);
+    at = patch(me, delta, at, f->lost, 2U);
+    at = patch(me, delta, at, f->unsent, 2U);
+    at = patch(me, delta, at, f->uptime, 4U);
+    at = patch(me, delta, at, me->count, 2U);
+
+#ifndef RADIO_AX25
+    for (at = 0U; (at < BEACON_TAIL) && (delta[at] == 0U); ++at) {
+    }
+    if (at < BEACON_TAIL) {
+        Radio_checkDelta(me->check, &delta[at], (uint16_t)(BEACON_TAIL - at));
+    }
+    Radio_sendChecked(me->frame, BEACON_LEN, me->check);
+#else
+    Radio_begin();                      /* the TNC adds the FCS */
+    Radio_write(me->frame, BEACON_LEN);
+    Radio_end();
+#endif
+}
@@ -2,14 +2,18 @@
 #include "qpn.h"        /* QP/C framework API */
 #include "bsp.h"        /* Board Support Package interface */
 #include "setup.h"
+#include "profiler.h"
+#include "amu.h"
 
 void BSP_init(void) {
-    Serial.print("Simple CubeSat example\n");
-    Serial.print("QP-nano version: ");
+    Serial.print(F("Simple CubeSat example\n"));
+    Serial.print(F("QP-nano version: "));
     Serial.println(QP_VERSION_STR);
-    Serial.println("Press Ctrl-C to quit...");
+    Serial.println(F("Press Ctrl-C to quit..."));
     
     timer1_init();
+    amu_init();
+    Profiler_init();
 }
 
 void BSP_ledOff(void) {
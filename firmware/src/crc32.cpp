@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include "crc32.h"
+
+#ifdef __AVR__
+
+#include <avr/pgmspace.h>
+
+static const uint32_t l_crcNibble[16] PROGMEM = {
+    0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+    0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+    0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+    0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+};
+
+uint32_t crc32_update(uint32_t crc, uint8_t const *data, uint16_t len) {
+    while (len-- != 0U) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ pgm_read_dword(&l_crcNibble[crc & 0x0FU]);
+        crc = (crc >> 4) ^ pgm_read_dword(&l_crcNibble[crc & 0x0FU]);
+    }
+    return crc;
+}
+
+#else /* host build: slicing-by-8 */
+
+static uint32_t l_crcSlice[8][256];
+
+static void buildTables(void) {
+    uint32_t c;
+    uint16_t n;
+    uint8_t k;
+
+    for (n = 0U; n < 256U; ++n) {
+        c = n;
+        for (k = 0U; k < 8U; ++k) {
+            c = (c & 1U) ? ((c >> 1) ^ 0xEDB88320UL) : (c >> 1);
+        }
+        l_crcSlice[0][n] = c;
+    }
+    for (n = 0U; n < 256U; ++n) {
+        for (k = 1U; k < 8U; ++k) {
+            l_crcSlice[k][n] = (l_crcSlice[k - 1U][n] >> 8)
+                               ^ l_crcSlice[0][l_crcSlice[k - 1U][n] & 0xFFU];
+        }
+    }
+}
+
+uint32_t crc32_update(uint32_t crc, uint8_t const *data, uint16_t len) {
+    if (l_crcSlice[0][1] == 0U) {
+        buildTables();
+    }
+    while (len >= 8U) {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8)
+                             | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        uint32_t hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8)
+                      | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = l_crcSlice[7][lo & 0xFFU] ^ l_crcSlice[6][(lo >> 8) & 0xFFU]
+            ^ l_crcSlice[5][(lo >> 16) & 0xFFU] ^ l_crcSlice[4][lo >> 24]
+            ^ l_crcSlice[3][hi & 0xFFU] ^ l_crcSlice[2][(hi >> 8) & 0xFFU]
+            ^ l_crcSlice[1][(hi >> 16) & 0xFFU] ^ l_crcSlice[0][hi >> 24];
+        data += 8;
+        len -= 8U;
+    }
+    while (len-- != 0U) {
+        crc = (crc >> 8) ^ l_crcSlice[0][(crc ^ *data++) & 0xFFU];
+    }
+    return crc;
+}
+
+#endif /* __AVR__ */
@@ -1,17 +1,43 @@
 #include <Arduino.h>
 #include "qpn.h"    /* QP-nano framework API */
 #include "bsp.h"  /* Board Support Package interface */
+#include "queue_stats.h"
+#include "profiler.h"
+#include "defer.h"
+#include "amu.h"
+#include "evt_pool.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "serial_frame.h"
+#include "memstat.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "messages.h"
+#include "radio.h"
+#include "communication.h"
+#include "beacon.h"
+#include "orbit_stats.h"
+
+/* Residency is kept per beacon state */
+Q_ASSERT_COMPILE((int)ORBIT_STATES == (int)BEACON_ST_COUNT);
 
 /* Define CubeSat Variables & Functions --------------------------------------*/
 float battery_watt_h = 0.0f;
 int active = 1;
 int r_to_transmit = 0;
+static SweepRefs l_sweepRefs;   /* keys for delta sweep packets */
+static uint16_t l_extractPeakUs; /* slowest IvParams_extract() so far */
 
 // static void dispatch(QSignal sig);
 
 /* Declare the CubeSat class --------------------------------------*/
 typedef struct CubeSat {
     QActive super;
+    DeferQueue deferred;    /* payload/telemetry requests held while off */
+    uint8_t listen;         /* seconds left to listen for the ground */
+    uint8_t state;          /* BEACON_ST_*, of the state last entered */
+    uint8_t beaconIn;       /* seconds to the next beacon */
+    uint8_t sweepIn;        /* seconds to the next scheduled sweep request */
 } CubeSat;
 
 static QState CubeSat_initial(CubeSat * const me);
@@ -26,6 +52,9 @@ static QState CubeSat_transmit(CubeSat * const me);
 static QState CubeSat_receive(CubeSat * const me);
 
 
+static void analyze_sweep(ivsweep_t const *sweep);
+static void beacon(CubeSat * const me);
+
 /* The single instance of the CubeSat active object -------------------------*/
 CubeSat AO_CubeSat;
 
@@ -33,6 +62,9 @@ CubeSat AO_CubeSat;
 void CubeSat_ctor(void) {
     CubeSat * const me = &AO_CubeSat;
     QActive_ctor(&me->super, Q_STATE_CAST(&CubeSat_initial));
+    DeferQueue_init(&me->deferred);
+    me->sweepIn = DC_SWEEP_PERIOD_S;
+    SweepCodec_initRefs(&l_sweepRefs);
 }
 
 static QState CubeSat_initial(CubeSat * const me) {
@@ -44,14 +76,15 @@ static QState CubeSat_launch(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Launch State\n");
+            Serial.print(F("Entry Signal from Launch State\n"));
+            me->state = BEACON_ST_LAUNCH;
             /* ALL SYSTEM IDLE/OFF CHECK*/
-            QACTIVE_POST_ISR((QActive *)&AO_CubeSat, Q_LEO_SIG, 0U);
+            QueueStats_post((QActive *)&AO_CubeSat, Q_LEO_SIG, 0U);
             status_ = Q_HANDLED();
             break;
         }
         case Q_LEO_SIG: {
-            Serial.print("LEO Signal from Launch State\n");
+            Serial.print(F("LEO Signal from Launch State\n"));
             status_ = Q_TRAN(&CubeSat_charge);
             break;
         }
@@ -66,23 +99,32 @@ static QState CubeSat_leo(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from LEO State\n");
+            Serial.print(F("Entry Signal from LEO State\n"));
+            me->state = BEACON_ST_LEO;
             status_ = Q_HANDLED();
             break;
         }
         case Q_BATTERY_SIG: {
-            Serial.println(battery_watt_h);
-            Serial.print("Battery Signal from LEO State\n");
+            Serial.print(F("Battery Signal from LEO State\n"));
+            DataCollection_second(me->state, l_extractPeakUs);
             battery_watt_h -= .01;
+            /* the payload schedule; Charge and Radio park the request until
+            * Payload is entered, and one parked request is enough */
+            if (--me->sweepIn == 0U) {
+                me->sweepIn = DC_SWEEP_PERIOD_S;
+                if (me->deferred.nUsed == 0U) {
+                    QueueStats_post(&me->super, Q_PAYLOAD_SIG, 0U);
+                }
+            }
 
             if (battery_watt_h > BATTERY_MAX_W * 0.5 && active == 0) {
-                Serial.print("Battery level high, transitioning to Active State\n");
+                Serial.print(F("Battery level high, transitioning to Active State\n"));
                 active = 1;
                 status_ = Q_TRAN(&CubeSat_active);
                 break;
             }
             if (battery_watt_h < BATTERY_MAX_W * 0.3 && active == 1) {
-                Serial.print("Battery level low, transitioning to Charge State\n");
+                Serial.print(F("Battery level low, transitioning to Charge State\n"));
                 active = 0;
                 status_ = Q_TRAN(&CubeSat_charge);
                 break;
@@ -92,7 +134,45 @@ static QState CubeSat_leo(CubeSat * const me) {
             break;
         }
         case Q_DEORBIT_SIG: {
-            Serial.print("Deorbit Signal from LEO State\n");
+            Serial.print(F("Deorbit Signal from LEO State\n"));
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_SWEEP_SIG: {
+            /* handled here so the pool block is released in every state */
+            Serial.print(F("Sweep Signal from LEO State\n"));
+            ivsweep_t const *sweep = (ivsweep_t const *)EvtPool_data(&g_sweepPool, (EvtHandle)Q_PAR(me));
+            if (sweep != (ivsweep_t const *)0) {
+                print_iv_curve(sweep);
+                analyze_sweep(sweep);
+            }
+            EvtPool_unref(&g_sweepPool, (EvtHandle)Q_PAR(me));
+            amu_on_sweep_released();
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_TIMEOUT_SIG: {
+            amu_on_timeout();
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_TWI_DONE_SIG: {
+            amu_on_twi_done(Q_PAR(me));
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_QUERY_SIG: {
+            uint32_t now = DataCollection_now();
+            uint32_t back = (uint32_t)(Q_PAR(me) >> 16) * 3600UL;
+
+            Communication_query((back < now) ? (now - back) : 0UL, 0xFFFFFFFFUL,
+                                (uint8_t)Q_PAR(me), (uint8_t)(Q_PAR(me) >> 8));
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_PROFILE_SIG: {
+            Profiler_dump();
+            Profiler_clear();
             status_ = Q_HANDLED();
             break;
         }
@@ -108,13 +188,20 @@ static QState CubeSat_charge(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Charge State\n");
-            Serial.print("TURN OFF/IDLE ALL SYSTEMS\n");
+            Serial.print(F("Entry Signal from Charge State\n"));
+            me->state = BEACON_ST_CHARGE;
+            Serial.print(F("TURN OFF/IDLE ALL SYSTEMS\n"));
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_PAYLOAD_SIG:
+        case Q_TELEMETRY_SIG: {
+            DeferQueue_defer(&me->deferred, &me->super);
             status_ = Q_HANDLED();
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Charge State\n");
+            Serial.print(F("Exit Signal from Charge State\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -130,12 +217,13 @@ static QState CubeSat_active(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Active State\n");
+            Serial.print(F("Entry Signal from Active State\n"));
+            me->state = BEACON_ST_ACTIVE;
             status_ = Q_HANDLED();
             break;
         }
         case Q_INIT_SIG: {
-            Serial.print("Init Signal from Active State\n");
+            Serial.print(F("Init Signal from Active State\n"));
             if (r_to_transmit == 1) {
                 status_ = Q_TRAN(&CubeSat_transmit);
             } else {
@@ -144,7 +232,7 @@ static QState CubeSat_active(CubeSat * const me) {
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Active State\n");
+            Serial.print(F("Exit Signal from Active State\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -160,12 +248,31 @@ static QState CubeSat_payload(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Payload State\n");
+            Serial.print(F("Entry Signal from Payload State\n"));
+            me->state = BEACON_ST_PAYLOAD;
+            DeferQueue_recall(&me->deferred, &me->super);
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_PAYLOAD_SIG: {
+            Serial.print(F("Payload Signal from Payload State\n"));
+#ifdef AMU_ADAPTIVE_SWEEP
+            if (!amu_sweep_adaptive(&me->super)) {
+#else
+            if (!amu_sweep_all(&me->super)) {
+#endif
+                Serial.print(F("AMU sweep busy or no AMU found\n"));
+            }
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_TELEMETRY_SIG: {
+            Serial.print(F("Telemetry Signal from Payload State\n"));
             status_ = Q_HANDLED();
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Payload State\n");
+            Serial.print(F("Exit Signal from Payload State\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -181,13 +288,14 @@ static QState CubeSat_detumble(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Detumble State\n");
-            Serial.print("TURN ON ADCS\n");
+            Serial.print(F("Entry Signal from Detumble State\n"));
+            me->state = BEACON_ST_DETUMBLE;
+            Serial.print(F("TURN ON ADCS\n"));
             status_ = Q_HANDLED();
             break;
         }
         case Q_TICK_SIG: {
-            Serial.print("Tick Signal from Detumble State\n");
+            Serial.print(F("Tick Signal from Detumble State\n"));
             battery_watt_h -= .15;
             /*WRITE DETUMBLE CODE IN HERE*/
             status_ = Q_TRAN(&CubeSat_telemetry);
@@ -195,8 +303,8 @@ static QState CubeSat_detumble(CubeSat * const me) {
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Detumble State\n");
-            Serial.print("TURN OFF ADCS\n");
+            Serial.print(F("Exit Signal from Detumble State\n"));
+            Serial.print(F("TURN OFF ADCS\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -212,22 +320,29 @@ static QState CubeSat_telemetry(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Telemetry State\n");
-            Serial.print("TURN ON Telemetry\n");
+            Serial.print(F("Entry Signal from Telemetry State\n"));
+            me->state = BEACON_ST_TELEMETRY;
+            Serial.print(F("TURN ON Telemetry\n"));
             status_ = Q_HANDLED();
             break;
         }
         case Q_TICK_SIG: {
             battery_watt_h -= .21;
-            Serial.print("Tick Signal from Telemetry State\n");
+            Serial.print(F("Tick Signal from Telemetry State\n"));
             /*WRITE Telemetry CODE IN HERE*/
+            QueueStats_report();
+            MemStat_report();
+            amu_report();
+            Serial.print(F("IV extract peak "));
+            Serial.print((unsigned long)l_extractPeakUs * (F_CPU / 1000000UL));
+            Serial.println(F(" cycles"));
             r_to_transmit = 1;
             status_ = Q_TRAN(&CubeSat_active);
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Telemetry State\n");
-            Serial.print("TURN OFF Telemetry\n");
+            Serial.print(F("Exit Signal from Telemetry State\n"));
+            Serial.print(F("TURN OFF Telemetry\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -243,15 +358,24 @@ static QState CubeSat_radio(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Radio State\n");
-            Serial.print("TURN ON RADIO\n");
+            Serial.print(F("Entry Signal from Radio State\n"));
+            me->state = BEACON_ST_RADIO;
+            me->beaconIn = 0U;      /* one as soon as the radio is on */
+            Serial.print(F("TURN ON RADIO\n"));
             battery_watt_h -= 1.5;
             status_ = Q_HANDLED();
             break;
         }
+        case Q_PAYLOAD_SIG:
+        case Q_TELEMETRY_SIG: {
+            /* keep the pass short, handle it once the radio is off */
+            DeferQueue_defer(&me->deferred, &me->super);
+            status_ = Q_HANDLED();
+            break;
+        }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal from Radio State\n");
-            Serial.print("TURN OFF RADIO\n");
+            Serial.print(F("Exit Signal from Radio State\n"));
+            Serial.print(F("TURN OFF RADIO\n"));
             status_ = Q_HANDLED();
             break;
         }
@@ -267,18 +391,31 @@ static QState CubeSat_transmit(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Transmit State\n");
+            Serial.print(F("Entry Signal from Transmit State\n"));
+            me->state = BEACON_ST_TRANSMIT;
+            Communication_beginPass();
             status_ = Q_HANDLED();
             break;
         }
         case Q_TICK_SIG: {
-            Serial.print("Tick Signal from Transmit State\n");
-            /*WRITE Telemetry CODE IN HERE*/
-            status_ = Q_TRAN(&CubeSat_receive);
+            Serial.print(F("Tick Signal from Transmit State\n"));
+            beacon(me);
+            if (Communication_tick()) {
+                status_ = Q_HANDLED();  /* more to send and pass left */
+            } else {
+                status_ = Q_TRAN(&CubeSat_receive);
+            }
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal in Transmit State\n");
+            Serial.print(F("Exit Signal in Transmit State\n"));
+            Serial.print(F("Pass: "));
+            Serial.print(g_downlink.frames);
+            Serial.print(F(" frames, "));
+            Serial.print(g_downlink.records);
+            Serial.print(F(" records, "));
+            Serial.print(g_downlink.payload);
+            Serial.println(F(" bytes"));
             r_to_transmit = 0;
             status_ = Q_HANDLED();
             break;
@@ -295,18 +432,31 @@ static QState CubeSat_receive(CubeSat * const me) {
     QState status_;
     switch (Q_SIG(me)) {
         case Q_ENTRY_SIG: {
-            Serial.print("Entry Signal from Receive State\n");
+            Serial.print(F("Entry Signal from Receive State\n"));
+            me->state = BEACON_ST_RECEIVE;
+            me->listen = DL_LISTEN_S;
             status_ = Q_HANDLED();
             break;
         }
         case Q_TICK_SIG: {
-            Serial.print("Tick Signal from Recieve State\n");
-            /*WRITE Telemetry CODE IN HERE*/
-            status_ = Q_TRAN(&CubeSat_active);
+            Serial.print(F("Tick Signal from Recieve State\n"));
+            beacon(me);
+            Communication_receive(&me->super);  /* commands, transfer requests, NACKs */
+            if (--me->listen != 0U) {
+                status_ = Q_HANDLED();
+            } else {
+                status_ = Q_TRAN(&CubeSat_active);
+            }
             break;
         }
         case Q_EXIT_SIG: {
-            Serial.print("Exit Signal in Transmit State\n");
+            Serial.print(F("Exit Signal in Receive State\n"));
+            Serial.print(F("Uplink: "));
+            Serial.print(g_commands.accepted);
+            Serial.print(F(" commands, "));
+            Serial.print(g_commands.rejected);
+            Serial.print(F(" rejected, last error "));
+            Serial.println(g_commands.lastError);
             status_ = Q_HANDLED();
             break;
         }
@@ -316,4 +466,109 @@ static QState CubeSat_receive(CubeSat * const me) {
         }
     }
     return status_;
-}
\ No newline at end of file
+}
+/* Sends the beacon every BEACON_PERIOD_S ticks while the radio is on */
+static void beacon(CubeSat * const me) {
+    BeaconFields f;
+
+    if (me->beaconIn != 0U) {
+        --me->beaconIn;
+        return;
+    }
+    me->beaconIn = BEACON_PERIOD_S - 1U;
+    f.battery = (battery_watt_h > 0.0f) ? (uint16_t)(battery_watt_h * 100.0f) : 0U;
+    f.state = me->state;
+    f.commands = g_commands.accepted;
+    f.lost = g_telemetryLog.lost;
+    f.unsent = (uint16_t)(g_telemetryLog.nextSeq - g_telemetryLog.unsentSeq);
+    f.uptime = DataCollection_now();
+    Beacon_send(&g_beacon, &f);
+}
+
+/* Downlink forms of a sweep, framed (or printed as hex lines) for the ground */
+static void print_packet(__FlashStringHelper const *name, uint8_t const *pkt,
+                         uint16_t len) {
+#ifndef SERIAL_TEXT_OUTPUT
+    (void)name;                 /* the packet type byte says which one */
+    SerialFrame_send(SF_PACKET, pkt, len);
+#else
+    uint16_t i;
+
+    Serial.print(name);
+    Serial.print(F(" packet ("));
+    Serial.print(len);
+    Serial.print(F(" bytes): "));
+    for (i = 0U; i < len; ++i) {
+        if (pkt[i] < 0x10U) {
+            Serial.print('0');
+        }
+        Serial.print(pkt[i], HEX);
+    }
+    Serial.println();
+#endif
+}
+
+static void analyze_sweep(ivsweep_t const *sweep) {
+    static uint8_t pkt[SWEEP_PKT_MAX];
+    IvParams p;
+    uint16_t len;
+#ifdef DC_LOG_SWEEPS
+    SweepRef *ref;
+    uint16_t seq;
+#endif
+    unsigned long t0 = micros();
+
+    IvParams_extract(sweep, &p);
+    t0 = micros() - t0;
+    if (t0 > l_extractPeakUs) {
+        l_extractPeakUs = (t0 < 0xFFFFUL) ? (uint16_t)t0 : 0xFFFFU;
+    }
+    IvParams_check(&p, &sweep->meta);
+    /* mean of the two readings in 0.01 C, and Isc in 0.1 mA */
+    OrbitStats_add(&g_orbitStats, ORBIT_TEMPERATURE,
+                   (sweep->meta.tsensor_start + sweep->meta.tsensor_end) * 50.0f);
+    OrbitStats_add(&g_orbitStats, ORBIT_SUN, (float)p.isc_uA * 0.01f);
+
+#ifdef SERIAL_TEXT_OUTPUT
+    Serial.print(F("IV params: Voc "));
+    Serial.print(p.voc_mV);
+    Serial.print(F(" mV, Isc "));
+    Serial.print(p.isc_uA);
+    Serial.print(F(" uA, Pmax "));
+    Serial.print(p.pmax_uW);
+    Serial.print(F(" uW at "));
+    Serial.print(p.vmp_mV);
+    Serial.print(F(" mV, FF "));
+    Serial.print(p.ff);
+    Serial.print(F("e-4, Rs "));
+    Serial.print(p.rs_mohm);
+    Serial.print(F(" mOhm, Rsh "));
+    Serial.print(p.rsh_ohm);
+    Serial.print(F(" Ohm, mismatch 0x"));
+    Serial.print(p.mismatch, HEX);
+    Serial.print(F(", "));
+    Serial.print(t0 * (F_CPU / 1000000UL));
+    Serial.println(F(" cycles"));
+#endif
+
+#ifdef DC_LOG_SWEEPS
+    /* a delta against a key the log no longer holds could never be decoded */
+    ref = SweepCodec_refOf(&l_sweepRefs, sweep->cell);
+    if ((ref != (SweepRef *)0)
+        && ((int16_t)(ref->keySeq - LogStore_oldest(&g_telemetryLog)) < 0)) {
+        SweepCodec_dropKey(ref);
+    }
+#endif
+    len = SweepCodec_encodeDelta(&l_sweepRefs, sweep, pkt, sizeof(pkt));
+    print_packet(F("Sweep"), pkt, len);
+#ifdef DC_LOG_SWEEPS
+    seq = DataCollection_logSweep(pkt, len);
+    ref = SweepCodec_refOf(&l_sweepRefs, sweep->cell);
+    if ((len != 0U) && SweepCodec_isKey(pkt) && (ref != (SweepRef *)0)) {
+        ref->keySeq = seq;
+    }
+#endif
+    len = SweepCodec_encodeParams(sweep, &p, pkt, sizeof(pkt));
+    print_packet(F("Params"), pkt, len);
+    DataCollection_logParams(pkt, (uint8_t)len);
+}
@@ -0,0 +1,40 @@
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+#include "defer.h"
+
+void DeferQueue_init(DeferQueue * const me) {
+    me->head = 0U;
+    me->nUsed = 0U;
+    me->dropped = 0U;
+}
+
+bool DeferQueue_defer(DeferQueue * const me, QActive const * const ao) {
+    if (me->nUsed >= DEFER_QUEUE_LEN) {
+        if (me->dropped != 0xFFU) {
+            ++me->dropped;
+        }
+        return false;
+    }
+    me->buf[me->head] = ao->super.evt;
+    me->head = (uint8_t)((me->head + 1U) % DEFER_QUEUE_LEN);
+    ++me->nUsed;
+    return true;
+}
+
+uint8_t DeferQueue_recall(DeferQueue * const me, QActive * const ao) {
+    uint8_t recalled = 0U;
+
+    while (me->nUsed != 0U) {
+        uint8_t tail = (uint8_t)((me->head + DEFER_QUEUE_LEN - me->nUsed)
+                                 % DEFER_QUEUE_LEN);
+        /* leave the rest parked if the AO queue is short of room */
+        if (!QueueStats_post(ao, me->buf[tail].sig, me->buf[tail].par)) {
+            break;
+        }
+        --me->nUsed;
+        ++recalled;
+    }
+    return recalled;
+}
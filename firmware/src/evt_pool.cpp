@@ -0,0 +1,80 @@
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "evt_pool.h"
+
+EvtPool g_sweepPool;
+
+static uint8_t indexOf(EvtPool const * const me, EvtHandle h) {
+    uint8_t idx = (uint8_t)(h & 0xFFU);
+
+    if ((idx >= me->nBlocks) || (me->refs[idx] == 0U)
+        || (me->gen[idx] != (uint8_t)(h >> 8))) {
+        return 0xFFU;
+    }
+    return idx;
+}
+
+void EvtPool_init(EvtPool * const me, void * const storage,
+                  uint16_t poolSize, uint16_t blockSize) {
+    uint8_t n = (uint8_t)(poolSize / blockSize);
+
+    me->storage = (uint8_t *)storage;
+    me->blockSize = blockSize;
+    me->nBlocks = (n < EVT_POOL_MAX_BLOCKS) ? n : (uint8_t)EVT_POOL_MAX_BLOCKS;
+    me->nFree = me->nBlocks;
+    me->nMin = me->nBlocks;
+    memset(me->refs, 0, sizeof(me->refs));
+    memset(me->gen, 0, sizeof(me->gen));
+}
+
+EvtHandle EvtPool_alloc(EvtPool * const me) {
+    EvtHandle h = EVT_HANDLE_NONE;
+    uint8_t i;
+
+    QF_INT_DISABLE();
+    for (i = 0U; i < me->nBlocks; ++i) {
+        if (me->refs[i] == 0U) {
+            me->refs[i] = 1U;
+            /* skip 0xFF so no handle ever equals EVT_HANDLE_NONE */
+            me->gen[i] = (uint8_t)((me->gen[i] + 1U) % 0xFFU);
+            --me->nFree;
+            if (me->nFree < me->nMin) {
+                me->nMin = me->nFree;
+            }
+            h = (EvtHandle)(((uint16_t)me->gen[i] << 8) | i);
+            break;
+        }
+    }
+    QF_INT_ENABLE();
+    return h;
+}
+
+void *EvtPool_data(EvtPool const * const me, EvtHandle h) {
+    uint8_t idx = indexOf(me, h);
+
+    if (idx == 0xFFU) {
+        return (void *)0;
+    }
+    return &me->storage[(uint16_t)idx * me->blockSize];
+}
+
+void EvtPool_ref(EvtPool * const me, EvtHandle h) {
+    QF_INT_DISABLE();
+    uint8_t idx = indexOf(me, h);
+    if ((idx != 0xFFU) && (me->refs[idx] != 0xFFU)) {
+        ++me->refs[idx];
+    }
+    QF_INT_ENABLE();
+}
+
+void EvtPool_unref(EvtPool * const me, EvtHandle h) {
+    QF_INT_DISABLE();
+    uint8_t idx = indexOf(me, h);
+    if (idx != 0xFFU) {
+        --me->refs[idx];
+        if (me->refs[idx] == 0U) {
+            ++me->nFree;
+        }
+    }
+    QF_INT_ENABLE();
+}
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "amu.h"
+#include "iv_params.h"
+
+#define IV_INFINITE_OHM 0x7FFFFFFFL
+
+/* Least-squares line through a run of points, in mV and uA */
+typedef struct {
+    int32_t xbar;
+    int32_t ybar;
+    int32_t sxx;
+    int64_t sxy;
+} LineFit;
+
+static int32_t toFixed(float x, float k) {
+    float y = x * k;
+    return (int32_t)(y < 0.0f ? y - 0.5f : y + 0.5f);
+}
+
+static int32_t mV(ivsweep_t const *s, uint8_t k) {
+    return toFixed(s->voltage[k], 1e3f);
+}
+
+static int32_t uA(ivsweep_t const *s, uint8_t k, int8_t sign) {
+    return sign * toFixed(s->current[k], 1e6f);
+}
+
+static void fitLine(ivsweep_t const *s, int8_t sign, uint8_t first,
+                    LineFit *f) {
+    int32_t sx = 0;
+    int32_t sy = 0;
+    uint8_t k;
+
+    for (k = first; k < first + IV_FIT_POINTS; ++k) {
+        sx += mV(s, k);
+        sy += uA(s, k, sign);
+    }
+    f->xbar = sx / IV_FIT_POINTS;
+    f->ybar = sy / IV_FIT_POINTS;
+    f->sxx = 0;
+    f->sxy = 0;
+    for (k = first; k < first + IV_FIT_POINTS; ++k) {
+        int32_t dx = mV(s, k) - f->xbar;
+        f->sxx += dx * dx;
+        f->sxy += (int64_t)dx * (uA(s, k, sign) - f->ybar);
+    }
+}
+
+/* -dV/dI of the fitted line, 'unit' per kOhm (mV/uA) */
+static int32_t resistance(LineFit const *f, int32_t unit) {
+    if (f->sxy >= 0) {
+        return IV_INFINITE_OHM;         /* flat or rising current */
+    }
+    return (int32_t)(-(int64_t)f->sxx * unit / f->sxy);
+}
+
+static bool agrees(int32_t ours, float theirs, float k) {
+    int32_t ref = toFixed(theirs, k);
+    int32_t diff = ours - ref;
+
+    if (ref < 0) {
+        ref = -ref;
+    }
+    if (diff < 0) {
+        diff = -diff;
+    }
+    return (int64_t)diff * 100 <= (int64_t)ref * IV_CHECK_TOL_PCT;
+}
+
+void IvParams_extract(ivsweep_t const *sweep, IvParams *p) {
+    LineFit f;
+    int8_t sign = 1;
+    int64_t pmax = 0;                   /* nW, 2.1 W overflows int32_t */
+    uint8_t first;
+    uint8_t k;
+
+    p->mismatch = 0U;
+
+    /* photocurrent is positive from here on, whatever the AMU convention */
+    if (sweep->current[0] < 0.0f) {
+        sign = -1;
+    }
+
+    /* Isc and Rsh: line through the points nearest 0 V, taken at 0 V */
+    fitLine(sweep, sign, 0U, &f);
+    p->isc_uA = (f.sxx == 0) ? f.ybar
+              : (int32_t)(f.ybar - f.sxy * f.xbar / f.sxx);
+    p->rsh_ohm = resistance(&f, 1000L);
+
+    /* Voc: interpolate at the sign change of the current */
+    for (k = 1U; k < IVSWEEP_POINTS; ++k) {
+        if (uA(sweep, k, sign) <= 0) {
+            break;
+        }
+    }
+    if (k < IVSWEEP_POINTS) {
+        int32_t v0 = mV(sweep, k - 1U);
+        int32_t i0 = uA(sweep, k - 1U, sign);
+        int32_t i1 = uA(sweep, k, sign);
+        p->voc_mV = (int16_t)(v0 + (int64_t)(mV(sweep, k) - v0) * i0 / (i0 - i1));
+        first = (k < IV_FIT_POINTS / 2U) ? 0U : (uint8_t)(k - IV_FIT_POINTS / 2U);
+        if (first > IVSWEEP_POINTS - IV_FIT_POINTS) {
+            first = IVSWEEP_POINTS - IV_FIT_POINTS;
+        }
+        fitLine(sweep, sign, first, &f);
+    }
+    else {
+        /* the sweep stopped short of Voc, extrapolate the last points */
+        fitLine(sweep, sign, IVSWEEP_POINTS - IV_FIT_POINTS, &f);
+        p->voc_mV = (int16_t)((f.sxy == 0) ? f.xbar
+                  : f.xbar - (int64_t)f.ybar * f.sxx / f.sxy);
+        p->mismatch |= IV_NO_VOC;
+    }
+    p->rs_mohm = resistance(&f, 1000000L);
+
+    /* Pmax: the best sampled operating point */
+    p->vmp_mV = 0;
+    p->imp_uA = 0;
+    for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+        int32_t v = mV(sweep, k);
+        int32_t i = uA(sweep, k, sign);
+        if ((v > 0) && (i > 0) && ((int64_t)v * i > pmax)) {
+            pmax = (int64_t)v * i;
+            p->vmp_mV = (int16_t)v;
+            p->imp_uA = i;
+        }
+    }
+    p->pmax_uW = (int32_t)(pmax / 1000);
+
+    if ((p->voc_mV > 0) && (p->isc_uA > 0)) {
+        p->ff = (uint16_t)(pmax * 10000 / ((int64_t)p->voc_mV * p->isc_uA));
+    }
+    else {
+        p->ff = 0U;
+    }
+}
+
+uint8_t IvParams_check(IvParams *p, ivsweep_meta_t const *meta) {
+    float isc = (meta->isc < 0.0f) ? -meta->isc : meta->isc;
+
+    p->mismatch &= (uint8_t)~(IV_MISMATCH_VOC | IV_MISMATCH_ISC
+                              | IV_MISMATCH_PMAX | IV_MISMATCH_FF);
+    if (!agrees(p->voc_mV, meta->voc, 1e3f)) {
+        p->mismatch |= IV_MISMATCH_VOC;
+    }
+    if (!agrees(p->isc_uA, isc, 1e6f)) {
+        p->mismatch |= IV_MISMATCH_ISC;
+    }
+    if (!agrees(p->pmax_uW, meta->pmax, 1e6f)) {
+        p->mismatch |= IV_MISMATCH_PMAX;
+    }
+    if (!agrees(p->ff, meta->ff, 1e4f)) {
+        p->mismatch |= IV_MISMATCH_FF;
+    }
+    return p->mismatch;
+}
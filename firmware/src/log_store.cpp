@@ -0,0 +1,372 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "log_store.h"
+
+/* The slot image is the LogRecord itself; no padding on AVR or x86 */
+Q_ASSERT_COMPILE(sizeof(LogRecord) == LOG_SLOT_SIZE);
+Q_ASSERT_COMPILE(offsetof(LogRecord, payload) == LOG_HEADER_SIZE);
+
+static uint32_t slotAddr(LogStore const * const me, uint16_t slot) {
+    return me->base + (uint32_t)slot * LOG_SLOT_SIZE;
+}
+
+/* Records behind 'seq', counting itself; 0 for nextSeq */
+static uint16_t ageOf(LogStore const * const me, uint16_t seq) {
+    return (uint16_t)(me->nextSeq - seq);
+}
+
+/* Slot of record 'seq', or nSlots when it is not stored */
+static uint16_t slotOf(LogStore const * const me, uint16_t seq) {
+    uint16_t age = ageOf(me, seq);
+
+    if ((age == 0U) || (age > me->count)) {
+        return me->nSlots;
+    }
+    return (uint16_t)(((uint32_t)me->head + me->nSlots - age) % me->nSlots);
+}
+
+static uint16_t recordCrc(LogRecord const *rec) {
+    uint16_t crc = crc16_ccitt(0xFFFFU, (uint8_t const *)rec,
+                               (uint16_t)offsetof(LogRecord, flags));
+    return crc16_ccitt(crc, rec->payload, rec->len);
+}
+
+static bool readSlot(LogStore const * const me, uint16_t slot, LogRecord *rec) {
+    me->dev->read(slotAddr(me, slot), rec, LOG_SLOT_SIZE);
+    return (rec->len <= LOG_PAYLOAD_MAX) && (recordCrc(rec) == rec->crc);
+}
+
+/* An erased or never written slot; anything else invalid is a torn write */
+static bool isBlank(LogStore const * const me, uint16_t slot) {
+    uint8_t b;
+    uint8_t i;
+
+    for (i = 0U; i < LOG_SLOT_SIZE; ++i) {
+        me->dev->read(slotAddr(me, slot) + i, &b, 1U);
+        if (b != 0xFFU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t readFlags(LogStore const * const me, uint16_t slot) {
+    uint8_t flags;
+
+    me->dev->read(slotAddr(me, slot) + offsetof(LogRecord, flags), &flags, 1U);
+    return flags;
+}
+
+/* Moves the unsent cursor past records that are gone or already sent */
+static void advanceUnsent(LogStore * const me) {
+    uint16_t oldest = LogStore_oldest(me);
+
+    if ((int16_t)(me->unsentSeq - oldest) < 0) {
+        me->lost += (uint16_t)(oldest - me->unsentSeq);
+        me->unsentSeq = oldest;
+    }
+    while ((me->unsentSeq != me->nextSeq)
+           && ((readFlags(me, slotOf(me, me->unsentSeq)) & LOG_FLAG_UNSENT) == 0U)) {
+        ++me->unsentSeq;
+    }
+}
+
+/* Makes room by forgetting the oldest records down to 'keep'. Records are
+* sent out of order, so each one is checked before it counts as lost. */
+static void dropOldest(LogStore * const me, uint16_t keep) {
+    uint16_t seq;
+
+    while (me->count > keep) {
+        seq = LogStore_oldest(me);
+        if (((int16_t)(seq - me->unsentSeq) >= 0)
+            && ((readFlags(me, slotOf(me, seq)) & LOG_FLAG_UNSENT) != 0U)) {
+            ++me->lost;
+        }
+        --me->count;
+    }
+    seq = LogStore_oldest(me);
+    if ((int16_t)(me->unsentSeq - seq) < 0) {
+        me->unsentSeq = seq;
+    }
+    advanceUnsent(me);
+}
+
+/* Sparse index ------------------------------------------------------------*/
+static void indexDropStale(LogStore * const me) {
+    uint8_t k = 0U;
+    uint8_t i;
+
+    while ((k < me->nIndex) && (ageOf(me, me->index[k].seq) > me->count)) {
+        ++k;
+    }
+    for (i = k; i < me->nIndex; ++i) {
+        me->index[i - k] = me->index[i];
+    }
+    me->nIndex = (uint8_t)(me->nIndex - k);
+}
+
+static void indexAdd(LogStore * const me, uint16_t seq, uint32_t time) {
+    uint8_t n = 0U;
+    uint8_t i;
+
+    if ((seq & (me->stride - 1U)) != 0U) {
+        return;
+    }
+    indexDropStale(me);
+    if (me->nIndex == LOG_INDEX_SIZE) {
+        /* full: keep every other sample at twice the stride */
+        me->stride = (uint16_t)(me->stride << 1);
+        for (i = 0U; i < me->nIndex; ++i) {
+            if ((me->index[i].seq & (me->stride - 1U)) == 0U) {
+                me->index[n++] = me->index[i];
+            }
+        }
+        me->nIndex = n;
+        if ((seq & (me->stride - 1U)) != 0U) {
+            return;
+        }
+    }
+    me->index[me->nIndex].time = time;
+    me->index[me->nIndex].seq = seq;
+    ++me->nIndex;
+}
+
+/* Samples the stored records at the smallest stride that fits the index */
+static void indexRebuild(LogStore * const me) {
+    LogRecord rec;
+    uint16_t seq;
+
+    me->stride = 1U;
+    while (me->count > (uint16_t)(me->stride * LOG_INDEX_SIZE)) {
+        me->stride = (uint16_t)(me->stride << 1);
+    }
+    me->nIndex = 0U;
+    seq = (uint16_t)((LogStore_oldest(me) + me->stride - 1U) & ~(me->stride - 1U));
+    while ((ageOf(me, seq) != 0U) && (ageOf(me, seq) <= me->count)) {
+        if (LogStore_read(me, seq, &rec)) {
+            me->index[me->nIndex].time = rec.time;
+            me->index[me->nIndex].seq = seq;
+            ++me->nIndex;
+        }
+        seq = (uint16_t)(seq + me->stride);
+    }
+}
+
+/* Public API --------------------------------------------------------------*/
+void LogStore_init(LogStore * const me, NvmDev const *dev,
+                   uint32_t base, uint32_t size) {
+    LogRecord rec;
+    uint16_t newest = 0U;
+    uint16_t newestSlot = 0U;
+    bool found = false;
+    uint16_t slot;
+
+    me->dev = dev;
+    me->base = base;
+    if (dev->eraseSize != 0U) {
+        size -= size % dev->eraseSize;  /* whole sectors only */
+    }
+    size /= LOG_SLOT_SIZE;
+    me->nSlots = (uint16_t)((size > LOG_MAX_SLOTS) ? (uint32_t)LOG_MAX_SLOTS : size);
+    me->head = 0U;
+    me->count = 0U;
+    me->nextSeq = 0U;
+    me->lost = 0U;
+    me->lastTime = 0U;
+
+    /* the newest valid record decides where appending resumes */
+    for (slot = 0U; slot < me->nSlots; ++slot) {
+        if (readSlot(me, slot, &rec)
+            && (!found || ((int16_t)(rec.seq - newest) > 0))) {
+            newest = rec.seq;
+            newestSlot = slot;
+            me->lastTime = rec.time;
+            found = true;
+        }
+    }
+    if (found) {
+        me->head = (uint16_t)((newestSlot + 1U) % me->nSlots);
+        me->nextSeq = (uint16_t)(newest + 1U);
+
+        /* older records count while the sequence runs unbroken backwards;
+        * a torn slot keeps its place as a record that no longer reads */
+        slot = newestSlot;
+        while (me->count < me->nSlots) {
+            if (readSlot(me, slot, &rec)) {
+                if (rec.seq != (uint16_t)(newest - me->count)) {
+                    break;
+                }
+            }
+            else if (isBlank(me, slot)) {
+                break;
+            }
+            ++me->count;
+            slot = (uint16_t)((slot + me->nSlots - 1U) % me->nSlots);
+        }
+    }
+
+    /* flash cannot rewrite a torn slot before its sector is erased, so its
+    * sequence number is spent and appending moves on to the next slot */
+    while ((dev->eraseSize != 0U) && ((slotAddr(me, me->head) % dev->eraseSize) != 0U)
+        && !isBlank(me, me->head)) {
+        me->head = (uint16_t)((me->head + 1U) % me->nSlots);
+        ++me->nextSeq;
+        if (me->count < me->nSlots) {
+            ++me->count;
+        }
+    }
+    me->unsentSeq = LogStore_oldest(me);
+    advanceUnsent(me);
+    indexRebuild(me);
+}
+
+uint16_t LogStore_append(LogStore * const me, uint8_t type, uint8_t tag,
+                         uint32_t time, void const *data, uint8_t len) {
+    LogRecord hdr;
+    uint32_t addr = slotAddr(me, me->head);
+    uint16_t keep = (uint16_t)(me->nSlots - 1U);
+    uint16_t seq = me->nextSeq;
+    bool erase;
+
+    if (len > LOG_PAYLOAD_MAX) {
+        len = LOG_PAYLOAD_MAX;
+    }
+    if (time < me->lastTime) {
+        time = me->lastTime;
+    }
+    erase = (me->dev->eraseSize != 0U) && ((addr % me->dev->eraseSize) == 0U);
+    if (erase) {
+        keep = (uint16_t)(me->nSlots - me->dev->eraseSize / LOG_SLOT_SIZE);
+    }
+    if (me->count > keep) {
+        dropOldest(me, keep);           /* the oldest records go first */
+    }
+    if (erase) {
+        me->dev->erase(addr);
+    }
+
+    hdr.seq = seq;
+    hdr.type = type;
+    hdr.tag = tag;
+    hdr.time = time;
+    hdr.len = len;
+    hdr.flags = 0xFFU;
+    hdr.crc = crc16_ccitt(crc16_ccitt(0xFFFFU, (uint8_t const *)&hdr,
+                                      (uint16_t)offsetof(LogRecord, flags)),
+                          (uint8_t const *)data, len);
+
+    /* payload first: a write torn by a reset leaves a header that fails */
+    me->dev->write(addr + LOG_HEADER_SIZE, data, len);
+    me->dev->write(addr, &hdr, LOG_HEADER_SIZE);
+
+    me->head = (uint16_t)((me->head + 1U) % me->nSlots);
+    ++me->count;
+    ++me->nextSeq;
+    me->lastTime = time;
+    indexAdd(me, seq, time);
+    return seq;
+}
+
+bool LogStore_read(LogStore const * const me, uint16_t seq, LogRecord *rec) {
+    uint16_t slot = slotOf(me, seq);
+
+    return (slot < me->nSlots) && readSlot(me, slot, rec) && (rec->seq == seq);
+}
+
+bool LogStore_oldestUnsent(LogStore const * const me, uint16_t *seq) {
+    *seq = me->unsentSeq;
+    return me->unsentSeq != me->nextSeq;
+}
+
+void LogStore_markSent(LogStore * const me, uint16_t seq) {
+    uint16_t slot = slotOf(me, seq);
+    uint8_t flags;
+
+    if (slot >= me->nSlots) {
+        return;
+    }
+    flags = (uint8_t)(readFlags(me, slot) & ~LOG_FLAG_UNSENT);
+    me->dev->write(slotAddr(me, slot) + offsetof(LogRecord, flags), &flags, 1U);
+    if (seq == me->unsentSeq) {
+        advanceUnsent(me);
+    }
+}
+
+uint16_t LogStore_seek(LogStore const * const me, uint32_t time) {
+    LogRecord rec;
+    uint16_t oldest = LogStore_oldest(me);
+    uint16_t lo = 0U;                   /* offsets from the oldest record */
+    uint16_t hi = me->count;
+    uint16_t mid;
+    uint16_t probe;
+    uint8_t i;
+
+    for (i = 0U; i < me->nIndex; ++i) {
+        uint16_t off = (uint16_t)(me->index[i].seq - oldest);
+        if (off >= me->count) {
+            continue;                   /* overwritten since it was sampled */
+        }
+        if (me->index[i].time < time) {
+            lo = (uint16_t)(off + 1U);
+        }
+        else {
+            hi = off;
+            break;
+        }
+    }
+    /* first readable record with rec.time >= time; a torn record is
+    * judged by the next readable one after it */
+    while (lo < hi) {
+        mid = (uint16_t)(lo + (hi - lo) / 2U);
+        probe = mid;
+        while ((probe < hi) && !LogStore_read(me, (uint16_t)(oldest + probe), &rec)) {
+            ++probe;
+        }
+        if ((probe < hi) && (rec.time < time)) {
+            lo = (uint16_t)(probe + 1U);
+        }
+        else {
+            hi = mid;
+        }
+    }
+    while ((lo < me->count) && !LogStore_read(me, (uint16_t)(oldest + lo), &rec)) {
+        ++lo;
+    }
+    return (uint16_t)(oldest + lo);
+}
+
+void LogStore_queryStart(LogStore const * const me, LogQuery *q,
+                         uint32_t from, uint32_t until, uint8_t type, uint8_t tag) {
+    q->seq = LogStore_seek(me, from);
+    q->until = until;
+    q->type = type;
+    q->tag = tag;
+    q->done = false;
+}
+
+bool LogStore_queryNext(LogStore const * const me, LogQuery *q, LogRecord *rec) {
+    uint8_t n;
+
+    for (n = 0U; (n < LOG_QUERY_SCAN) && !q->done; ++n) {
+        if (ageOf(me, q->seq) == 0U) {
+            q->done = true;
+        }
+        else if (ageOf(me, q->seq) > me->count) {
+            q->seq = LogStore_oldest(me);   /* overtaken by appends */
+        }
+        else if (LogStore_read(me, q->seq++, rec)) {
+            if (rec->time > q->until) {
+                q->done = true;
+            }
+            else if (((q->type == LOG_TYPE_ANY) || (rec->type == q->type))
+                     && ((q->tag == LOG_TAG_NONE) || (rec->tag == q->tag))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
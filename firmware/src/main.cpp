@@ -3,11 +3,20 @@
 #include "config.h"
 #include "qpn.h"    /* QP-nano framework API */
 #include "bsp.h"  /* Board Support Package interface */
+#include "amu.h"
+#include "evt_pool.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "messages.h"
+#include "radio.h"
+#include "communication.h"
+#include "beacon.h"
 
 // Q_DEFINE_THIS_FILE
 
 /* Local-scope objects -----------------------------------------------------*/
 static QEvt l_CubeSatQSto[10]; /* Event queue storage for CubeSat */
+static ivsweep_t l_sweepPoolSto[1]; /* Event pool storage for IV sweeps */
 
 /* QF_active[] array defines all active object control blocks --------------*/
 QActiveCB const Q_ROM QF_active[] = {
@@ -18,10 +27,15 @@ QActiveCB const Q_ROM QF_active[] = {
 void setup() {
     Serial.begin(BAUD_RATE);
     while (!Serial);  // Wait for serial connection
-    Serial.println("QF_INIT");
+    Serial.println(F("QF_INIT"));
 
     // Initialize the QF-nano framework
     QF_init(Q_DIM(QF_active));
+    EvtPool_init(&g_sweepPool, l_sweepPoolSto, sizeof(l_sweepPoolSto), sizeof(l_sweepPoolSto[0]));
+    DataCollection_init();
+    Radio_init();
+    Communication_init();
+    Beacon_init(&g_beacon);
     BSP_init();
     CubeSat_ctor();  // Initialize CubeSat AO
 }
@@ -0,0 +1,50 @@
+#include <Arduino.h>
+#include "memstat.h"
+
+/* Linker and avr-libc symbols */
+extern uint8_t _end;            /* end of .bss/.noinit, start of the heap */
+extern uint8_t __stack;         /* RAMEND */
+extern char *__brkval;          /* heap top, 0 until the first malloc() */
+
+/* Runs from .init3, after the stack pointer is set up and before the C
+* runtime initializes .data/.bss and calls main(). Naked and inlined-only,
+* so it pushes nothing onto the stack it is painting.
+*/
+extern "C" void MemStat_paint(void) __attribute__((naked, used, section(".init3")));
+extern "C" void MemStat_paint(void) {
+    uint8_t *p = &_end;
+
+    while (p <= &__stack) {
+        *p = MEMSTAT_PAINT;
+        ++p;
+    }
+}
+
+static uint8_t *heapTop(void) {
+    return (__brkval != (char *)0) ? (uint8_t *)__brkval : &_end;
+}
+
+void MemStat_get(MemStat * const out) {
+    uint8_t const *p = heapTop();
+    uint8_t probe;  /* lives at the current stack pointer */
+
+    out->freeNow = (uint16_t)(&probe - heapTop());
+
+    while ((p <= &__stack) && (*p == MEMSTAT_PAINT)) {
+        ++p;
+    }
+    out->neverUsed = (uint16_t)(p - heapTop());
+    out->stackPeak = (uint16_t)(&__stack - p + 1);
+}
+
+void MemStat_report(void) {
+    MemStat m;
+
+    MemStat_get(&m);
+    Serial.print(F("RAM free: "));
+    Serial.print(m.freeNow);
+    Serial.print(F(" never used: "));
+    Serial.print(m.neverUsed);
+    Serial.print(F(" stack peak: "));
+    Serial.println(m.stackPeak);
+}
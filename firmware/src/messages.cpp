@@ -1 +1,331 @@
-// Placeholder
\ No newline at end of file
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"
+#include "log_store.h"
+#include "serial_frame.h"
+#include "messages.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define FCS_TABLE        PROGMEM
+#define FCS_READ(t_, i_) pgm_read_word(&(t_)[i_])
+#define CMD_TABLE        PROGMEM
+#define CMD_READ(t_, i_) pgm_read_byte(&(t_)[i_])
+#define CMD_COPY(d_, s_, n_) memcpy_P((d_), (s_), (n_))
+#else
+#define FCS_TABLE
+#define FCS_READ(t_, i_) ((t_)[i_])
+#define CMD_TABLE
+#define CMD_READ(t_, i_) ((t_)[i_])
+#define CMD_COPY(d_, s_, n_) memcpy((d_), (s_), (n_))
+#endif
+
+Q_ASSERT_COMPILE((int)CMD_LEN_MAX <= (int)SF_RX_MAX);
+Q_ASSERT_COMPILE(MAX_SIG <= 0x100);
+
+/* CRC-16/X.25, reflected 0x8408, a nibble at a time as crc32.cpp */
+static const uint16_t l_fcsNibble[16] FCS_TABLE = {
+    0x0000U, 0x1081U, 0x2102U, 0x3183U, 0x4204U, 0x5285U, 0x6306U, 0x7387U,
+    0x8408U, 0x9489U, 0xA50AU, 0xB58BU, 0xC60CU, 0xD68DU, 0xE70EU, 0xF78FU
+};
+
+uint16_t Ax25_fcs(uint16_t fcs, void const *data, uint16_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+
+    while (len-- != 0U) {
+        fcs ^= *p++;
+        fcs = (uint16_t)((fcs >> 4) ^ FCS_READ(l_fcsNibble, fcs & 0x0FU));
+        fcs = (uint16_t)((fcs >> 4) ^ FCS_READ(l_fcsNibble, fcs & 0x0FU));
+    }
+    return fcs;
+}
+
+/* AX.25 -------------------------------------------------------------------*/
+static void putAddress(uint8_t *a, char const *call, uint8_t ssidByte) {
+    uint8_t i;
+
+    for (i = 0U; i < AX25_ADDR_LEN - 1U; ++i) {
+        a[i] = (uint8_t)(((*call != '\0') ? (uint8_t)*call++ : (uint8_t)' ') << 1);
+    }
+    a[AX25_ADDR_LEN - 1U] = ssidByte;
+}
+
+void Ax25_header(uint8_t *hdr, char const *dest, char const *src, uint8_t srcSsid) {
+    /* command frame: C bit set in the destination SSID, clear in the
+    * source; the source is the last address */
+    putAddress(&hdr[0], dest, 0xE0U);
+    putAddress(&hdr[AX25_ADDR_LEN], src, (uint8_t)(0x61U | ((srcSsid & 0x0FU) << 1)));
+    hdr[2U * AX25_ADDR_LEN] = AX25_CONTROL_UI;
+    hdr[2U * AX25_ADDR_LEN + 1U] = AX25_PID_NONE;
+}
+
+/* HDLC --------------------------------------------------------------------*/
+static void putBit(Hdlc * const me, uint8_t bit) {
+    me->acc |= (uint8_t)(bit << me->nBits);
+    if (++me->nBits == 8U) {
+        me->out(me->acc);
+        me->acc = 0U;
+        me->nBits = 0U;
+    }
+}
+
+static void putFlag(Hdlc * const me) {
+    uint8_t f = HDLC_FLAG;
+    uint8_t i;
+
+    for (i = 0U; i < 8U; ++i) {
+        putBit(me, (uint8_t)(f & 1U));
+        f >>= 1;
+    }
+    me->ones = 0U;
+}
+
+static void putStuffed(Hdlc * const me, uint8_t b) {
+    /* the 1s already in a row sit below the byte, in time order */
+    uint16_t v = (uint16_t)(((uint16_t)b << 5) | ((0x1FU << (5U - me->ones)) & 0x1FU));
+    uint8_t i;
+
+    if ((v & (v >> 1) & (v >> 2) & (v >> 3) & (v >> 4)) == 0U) {
+        /* no run of five: the byte goes out whole */
+        me->out((uint8_t)(me->acc | (uint8_t)(b << me->nBits)));
+        me->acc = (me->nBits != 0U) ? (uint8_t)(b >> (8U - me->nBits)) : 0U;
+        for (me->ones = 0U; (b & 0x80U) != 0U; b = (uint8_t)(b << 1)) {
+            ++me->ones;
+        }
+        return;
+    }
+    for (i = 0U; i < 8U; ++i) {
+        uint8_t bit = (uint8_t)(b & 1U);
+
+        b >>= 1;
+        putBit(me, bit);
+        if (bit == 0U) {
+            me->ones = 0U;
+        }
+        else if (++me->ones == 5U) {
+            putBit(me, 0U);
+            me->ones = 0U;
+        }
+    }
+}
+
+void Hdlc_begin(Hdlc * const me, void (*out)(uint8_t b), uint8_t flags) {
+    me->out = out;
+    me->fcs = AX25_FCS_INIT;
+    me->acc = 0U;
+    me->nBits = 0U;
+    do {
+        putFlag(me);                    /* at least one */
+    } while (flags-- > 1U);
+}
+
+void Hdlc_write(Hdlc * const me, void const *data, uint16_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+
+    me->fcs = Ax25_fcs(me->fcs, p, len);
+    while (len-- != 0U) {
+        putStuffed(me, *p++);
+    }
+}
+
+void Hdlc_writev(Hdlc * const me, MsgSegment const *seg, uint8_t n) {
+    while (n-- != 0U) {
+        Hdlc_write(me, seg->data, seg->len);
+        ++seg;
+    }
+}
+
+void Hdlc_end(Hdlc * const me) {
+    uint16_t fcs = Ax25_fcsFinal(me->fcs);
+
+    putStuffed(me, (uint8_t)fcs);
+    putStuffed(me, (uint8_t)(fcs >> 8));
+    putFlag(me);
+    while (me->nBits != 0U) {
+        putBit(me, 0U);
+    }
+}
+
+/* KISS --------------------------------------------------------------------*/
+void Kiss_begin(Kiss * const me, void (*out)(uint8_t b)) {
+    me->out = out;
+    out(KISS_FEND);
+    out(KISS_DATA);
+}
+
+void Kiss_write(Kiss * const me, void const *data, uint16_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+
+    while (len-- != 0U) {
+        uint8_t b = *p++;
+
+        if (b == KISS_FEND) {
+            me->out(KISS_FESC);
+            me->out(KISS_TFEND);
+        }
+        else if (b == KISS_FESC) {
+            me->out(KISS_FESC);
+            me->out(KISS_TFESC);
+        }
+        else {
+            me->out(b);
+        }
+    }
+}
+
+void Kiss_writev(Kiss * const me, MsgSegment const *seg, uint8_t n) {
+    while (n-- != 0U) {
+        Kiss_write(me, seg->data, seg->len);
+        ++seg;
+    }
+}
+
+void Kiss_end(Kiss * const me) {
+    me->out(KISS_FEND);
+}
+
+/* SipHash -----------------------------------------------------------------*/
+#define ROTL64(x_, b_) (((x_) << (b_)) | ((x_) >> (64 - (b_))))
+
+static uint64_t getU64(uint8_t const *p) {
+    uint64_t v = 0U;
+    uint8_t i;
+
+    for (i = 8U; i-- != 0U;) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void sipRounds(uint64_t *v, uint8_t n) {
+    while (n-- != 0U) {
+        v[0] += v[1]; v[1] = ROTL64(v[1], 13); v[1] ^= v[0]; v[0] = ROTL64(v[0], 32);
+        v[2] += v[3]; v[3] = ROTL64(v[3], 16); v[3] ^= v[2];
+        v[0] += v[3]; v[3] = ROTL64(v[3], 21); v[3] ^= v[0];
+        v[2] += v[1]; v[1] = ROTL64(v[1], 17); v[1] ^= v[2]; v[2] = ROTL64(v[2], 32);
+    }
+}
+
+static void sipBlock(uint64_t *v, uint64_t m) {
+    v[3] ^= m;
+    sipRounds(v, 2U);
+    v[0] ^= m;
+}
+
+void SipHash24(uint8_t *out, uint8_t const *key, void const *data, uint8_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+    uint8_t last[8];
+    uint64_t k0 = getU64(&key[0]);
+    uint64_t k1 = getU64(&key[8]);
+    uint64_t v[4];
+    uint64_t h;
+    uint8_t i;
+
+    v[0] = k0 ^ 0x736F6D6570736575ULL;
+    v[1] = k1 ^ 0x646F72616E646F6DULL;
+    v[2] = k0 ^ 0x6C7967656E657261ULL;
+    v[3] = k1 ^ 0x7465646279746573ULL;
+    for (i = len; i >= 8U; i = (uint8_t)(i - 8U), p += 8) {
+        sipBlock(v, getU64(p));
+    }
+    memset(last, 0, sizeof(last));
+    memcpy(last, p, i);
+    last[7] = len;
+    sipBlock(v, getU64(last));
+    v[2] ^= 0xFFU;
+    sipRounds(v, 4U);
+    h = v[0] ^ v[1] ^ v[2] ^ v[3];
+    for (i = 0U; i < 8U; ++i) {
+        out[i] = (uint8_t)h;
+        h >>= 8;
+    }
+}
+
+/* Commands ----------------------------------------------------------------*/
+enum {
+    CMD_ARGS,                           /* argument bytes */
+    CMD_ARG0_MAX,                       /* bound on the first of them */
+    CMD_SIG,
+    CMD_COLUMNS
+};
+
+/* Indexed by opcode */
+static const uint8_t l_commands[CMD_COUNT][CMD_COLUMNS] CMD_TABLE = {
+    /* CMD_PING      */ { 0U, 0U, 0U },
+    /* CMD_SWEEP     */ { 0U, 0U, (uint8_t)Q_PAYLOAD_SIG },
+    /* CMD_TELEMETRY */ { 0U, 0U, (uint8_t)Q_TELEMETRY_SIG },
+    /* CMD_PROFILE   */ { 0U, 0U, (uint8_t)Q_PROFILE_SIG },
+    /* CMD_QUERY     */ { 4U, (uint8_t)LOG_REC_SWEEP, (uint8_t)Q_QUERY_SIG }
+};
+
+static const uint8_t l_cmdKey[CMD_KEY_LEN] CMD_TABLE = { CMD_KEY };
+
+static CmdResult check(CommandAuth * const me, uint8_t const *frame, uint8_t len,
+                       Command *cmd) {
+    uint8_t key[CMD_KEY_LEN];
+    uint8_t tag[CMD_TAG_LEN];
+    uint8_t diff = 0U;
+    uint8_t args;
+    uint16_t counter;
+    uint8_t i;
+
+    if ((len < CMD_LEN_MIN) || (len > CMD_LEN_MAX)) {
+        return CMD_BAD_LENGTH;
+    }
+    len = (uint8_t)(len - CMD_TAG_LEN);
+    CMD_COPY(key, l_cmdKey, sizeof(key));
+    SipHash24(tag, key, frame, len);
+    memset(key, 0, sizeof(key));
+    for (i = 0U; i < CMD_TAG_LEN; ++i) {
+        diff |= (uint8_t)(tag[i] ^ frame[len + i]);
+    }
+    if (diff != 0U) {
+        return CMD_BAD_TAG;
+    }
+
+    cmd->opcode = frame[1];
+    if (cmd->opcode >= CMD_COUNT) {
+        return CMD_BAD_OPCODE;
+    }
+    args = (uint8_t)(len - CMD_HEADER_LEN);
+    if (args != CMD_READ(l_commands[cmd->opcode], CMD_ARGS)) {
+        return CMD_BAD_LENGTH;
+    }
+    if ((args != 0U)
+        && (frame[CMD_HEADER_LEN] > CMD_READ(l_commands[cmd->opcode], CMD_ARG0_MAX))) {
+        return CMD_BAD_ARG;
+    }
+    counter = (uint16_t)(frame[2] | (frame[3] << 8));
+    if ((int16_t)(counter - me->counter) <= 0) {
+        return CMD_REPLAYED;
+    }
+    cmd->counter = counter;
+    cmd->sig = CMD_READ(l_commands[cmd->opcode], CMD_SIG);
+    cmd->par = 0U;
+    for (i = args; i-- != 0U;) {
+        cmd->par = (cmd->par << 8) | frame[CMD_HEADER_LEN + i];
+    }
+    return CMD_OK;
+}
+
+CmdResult Command_parse(CommandAuth * const me, uint8_t const *frame, uint8_t len,
+                        Command *cmd) {
+    CmdResult r = check(me, frame, len, cmd);
+
+    if (r != CMD_OK) {
+        Command_reject(me, r);
+    }
+    return r;
+}
+
+void Command_accept(CommandAuth * const me, Command const *cmd) {
+    me->counter = cmd->counter;
+    ++me->accepted;
+}
+
+void Command_reject(CommandAuth * const me, CmdResult r) {
+    ++me->rejected;
+    me->lastError = (uint8_t)r;
+}
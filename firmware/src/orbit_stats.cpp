@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "log_store.h"
+#include "orbit_stats.h"
+
+/* The summary is one record */
+Q_ASSERT_COMPILE(sizeof(LogOrbit) <= LOG_PAYLOAD_MAX);
+
+OrbitStats g_orbitStats;
+
+void OrbitStats_start(OrbitStats * const me, uint32_t now) {
+    memset(me, 0, sizeof(*me));
+    me->orbit = now / ORBIT_PERIOD_S;
+}
+
+void OrbitStats_add(OrbitStats * const me, uint8_t ch, float x) {
+    Welford * const w = &me->ch[ch];
+    float d;
+
+    if (w->n == 0xFFFFU) {
+        return;                         /* far more than an orbit holds */
+    }
+    if (w->n == 0U) {
+        w->min = x;
+        w->max = x;
+    }
+    else if (x < w->min) {
+        w->min = x;
+    }
+    else if (x > w->max) {
+        w->max = x;
+    }
+    ++w->n;
+    d = x - w->mean;
+    w->mean += d / (float)w->n;
+    w->m2 += d * (x - w->mean);
+}
+
+void OrbitStats_tick(OrbitStats * const me, uint8_t state) {
+    if ((state < ORBIT_STATES) && (me->residency[state] != 0xFFFFU)) {
+        ++me->residency[state];
+    }
+}
+
+bool OrbitStats_due(OrbitStats const * const me, uint32_t now) {
+    return (now / ORBIT_PERIOD_S) != me->orbit;
+}
+
+static int16_t toI16(float x) {
+    if (x >= 32767.0f) {
+        return 32767;
+    }
+    if (x <= -32768.0f) {
+        return -32768;
+    }
+    return (int16_t)((x < 0.0f) ? (x - 0.5f) : (x + 0.5f));
+}
+
+void OrbitStats_summarize(OrbitStats const * const me, LogOrbit *out) {
+    uint8_t i;
+
+    out->orbit = (uint16_t)me->orbit;
+    for (i = 0U; i < ORBIT_CHANNELS; ++i) {
+        Welford const *w = &me->ch[i];
+        OrbitChannel *c = &out->ch[i];
+
+        c->n = w->n;
+        c->min = toI16(w->min);
+        c->max = toI16(w->max);
+        c->mean = toI16(w->mean);
+        c->sd = (w->n > 1U) ? toI16((float)sqrt(w->m2 / (float)(w->n - 1U))) : 0;
+    }
+    memcpy(out->residency, me->residency, sizeof(out->residency));
+}
@@ -1,63 +1,96 @@
 #include <Arduino.h>
-#include <Wire.h>
-
-#define IVSWEEP_POINTS 40      // Must match setting in AMU.
-#define AMU_TWI_ADDRESS 0x0F // Must match AMU
-
-#define TWI_BUFFER_LEN 32
+#include "qpn.h"
+#include "bsp.h"
+#include "queue_stats.h"
+#include "amu.h"
+#include "twi.h"
+#include "evt_pool.h"
+#include "crc32.h"
+#include "serial_frame.h"
+
+enum
+{
+  AMU_IDLE,
+  AMU_CONFIGURE, // Setting the sweep type, one AMU at a time.
+  AMU_TRIGGER,   // Triggering, one AMU at a time.
+  AMU_SWEEPING,  // All AMUs triggered, waiting for the sweep time.
+  AMU_HARVEST    // Reading results back one AMU at a time.
+};
+
+// Steps through one cell, each started on the last one's Q_TWI_DONE_SIG.
+enum
+{
+  AMU_STEP_READ,   // Harvest read.
+  AMU_STEP_TABLE,  // Coarse pass: user table write.
+  AMU_STEP_VALUE,  // Sweep type into the transfer register.
+  AMU_STEP_COMMAND // Command write.
+};
 
-#define AMU_REG_CMD 0x00
-#define AMU_REG_DATA_PTR_TIMESTAMP 0xF0
-#define AMU_REG_DATA_PTR_VOLTAGE 0xF1
-#define AMU_REG_DATA_PTR_CURRENT 0xF2
-#define AMU_REG_DATA_PTR_SWEEP_META 0xF6
-#define AMU_REG_TRANSFER_PTR 0xFE
+enum
+{
+  AMU_PASS_SINGLE, // One sweep with the AMUs' current configuration.
+  AMU_PASS_COARSE, // Adaptive, first pass: linear sweep, V and I only.
+  AMU_PASS_DENSE   // Adaptive, second pass: user sweep around the knee.
+};
 
-#define CMD_SWEEP_TRIG_SWEEP 0x0142
-#define CMD_SWEEP_TRIG_ISC 0x0143
-#define CMD_SWEEP_TRIG_VOC 0x0144
+// Sweep regions read back per AMU, in one TWI sequence.
+struct amu_region_t
+{
+  uint8_t reg;
+  uint16_t offset;
+  uint16_t size;
+};
 
-#define AMU_TWI_TRANSFER_READ 1
-#define AMU_TWI_TRANSFER_WRITE 0
+#define AMU_NUM_REGIONS (sizeof(amu_regions) / sizeof(amu_regions[0]))
 
-#define CMD_RW_BIT 7
-#define CMD_READ (1 << CMD_RW_BIT)
-#define CMD_WRITE (0 << CMD_RW_BIT)
+static const amu_region_t amu_regions[] = {
+    {AMU_REG_DATA_PTR_TIMESTAMP, offsetof(ivsweep_t, timestamp), sizeof(((ivsweep_t *)0)->timestamp)},
+    {AMU_REG_DATA_PTR_VOLTAGE, offsetof(ivsweep_t, voltage), sizeof(((ivsweep_t *)0)->voltage)},
+    {AMU_REG_DATA_PTR_CURRENT, offsetof(ivsweep_t, current), sizeof(((ivsweep_t *)0)->current)},
+    {AMU_REG_DATA_PTR_SWEEP_META, offsetof(ivsweep_t, meta), sizeof(((ivsweep_t *)0)->meta)},
+};
 
-#define AMU_TRANSFER_REG_SIZE (IVSWEEP_POINTS * 8) // sizeof(float) * 2
+Q_ASSERT_COMPILE(AMU_MAX_DEVICES <= 8); // amu_bus.live
 
 // Global variables.
 static volatile uint8_t amu_transfer_reg[AMU_TRANSFER_REG_SIZE];
 
-// Type definitions.
-typedef struct
-{
-  float voc;
-  float isc;
-  float tsensor_start;
-  float tsensor_end;
-  float ff;
-  float eff;
-  float vmax;
-  float imax;
-  float pmax;
-  float adc;
-  uint32_t timestamp;
-  uint32_t crc;
-} ivsweep_meta_t;
-
-typedef struct
-{
-  float measurement;
-  float temperature;
-} amu_meas_t;
+static struct
+{
+  uint8_t addr[AMU_MAX_DEVICES];
+  uint8_t count;
+  uint8_t phase;
+  uint8_t next;     // Next cell to configure, trigger or harvest.
+  uint8_t step;     // AMU_STEP_* of the write or read in flight.
+  uint8_t live;     // Cells in this sweep, one bit each; a failed write drops one.
+  uint8_t type;     // Sweep type being configured.
+  uint8_t value;    // Source of the transfer register write.
+  uint8_t cmd[2];   // Source of the command write.
+  EvtHandle handle; // Block being filled, EVT_HANDLE_NONE if waiting for one.
+  TwiSeg segs[4];   // Scatter list into 'handle', one per amu_regions entry.
+  uint8_t nSegs;
+  uint8_t pass;
+  bool user;        // Some AMU may be left on the user sweep type.
+  uint8_t attempt;  // Re-reads spent on the current cell.
+  uint16_t errors;  // Bus failures.
+  uint16_t crcFails;
+  uint16_t retries;
+  uint16_t dropped; // Sweeps given up on after AMU_READ_RETRIES.
+  QActive *owner;
+} amu_bus;
 
 // Function prototypes.
-int amu_wire_transfer(uint8_t address, uint8_t reg, uint8_t *data, size_t len, uint8_t read);
-void measure_voc();
-void measure_isc();
-void measure_iv_curve();
-int8_t amu_dev_send_command(uint8_t address, uint16_t command);
+// Configuration values go through the transfer register, then the command
+// applies them, the write-side mirror of query<T>().
+int8_t amu_dev_configure(uint8_t address, uint16_t command, uint8_t value)
+{
+  int8_t status = amu_wire_transfer(address, (uint8_t)AMU_REG_TRANSFER_PTR, &value, 1, AMU_TWI_TRANSFER_WRITE);
+  if (status != TWI_OK)
+  {
+    return status;
+  }
+  return amu_dev_send_command(address, (uint16_t)(command | CMD_WRITE));
+}
 
 template <typename T>
 void read_twi_reg(uint8_t address, uint8_t reg, T *data, size_t len);
@@ -76,7 +109,7 @@ T query(uint16_t command);
 //   pinMode(18, INPUT_PULLUP);
 //   pinMode(19, INPUT_PULLUP);
 
-//   Serial.println("Hi, welcome to AMU example.");
+//   Serial.println(F("Hi, welcome to AMU example."));
 // }
 
 // void loop()
@@ -86,63 +119,469 @@ T query(uint16_t command);
 //     char received = Serial.read();
 //     if (received == 'i')
 //     {
-//       Serial.println("Measuring Isc...");
+//       Serial.println(F("Measuring Isc..."));
 //       measure_isc();
 //     }
 //     else if (received == 'v')
 //     {
-//       Serial.println("Measuring Voc...");
+//       Serial.println(F("Measuring Voc..."));
 //       measure_voc();
 //     }
 //     else if (received == 's')
 //     {
-//       Serial.println("Measuring IV Curve...");
+//       Serial.println(F("Measuring IV Curve..."));
 //       measure_iv_curve();
 //     }
 //   }
 // }
 
 // Function definitions.
-int amu_wire_transfer(uint8_t address, uint8_t reg, uint8_t *data, size_t len, uint8_t read)
+void amu_init()
 {
-  uint8_t packetNum = 0;
-  if (read)
+  TWI_init(TWI_FREQ_HZ);
+  amu_bus.phase = AMU_IDLE;
+  amu_bus.handle = EVT_HANDLE_NONE;
+  amu_discover();
+}
+
+uint8_t amu_discover()
+{
+  amu_bus.count = 0;
+  for (uint8_t addr = AMU_TWI_ADDR_FIRST; addr <= AMU_TWI_ADDR_LAST && amu_bus.count < AMU_MAX_DEVICES; addr++)
   {
-    if (len > 0)
+    if (TWI_probe(addr) == TWI_OK)
     {
-      Wire.beginTransmission(address);
-      Wire.write(reg);
-      Wire.endTransmission();
-      while (len > TWI_BUFFER_LEN)
+      amu_bus.addr[amu_bus.count++] = addr;
+    }
+  }
+  return amu_bus.count;
+}
+
+static bool amu_start_value(uint8_t address, uint8_t value)
+{
+  amu_bus.value = value;
+  return TWI_startWrite(address, (uint8_t)AMU_REG_TRANSFER_PTR, &amu_bus.value, 1, amu_bus.owner, Q_TWI_DONE_SIG);
+}
+
+static bool amu_start_command(uint8_t address, uint16_t command)
+{
+  amu_bus.cmd[0] = (uint8_t)command;
+  amu_bus.cmd[1] = (uint8_t)(command >> 8);
+  return TWI_startWrite(address, (uint8_t)AMU_REG_CMD, amu_bus.cmd, sizeof(amu_bus.cmd), amu_bus.owner, Q_TWI_DONE_SIG);
+}
+
+// Start the write for amu_bus.step on the current cell of a configure or
+// trigger phase. Busy-waiting on the bus here would stall the owner for up
+// to the TWI timeout per AMU, so every write ends in Q_TWI_DONE_SIG.
+static bool amu_start_step()
+{
+  uint8_t addr = amu_bus.addr[amu_bus.next];
+
+  if (amu_bus.phase == AMU_TRIGGER)
+  {
+    return amu_start_command(addr, (uint16_t)CMD_SWEEP_TRIG_SWEEP);
+  }
+  if (amu_bus.step == AMU_STEP_VALUE)
+  {
+    return amu_start_value(addr, amu_bus.type);
+  }
+  return amu_start_command(addr, (uint16_t)(CMD_SWEEP_CONF_TYPE | CMD_WRITE));
+}
+
+static void amu_trigger_start();
+
+static uint8_t amu_all_cells()
+{
+  return (uint8_t)((1U << amu_bus.count) - 1U);
+}
+
+// Walk the live cells of the configure or trigger phase. A cell whose write
+// fails is dropped from this sweep, so its previous sweep is never harvested
+// as if it were new.
+static void amu_step_next()
+{
+  while (amu_bus.next < amu_bus.count)
+  {
+    if (amu_bus.live & (1U << amu_bus.next))
+    {
+      if (amu_start_step())
       {
-        Wire.requestFrom(address, (uint8_t)TWI_BUFFER_LEN, false);
-        Wire.readBytes(&data[packetNum * TWI_BUFFER_LEN], TWI_BUFFER_LEN);
-        packetNum++;
-        len -= TWI_BUFFER_LEN;
+        return; // Continued by amu_on_twi_done().
       }
-      Wire.requestFrom(address, (uint8_t)len);
-      Wire.readBytes(&data[packetNum * TWI_BUFFER_LEN], len);
+      amu_bus.errors++;
+      amu_bus.live &= (uint8_t)~(1U << amu_bus.next);
     }
-    else
+    amu_bus.step = AMU_STEP_VALUE;
+    amu_bus.next++;
+  }
+
+  if (amu_bus.phase == AMU_CONFIGURE)
+  {
+    // A cell that failed may still be on the user type.
+    amu_bus.user = (amu_bus.type != AMU_SWEEP_TYPE_LINEAR) || (amu_bus.live != amu_all_cells());
+    amu_trigger_start();
+    return;
+  }
+  amu_bus.next = 0;
+  if (amu_bus.live == 0)
+  {
+    amu_bus.phase = AMU_IDLE;
+    return;
+  }
+  // Wait one sweep time after the last trigger on the owner's time event.
+  amu_bus.phase = AMU_SWEEPING;
+  QActive_armX(amu_bus.owner, 0U, AMU_SWEEP_TICKS, 0U);
+}
+
+static void amu_on_write_done(uint32_t par)
+{
+  if (TWI_EVT_STATUS(par) != TWI_OK)
+  {
+    amu_bus.errors++;
+    amu_bus.live &= (uint8_t)~(1U << amu_bus.next);
+  }
+  else if (amu_bus.phase == AMU_CONFIGURE && amu_bus.step == AMU_STEP_VALUE)
+  {
+    amu_bus.step = AMU_STEP_COMMAND;
+    amu_step_next();
+    return;
+  }
+  amu_bus.step = AMU_STEP_VALUE;
+  amu_bus.next++;
+  amu_step_next();
+}
+
+// Trigger every live AMU so all sweeps run in parallel.
+static void amu_trigger_start()
+{
+  amu_bus.phase = AMU_TRIGGER;
+  amu_bus.next = 0;
+  amu_step_next();
+}
+
+static void amu_configure_start(uint8_t sweep_type)
+{
+  amu_bus.phase = AMU_CONFIGURE;
+  amu_bus.type = sweep_type;
+  amu_bus.next = 0;
+  amu_bus.step = AMU_STEP_VALUE;
+  amu_step_next();
+}
+
+static void amu_sweep_begin(QActive *owner, uint8_t pass)
+{
+  amu_bus.owner = owner;
+  amu_bus.pass = pass;
+  amu_bus.live = amu_all_cells();
+  amu_bus.step = AMU_STEP_VALUE;
+}
+
+bool amu_sweep_all(QActive *owner)
+{
+  if (amu_bus.phase != AMU_IDLE || amu_bus.count == 0)
+  {
+    return false;
+  }
+  amu_sweep_begin(owner, AMU_PASS_SINGLE);
+  if (amu_bus.user)
+  {
+    amu_configure_start(AMU_SWEEP_TYPE_LINEAR);
+  }
+  else
+  {
+    amu_trigger_start();
+  }
+  return true;
+}
+
+#ifdef AMU_ADAPTIVE_SWEEP
+// Two passes: a linear sweep locates the knee of every cell, then each AMU
+// gets a user sweep table that spends AMU_KNEE_POINTS of its points there.
+// Only the second pass is delivered, so it costs no extra downlink.
+bool amu_sweep_adaptive(QActive *owner)
+{
+  if (amu_bus.phase != AMU_IDLE || amu_bus.count == 0)
+  {
+    return false;
+  }
+  amu_sweep_begin(owner, AMU_PASS_COARSE);
+  amu_configure_start(AMU_SWEEP_TYPE_LINEAR);
+  return true;
+}
+#endif
+
+// Replace the coarse voltages with the dense pass table, in place: the
+// samples either side of the power maximum bound the knee window, the
+// remaining points cover 0 V to the knee and the knee to just past Voc.
+static void amu_knee_table(ivsweep_t *sweep)
+{
+  const uint8_t n_low = (IVSWEEP_POINTS - AMU_KNEE_POINTS) / 2;
+  const uint8_t n_high = IVSWEEP_POINTS - AMU_KNEE_POINTS - n_low;
+  float sign = (sweep->current[0] < 0.0f) ? -1.0f : 1.0f;
+  float *v = sweep->voltage;
+  float voc = v[IVSWEEP_POINTS - 1];
+  float pmax = 0.0f;
+  uint8_t kmax = 0;
+
+  for (uint8_t k = 0; k < IVSWEEP_POINTS; k++)
+  {
+    float p = v[k] * sweep->current[k] * sign;
+    if (p > pmax)
+    {
+      pmax = p;
+      kmax = k;
+    }
+  }
+  for (uint8_t k = 1; k < IVSWEEP_POINTS; k++)
+  {
+    float i1 = sweep->current[k] * sign;
+    if (i1 <= 0.0f)
     {
-      Wire.beginTransmission(address);
-      return Wire.endTransmission();
+      float i0 = sweep->current[k - 1] * sign;
+      voc = v[k - 1] + (v[k] - v[k - 1]) * i0 / (i0 - i1);
+      break;
+    }
+  }
+
+  float lo = v[kmax > 0 ? kmax - 1 : 0];
+  float hi = v[kmax + 1 < IVSWEEP_POINTS ? kmax + 1 : IVSWEEP_POINTS - 1];
+  float end = voc * 1.02f;
+  if (hi > end)
+  {
+    hi = end;
+  }
+  for (uint8_t k = 0; k < n_low; k++)
+  {
+    v[k] = lo * k / n_low;
+  }
+  for (uint8_t k = 0; k < AMU_KNEE_POINTS; k++)
+  {
+    v[n_low + k] = lo + (hi - lo) * k / (AMU_KNEE_POINTS - 1);
+  }
+  for (uint8_t k = 0; k < n_high; k++)
+  {
+    v[n_low + AMU_KNEE_POINTS + k] = hi + (end - hi) * (k + 1) / n_high;
+  }
+}
+
+static bool amu_harvest_start()
+{
+  amu_bus.step = AMU_STEP_READ;
+  return TWI_startReadSeq(amu_bus.addr[amu_bus.next], amu_bus.segs, amu_bus.nSegs, amu_bus.owner, Q_TWI_DONE_SIG);
+}
+
+// Read all four regions of the next cell straight into a pool block as one
+// TWI sequence: one bus transaction, one completion event, no copies.
+static void amu_harvest_next()
+{
+  while (amu_bus.next < amu_bus.count)
+  {
+    if (!(amu_bus.live & (1U << amu_bus.next)))
+    {
+      amu_bus.next++; // Not triggered, its registers hold the last sweep.
+      continue;
+    }
+    amu_bus.handle = EvtPool_alloc(&g_sweepPool);
+    if (amu_bus.handle == EVT_HANDLE_NONE)
+    {
+      return; // Resumed by amu_on_sweep_released().
+    }
+
+    ivsweep_t *sweep = (ivsweep_t *)EvtPool_data(&g_sweepPool, amu_bus.handle);
+    sweep->cell = amu_bus.next;
+    sweep->address = amu_bus.addr[amu_bus.next];
+    // The coarse pass only needs voltage[] and current[].
+    uint8_t first = (amu_bus.pass == AMU_PASS_COARSE) ? 1 : 0;
+    amu_bus.nSegs = (amu_bus.pass == AMU_PASS_COARSE) ? 2 : AMU_NUM_REGIONS;
+    for (uint8_t i = 0; i < amu_bus.nSegs; i++)
+    {
+      amu_bus.segs[i].reg = amu_regions[first + i].reg;
+      amu_bus.segs[i].buf = (uint8_t *)sweep + amu_regions[first + i].offset;
+      amu_bus.segs[i].len = amu_regions[first + i].size;
+    }
+    amu_bus.attempt = 0;
+    if (amu_harvest_start())
+    {
+      return; // Continued by amu_on_twi_done().
+    }
+    // Bus busy or wedged, drop this cell.
+    amu_bus.errors++;
+    EvtPool_unref(&g_sweepPool, amu_bus.handle);
+    amu_bus.handle = EVT_HANDLE_NONE;
+    amu_bus.next++;
+  }
+  if (amu_bus.pass == AMU_PASS_COARSE)
+  {
+    amu_bus.pass = AMU_PASS_DENSE;
+    amu_trigger_start();
+    return;
+  }
+  amu_bus.phase = AMU_IDLE;
+}
+
+// Only the sweep wait runs on the time event. Every other phase moves on
+// Q_TWI_DONE_SIG, which TWI_tickISR() posts with TWI_TIMEOUT when the
+// transfer never completes, so no phase can be left waiting.
+void amu_on_timeout()
+{
+  if (amu_bus.phase == AMU_SWEEPING)
+  {
+    amu_bus.phase = AMU_HARVEST;
+    amu_harvest_next();
+  }
+}
+
+static bool amu_start_coarse_step(ivsweep_t *sweep, uint8_t addr)
+{
+  switch (amu_bus.step)
+  {
+  case AMU_STEP_TABLE:
+    amu_knee_table(sweep);
+    // The table must stay in the block until the write is done.
+    return TWI_startWrite(addr, AMU_REG_DATA_PTR_USER_SWEEP, (const uint8_t *)sweep->voltage, sizeof(sweep->voltage), amu_bus.owner, Q_TWI_DONE_SIG);
+  case AMU_STEP_VALUE:
+    return amu_start_value(addr, AMU_SWEEP_TYPE_USER1);
+  default:
+    amu_bus.user = true; // From here the AMU may be on the user type.
+    return amu_start_command(addr, (uint16_t)(CMD_SWEEP_CONF_TYPE | CMD_WRITE));
+  }
+}
+
+// Coarse pass, per cell: read V and I, write the cell its user table, then
+// switch it to the user sweep type, each step on the last one's completion.
+// A cell whose coarse pass fails keeps the linear sweep for the dense pass.
+static void amu_on_coarse_done(ivsweep_t *sweep, uint32_t par)
+{
+  bool ok = (TWI_EVT_STATUS(par) == TWI_OK);
+
+  if (ok && amu_bus.step != AMU_STEP_COMMAND)
+  {
+    amu_bus.step++;
+    if (amu_start_coarse_step(sweep, amu_bus.addr[amu_bus.next]))
+    {
+      return;
+    }
+    ok = false;
+  }
+  if (!ok)
+  {
+    amu_bus.errors++;
+  }
+  EvtPool_unref(&g_sweepPool, amu_bus.handle);
+  amu_bus.handle = EVT_HANDLE_NONE;
+  amu_bus.next++;
+  amu_harvest_next();
+}
+
+void amu_on_twi_done(uint32_t par)
+{
+  if (amu_bus.phase == AMU_CONFIGURE || amu_bus.phase == AMU_TRIGGER)
+  {
+    amu_on_write_done(par);
+    return;
+  }
+  if (amu_bus.phase != AMU_HARVEST || amu_bus.handle == EVT_HANDLE_NONE)
+  {
+    return;
+  }
+  ivsweep_t *sweep = (ivsweep_t *)EvtPool_data(&g_sweepPool, amu_bus.handle);
+  if (amu_bus.pass == AMU_PASS_COARSE)
+  {
+    amu_on_coarse_done(sweep, par);
+    return;
+  }
+  TwiStatus status = TWI_EVT_STATUS(par);
+  bool ok = (status == TWI_OK);
+  if (!ok)
+  {
+    amu_bus.errors++;
+  }
+  else if (!amu_sweep_crc_ok(sweep))
+  {
+    amu_bus.crcFails++;
+    ok = false;
+  }
+
+  // The AMU keeps the sweep until the next trigger, so read it again
+  // rather than let a corrupted copy reach telemetry. A cell that timed
+  // out is wedged or holding the bus; another try would only cost the
+  // others another TWI_ASYNC_TIMEOUT_TICKS.
+  if (!ok && status != TWI_TIMEOUT && amu_bus.attempt < AMU_READ_RETRIES)
+  {
+    amu_bus.attempt++;
+    amu_bus.retries++;
+    if (amu_harvest_start())
+    {
+      return;
+    }
+    amu_bus.errors++;
+  }
+
+  if (ok)
+  {
+    sweep->bus_us = TWI_lastTransferUs();
+    if (!QueueStats_post(amu_bus.owner, Q_SWEEP_SIG, amu_bus.handle))
+    {
+      amu_bus.dropped++; // Good, but the owner had no room for it.
+      EvtPool_unref(&g_sweepPool, amu_bus.handle);
     }
   }
   else
   {
-    Wire.beginTransmission(address);
-    Wire.write(reg);
-    Wire.write(data, len);
-    Wire.endTransmission();
+    amu_bus.dropped++;
+    EvtPool_unref(&g_sweepPool, amu_bus.handle);
+  }
+  amu_bus.handle = EVT_HANDLE_NONE;
+  amu_bus.next++;
+  amu_harvest_next();
+}
+
+void amu_on_sweep_released()
+{
+  if (amu_bus.phase == AMU_HARVEST && amu_bus.handle == EVT_HANDLE_NONE)
+  {
+    amu_harvest_next();
   }
+}
+
+bool amu_sweep_crc_ok(const ivsweep_t *sweep)
+{
+  uint32_t crc = CRC32_INIT;
+  crc = crc32_update(crc, (const uint8_t *)sweep->timestamp, sizeof(sweep->timestamp));
+  crc = crc32_update(crc, (const uint8_t *)sweep->voltage, sizeof(sweep->voltage));
+  crc = crc32_update(crc, (const uint8_t *)sweep->current, sizeof(sweep->current));
+  return crc32_final(crc) == sweep->meta.crc;
+}
+
+void amu_report()
+{
+  Serial.print(F("AMU "));
+  Serial.print(amu_bus.count);
+  Serial.print(F(" found, bus errors "));
+  Serial.print(amu_bus.errors);
+  Serial.print(F(", CRC fails "));
+  Serial.print(amu_bus.crcFails);
+  Serial.print(F(", retries "));
+  Serial.print(amu_bus.retries);
+  Serial.print(F(", dropped "));
+  Serial.println(amu_bus.dropped);
+}
 
-  return 0;
+int amu_wire_transfer(uint8_t address, uint8_t reg, uint8_t *data, size_t len, uint8_t read)
+{
+  // One bus transaction of any length; no 32-byte chunking.
+  if (read && len > 0)
+  {
+    return TWI_read(address, reg, data, (uint16_t)len);
+  }
+  return TWI_write(address, reg, data, read ? 0U : (uint16_t)len);
 }
 
 int8_t amu_dev_send_command(uint8_t address, uint16_t command)
 {
-  return amu_wire_transfer(address, (uint8_t)AMU_REG_CMD, (uint8_t *)&command, 1, AMU_TWI_TRANSFER_WRITE);
+  uint8_t bytes[2] = {(uint8_t)command, (uint8_t)(command >> 8)};
+
+  return amu_wire_transfer(address, (uint8_t)AMU_REG_CMD, bytes, sizeof(bytes), AMU_TWI_TRANSFER_WRITE);
 }
 
 template <typename T>
@@ -154,6 +593,7 @@ void read_twi_reg(uint8_t address, uint8_t reg, T *data, size_t len)
 template <typename T>
 T query(uint16_t command)
 {
+  static_assert(sizeof(T) <= AMU_TRANSFER_REG_SIZE, "query<T>() result does not fit amu_transfer_reg");
   T *data = (T *)amu_transfer_reg;
   amu_dev_send_command(AMU_TWI_ADDRESS, (command | CMD_READ));
   delay(100);
@@ -161,32 +601,24 @@ T query(uint16_t command)
   return *data;
 }
 
-int16_t compress_temperature(float temperature)
-{
-  return (int16_t)(temperature * 100);
-}
-
-int16_t compress_current(float current)
-{
-  return (int16_t)(current * 1e4);
-}
-
-int16_t compress_voltage(float voltage)
-{
-  return (int16_t)(voltage * 1e3);
-}
-
 void measure_voc()
 {
   // Trigger Voc.
   amu_meas_t measurement = query<amu_meas_t>((uint16_t)CMD_SWEEP_TRIG_VOC);
 
-  // Print the Voc data.
-  Serial.print("\n\n");
-  Serial.print("Voc: ");
+#ifdef SERIAL_TEXT_OUTPUT
+  Serial.print(F("\n\n"));
+  Serial.print(F("Voc: "));
   Serial.println(measurement.measurement, 6);
-  Serial.print("Temperature: ");
+  Serial.print(F("Temperature: "));
   Serial.println(measurement.temperature, 6);
+#else
+  uint8_t kind = SF_MEAS_VOC;
+  SerialFrame_begin(SF_MEAS);
+  SerialFrame_write(&kind, sizeof(kind));
+  SerialFrame_write(&measurement, sizeof(measurement));
+  SerialFrame_end();
+#endif
 }
 
 void measure_isc()
@@ -194,66 +626,123 @@ void measure_isc()
   // Trigger Isc.
   amu_meas_t measurement = query<amu_meas_t>((uint16_t)CMD_SWEEP_TRIG_ISC);
 
-  // Print the Voc data.
-  Serial.print("\n\n");
-  Serial.print("Isc: ");
+#ifdef SERIAL_TEXT_OUTPUT
+  Serial.print(F("\n\n"));
+  Serial.print(F("Isc: "));
   Serial.println(measurement.measurement, 6);
-  Serial.print("Temperature: ");
+  Serial.print(F("Temperature: "));
   Serial.println(measurement.temperature, 6);
+#else
+  uint8_t kind = SF_MEAS_ISC;
+  SerialFrame_begin(SF_MEAS);
+  SerialFrame_write(&kind, sizeof(kind));
+  SerialFrame_write(&measurement, sizeof(measurement));
+  SerialFrame_end();
+#endif
 }
 
-void measure_iv_curve()
+uint16_t measure_iv_curve()
 {
+  EvtHandle handle = EvtPool_alloc(&g_sweepPool);
+  ivsweep_t *sweep = (ivsweep_t *)EvtPool_data(&g_sweepPool, handle);
+  if (sweep == NULL)
+  {
+    return EVT_HANDLE_NONE; // Previous sweep still in use.
+  }
+
+  sweep->cell = 0;
+  sweep->address = AMU_TWI_ADDRESS;
   amu_dev_send_command(AMU_TWI_ADDRESS, (uint16_t)CMD_SWEEP_TRIG_SWEEP);
   delay(1500); // Wait for sweep to finish.
 
-  // Read the sweep data.
-  uint32_t timestamp[IVSWEEP_POINTS];
-  float voltage[IVSWEEP_POINTS];
-  float current[IVSWEEP_POINTS];
-  read_twi_reg<uint32_t>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_TIMESTAMP, timestamp, sizeof(uint32_t) * IVSWEEP_POINTS);
-  read_twi_reg<float>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_VOLTAGE, voltage, sizeof(float) * IVSWEEP_POINTS);
-  read_twi_reg<float>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_CURRENT, current, sizeof(float) * IVSWEEP_POINTS);
+  // Read the sweep data straight into the pool block, one transfer per
+  // region. Kept as the bus-time baseline for the harvest sequence.
+  for (uint8_t attempt = 0; attempt <= AMU_READ_RETRIES; attempt++)
+  {
+    read_twi_reg<uint32_t>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_TIMESTAMP, sweep->timestamp, sizeof(sweep->timestamp));
+    sweep->bus_us = TWI_lastTransferUs();
+    read_twi_reg<float>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_VOLTAGE, sweep->voltage, sizeof(sweep->voltage));
+    sweep->bus_us += TWI_lastTransferUs();
+    read_twi_reg<float>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_CURRENT, sweep->current, sizeof(sweep->current));
+    sweep->bus_us += TWI_lastTransferUs();
+    read_twi_reg<ivsweep_meta_t>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_SWEEP_META, &sweep->meta, sizeof(sweep->meta));
+    sweep->bus_us += TWI_lastTransferUs();
+    if (amu_sweep_crc_ok(sweep))
+    {
+      return handle;
+    }
+    amu_bus.crcFails++;
+    if (attempt < AMU_READ_RETRIES)
+    {
+      amu_bus.retries++;
+    }
+  }
 
-  ivsweep_meta_t sweep_meta;
-  read_twi_reg<ivsweep_meta_t>(AMU_TWI_ADDRESS, AMU_REG_DATA_PTR_SWEEP_META, &sweep_meta, sizeof(ivsweep_meta_t));
+  amu_bus.dropped++;
+  EvtPool_unref(&g_sweepPool, handle);
+  return EVT_HANDLE_NONE;
+}
 
-  Serial.println("Metadata:");
-  Serial.print("Voc: ");
+void print_iv_curve(const ivsweep_t *sweep)
+{
+#ifndef SERIAL_TEXT_OUTPUT
+  // Two frames, so the ground can tell a short sweep from a lost meta read.
+  SerialFrame_begin(SF_SWEEP);
+  SerialFrame_write(&sweep->cell, sizeof(sweep->cell));
+  SerialFrame_write(&sweep->address, sizeof(sweep->address));
+  SerialFrame_write(sweep->timestamp, sizeof(sweep->timestamp));
+  SerialFrame_write(sweep->voltage, sizeof(sweep->voltage));
+  SerialFrame_write(sweep->current, sizeof(sweep->current));
+  SerialFrame_end();
+
+  SerialFrame_begin(SF_META);
+  SerialFrame_write(&sweep->cell, sizeof(sweep->cell));
+  SerialFrame_write(&sweep->address, sizeof(sweep->address));
+  SerialFrame_write(&sweep->bus_us, sizeof(sweep->bus_us));
+  SerialFrame_write(&sweep->meta, sizeof(sweep->meta));
+  SerialFrame_end();
+#else
+  const ivsweep_meta_t &sweep_meta = sweep->meta;
+
+  Serial.println(F("Metadata:"));
+  Serial.print(F("Voc: "));
   Serial.println(sweep_meta.voc);
-  Serial.print("Isc: ");
+  Serial.print(F("Isc: "));
   Serial.println(sweep_meta.isc);
-  Serial.print("Tsensor Start: ");
+  Serial.print(F("Tsensor Start: "));
   Serial.println(sweep_meta.tsensor_start);
-  Serial.print("Tsensor End: ");
+  Serial.print(F("Tsensor End: "));
   Serial.println(sweep_meta.tsensor_end);
-  Serial.print("FF: ");
+  Serial.print(F("FF: "));
   Serial.println(sweep_meta.ff);
-  Serial.print("Eff: ");
+  Serial.print(F("Eff: "));
   Serial.println(sweep_meta.eff);
-  Serial.print("Vmax: ");
+  Serial.print(F("Vmax: "));
   Serial.println(sweep_meta.vmax);
-  Serial.print("Imax: ");
+  Serial.print(F("Imax: "));
   Serial.println(sweep_meta.imax);
-  Serial.print("Pmax: ");
+  Serial.print(F("Pmax: "));
   Serial.println(sweep_meta.pmax);
-  Serial.print("ADC: ");
+  Serial.print(F("ADC: "));
   Serial.println(sweep_meta.adc);
-  Serial.print("Timestamp: ");
+  Serial.print(F("Timestamp: "));
   Serial.println(sweep_meta.timestamp);
-  Serial.print("CRC: ");
+  Serial.print(F("CRC: "));
   Serial.println(sweep_meta.crc);
+  Serial.print(F("Bus time [us]: "));
+  Serial.println(sweep->bus_us);
   Serial.println();
   Serial.flush();
-  Serial.println("IV Curve: ");
+  Serial.println(F("IV Curve: "));
   for (int i = 0; i < IVSWEEP_POINTS; i++)
   {
-    Serial.print(timestamp[i], 6);
-    Serial.print("\t");
-    Serial.print(voltage[i], 12);
-    Serial.print("\t");
-    Serial.print(current[i], 12);
-    Serial.print("\n");
+    Serial.print(sweep->timestamp[i], 6);
+    Serial.print('\t');
+    Serial.print(sweep->voltage[i], 12);
+    Serial.print('\t');
+    Serial.print(sweep->current[i], 12);
+    Serial.print('\n');
   }
   Serial.println();
+#endif
 }
\ No newline at end of file
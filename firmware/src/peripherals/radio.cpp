@@ -1 +1,411 @@
-// Placeholder
\ No newline at end of file
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "radio.h"
+
+#define RS_A0 0xFFU                     /* log of zero */
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define RS_TABLE        PROGMEM
+#define RS_READ(t_, i_) pgm_read_byte(&(t_)[i_])
+#else
+#define RS_TABLE
+#define RS_READ(t_, i_) ((t_)[i_])
+#endif
+
+/* Reed-Solomon tables ------------------------------------------------------*/
+/* Antilog over two periods, so a sum of two logs needs no reduction */
+static const uint8_t l_rsAlpha[510] RS_TABLE = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x87, 0x89, 0x95, 0xAD, 0xDD, 0x3D, 0x7A, 0xF4,
+    0x6F, 0xDE, 0x3B, 0x76, 0xEC, 0x5F, 0xBE, 0xFB, 0x71, 0xE2, 0x43, 0x86, 0x8B, 0x91, 0xA5, 0xCD,
+    0x1D, 0x3A, 0x74, 0xE8, 0x57, 0xAE, 0xDB, 0x31, 0x62, 0xC4, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0x67,
+    0xCE, 0x1B, 0x36, 0x6C, 0xD8, 0x37, 0x6E, 0xDC, 0x3F, 0x7E, 0xFC, 0x7F, 0xFE, 0x7B, 0xF6, 0x6B,
+    0xD6, 0x2B, 0x56, 0xAC, 0xDF, 0x39, 0x72, 0xE4, 0x4F, 0x9E, 0xBB, 0xF1, 0x65, 0xCA, 0x13, 0x26,
+    0x4C, 0x98, 0xB7, 0xE9, 0x55, 0xAA, 0xD3, 0x21, 0x42, 0x84, 0x8F, 0x99, 0xB5, 0xED, 0x5D, 0xBA,
+    0xF3, 0x61, 0xC2, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0,
+    0x47, 0x8E, 0x9B, 0xB1, 0xE5, 0x4D, 0x9A, 0xB3, 0xE1, 0x45, 0x8A, 0x93, 0xA1, 0xC5, 0x0D, 0x1A,
+    0x34, 0x68, 0xD0, 0x27, 0x4E, 0x9C, 0xBF, 0xF9, 0x75, 0xEA, 0x53, 0xA6, 0xCB, 0x11, 0x22, 0x44,
+    0x88, 0x97, 0xA9, 0xD5, 0x2D, 0x5A, 0xB4, 0xEF, 0x59, 0xB2, 0xE3, 0x41, 0x82, 0x83, 0x81, 0x85,
+    0x8D, 0x9D, 0xBD, 0xFD, 0x7D, 0xFA, 0x73, 0xE6, 0x4B, 0x96, 0xAB, 0xD1, 0x25, 0x4A, 0x94, 0xAF,
+    0xD9, 0x35, 0x6A, 0xD4, 0x2F, 0x5E, 0xBC, 0xFF, 0x79, 0xF2, 0x63, 0xC6, 0x0B, 0x16, 0x2C, 0x58,
+    0xB0, 0xE7, 0x49, 0x92, 0xA3, 0xC1, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0xC7, 0x09, 0x12, 0x24,
+    0x48, 0x90, 0xA7, 0xC9, 0x15, 0x2A, 0x54, 0xA8, 0xD7, 0x29, 0x52, 0xA4, 0xCF, 0x19, 0x32, 0x64,
+    0xC8, 0x17, 0x2E, 0x5C, 0xB8, 0xF7, 0x69, 0xD2, 0x23, 0x46, 0x8C, 0x9F, 0xB9, 0xF5, 0x6D, 0xDA,
+    0x33, 0x66, 0xCC, 0x1F, 0x3E, 0x7C, 0xF8, 0x77, 0xEE, 0x5B, 0xB6, 0xEB, 0x51, 0xA2, 0xC3, 0x01,
+    0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x87, 0x89, 0x95, 0xAD, 0xDD, 0x3D, 0x7A, 0xF4, 0x6F,
+    0xDE, 0x3B, 0x76, 0xEC, 0x5F, 0xBE, 0xFB, 0x71, 0xE2, 0x43, 0x86, 0x8B, 0x91, 0xA5, 0xCD, 0x1D,
+    0x3A, 0x74, 0xE8, 0x57, 0xAE, 0xDB, 0x31, 0x62, 0xC4, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0x67, 0xCE,
+    0x1B, 0x36, 0x6C, 0xD8, 0x37, 0x6E, 0xDC, 0x3F, 0x7E, 0xFC, 0x7F, 0xFE, 0x7B, 0xF6, 0x6B, 0xD6,
+    0x2B, 0x56, 0xAC, 0xDF, 0x39, 0x72, 0xE4, 0x4F, 0x9E, 0xBB, 0xF1, 0x65, 0xCA, 0x13, 0x26, 0x4C,
+    0x98, 0xB7, 0xE9, 0x55, 0xAA, 0xD3, 0x21, 0x42, 0x84, 0x8F, 0x99, 0xB5, 0xED, 0x5D, 0xBA, 0xF3,
+    0x61, 0xC2, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0x47,
+    0x8E, 0x9B, 0xB1, 0xE5, 0x4D, 0x9A, 0xB3, 0xE1, 0x45, 0x8A, 0x93, 0xA1, 0xC5, 0x0D, 0x1A, 0x34,
+    0x68, 0xD0, 0x27, 0x4E, 0x9C, 0xBF, 0xF9, 0x75, 0xEA, 0x53, 0xA6, 0xCB, 0x11, 0x22, 0x44, 0x88,
+    0x97, 0xA9, 0xD5, 0x2D, 0x5A, 0xB4, 0xEF, 0x59, 0xB2, 0xE3, 0x41, 0x82, 0x83, 0x81, 0x85, 0x8D,
+    0x9D, 0xBD, 0xFD, 0x7D, 0xFA, 0x73, 0xE6, 0x4B, 0x96, 0xAB, 0xD1, 0x25, 0x4A, 0x94, 0xAF, 0xD9,
+    0x35, 0x6A, 0xD4, 0x2F, 0x5E, 0xBC, 0xFF, 0x79, 0xF2, 0x63, 0xC6, 0x0B, 0x16, 0x2C, 0x58, 0xB0,
+    0xE7, 0x49, 0x92, 0xA3, 0xC1, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0xC7, 0x09, 0x12, 0x24, 0x48,
+    0x90, 0xA7, 0xC9, 0x15, 0x2A, 0x54, 0xA8, 0xD7, 0x29, 0x52, 0xA4, 0xCF, 0x19, 0x32, 0x64, 0xC8,
+    0x17, 0x2E, 0x5C, 0xB8, 0xF7, 0x69, 0xD2, 0x23, 0x46, 0x8C, 0x9F, 0xB9, 0xF5, 0x6D, 0xDA, 0x33,
+    0x66, 0xCC, 0x1F, 0x3E, 0x7C, 0xF8, 0x77, 0xEE, 0x5B, 0xB6, 0xEB, 0x51, 0xA2, 0xC3
+};
+
+static const uint8_t l_rsIndex[256] RS_TABLE = {
+    0xFF, 0x00, 0x01, 0x63, 0x02, 0xC6, 0x64, 0x6A, 0x03, 0xCD, 0xC7, 0xBC, 0x65, 0x7E, 0x6B, 0x2A,
+    0x04, 0x8D, 0xCE, 0x4E, 0xC8, 0xD4, 0xBD, 0xE1, 0x66, 0xDD, 0x7F, 0x31, 0x6C, 0x20, 0x2B, 0xF3,
+    0x05, 0x57, 0x8E, 0xE8, 0xCF, 0xAC, 0x4F, 0x83, 0xC9, 0xD9, 0xD5, 0x41, 0xBE, 0x94, 0xE2, 0xB4,
+    0x67, 0x27, 0xDE, 0xF0, 0x80, 0xB1, 0x32, 0x35, 0x6D, 0x45, 0x21, 0x12, 0x2C, 0x0D, 0xF4, 0x38,
+    0x06, 0x9B, 0x58, 0x1A, 0x8F, 0x79, 0xE9, 0x70, 0xD0, 0xC2, 0xAD, 0xA8, 0x50, 0x75, 0x84, 0x48,
+    0xCA, 0xFC, 0xDA, 0x8A, 0xD6, 0x54, 0x42, 0x24, 0xBF, 0x98, 0x95, 0xF9, 0xE3, 0x5E, 0xB5, 0x15,
+    0x68, 0x61, 0x28, 0xBA, 0xDF, 0x4C, 0xF1, 0x2F, 0x81, 0xE6, 0xB2, 0x3F, 0x33, 0xEE, 0x36, 0x10,
+    0x6E, 0x18, 0x46, 0xA6, 0x22, 0x88, 0x13, 0xF7, 0x2D, 0xB8, 0x0E, 0x3D, 0xF5, 0xA4, 0x39, 0x3B,
+    0x07, 0x9E, 0x9C, 0x9D, 0x59, 0x9F, 0x1B, 0x08, 0x90, 0x09, 0x7A, 0x1C, 0xEA, 0xA0, 0x71, 0x5A,
+    0xD1, 0x1D, 0xC3, 0x7B, 0xAE, 0x0A, 0xA9, 0x91, 0x51, 0x5B, 0x76, 0x72, 0x85, 0xA1, 0x49, 0xEB,
+    0xCB, 0x7C, 0xFD, 0xC4, 0xDB, 0x1E, 0x8B, 0xD2, 0xD7, 0x92, 0x55, 0xAA, 0x43, 0x0B, 0x25, 0xAF,
+    0xC0, 0x73, 0x99, 0x77, 0x96, 0x5C, 0xFA, 0x52, 0xE4, 0xEC, 0x5F, 0x4A, 0xB6, 0xA2, 0x16, 0x86,
+    0x69, 0xC5, 0x62, 0xFE, 0x29, 0x7D, 0xBB, 0xCC, 0xE0, 0xD3, 0x4D, 0x8C, 0xF2, 0x1F, 0x30, 0xDC,
+    0x82, 0xAB, 0xE7, 0x56, 0xB3, 0x93, 0x40, 0xD8, 0x34, 0xB0, 0xEF, 0x26, 0x37, 0x0C, 0x11, 0x44,
+    0x6F, 0x78, 0x19, 0x9A, 0x47, 0x74, 0xA7, 0xC1, 0x23, 0x53, 0x89, 0xFB, 0x14, 0x5D, 0xF8, 0x97,
+    0x2E, 0x4B, 0xB9, 0x60, 0x0F, 0xED, 0x3E, 0xE5, 0xF6, 0x87, 0xA5, 0x17, 0x3A, 0xA3, 0x3C, 0xB7
+};
+
+/* Generator polynomial, log form, x^0 first */
+static const uint8_t l_rsGen[RS_PARITY + 1] RS_TABLE = {
+    0x00, 0xF9, 0x3B, 0x42, 0x04, 0x2B, 0x7E, 0xFB, 0x61, 0x1E, 0x03, 0xD5, 0x32, 0x42, 0xAA, 0x05,
+    0x18, 0x05, 0xAA, 0x42, 0x32, 0xD5, 0x03, 0x1E, 0x61, 0xFB, 0x7E, 0x2B, 0x04, 0x42, 0x3B, 0xF9,
+    0x00
+};
+
+/* Local-scope objects -----------------------------------------------------*/
+#ifndef RADIO_AX25
+static RsEncoder l_rs;
+static uint8_t l_conv;                  /* convolutional encoder state */
+#endif
+static uint16_t l_len;                  /* frame bytes written */
+
+/* Encoders ----------------------------------------------------------------*/
+void Rs_begin(RsEncoder * const me) {
+    memset(me->parity, 0, sizeof(me->parity));
+    me->head = 0U;
+}
+
+/* Logical parity[j] is parity[(head + j) % RS_PARITY]; shifting the
+* register is moving the head */
+void Rs_update(RsEncoder * const me, uint8_t const *data, uint16_t len) {
+    uint8_t h = me->head;
+    uint8_t fb;
+    uint8_t j;
+    uint8_t k;
+
+    while (len-- != 0U) {
+        fb = RS_READ(l_rsIndex, *data++ ^ me->parity[h]);
+        if (fb != RS_A0) {
+            k = h;
+            for (j = 1U; j < RS_PARITY; ++j) {
+                k = (uint8_t)((k + 1U) & (RS_PARITY - 1U));
+                me->parity[k] ^= RS_READ(l_rsAlpha, fb + RS_READ(l_rsGen, RS_PARITY - j));
+            }
+            me->parity[h] = RS_READ(l_rsAlpha, fb + RS_READ(l_rsGen, 0));
+        }
+        else {
+            me->parity[h] = 0U;
+        }
+        h = (uint8_t)((h + 1U) & (RS_PARITY - 1U));
+    }
+    me->head = h;
+}
+
+void Rs_end(RsEncoder * const me, uint8_t *parity) {
+    uint8_t j;
+
+    for (j = 0U; j < RS_PARITY; ++j) {
+        parity[j] = me->parity[(me->head + j) & (RS_PARITY - 1U)];
+    }
+}
+
+static uint8_t parityOf(uint8_t x) {
+    x ^= (uint8_t)(x >> 4);
+    x ^= (uint8_t)(x >> 2);
+    x ^= (uint8_t)(x >> 1);
+    return (uint8_t)(x & 1U);
+}
+
+/* Generators 171 and 133 octal, as masks on a register shifted left */
+#define CONV_POLY_A 0x4FU
+#define CONV_POLY_B 0x6DU
+
+uint16_t Conv_encode(uint8_t *state, uint8_t b) {
+    uint8_t sr = *state;
+    uint16_t out = 0U;
+    uint8_t i;
+
+    for (i = 0U; i < 8U; ++i) {
+        sr = (uint8_t)((sr << 1) | (b >> 7));
+        b = (uint8_t)(b << 1);
+        out = (uint16_t)((out << 2) | (parityOf(sr & CONV_POLY_A) << 1)
+                         | parityOf(sr & CONV_POLY_B));
+    }
+    *state = (uint8_t)(sr & 0x3FU);
+    return out;
+}
+
+uint16_t Conv_flush(uint8_t *state) {
+    uint16_t out = Conv_encode(state, 0U);
+
+    return (uint16_t)(out & 0xFFF0U);   /* 6 tail bits, 12 coded */
+}
+
+/* Frame output ------------------------------------------------------------*/
+/* The radio is not wired up yet; frames go out on the serial link */
+#ifdef RADIO_AX25
+
+static uint8_t l_header[AX25_HEADER_LEN];
+static Kiss l_kiss;
+static volatile uint8_t l_discard;
+
+static void serialOut(uint8_t b) {
+    Serial.write(b);
+}
+
+static void discard(uint8_t b) {
+    l_discard ^= b;
+}
+
+void Radio_init(void) {
+    Hdlc hdlc;
+    uint8_t b;
+    uint16_t i;
+    unsigned long t;
+
+    Ax25_header(l_header, AX25_DEST, AX25_CALLSIGN, AX25_SSID);
+
+    /* a full frame as the modem would get it, a byte per call */
+    t = micros();
+    Hdlc_begin(&hdlc, &discard, 1U);
+    Hdlc_write(&hdlc, l_header, AX25_HEADER_LEN);
+    for (i = 0U; i < AX25_INFO_MAX; ++i) {
+        b = (uint8_t)i;
+        Hdlc_write(&hdlc, &b, 1U);
+    }
+    Hdlc_end(&hdlc);
+    t = micros() - t;
+
+    Serial.print(F("AX.25: HDLC "));
+    Serial.print(t * (F_CPU / 1000000UL) / (AX25_HEADER_LEN + AX25_INFO_MAX));
+    Serial.println(F(" cycles/byte"));
+}
+
+void Radio_begin(void) {
+    l_len = 0U;
+#ifndef SERIAL_TEXT_OUTPUT
+    Kiss_begin(&l_kiss, &serialOut);
+    Kiss_write(&l_kiss, l_header, AX25_HEADER_LEN);
+#endif
+}
+
+void Radio_write(void const *data, uint16_t len) {
+    if (len > (uint16_t)(RADIO_FRAME_MAX - l_len)) {
+        len = (uint16_t)(RADIO_FRAME_MAX - l_len);  /* the TNC would drop it */
+    }
+    l_len = (uint16_t)(l_len + len);
+#ifndef SERIAL_TEXT_OUTPUT
+    Kiss_write(&l_kiss, data, len);
+#else
+    (void)data;
+#endif
+}
+
+void Radio_end(void) {
+#ifndef SERIAL_TEXT_OUTPUT
+    Kiss_end(&l_kiss);
+#else
+    Serial.print(F("AX.25 frame: "));
+    Serial.print(l_len);
+    Serial.println(F(" bytes of info"));
+#endif
+}
+
+#else /* RS codewords */
+
+static void emit(uint8_t const *p, uint8_t len) {
+#ifndef SERIAL_TEXT_OUTPUT
+    SerialFrame_write(p, len);
+#else
+    (void)p;                    /* the records are printed as text */
+    (void)len;
+#endif
+}
+
+#ifdef RADIO_CONVOLUTIONAL
+static void emitCoded(uint16_t c) {
+    uint8_t coded[2];
+
+    coded[0] = (uint8_t)(c >> 8);
+    coded[1] = (uint8_t)c;
+    emit(coded, sizeof(coded));
+}
+#endif
+
+static void put(uint8_t b) {
+#ifdef RADIO_CONVOLUTIONAL
+    emitCoded(Conv_encode(&l_conv, b));
+#else
+    emit(&b, 1U);
+#endif
+}
+
+void Radio_init(void) {
+    uint8_t b;
+    uint16_t i;
+    volatile uint16_t sink = 0U;
+    unsigned long t0;
+    unsigned long t1;
+
+    /* a full-length codeword, a byte per call like record headers */
+    t0 = micros();
+    Rs_begin(&l_rs);
+    for (i = 0U; i < RS_DATA_MAX; ++i) {
+        b = (uint8_t)i;
+        Rs_update(&l_rs, &b, 1U);
+    }
+    t0 = micros() - t0;
+    t1 = micros();
+    for (i = 0U; i < RS_DATA_MAX + RS_PARITY; ++i) {
+        sink ^= Conv_encode(&l_conv, (uint8_t)i);
+    }
+    t1 = micros() - t1;
+    l_conv = 0U;
+
+    Serial.print(F("FEC: RS "));
+    Serial.print(t0 * (F_CPU / 1000000UL) / RS_DATA_MAX);
+    Serial.print(F(" cycles/byte, convolutional "));
+    Serial.print(t1 * (F_CPU / 1000000UL) / (RS_DATA_MAX + RS_PARITY));
+    Serial.println(F(" cycles/byte"));
+}
+
+void Radio_begin(void) {
+    Rs_begin(&l_rs);
+    l_conv = 0U;
+    l_len = 0U;
+#ifndef SERIAL_TEXT_OUTPUT
+    SerialFrame_begin(SF_CODEWORD);
+#endif
+}
+
+void Radio_write(void const *data, uint16_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+
+    if (len > (uint16_t)(RADIO_FRAME_MAX - l_len)) {
+        len = (uint16_t)(RADIO_FRAME_MAX - l_len);  /* the code cannot cover more */
+    }
+    Rs_update(&l_rs, p, len);
+    l_len = (uint16_t)(l_len + len);
+    while (len-- != 0U) {
+        put(*p++);
+    }
+}
+
+void Radio_end(void) {
+    uint8_t parity[RS_PARITY];
+    uint8_t i;
+
+    Rs_end(&l_rs, parity);
+    for (i = 0U; i < RS_PARITY; ++i) {
+        put(parity[i]);
+    }
+#ifdef RADIO_CONVOLUTIONAL
+    emitCoded(Conv_flush(&l_conv));
+#endif
+#ifndef SERIAL_TEXT_OUTPUT
+    SerialFrame_end();
+#else
+    Serial.print(F("Codeword: "));
+    Serial.print(l_len);
+    Serial.print(F(" bytes, parity "));
+    for (i = 0U; i < RS_PARITY; ++i) {
+        if (parity[i] < 0x10U) {
+            Serial.print('0');
+        }
+        Serial.print(parity[i], HEX);
+    }
+    Serial.println();
+#endif
+}
+
+void Radio_check(uint8_t *check, void const *frame, uint16_t len) {
+    RsEncoder rs;
+
+    Rs_begin(&rs);
+    Rs_update(&rs, (uint8_t const *)frame, len);
+    Rs_end(&rs, check);
+}
+
+void Radio_checkDelta(uint8_t *check, uint8_t const *delta, uint16_t n) {
+    uint8_t parity[RS_PARITY];
+    uint8_t i;
+
+    Radio_check(parity, delta, n);
+    for (i = 0U; i < RS_PARITY; ++i) {
+        check[i] ^= parity[i];
+    }
+}
+
+void Radio_sendChecked(void const *frame, uint16_t len, uint8_t const *check) {
+    uint8_t const *p = (uint8_t const *)frame;
+
+#ifndef SERIAL_TEXT_OUTPUT
+    SerialFrame_begin(SF_CODEWORD);
+#endif
+#ifdef RADIO_CONVOLUTIONAL
+    uint8_t i;
+
+    l_conv = 0U;
+    for (i = 0U; i < len; ++i) {
+        put(p[i]);
+    }
+    for (i = 0U; i < RS_PARITY; ++i) {
+        put(check[i]);
+    }
+    emitCoded(Conv_flush(&l_conv));
+#else
+    emit(p, (uint8_t)len);              /* len <= RADIO_FRAME_MAX */
+    emit(check, RS_PARITY);
+#endif
+#ifndef SERIAL_TEXT_OUTPUT
+    SerialFrame_end();
+#else
+    Serial.print(F("Codeword: "));
+    Serial.print(len);
+    Serial.println(F(" bytes, parity kept"));
+#endif
+}
+
+#endif /* RADIO_AX25 */
+
+void Radio_writev(MsgSegment const *seg, uint8_t n) {
+    while (n-- != 0U) {
+        Radio_write(seg->data, seg->len);
+        ++seg;
+    }
+}
+
+/* Uplink ------------------------------------------------------------------*/
+static SerialRx l_rx;
+
+uint8_t Radio_receive(uint8_t const **frame) {
+    uint8_t n;
+
+    while (Serial.available() > 0) {
+        n = SerialFrame_receive(&l_rx, (uint8_t)Serial.read());
+        if (n != 0U) {
+            *frame = l_rx.buf;
+            return n;
+        }
+    }
+    return 0U;
+}
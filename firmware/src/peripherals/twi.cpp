@@ -0,0 +1,263 @@
+#include <Arduino.h>
+#include <util/twi.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+#include "twi.h"
+
+#define TWI_SYNC_TIMEOUT_MS 100U
+#define TWI_STOP_SPINS      255U        /* > 100 us, one SCL period at 10 kHz */
+
+/* Local-scope objects -----------------------------------------------------*/
+static struct {
+    TwiSeg const *seg;          /* current segment, the rest follow it */
+    uint8_t nSeg;               /* segments left, including the current one */
+    uint16_t idx;               /* bytes done in the current segment */
+    uint16_t total;             /* bytes done over all segments */
+    uint8_t sla;                /* 7-bit address << 1 */
+    bool read;
+    bool probe;                 /* stop right after SLA+W */
+    bool regSent;               /* register pointer of 'seg' is written */
+    QActive *owner;
+    enum_t sig;
+} l_xfer;
+
+static TwiSeg l_single;         /* segment of the single-register calls */
+static volatile bool l_busy;
+static volatile TwiStatus l_status;
+static uint8_t l_ticksLeft;     /* system ticks until the transfer expires */
+static unsigned long l_t0;
+static volatile uint32_t l_lastUs;
+
+#define TWCR_GO    ((1U << TWINT) | (1U << TWEN) | (1U << TWIE))
+#define TWCR_START (TWCR_GO | (1U << TWSTA))
+#define TWCR_ACK   (TWCR_GO | (1U << TWEA))
+#define TWCR_STOP  ((1U << TWINT) | (1U << TWEN) | (1U << TWSTO))
+
+/* Called from an ISR with the final status of the transfer */
+static void finish(TwiStatus status) {
+    if (status == TWI_TIMEOUT) {
+        TWCR = 0U;                                                  // Release the bus
+        TWCR = (1U << TWEN);
+    }
+    else {
+        /* after lost arbitration another master owns the bus, so no STOP */
+        TWCR = (status == TWI_ARB_LOST) ? (uint8_t)(1U << TWEN) : (uint8_t)TWCR_STOP;
+    }
+    l_lastUs = micros() - l_t0;
+    l_status = status;
+    l_busy = false;
+    if (l_xfer.owner != (QActive *)0) {
+        QueueStats_postISR(l_xfer.owner, l_xfer.sig,
+                           (QParam)status | ((QParam)l_xfer.total << 16));
+    }
+}
+
+/* Called from the ISR when the current read segment is complete */
+static void nextSegment(void) {
+    ++l_xfer.seg;
+    if (--l_xfer.nSeg == 0U) {
+        finish(TWI_OK);
+    }
+    else {
+        l_xfer.idx = 0U;
+        l_xfer.regSent = false;
+        TWCR = TWCR_START;                                          // Repeated start, keep the bus
+    }
+}
+
+/* The STOP of the last transfer goes out after finish() returns, and a
+* START written while TWSTO is still set can be lost, leaving the transfer
+* to time out. TWSTO clears once the STOP is on the bus, one SCL period. */
+static void waitStop(void) {
+    uint8_t spins = TWI_STOP_SPINS;
+
+    while (((TWCR & (1U << TWSTO)) != 0U) && (--spins != 0U)) {
+    }
+}
+
+static bool start(uint8_t addr, TwiSeg const *seg, uint8_t nSeg,
+                  bool read, bool probe, QActive * const owner, enum_t sig) {
+    bool started = false;
+
+    QF_INT_DISABLE();
+    if (!l_busy) {
+        l_busy = true;
+        l_xfer.seg = seg;
+        l_xfer.nSeg = nSeg;
+        l_xfer.idx = 0U;
+        l_xfer.total = 0U;
+        l_xfer.sla = (uint8_t)(addr << 1);
+        l_xfer.read = read;
+        l_xfer.probe = probe;
+        l_xfer.regSent = false;
+        l_xfer.owner = owner;
+        l_xfer.sig = sig;
+        l_ticksLeft = TWI_ASYNC_TIMEOUT_TICKS;
+        waitStop();
+        l_t0 = micros();
+        TWCR = TWCR_START;
+        started = true;
+    }
+    QF_INT_ENABLE();
+    return started;
+}
+
+/* l_single is only touched while the bus is idle */
+static bool startSingle(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len,
+                        bool read, bool probe, QActive * const owner,
+                        enum_t sig) {
+    if (l_busy) {
+        return false;
+    }
+    l_single.reg = reg;
+    l_single.buf = buf;
+    l_single.len = len;
+    return start(addr, &l_single, 1U, read, probe, owner, sig);
+}
+
+static TwiStatus waitSync(void) {
+    unsigned long t0 = millis();
+
+    while (l_busy) {
+        if (millis() - t0 > TWI_SYNC_TIMEOUT_MS) {
+            TWI_abort();
+            return TWI_TIMEOUT;
+        }
+    }
+    return l_status;
+}
+
+void TWI_init(uint32_t freq) {
+    PORTD |= (1U << PD0) | (1U << PD1);                             // SCL/SDA pull-ups
+    TWSR = 0U;                                                      // Prescaler 1
+    TWBR = (uint8_t)(((F_CPU / freq) - 16U) / 2U);
+    TWCR = (1U << TWEN);
+    l_busy = false;
+}
+
+bool TWI_startRead(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len,
+                   QActive * const owner, enum_t sig) {
+    return startSingle(addr, reg, buf, len, true, false, owner, sig);
+}
+
+bool TWI_startReadSeq(uint8_t addr, TwiSeg const *seg, uint8_t nSeg,
+                      QActive * const owner, enum_t sig) {
+    return (nSeg != 0U) && start(addr, seg, nSeg, true, false, owner, sig);
+}
+
+bool TWI_startWrite(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len, QActive * const owner, enum_t sig) {
+    return startSingle(addr, reg, (uint8_t *)buf, len, false, false, owner, sig);
+}
+
+bool TWI_isBusy(void) {
+    return l_busy;
+}
+
+uint32_t TWI_lastTransferUs(void) {
+    return l_lastUs;
+}
+
+void TWI_abort(void) {
+    QF_INT_DISABLE();
+    TWCR = 0U;                                                      // Release the bus
+    TWCR = (1U << TWEN);
+    l_busy = false;
+    QF_INT_ENABLE();
+}
+
+/* Runs in the system tick ISR, which the TWI_vect ISR cannot preempt */
+void TWI_tickISR(void) {
+    if (l_busy && (--l_ticksLeft == 0U)) {
+        finish(TWI_TIMEOUT);
+    }
+}
+
+TwiStatus TWI_probe(uint8_t addr) {
+    if (!startSingle(addr, 0U, (uint8_t *)0, 0U, false, true, (QActive *)0, 0)) {
+        return TWI_BUS_ERROR;
+    }
+    return waitSync();
+}
+
+TwiStatus TWI_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len) {
+    if (!startSingle(addr, reg, buf, len, true, false, (QActive *)0, 0)) {
+        return TWI_BUS_ERROR;
+    }
+    return waitSync();
+}
+
+TwiStatus TWI_write(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len) {
+    if (!startSingle(addr, reg, (uint8_t *)buf, len, false, false, (QActive *)0, 0)) {
+        return TWI_BUS_ERROR;
+    }
+    return waitSync();
+}
+
+ISR(TWI_vect) {
+    switch (TW_STATUS) {
+        case TW_START:
+        case TW_REP_START:
+            /* register pointer first (SLA+W), then the data (SLA+R) */
+            TWDR = l_xfer.sla | (l_xfer.regSent ? TW_READ : TW_WRITE);
+            TWCR = TWCR_GO;
+            break;
+        case TW_MT_SLA_ACK:
+            if (l_xfer.probe) {
+                finish(TWI_OK);
+                break;
+            }
+            TWDR = l_xfer.seg->reg;
+            TWCR = TWCR_GO;
+            break;
+        case TW_MT_DATA_ACK:
+            if (l_xfer.read) {
+                l_xfer.regSent = true;
+                TWCR = TWCR_START;                                  // Repeated start, no STOP
+            }
+            else if (l_xfer.idx < l_xfer.seg->len) {
+                TWDR = l_xfer.seg->buf[l_xfer.idx++];
+                ++l_xfer.total;
+                TWCR = TWCR_GO;
+            }
+            else {
+                finish(TWI_OK);
+            }
+            break;
+        case TW_MR_SLA_ACK:
+            if (l_xfer.seg->len == 0U) {
+                nextSegment();
+            }
+            else {
+                TWCR = (l_xfer.seg->len > 1U) ? TWCR_ACK : TWCR_GO; // NACK the last byte
+            }
+            break;
+        case TW_MR_DATA_ACK:
+            l_xfer.seg->buf[l_xfer.idx++] = TWDR;
+            ++l_xfer.total;
+            TWCR = (l_xfer.idx + 1U < l_xfer.seg->len) ? TWCR_ACK : TWCR_GO;
+            break;
+        case TW_MR_DATA_NACK:
+            l_xfer.seg->buf[l_xfer.idx++] = TWDR;
+            ++l_xfer.total;
+            nextSegment();
+            break;
+        case TW_MT_SLA_NACK:
+        case TW_MR_SLA_NACK:
+            finish(TWI_NACK_ADDR);
+            break;
+        case TW_MT_DATA_NACK:
+            /* a NACK on the last written byte still delivered it */
+            finish(((l_xfer.read == false) && (l_xfer.idx == l_xfer.seg->len))
+                   ? TWI_OK : TWI_NACK_DATA);
+            break;
+        case TW_MT_ARB_LOST:
+            finish(TWI_ARB_LOST);
+            break;
+        default:
+            finish(TWI_BUS_ERROR);
+            break;
+    }
+}
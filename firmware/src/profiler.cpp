@@ -0,0 +1,118 @@
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "profiler.h"
+
+#ifdef PROFILER_ENABLED
+
+/* Local-scope objects -----------------------------------------------------*/
+static ProfilerSlot l_slots[PROFILER_SLOTS];
+static QStateHandler l_state;       /* sample in progress */
+static QSignal l_sig;
+static uint16_t l_missed;           /* samples lost to a full table */
+
+void Profiler_init(void) {
+    // Configure Timer3 free-running, prescaler 64 (4 us per tick at 16 MHz)
+    TCCR3A = 0U;                                                    // Normal mode
+    TCCR3B = (1U << CS31) | (1U << CS30);                           // Prescaler 64
+    TIMSK3 = 0U;                                                    // No interrupts
+    Profiler_clear();
+}
+
+void Profiler_begin(QActive const * const a) {
+    l_state = a->super.state;
+    l_sig = a->super.evt.sig;
+    TCNT3 = 0U;
+    TIFR3 = (1U << TOV3);                                           // Clear overflow flag
+}
+
+void Profiler_end(void) {
+    uint16_t ticks = TCNT3;
+    ProfilerSlot *slot = (ProfilerSlot *)0;
+    uint8_t bucket = 0U;
+    uint16_t scale;
+    uint8_t i;
+    bool over = ((TIFR3 & (1U << TOV3)) != 0U);                     // Wrapped: 262 ms or more
+
+    for (i = 0U; i < PROFILER_SLOTS; ++i) {
+        if ((l_slots[i].count == 0U) && (l_slots[i].over == 0U)) {
+            slot = &l_slots[i];
+            slot->state = l_state;
+            slot->sig = l_sig;
+            slot->min = 0xFFFFU;
+            break;
+        }
+        if ((l_slots[i].state == l_state) && (l_slots[i].sig == l_sig)) {
+            slot = &l_slots[i];
+            break;
+        }
+    }
+    if (slot == (ProfilerSlot *)0) {
+        ++l_missed;
+        return;
+    }
+
+    if (over) {
+        if (slot->over != 0xFFU) {
+            ++slot->over;
+        }
+        return;
+    }
+    if (slot->count != 0xFFFFU) {
+        ++slot->count;
+        slot->sum += ticks;
+    }
+    if (ticks < slot->min) {
+        slot->min = ticks;
+    }
+    if (ticks > slot->max) {
+        slot->max = ticks;
+    }
+    for (scale = ticks >> 2; (scale != 0U) && (bucket < PROFILER_BUCKETS - 1U); scale >>= 2) {
+        ++bucket;
+    }
+    if (slot->hist[bucket] != 0xFFU) {
+        ++slot->hist[bucket];
+    }
+}
+
+void Profiler_clear(void) {
+    memset(l_slots, 0, sizeof(l_slots));
+    l_missed = 0U;
+}
+
+void Profiler_dump(void) {
+    uint8_t i;
+    uint8_t b;
+
+    Serial.println(F("Profile: state\tsig\tcount\tmin\tmean\tmax [cycles]\tover\thist"));
+    for (i = 0U; i < PROFILER_SLOTS; ++i) {
+        ProfilerSlot const *slot = &l_slots[i];
+        if ((slot->count == 0U) && (slot->over == 0U)) {
+            break;
+        }
+        Serial.print((uint16_t)(uintptr_t)slot->state, HEX);
+        Serial.print('\t');
+        Serial.print(slot->sig);
+        Serial.print('\t');
+        Serial.print(slot->count);
+        Serial.print('\t');
+        Serial.print((slot->count != 0U) ? (uint32_t)slot->min * PROFILER_CYCLES_PER_TICK
+                                         : 0UL);
+        Serial.print('\t');
+        Serial.print((slot->count != 0U) ? slot->sum / slot->count * PROFILER_CYCLES_PER_TICK
+                                         : 0UL);
+        Serial.print('\t');
+        Serial.print((uint32_t)slot->max * PROFILER_CYCLES_PER_TICK);
+        Serial.print('\t');
+        Serial.print(slot->over);
+        Serial.print('\t');
+        for (b = 0U; b < PROFILER_BUCKETS; ++b) {
+            Serial.print(slot->hist[b]);
+            Serial.print(b + 1U < PROFILER_BUCKETS ? ' ' : '\n');
+        }
+    }
+    Serial.print(F("Missed: "));
+    Serial.println(l_missed);
+}
+
+#endif /* PROFILER_ENABLED */
@@ -0,0 +1,124 @@
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+
+/* Local-scope objects -----------------------------------------------------*/
+static QueueStats l_stats[QSTATS_MAX_ACTIVE];
+
+/* Critical signals may take any free slot. Everything else is periodic and
+* the next occurrence supersedes a dropped one.
+*/
+static uint_fast8_t marginOf(enum_t sig) {
+    switch (sig) {
+        case Q_LEO_SIG:
+        case Q_DEORBIT_SIG:
+        case Q_DETUMBLE_SIG:
+        case Q_SWEEP_SIG:       /* carries a pool reference */
+        case Q_TWI_DONE_SIG:    /* the AMU harvest stalls without it */
+        case Q_TIMEOUT_SIG:     /* one-shot, see QueueStats_tickXISR() */
+        case Q_PAYLOAD_SIG:     /* uplink commands: the counter is spent */
+        case Q_TELEMETRY_SIG:   /* only once they are posted */
+        case Q_PROFILE_SIG:
+        case Q_QUERY_SIG:
+            return 0U;
+        default:
+            return (uint_fast8_t)QSTATS_DROP_MARGIN;
+    }
+}
+
+/* Must be called with interrupts disabled */
+static void record(QActive * const ao, enum_t const sig, bool posted) {
+    QueueStats * const s = &l_stats[ao->prio - 1U];
+
+    if (posted) {
+        if (ao->nUsed > s->peak) {
+            s->peak = ao->nUsed;
+        }
+        if (s->posted != 0xFFFFU) {
+            ++s->posted;
+        }
+    }
+    else if ((sig >= Q_TIMEOUT_SIG) && (sig < MAX_SIG)) {
+        if (s->failed[sig - Q_TIMEOUT_SIG] != 0xFFFFU) {
+            ++s->failed[sig - Q_TIMEOUT_SIG];
+        }
+    }
+}
+
+bool QueueStats_post(QActive * const ao, enum_t const sig, QParam const par) {
+    bool posted = QActive_postX_(ao, marginOf(sig), sig, par);
+
+    QF_INT_DISABLE();
+    record(ao, sig, posted);
+    QF_INT_ENABLE();
+    return posted;
+}
+
+bool QueueStats_postISR(QActive * const ao, enum_t const sig, QParam const par) {
+    bool posted = QActive_postXISR_(ao, marginOf(sig), sig, par);
+
+    record(ao, sig, posted);  /* interrupts are already disabled in the ISR */
+    return posted;
+}
+
+/* QF_tickXISR() with the timeout posted through QueueStats_postISR(): the
+* stock one posts with QF_NO_MARGIN and asserts on a full queue */
+void QueueStats_tickXISR(uint_fast8_t const tickRate) {
+    uint_fast8_t p = QF_maxActive_;
+
+    do {
+        QActive *a = QF_ROM_ACTIVE_GET_(p);
+        QTimer *t = &a->tickCtr[tickRate];
+
+        if (t->nTicks != 0U) {
+            --t->nTicks;
+            if (t->nTicks == 0U) {
+#ifdef QF_TIMEEVT_PERIODIC
+                t->nTicks = t->interval;    /* re-arm, or stay disarmed */
+#endif
+                QueueStats_postISR(a, (enum_t)Q_TIMEOUT_SIG + (enum_t)tickRate, 0U);
+            }
+        }
+        --p;
+    } while (p != 0U);
+}
+
+void QueueStats_get(uint8_t prio, QueueStats * const out) {
+    QF_INT_DISABLE();
+    *out = l_stats[prio - 1U];
+    QF_INT_ENABLE();
+    out->qlen = Q_ROM_BYTE(QF_active[prio].qlen);
+}
+
+void QueueStats_clear(void) {
+    QF_INT_DISABLE();
+    memset(l_stats, 0, sizeof(l_stats));
+    QF_INT_ENABLE();
+}
+
+void QueueStats_report(void) {
+    QueueStats s;
+    uint8_t prio;
+    uint8_t i;
+
+    for (prio = 1U; prio <= QSTATS_MAX_ACTIVE; ++prio) {
+        QueueStats_get(prio, &s);
+        Serial.print(F("Queue AO"));
+        Serial.print(prio);
+        Serial.print(F(" peak "));
+        Serial.print(s.peak);
+        Serial.print('/');
+        Serial.print(s.qlen);
+        Serial.print(F(" posted "));
+        Serial.println(s.posted);
+        for (i = 0U; i < QSTATS_NUM_SIGS; ++i) {
+            if (s.failed[i] != 0U) {
+                Serial.print(F("  sig "));
+                Serial.print(i + Q_TIMEOUT_SIG);
+                Serial.print(F(" failed "));
+                Serial.println(s.failed[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#include <Arduino.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "serial_frame.h"
+
+/* Local-scope objects -----------------------------------------------------*/
+static uint16_t l_crc;
+
+static void putEscaped(uint8_t b) {
+    if (b == SLIP_END) {
+        Serial.write((uint8_t)SLIP_ESC);
+        Serial.write((uint8_t)SLIP_ESC_END);
+    }
+    else if (b == SLIP_ESC) {
+        Serial.write((uint8_t)SLIP_ESC);
+        Serial.write((uint8_t)SLIP_ESC_ESC);
+    }
+    else {
+        Serial.write(b);
+    }
+}
+
+void SerialFrame_begin(uint8_t type) {
+    Serial.write((uint8_t)SLIP_END);    /* flushes any line noise too */
+    l_crc = crc16_ccitt(0xFFFFU, &type, 1U);
+    putEscaped(type);
+}
+
+void SerialFrame_write(void const *data, uint16_t len) {
+    uint8_t const *p = (uint8_t const *)data;
+
+    l_crc = crc16_ccitt(l_crc, p, len);
+    while (len-- != 0U) {
+        putEscaped(*p++);
+    }
+}
+
+void SerialFrame_end(void) {
+    putEscaped((uint8_t)l_crc);
+    putEscaped((uint8_t)(l_crc >> 8));
+    Serial.write((uint8_t)SLIP_END);
+}
+
+void SerialFrame_send(uint8_t type, void const *data, uint16_t len) {
+    SerialFrame_begin(type);
+    SerialFrame_write(data, len);
+    SerialFrame_end();
+}
+
+uint8_t SerialFrame_receive(SerialRx * const me, uint8_t b) {
+    uint8_t n;
+
+    if (b == SLIP_END) {
+        n = me->len;
+        me->len = 0U;
+        me->esc = false;
+        if (me->overrun || (n < 3U)) {
+            me->overrun = false;
+            return 0U;                  /* idle, text or too long */
+        }
+        n = (uint8_t)(n - 2U);
+        if (crc16_ccitt(0xFFFFU, me->buf, n)
+            != (uint16_t)(me->buf[n] | (me->buf[n + 1U] << 8))) {
+            return 0U;
+        }
+        return n;
+    }
+    if (me->esc) {
+        b = (b == SLIP_ESC_END) ? (uint8_t)SLIP_END
+          : (b == SLIP_ESC_ESC) ? (uint8_t)SLIP_ESC : b;
+        me->esc = false;
+    }
+    else if (b == SLIP_ESC) {
+        me->esc = true;
+        return 0U;
+    }
+    if (me->len < sizeof(me->buf)) {
+        me->buf[me->len++] = b;
+    }
+    else {
+        me->overrun = true;
+    }
+    return 0U;
+}
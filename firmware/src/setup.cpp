@@ -1,13 +1,16 @@
 #include <Arduino.h>
 #include "qpn.h"            /* QP/C framework API */
 #include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+#include "twi.h"
 
 // Interrupt for Timer1
 ISR(TIMER1_COMPA_vect) {
-    QACTIVE_POST_ISR((QActive *)&AO_CubeSat, Q_BATTERY_SIG, 0U);
-    QACTIVE_POST_ISR((QActive *)&AO_CubeSat, Q_TICK_SIG, 0U);
+    QueueStats_postISR((QActive *)&AO_CubeSat, Q_BATTERY_SIG, 0U);
+    QueueStats_postISR((QActive *)&AO_CubeSat, Q_TICK_SIG, 0U);
 
-    // QF_tickXISR(0);         // Process time events for tick rate 0
+    TWI_tickISR();           // Expire a transfer whose interrupt never came
+    QueueStats_tickXISR(0U); // Process time events for tick rate 0
 }
 
 void timer1_init(void){
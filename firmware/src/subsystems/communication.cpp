@@ -1 +1,504 @@
-// Placeholder
\ No newline at end of file
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"
+#include "queue_stats.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "radio.h"
+#include "communication.h"
+
+/* One frame is one codeword, and records go out as their header prefix */
+Q_ASSERT_COMPILE((int)DL_FRAME_PAYLOAD <= (int)RADIO_FRAME_MAX);
+Q_ASSERT_COMPILE(DL_RECORD_OVERHEAD == offsetof(LogRecord, flags));
+/* Even empty records cannot overfill DownlinkFrame::seq */
+Q_ASSERT_COMPILE((DL_FRAME_RECORDS + 1) * DL_RECORD_OVERHEAD > DL_FRAME_PAYLOAD);
+/* Candidate sets are bitmasks */
+Q_ASSERT_COMPILE(DL_CANDIDATES <= 16);
+/* The status record fits in any frame, and a NACK can cover a transfer in
+* a few uplink frames */
+Q_ASSERT_COMPILE(DL_RECORD_OVERHEAD + XFER_STATUS_LEN <= DL_FRAME_PAYLOAD);
+Q_ASSERT_COMPILE((XFER_CHUNKS_MAX % 8) == 0);
+
+enum {
+    DL_NEWEST,                          /* worth most fresh, halves by the hour */
+    DL_OLDEST                           /* worth more the longer it waits */
+};
+
+typedef struct DownlinkClass {
+    uint8_t type;
+    uint8_t weight;
+    uint8_t policy;
+} DownlinkClass;
+
+typedef struct Candidate {
+    uint16_t seq;
+    uint16_t value;
+    uint8_t bytes;                      /* record with its frame overhead */
+    uint8_t units;
+    bool sweep;                         /* a LOG_REC_SWEEP part */
+} Candidate;
+
+/* Local-scope objects -----------------------------------------------------*/
+static DownlinkClass const l_classes[] = {
+    /* type                 weight  policy */
+    { LOG_REC_ORBIT,        24U,    DL_NEWEST },
+    { LOG_REC_HOUSEKEEPING, 16U,    DL_NEWEST },
+    { LOG_REC_PARAMS,        8U,    DL_NEWEST },
+    { LOG_REC_SWEEP,         2U,    DL_OLDEST }
+};
+
+static LogRecord l_rec;                 /* 64 bytes, kept off the stack */
+
+/* Scheduling --------------------------------------------------------------*/
+uint16_t Downlink_value(uint8_t type, uint32_t time, uint32_t now) {
+    uint32_t age_h = (now > time) ? (now - time) / 3600UL : 0UL;
+    uint8_t weight = 1U;
+    uint8_t policy = DL_OLDEST;
+    uint8_t i;
+
+    for (i = 0U; i < sizeof(l_classes) / sizeof(l_classes[0]); ++i) {
+        if (l_classes[i].type == type) {
+            weight = l_classes[i].weight;
+            policy = l_classes[i].policy;
+        }
+    }
+    if (age_h > 255UL) {
+        age_h = 255UL;
+    }
+    if (policy == DL_NEWEST) {
+        return (uint16_t)(weight * 256UL / (age_h + 1UL));
+    }
+    return (uint16_t)(weight * (16UL + age_h));
+}
+
+static bool inFrame(DownlinkFrame const *f, uint16_t seq) {
+    uint8_t i;
+
+    for (i = 0U; i < f->n; ++i) {
+        if (f->seq[i] == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Adds record 'seq' when it is readable, unsent and not already taken;
+* sweep parts only when 'sweeps' is set */
+static uint8_t consider(Downlink * const me, uint32_t now, DownlinkFrame const *f,
+                        uint16_t seq, bool sweeps, Candidate *c, uint8_t n) {
+    if (LogStore_read(me->log, seq, &l_rec)
+        && ((l_rec.flags & LOG_FLAG_UNSENT) != 0U) && !inFrame(f, seq)
+        && (sweeps || (l_rec.type != LOG_REC_SWEEP))) {
+        c[n].seq = seq;
+        c[n].sweep = (l_rec.type == LOG_REC_SWEEP);
+        c[n].value = Downlink_value(l_rec.type, l_rec.time, now);
+        c[n].bytes = (uint8_t)(l_rec.len + DL_RECORD_OVERHEAD);
+        c[n].units = (uint8_t)((c[n].bytes + DL_UNIT - 1U) / DL_UNIT);
+        ++n;
+    }
+    return n;
+}
+
+/* Up to DL_CANDIDATES / 2 of the oldest unsent records, the rest from the
+* newest end; each end looks at no more than 2 * DL_CANDIDATES records.
+* Sweep parts come from the oldest end only, so they are in log order. */
+static uint8_t gather(Downlink * const me, uint32_t now, DownlinkFrame const *f,
+                      Candidate *c) {
+    uint16_t seq;
+    uint16_t end = me->log->nextSeq;
+    uint8_t n = 0U;
+    uint8_t scan;
+
+    if (!LogStore_oldestUnsent(me->log, &seq)) {
+        return 0U;
+    }
+    for (scan = 0U; (scan < 2U * DL_CANDIDATES) && (n < DL_CANDIDATES / 2)
+                    && (seq != end); ++scan, ++seq) {
+        n = consider(me, now, f, seq, true, c, n);
+    }
+    for (scan = 0U; (scan < 2U * DL_CANDIDATES) && (n < DL_CANDIDATES)
+                    && (end != seq); ++scan) {
+        --end;
+        n = consider(me, now, f, end, false, c, n);
+    }
+    return n;
+}
+
+/* 0/1 knapsack over 'units' of room; take[u] is the best set that fits u */
+static uint16_t pack(Candidate const *c, uint8_t n, uint8_t units) {
+    static uint16_t best[DL_FRAME_UNITS + 1];
+    static uint16_t take[DL_FRAME_UNITS + 1];
+    uint16_t v;
+    uint8_t i;
+    uint8_t u;
+
+    memset(best, 0, sizeof(best));
+    memset(take, 0, sizeof(take));
+    for (i = 0U; i < n; ++i) {
+        /* downwards, so best[u - w] still excludes item i */
+        for (u = units; u >= c[i].units; --u) {
+            v = (uint16_t)(best[u - c[i].units] + c[i].value);
+            if (v > best[u]) {
+                best[u] = v;
+                take[u] = (uint16_t)(take[u - c[i].units] | (1U << i));
+            }
+        }
+    }
+    return take[units];
+}
+
+static void take(DownlinkFrame *f, Candidate const *c) {
+    f->seq[f->n++] = c->seq;
+    f->bytes += c->bytes;
+    f->value += c->value;
+}
+
+/* Transfer ----------------------------------------------------------------*/
+#define XFER_FLAGGED(t_, i_) ((((t_)->missing[(i_) >> 3] >> ((i_) & 7U)) & 1U) != 0U)
+
+static void unflag(Transfer * const t, uint16_t i) {
+    if (XFER_FLAGGED(t, i)) {
+        t->missing[i >> 3] &= (uint8_t)~(1U << (i & 7U));
+        --t->flagged;
+    }
+}
+
+void Downlink_startTransfer(Downlink * const me, uint8_t id, uint32_t from,
+                            uint32_t until, uint8_t type, uint8_t tag) {
+    Transfer * const t = &me->xfer;
+    uint16_t end;
+    uint16_t i;
+
+    if ((id == 0U) || (id == t->id)) {
+        return;                         /* a repeated request */
+    }
+    end = (until == 0xFFFFFFFFUL) ? me->log->nextSeq : LogStore_seek(me->log, until + 1UL);
+    t->id = id;
+    t->type = type;
+    t->tag = tag;
+    t->base = LogStore_seek(me->log, from);
+    /* 'until' before 'from', or before the oldest record, is empty rather
+    * than a wrapped-around count of the whole log */
+    t->count = ((int16_t)(end - t->base) > 0) ? (uint16_t)(end - t->base) : 0U;
+    if (t->count > XFER_CHUNKS_MAX) {
+        t->count = XFER_CHUNKS_MAX;
+    }
+    memset(t->missing, 0, sizeof(t->missing));
+    for (i = 0U; i < t->count; ++i) {
+        t->missing[i >> 3] |= (uint8_t)(1U << (i & 7U));
+    }
+    t->flagged = t->count;
+    t->cursor = 0U;
+    t->announce = true;
+}
+
+void Downlink_nack(Downlink * const me, uint8_t id, uint16_t first,
+                   uint8_t const *missing, uint16_t bits) {
+    Transfer * const t = &me->xfer;
+    uint16_t i;
+
+    if ((id == 0U) || (id != t->id)) {
+        return;
+    }
+    for (i = 0U; (i < bits) && ((uint16_t)(first + i) < t->count); ++i) {
+        if (((missing[i >> 3] >> (i & 7U)) & 1U) == 0U) {
+            unflag(t, (uint16_t)(first + i));
+        }
+    }
+    t->cursor = 0U;                     /* a new round, of what is missing */
+}
+
+/* Flagged chunks from the cursor on, starting over at the end, while
+* they fit */
+static void planChunks(Downlink * const me, DownlinkFrame *f) {
+    Transfer * const t = &me->xfer;
+    uint16_t seq;
+    uint8_t size;
+    uint8_t reads;
+
+    for (reads = 0U; (t->flagged != 0U) && (reads < XFER_SCAN);) {
+        if (t->cursor >= t->count) {
+            t->cursor = 0U;             /* no NACK yet: the next round */
+        }
+        if (!XFER_FLAGGED(t, t->cursor)) {
+            ++t->cursor;
+            continue;
+        }
+        seq = (uint16_t)(t->base + t->cursor);
+        ++reads;
+        if (!LogStore_read(me->log, seq, &l_rec)
+            || ((t->type != LOG_TYPE_ANY) && (l_rec.type != t->type))
+            || ((t->tag != LOG_TAG_NONE) && (l_rec.tag != t->tag))) {
+            unflag(t, t->cursor);       /* gone, or not part of it */
+            ++t->cursor;
+            continue;
+        }
+        size = (uint8_t)(l_rec.len + DL_RECORD_OVERHEAD);
+        if (f->bytes + size > DL_FRAME_PAYLOAD) {
+            break;                      /* first in the next frame */
+        }
+        if (!inFrame(f, seq)) {
+            f->seq[f->n++] = seq;
+            f->bytes += size;
+        }
+        ++t->cursor;
+    }
+}
+
+uint8_t Downlink_planFrame(Downlink * const me, uint32_t now, DownlinkFrame *f) {
+    Candidate c[DL_CANDIDATES];
+    uint16_t mask;
+    uint8_t units;
+    uint8_t bytes;
+    uint8_t size;
+    uint8_t polls;
+    uint8_t round;
+    uint8_t n;
+    uint8_t i;
+    bool held;
+
+    f->n = 0U;
+    f->bytes = 0U;
+    f->value = 0U;
+    f->status = false;
+
+    /* query results, in order, while they fit */
+    for (polls = 0U; polls < DL_FRAME_RECORDS; ++polls) {
+        if (!me->queryHeld) {
+            if (me->query.done) {
+                break;
+            }
+            if (!LogStore_queryNext(me->log, &me->query, &l_rec)) {
+                continue;               /* a scan without a match */
+            }
+            me->queryHeld = true;
+            me->heldSeq = l_rec.seq;
+            me->heldLen = l_rec.len;
+        }
+        size = (uint8_t)(me->heldLen + DL_RECORD_OVERHEAD);
+        if (f->bytes + size > DL_FRAME_PAYLOAD) {
+            break;
+        }
+        f->seq[f->n++] = me->heldSeq;
+        f->bytes += size;
+        me->queryHeld = false;
+    }
+
+    /* the transfer: its status once a pass, then a round of chunks */
+    if (me->xfer.id != 0U) {
+        if (me->xfer.announce
+            && (f->bytes + DL_RECORD_OVERHEAD + XFER_STATUS_LEN <= DL_FRAME_PAYLOAD)) {
+            f->status = true;
+            f->bytes += DL_RECORD_OVERHEAD + XFER_STATUS_LEN;
+            me->xfer.announce = false;
+        }
+        planChunks(me, f);
+    }
+
+    /* the rest of the frame by value, drawing new candidates while the
+    * last ones left room */
+    for (round = 0U; round < DL_ROUNDS; ++round) {
+        units = (uint8_t)((DL_FRAME_PAYLOAD - f->bytes) / DL_UNIT);
+        n = gather(me, now, f, c);
+        if (n == 0U) {
+            break;
+        }
+        mask = pack(c, n, units);
+        /* then top up, to the byte, what the rounding to DL_UNIT left over */
+        bytes = f->bytes;
+        for (i = 0U; i < n; ++i) {
+            if ((mask & (1U << i)) != 0U) {
+                bytes = (uint8_t)(bytes + c[i].bytes);
+            }
+        }
+        for (i = 0U; i < n; ++i) {
+            if (((mask & (1U << i)) == 0U) && (bytes + c[i].bytes <= DL_FRAME_PAYLOAD)) {
+                mask |= (uint16_t)(1U << i);
+                bytes = (uint8_t)(bytes + c[i].bytes);
+            }
+        }
+        /* no sweep part past one left behind: a delta never goes down
+        * ahead of its key (datacollection.h) */
+        held = false;
+        for (i = 0U; i < n; ++i) {
+            if (c[i].sweep) {
+                if (held) {
+                    mask &= (uint16_t)~(1U << i);
+                }
+                else if ((mask & (1U << i)) == 0U) {
+                    held = true;
+                }
+            }
+        }
+        for (i = 0U; i < n; ++i) {
+            if ((mask & (1U << i)) != 0U) {
+                take(f, &c[i]);
+            }
+        }
+    }
+    return (uint8_t)(f->n + (f->status ? 1U : 0U));
+}
+
+/* Pass --------------------------------------------------------------------*/
+void Downlink_init(Downlink * const me, LogStore *log, DownlinkSink const *sink) {
+    memset(me, 0, sizeof(*me));
+    me->log = log;
+    me->sink = sink;
+    me->query.done = true;
+}
+
+void Downlink_beginPass(Downlink * const me, uint16_t pass_s, uint16_t rate_bps) {
+    me->framesLeft = (uint16_t)((uint32_t)pass_s * (rate_bps / 8U) / DL_FRAME_AIR);
+    me->airPerTick = (uint16_t)(rate_bps / 8U);     /* one tick per second */
+    me->credit = 0U;
+    if (me->xfer.id != 0U) {
+        me->xfer.announce = true;
+    }
+    me->frames = 0U;
+    me->records = 0U;
+    me->payload = 0UL;
+}
+
+static void sendStatus(Downlink * const me, uint32_t now) {
+    Transfer * const t = &me->xfer;
+
+    l_rec.seq = t->base;
+    l_rec.type = LOG_REC_XFER;
+    l_rec.tag = t->id;
+    l_rec.time = now;
+    l_rec.len = XFER_STATUS_LEN;
+    l_rec.flags = 0U;
+    l_rec.payload[0] = (uint8_t)t->count;
+    l_rec.payload[1] = (uint8_t)(t->count >> 8);
+    l_rec.payload[2] = (uint8_t)t->flagged;
+    l_rec.payload[3] = (uint8_t)(t->flagged >> 8);
+    me->sink->record(&l_rec);
+    if (t->flagged == 0U) {
+        t->id = 0U;                     /* all there, and the ground knows */
+    }
+}
+
+static void sendFrame(Downlink * const me, uint32_t now, DownlinkFrame const *f) {
+    uint8_t i;
+
+    me->sink->begin();
+    if (f->status) {
+        sendStatus(me, now);
+    }
+    for (i = 0U; i < f->n; ++i) {
+        if (LogStore_read(me->log, f->seq[i], &l_rec)) {
+            me->sink->record(&l_rec);
+            if ((l_rec.flags & LOG_FLAG_UNSENT) != 0U) {
+                LogStore_markSent(me->log, f->seq[i]);
+            }
+        }
+    }
+    me->sink->end();
+    ++me->frames;
+    me->records += f->n + (f->status ? 1U : 0U);
+    me->payload += f->bytes;
+}
+
+bool Downlink_tick(Downlink * const me, uint32_t now) {
+    static DownlinkFrame f;
+
+    me->credit += me->airPerTick;
+    while ((me->framesLeft != 0U) && (me->credit >= DL_FRAME_AIR)) {
+        if (Downlink_planFrame(me, now, &f) == 0U) {
+            me->framesLeft = 0U;        /* nothing left to send */
+            break;
+        }
+        sendFrame(me, now, &f);
+        me->credit -= DL_FRAME_AIR;
+        --me->framesLeft;
+    }
+    return me->framesLeft != 0U;
+}
+
+/* Flight glue -------------------------------------------------------------*/
+/* Straight from the record as read: header prefix, then payload */
+static void radioRecord(LogRecord const *rec) {
+    MsgSegment seg[2];
+
+    seg[0].data = rec;
+    seg[0].len = DL_RECORD_OVERHEAD;
+    seg[1].data = rec->payload;
+    seg[1].len = rec->len;
+    Radio_writev(seg, 2U);
+#ifdef SERIAL_TEXT_OUTPUT
+    DataCollection_printRecord(rec);
+#endif
+}
+
+static DownlinkSink const l_radioSink = { &Radio_begin, &radioRecord, &Radio_end };
+
+Downlink g_downlink;
+CommandAuth g_commands;
+
+void Communication_init(void) {
+    Downlink_init(&g_downlink, &g_telemetryLog, &l_radioSink);
+    g_commands.counter = DataCollection_loadCounter();
+}
+
+void Communication_beginPass(void) {
+    Downlink_beginPass(&g_downlink, DL_PASS_S, DL_RATE_BPS);
+}
+
+bool Communication_tick(void) {
+    return Downlink_tick(&g_downlink, DataCollection_now());
+}
+
+void Communication_query(uint32_t from, uint32_t until, uint8_t type, uint8_t tag) {
+    LogStore_queryStart(g_downlink.log, &g_downlink.query, from, until, type, tag);
+    g_downlink.queryHeld = false;
+}
+
+static uint32_t getU32(uint8_t const *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+           | ((uint32_t)p[3] << 24);
+}
+
+void Communication_receive(QActive * const ao) {
+    uint8_t const *p;
+    uint8_t n;
+    Command cmd;
+
+    while ((n = Radio_receive(&p)) != 0U) {
+        switch (p[0]) {
+            case SF_XFER_START: {
+                if (n == 12U) {
+                    Downlink_startTransfer(&g_downlink, p[1], getU32(&p[2]), getU32(&p[6]),
+                                           p[10], p[11]);
+                }
+                break;
+            }
+            case SF_XFER_NACK: {
+                if (n > 4U) {
+                    Downlink_nack(&g_downlink, p[1], (uint16_t)(p[2] | (p[3] << 8)), &p[4],
+                                  (uint16_t)(8U * (n - 4U)));
+                }
+                break;
+            }
+            case SF_COMMAND: {
+                if (Command_parse(&g_commands, p, n, &cmd) != CMD_OK) {
+                    break;
+                }
+                if ((cmd.sig != 0U)
+                    && !QueueStats_post(ao, (enum_t)cmd.sig, (QParam)cmd.par)) {
+                    Command_reject(&g_commands, CMD_QUEUE_FULL);
+                    break;
+                }
+                Command_accept(&g_commands, &cmd);
+                DataCollection_saveCounter(g_commands.counter);
+                break;
+            }
+            default: {
+                break;                  /* not for us */
+            }
+        }
+    }
+}
@@ -1 +1,165 @@
-// Placeholder
\ No newline at end of file
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "amu.h"
+#include "memstat.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "orbit_stats.h"
+
+/* EEPROM backend ----------------------------------------------------------*/
+static void eepromRead(uint32_t addr, void *buf, uint16_t len) {
+    eeprom_read_block(buf, (void const *)(uintptr_t)addr, len);
+}
+
+static void eepromWrite(uint32_t addr, void const *buf, uint16_t len) {
+    eeprom_update_block(buf, (void *)(uintptr_t)addr, len);
+}
+
+NvmDev const g_nvmEeprom = {
+    &eepromRead, &eepromWrite, (void (*)(uint32_t))0, E2END + 1U, 0U
+};
+
+LogStore g_telemetryLog;
+
+/* Local-scope objects -----------------------------------------------------*/
+static uint32_t l_timeBase;             /* mission time at boot */
+static uint8_t l_paramsIn[AMU_MAX_DEVICES];     /* sweeps to the next logged one */
+
+/* Command counter ---------------------------------------------------------*/
+/* the last DC_COUNTER_SIZE bytes of the EEPROM, past the log */
+static uint32_t counterAddr(void) {
+    return g_nvmEeprom.size - DC_COUNTER_SIZE;
+}
+
+uint16_t DataCollection_loadCounter(void) {
+    uint16_t c[2];
+
+    g_nvmEeprom.read(counterAddr(), c, sizeof(c));
+    return ((uint16_t)~c[1] == c[0]) ? c[0] : 0U;
+}
+
+void DataCollection_saveCounter(uint16_t counter) {
+    uint16_t c[2];
+
+    c[0] = counter;
+    c[1] = (uint16_t)~counter;
+    g_nvmEeprom.write(counterAddr(), c, sizeof(c));
+}
+
+/* Record log --------------------------------------------------------------*/
+void DataCollection_init(void) {
+    uint16_t seq;
+
+    LogStore_init(&g_telemetryLog, &g_nvmEeprom, 0U, g_nvmEeprom.size - DC_COUNTER_SIZE);
+    l_timeBase = g_telemetryLog.lastTime + 1U;
+    OrbitStats_start(&g_orbitStats, l_timeBase);
+    Serial.print(F("Log: "));
+    Serial.print(g_telemetryLog.count);
+    Serial.print(F(" of "));
+    Serial.print(g_telemetryLog.nSlots);
+    Serial.print(F(" records, next "));
+    Serial.print(g_telemetryLog.nextSeq);
+    if (LogStore_oldestUnsent(&g_telemetryLog, &seq)) {
+        Serial.print(F(", unsent from "));
+        Serial.print(seq);
+    }
+    Serial.println();
+}
+
+uint32_t DataCollection_now(void) {
+    return l_timeBase + millis() / 1000UL;
+}
+
+void DataCollection_logParams(uint8_t const *pkt, uint8_t len) {
+    uint8_t cell;
+
+    if (len == 0U) {
+        return;
+    }
+    cell = pkt[2];                      /* byte 2 of a parameter packet */
+    if (cell < AMU_MAX_DEVICES) {
+        if (l_paramsIn[cell] != 0U) {
+            --l_paramsIn[cell];
+            return;
+        }
+        l_paramsIn[cell] = DC_PARAMS_EVERY - 1U;
+    }
+    LogStore_append(&g_telemetryLog, LOG_REC_PARAMS, cell,
+                    DataCollection_now(), pkt, len);
+}
+
+static void logHousekeeping(uint32_t now, uint16_t extractUs) {
+    LogHousekeeping hk;
+    MemStat m;
+
+    MemStat_get(&m);
+    hk.uptime_s = millis() / 1000UL;
+    hk.battery_wh = battery_watt_h;
+    hk.stackPeak = m.stackPeak;
+    hk.lost = g_telemetryLog.lost;
+    hk.extractUs = extractUs;
+    LogStore_append(&g_telemetryLog, LOG_REC_HOUSEKEEPING, LOG_TAG_NONE,
+                    now, &hk, sizeof(hk));
+}
+
+uint16_t DataCollection_logSweep(uint8_t const *pkt, uint16_t len) {
+    static uint8_t part[LOG_PAYLOAD_MAX];
+    uint8_t count = (uint8_t)((len + DC_SWEEP_CHUNK - 1U) / DC_SWEEP_CHUNK);
+    uint16_t first = g_telemetryLog.nextSeq;
+    uint8_t cell;
+    uint8_t chunk;
+    uint8_t i;
+
+    if ((len < 3U) || (count > 0x0FU)) {
+        return first;
+    }
+    cell = pkt[2];                      /* as in a parameter packet */
+    for (i = 0U; i < count; ++i) {
+        chunk = (len > DC_SWEEP_CHUNK) ? (uint8_t)DC_SWEEP_CHUNK : (uint8_t)len;
+        part[0] = (uint8_t)((i << 4) | count);
+        memcpy(&part[1], pkt, chunk);
+        LogStore_append(&g_telemetryLog, LOG_REC_SWEEP, cell,
+                        DataCollection_now(), part, (uint8_t)(chunk + 1U));
+        pkt += chunk;
+        len = (uint16_t)(len - chunk);
+    }
+    return first;
+}
+
+void DataCollection_second(uint8_t state, uint16_t extractUs) {
+    LogOrbit s;
+    uint32_t now = DataCollection_now();
+
+    if (OrbitStats_due(&g_orbitStats, now)) {
+        OrbitStats_summarize(&g_orbitStats, &s);
+        LogStore_append(&g_telemetryLog, LOG_REC_ORBIT, LOG_TAG_NONE,
+                        now, &s, sizeof(s));
+        OrbitStats_start(&g_orbitStats, now);
+        logHousekeeping(now, extractUs);
+    }
+    OrbitStats_add(&g_orbitStats, ORBIT_BATTERY, battery_watt_h * 100.0f);
+    OrbitStats_tick(&g_orbitStats, state);
+}
+
+void DataCollection_printRecord(LogRecord const *rec) {
+    uint8_t i;
+
+    Serial.print(F("Log record "));
+    Serial.print(rec->seq);
+    Serial.print(F(" type "));
+    Serial.print(rec->type);
+    Serial.print(F(" tag "));
+    Serial.print(rec->tag);
+    Serial.print(F(" at "));
+    Serial.print(rec->time);
+    Serial.print(F(": "));
+    for (i = 0U; i < rec->len; ++i) {
+        if (rec->payload[i] < 0x10U) {
+            Serial.print('0');
+        }
+        Serial.print(rec->payload[i], HEX);
+    }
+    Serial.println();
+}
@@ -0,0 +1,430 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "qpn.h"            /* QP-nano framework API */
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+
+/* Output cursor; 'p' becomes NULL once the buffer is exhausted */
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+} Writer;
+
+static void putByte(Writer *w, uint8_t b) {
+    if (w->p == (uint8_t *)0) {
+        return;
+    }
+    if (w->p >= w->end) {
+        w->p = (uint8_t *)0;
+        return;
+    }
+    *w->p++ = b;
+}
+
+static void putU16(Writer *w, uint16_t v) {
+    putByte(w, (uint8_t)v);
+    putByte(w, (uint8_t)(v >> 8));
+}
+
+static void putU32(Writer *w, uint32_t v) {
+    putU16(w, (uint16_t)v);
+    putU16(w, (uint16_t)(v >> 16));
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void putVarint(Writer *w, int32_t v) {
+    uint32_t z = zigzag(v);
+
+    while (z >= 0x80U) {
+        putByte(w, (uint8_t)(z | 0x80U));
+        z >>= 7;
+    }
+    putByte(w, (uint8_t)z);
+}
+
+static int32_t scale(float x, float k) {
+    float y = x * k;
+    return (int32_t)(y < 0.0f ? y - 0.5f : y + 0.5f);
+}
+
+/* Difference coder: emits the first value, then first differences, then
+* (for order 2) second differences. Streams, so no channel copy is needed.
+*/
+typedef struct {
+    int32_t last;
+    int32_t lastDelta;
+} Diff;
+
+static int32_t diffCode(Diff *d, int32_t v, uint8_t i, uint8_t order) {
+    int32_t delta = v - d->last;
+    int32_t code = delta;
+
+    if (i == 0U) {
+        code = v;
+    }
+    else if ((order == 2U) && (i >= 2U)) {
+        code = delta - d->lastDelta;
+    }
+    d->last = v;
+    d->lastDelta = delta;
+    return code;
+}
+
+static void putDiff(Writer *w, Diff *d, int32_t v, uint8_t i, uint8_t order) {
+    putVarint(w, diffCode(d, v, i, order));
+}
+
+/* Appends the CRC into the two bytes held back from 'end' */
+static uint16_t finish(Writer *w, uint8_t const *out) {
+    uint16_t len;
+
+    if (w->p == (uint8_t *)0) {
+        return 0U;
+    }
+    len = (uint16_t)(w->p - out);
+    w->end += 2;
+    putU16(w, crc16_ccitt(0xFFFFU, out, len));
+    return (uint16_t)(len + 2U);
+}
+
+int16_t compress_temperature(float temperature) {
+    return (int16_t)scale(temperature, SWEEP_TEMPERATURE_SCALE);
+}
+
+int16_t compress_current(float current) {
+    return (int16_t)scale(current, SWEEP_CURRENT_SCALE);
+}
+
+int16_t compress_voltage(float voltage) {
+    return (int16_t)scale(voltage, SWEEP_VOLTAGE_SCALE);
+}
+
+uint16_t crc16_ccitt(uint16_t crc, uint8_t const *data, uint16_t len) {
+    uint8_t b;
+
+    while (len-- != 0U) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (b = 0U; b < 8U; ++b) {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U)
+                                  : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t SweepCodec_encode(ivsweep_t const *sweep, uint8_t *out, uint16_t cap) {
+    Diff d = { 0, 0 };
+    Writer w;
+    uint8_t i;
+
+    if (cap < 2U) {
+        return 0U;
+    }
+    w.p = out;
+    w.end = out + cap - 2U;      /* room for the CRC */
+
+    putByte(&w, SWEEP_PKT_TYPE);
+    putByte(&w, SWEEP_PKT_VERSION);
+    putByte(&w, sweep->cell);
+    putByte(&w, IVSWEEP_POINTS);
+    putU32(&w, sweep->meta.timestamp);
+    putU16(&w, (uint16_t)compress_voltage(sweep->meta.voc));
+    putU16(&w, (uint16_t)compress_current(sweep->meta.isc));
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_start));
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_end));
+
+    for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+        putDiff(&w, &d, (int32_t)sweep->timestamp[i], i, 2U);
+    }
+    for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+        putDiff(&w, &d, scale(sweep->voltage[i], SWEEP_VOLTAGE_SCALE), i, 2U);
+    }
+    for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+        putDiff(&w, &d, scale(sweep->current[i], SWEEP_CURRENT_SCALE), i, 1U);
+    }
+
+    return finish(&w, out);
+}
+
+/* Delta packets ----------------------------------------------------------*/
+enum {
+    DELTA_TIME,
+    DELTA_VOLTAGE,
+    DELTA_CURRENT,
+    DELTA_CHANNELS,
+    DELTA_K_MAX = 15,               /* a nibble */
+    DELTA_CODE_MAX = 0x40000000     /* zigzag codes past this force a key */
+};
+
+/* Bits MSB first into a Writer */
+typedef struct {
+    Writer *w;
+    uint8_t acc;
+    uint8_t n;
+} BitWriter;
+
+static void putBits(BitWriter *b, uint32_t v, uint8_t n) {
+    while (n-- != 0U) {
+        b->acc = (uint8_t)((b->acc << 1) | ((v >> n) & 1U));
+        if (++b->n == 8U) {
+            putByte(b->w, b->acc);
+            b->acc = 0U;
+            b->n = 0U;
+        }
+    }
+}
+
+static uint8_t bitLength(uint32_t v) {
+    uint8_t n = 0U;
+
+    while (v != 0U) {
+        ++n;
+        v >>= 1;
+    }
+    return n;
+}
+
+/* Order-k Exp-Golomb: m = (z >> k) + 1 with as many leading zeros as it
+* has bits after the first, then the low k bits of z */
+static uint8_t expGolombBits(uint32_t z, uint8_t k) {
+    return (uint8_t)(2U * bitLength((z >> k) + 1U) - 1U + k);
+}
+
+static void putExpGolomb(BitWriter *b, uint32_t z, uint8_t k) {
+    uint32_t m = (z >> k) + 1U;
+    uint8_t n = bitLength(m);
+
+    putBits(b, 0U, (uint8_t)(n - 1U));
+    putBits(b, m, n);
+    putBits(b, z, k);
+}
+
+/* Zigzag code of point i of channel ch; points go in order, 'd' carries
+* the differences. Without a reference (NULL) the current is coded as is */
+static uint32_t deltaCode(SweepRef const *ref, ivsweep_t const *sweep,
+                          uint8_t ch, uint8_t i, Diff *d) {
+    int32_t current;
+
+    if (ch == DELTA_TIME) {
+        return zigzag(diffCode(d, (int32_t)sweep->timestamp[i], i, 2U));
+    }
+    if (ch == DELTA_VOLTAGE) {
+        return zigzag(diffCode(d, scale(sweep->voltage[i], SWEEP_VOLTAGE_SCALE), i, 2U));
+    }
+    current = scale(sweep->current[i], SWEEP_CURRENT_SCALE);
+    if (ref != (SweepRef *)0) {
+        current -= ref->current[i];
+    }
+    return zigzag(diffCode(d, current, i, 1U));
+}
+
+/* The k that codes channel ch in the fewest bits; adds them to *bits, or
+* returns DELTA_K_MAX + 1 when a code is too large for a delta */
+static uint8_t bestK(SweepRef const *ref, ivsweep_t const *sweep, uint8_t ch,
+                     uint16_t *bits) {
+    uint16_t cost[DELTA_K_MAX + 1];
+    Diff d = { 0, 0 };
+    uint32_t z;
+    uint8_t best = 0U;
+    uint8_t i;
+    uint8_t k;
+
+    memset(cost, 0, sizeof(cost));
+    for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+        z = deltaCode(ref, sweep, ch, i, &d);
+        if (z >= DELTA_CODE_MAX) {
+            return DELTA_K_MAX + 1U;
+        }
+        for (k = 0U; k <= DELTA_K_MAX; ++k) {
+            cost[k] = (uint16_t)(cost[k] + expGolombBits(z, k));
+        }
+    }
+    for (k = 1U; k <= DELTA_K_MAX; ++k) {
+        if (cost[k] < cost[best]) {
+            best = k;
+        }
+    }
+    *bits = (uint16_t)(*bits + cost[best]);
+    return best;
+}
+
+/* The cell's slot; a free one it takes, or NULL when there is none. A
+* slot whose key is due goes to the next cell without one, if any waits */
+static SweepRef *refFor(SweepRefs * const me, uint8_t cell) {
+    SweepRef *free = (SweepRef *)0;
+    uint8_t i;
+
+    for (i = 0U; i < SWEEP_REF_SLOTS; ++i) {
+        if (me->slot[i].cell == cell) {
+            if ((me->slot[i].deltas >= SWEEP_KEY_INTERVAL) && me->waiting) {
+                me->slot[i].cell = 0xFFU;
+                me->waiting = false;
+                return (SweepRef *)0;
+            }
+            return &me->slot[i];
+        }
+        if (me->slot[i].cell == 0xFFU) {
+            free = &me->slot[i];
+        }
+    }
+    if (free != (SweepRef *)0) {
+        free->cell = cell;
+        free->deltas = SWEEP_KEY_INTERVAL;  /* no key yet */
+    }
+    else {
+        me->waiting = true;
+    }
+    return free;
+}
+
+static void rekey(SweepRef *ref, ivsweep_t const *sweep) {
+    int32_t q;
+    uint8_t i;
+
+    ref->keyTime = (uint16_t)sweep->meta.timestamp;
+    ref->deltas = 0U;
+    for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+        q = scale(sweep->current[i], SWEEP_CURRENT_SCALE);
+        if ((q > 32767L) || (q < -32768L)) {
+            ref->deltas = SWEEP_KEY_INTERVAL;   /* not a usable key */
+        }
+        ref->current[i] = (int16_t)q;
+    }
+}
+
+void SweepCodec_initRefs(SweepRefs * const me) {
+    uint8_t i;
+
+    memset(me, 0, sizeof(*me));
+    for (i = 0U; i < SWEEP_REF_SLOTS; ++i) {
+        me->slot[i].cell = 0xFFU;
+    }
+}
+
+SweepRef *SweepCodec_refOf(SweepRefs * const me, uint8_t cell) {
+    uint8_t i;
+
+    for (i = 0U; i < SWEEP_REF_SLOTS; ++i) {
+        if (me->slot[i].cell == cell) {
+            return &me->slot[i];
+        }
+    }
+    return (SweepRef *)0;
+}
+
+/* A delta packet against 'ref', or an unkeyed one (NULL), with the k
+* already chosen per channel */
+static uint16_t writeDelta(SweepRef const *ref, ivsweep_t const *sweep,
+                           uint8_t const *k, uint8_t *out, uint16_t cap) {
+    uint8_t ch;
+    uint8_t i;
+    Diff d;
+    Writer w;
+    BitWriter b;
+
+    w.p = out;
+    w.end = out + cap - 2U;
+    putByte(&w, SWEEP_PKT_DELTA);
+    putByte(&w, SWEEP_PKT_VERSION);
+    putByte(&w, sweep->cell);
+    putByte(&w, IVSWEEP_POINTS);
+    putU16(&w, (ref != (SweepRef *)0) ? ref->keyTime : 0U);
+    putU32(&w, sweep->meta.timestamp);
+    putU16(&w, (uint16_t)compress_voltage(sweep->meta.voc));
+    putU16(&w, (uint16_t)compress_current(sweep->meta.isc));
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_start));
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_end));
+    putByte(&w, (uint8_t)(k[DELTA_TIME] | (k[DELTA_VOLTAGE] << 4)));
+    putByte(&w, (uint8_t)(k[DELTA_CURRENT]
+                          | ((ref != (SweepRef *)0) ? 0U : SWEEP_DELTA_UNKEYED)));
+
+    b.w = &w;
+    b.acc = 0U;
+    b.n = 0U;
+    for (ch = 0U; ch < DELTA_CHANNELS; ++ch) {
+        d.last = 0;
+        d.lastDelta = 0;
+        for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+            putExpGolomb(&b, deltaCode(ref, sweep, ch, i, &d), k[ch]);
+        }
+    }
+    putBits(&b, 0U, (uint8_t)((8U - b.n) & 7U));
+    return finish(&w, out);
+}
+
+static uint16_t deltaLen(uint16_t bits) {
+    return (uint16_t)(SWEEP_DELTA_HEADER + (bits + 7U) / 8U + 2U);
+}
+
+uint16_t SweepCodec_encodeDelta(SweepRefs * const me, ivsweep_t const *sweep,
+                                uint8_t *out, uint16_t cap) {
+    SweepRef *ref = refFor(me, sweep->cell);
+    uint8_t k[DELTA_CHANNELS];
+    uint8_t kOwn;                   /* current k without the key */
+    uint16_t bits = 0U;
+    uint16_t own;
+    uint16_t keyed = 0U;
+    uint16_t len = 0U;
+
+    /* time and voltage cost the same with or without a key */
+    k[DELTA_TIME] = bestK((SweepRef *)0, sweep, DELTA_TIME, &bits);
+    k[DELTA_VOLTAGE] = bestK((SweepRef *)0, sweep, DELTA_VOLTAGE, &bits);
+    if ((k[DELTA_TIME] <= DELTA_K_MAX) && (k[DELTA_VOLTAGE] <= DELTA_K_MAX)) {
+        own = bits;
+        kOwn = bestK((SweepRef *)0, sweep, DELTA_CURRENT, &own);
+        own = (kOwn <= DELTA_K_MAX) ? deltaLen(own) : 0U;
+        if ((ref != (SweepRef *)0) && (ref->deltas < SWEEP_KEY_INTERVAL)) {
+            k[DELTA_CURRENT] = bestK(ref, sweep, DELTA_CURRENT, &bits);
+            keyed = (k[DELTA_CURRENT] <= DELTA_K_MAX) ? deltaLen(bits) : 0U;
+        }
+        if ((keyed != 0U) && ((own == 0U) || (keyed < own)) && (keyed <= cap)) {
+            ++ref->deltas;
+            return writeDelta(ref, sweep, k, out, cap);
+        }
+        if ((own != 0U) && (own <= cap)) {
+            k[DELTA_CURRENT] = kOwn;
+            len = writeDelta((SweepRef *)0, sweep, k, out, cap);
+        }
+    }
+    /* not worth a delta against the key, or none due: a new key */
+    if (len == 0U) {
+        len = SweepCodec_encode(sweep, out, cap);
+    }
+    if ((len != 0U) && (ref != (SweepRef *)0)) {
+        rekey(ref, sweep);
+    }
+    return len;
+}
+
+uint16_t SweepCodec_encodeParams(ivsweep_t const *sweep, IvParams const *p,
+                                 uint8_t *out, uint16_t cap) {
+    Writer w;
+
+    if (cap < 2U) {
+        return 0U;
+    }
+    w.p = out;
+    w.end = out + cap - 2U;
+
+    putByte(&w, SWEEP_PKT_PARAMS);
+    putByte(&w, SWEEP_PKT_VERSION);
+    putByte(&w, sweep->cell);
+    putByte(&w, p->mismatch);
+    putU32(&w, sweep->meta.timestamp);
+    putU16(&w, (uint16_t)p->voc_mV);
+    putU16(&w, (uint16_t)p->vmp_mV);
+    putU32(&w, (uint32_t)p->isc_uA);
+    putU32(&w, (uint32_t)p->imp_uA);
+    putU32(&w, (uint32_t)p->pmax_uW);
+    putU16(&w, p->ff);
+    putU32(&w, (uint32_t)p->rs_mohm);
+    putU32(&w, (uint32_t)p->rsh_ohm);
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_start));
+    putU16(&w, (uint16_t)compress_temperature(sweep->meta.tsensor_end));
+    return finish(&w, out);
+}
@@ -0,0 +1,63 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/* Host stand-in for the Arduino core ---------------------------------------*/
+/*
+* Just enough of Arduino.h to build the AMU driver on Linux. Time is virtual:
+* micros()/millis() read g_emuUs, which only the emulator advances, and
+* delay() moves it forward instead of sleeping. Serial output goes to stdout
+* when Serial.verbose is set and is discarded otherwise.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HEX 16
+#define DEC 10
+
+/* flash strings are plain strings here */
+class __FlashStringHelper;
+#define F(s_) (reinterpret_cast<__FlashStringHelper const *>(s_))
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+extern uint32_t g_emuUs;
+
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class HostSerial {
+public:
+    bool verbose;
+
+    void begin(unsigned long baud) { (void)baud; }
+    operator bool() const { return true; }
+    void flush() {}
+
+    size_t write(uint8_t b);
+    int available();
+    int read();
+    size_t print(char const *s);
+    size_t print(__FlashStringHelper const *s) { return print((char const *)s); }
+    size_t print(char c);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(double x, int digits = 2);
+    size_t println() { return print("\n"); }
+
+    template <typename T>
+    size_t println(T x) { return print(x) + println(); }
+    template <typename T>
+    size_t println(T x, int arg) { return print(x, arg) + println(); }
+};
+
+extern HostSerial Serial;
+
+#endif /* ARDUINO_H */
@@ -0,0 +1,75 @@
+#ifndef AMU_EMU_H
+#define AMU_EMU_H
+
+/* Host emulator of the Angstrom AMU TWI register map -----------------------*/
+/*
+* Each AmuEmu answers at one TWI address with the registers the driver uses:
+*
+*   AMU_REG_CMD           CMD_*, low byte first, bit 7 set for a query into
+*                         the transfer reg; a single byte is ignored
+*   0xF0/0xF1/0xF2/0xF6   timestamp[], voltage[], current[], ivsweep_meta_t
+*   AMU_REG_TRANSFER_PTR  amu_meas_t result of the last Isc/Voc query, or
+*                         the value for the next CMD_SWEEP_CONF_* command
+*   0xF3                  user sweep voltage table (AMU_SWEEP_TYPE_USER1)
+*
+* CMD_SWEEP_TRIG_SWEEP starts a sweep that completes sweepUs later; until
+* then the data registers still hold the previous sweep, as on the real
+* AMU. Curves come from the single-diode model
+*   I = Iph - I0 (exp((V + I Rs) / a) - 1) - (V + I Rs) / Rsh
+* sampled at IVSWEEP_POINTS voltages from 0 to just past Voc (or at the
+* user table), and meta.crc is
+* the CRC-32 the driver checks. The TWI layer (twi_emu.cpp) routes every
+* transfer here and may flip bits on the way with probability 'ber'. A
+* command write is NACKed with probability 'nack', and then has no effect.
+*/
+typedef struct AmuEmuModel {
+    float iph;                  /* photocurrent [A] */
+    float i0;                   /* saturation current [A] */
+    float a;                    /* n Ns kT/q [V] */
+    float rs;                   /* [Ohm] */
+    float rsh;                  /* [Ohm] */
+    float tempC;
+    float noiseA;               /* uniform current noise, +/- [A] */
+} AmuEmuModel;
+
+typedef struct AmuEmu {
+    uint8_t addr;
+    AmuEmuModel model;
+    ivsweep_t regs;             /* data registers, only the arrays and meta */
+    amu_meas_t transfer;
+    float userTable[IVSWEEP_POINTS];
+    uint8_t sweepType;
+    bool sweeping;
+    uint32_t doneUs;            /* sweep (or query) completion time */
+    uint32_t triggerMs;         /* meta.timestamp of the sweep in progress */
+    uint16_t pendingCmd;
+    bool earlyRead;             /* meta read before the sweep was done */
+    uint32_t sweeps;            /* completed sweeps */
+} AmuEmu;
+
+enum {
+    AMU_EMU_MAX = AMU_MAX_DEVICES
+};
+
+typedef struct AmuEmuConfig {
+    uint32_t sweepUs;           /* trigger to data valid */
+    uint32_t queryUs;           /* Isc/Voc trigger to result valid */
+    float ber;                  /* per-bit error rate on reads */
+    float nack;                 /* chance a command write is NACKed */
+    uint32_t seed;
+} AmuEmuConfig;
+
+void AmuEmu_init(AmuEmuConfig const *cfg);
+AmuEmu *AmuEmu_add(uint8_t addr, AmuEmuModel const *model);
+AmuEmu *AmuEmu_find(uint8_t addr);
+float AmuEmu_voc(AmuEmuModel const *model);
+float AmuEmu_pmax(AmuEmuModel const *model);
+
+/* Register access, called by the TWI emulation; false is a NACK */
+bool AmuEmu_write(uint8_t addr, uint8_t reg, uint8_t const *buf, uint16_t len);
+bool AmuEmu_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len);
+
+uint32_t AmuEmu_bitFlips(void);
+uint32_t AmuEmu_nacks(void);
+
+#endif /* AMU_EMU_H */
@@ -0,0 +1,24 @@
+#ifndef TWI_EMU_H
+#define TWI_EMU_H
+
+/* Host TWI master behind the firmware's twi.h ------------------------------*/
+/*
+* Implements the twi.h API on top of AmuEmu. Every transfer costs its bus
+* time at TWI_FREQ_HZ: 9 SCL clocks per byte including the address bytes,
+* one per (repeated) START and one for the STOP. Synchronous calls advance
+* g_emuUs by that much. Asynchronous ones move the data immediately but
+* only post their completion event once TwiEmu_poll() sees the virtual
+* clock reach the end of the transfer, as the TWI_vect ISR would.
+*
+* With a loss rate set, that many asynchronous transfers never complete,
+* like a lost interrupt or a held SCL, and are left to TWI_tickISR().
+*/
+void TwiEmu_setLoss(float rate);
+uint32_t TwiEmu_nextUs(void);       /* completion time, or 0 if idle/lost */
+void TwiEmu_poll(void);
+
+uint32_t TwiEmu_bytes(void);        /* data bytes moved, all transfers */
+uint32_t TwiEmu_busUs(void);        /* bus time, all transfers */
+uint32_t TwiEmu_timeouts(void);     /* transfers expired by TWI_tickISR() */
+
+#endif /* TWI_EMU_H */
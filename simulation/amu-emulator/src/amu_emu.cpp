@@ -0,0 +1,264 @@
+#include <math.h>
+#include "Arduino.h"
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "amu.h"
+#include "crc32.h"
+#include "amu_emu.h"
+
+/* Local-scope objects -----------------------------------------------------*/
+static AmuEmu l_dev[AMU_EMU_MAX];
+static uint8_t l_nDev;
+static AmuEmuConfig l_cfg;
+static uint32_t l_rng;
+static uint32_t l_flips;
+static uint32_t l_nacks;
+
+static uint32_t rnd(void) {                 /* xorshift32 */
+    l_rng ^= l_rng << 13;
+    l_rng ^= l_rng >> 17;
+    l_rng ^= l_rng << 5;
+    return l_rng;
+}
+
+static float rndUnit(void) {                /* [0, 1) */
+    return (float)(rnd() >> 8) / 16777216.0f;
+}
+
+/* Solve the implicit diode equation for I at V by Newton's method */
+static float diodeCurrent(AmuEmuModel const *m, float v) {
+    float i = m->iph;
+    uint8_t k;
+
+    for (k = 0U; k < 30U; ++k) {
+        float e = expf((v + i * m->rs) / m->a);
+        float f = m->iph - m->i0 * (e - 1.0f) - (v + i * m->rs) / m->rsh - i;
+        float df = -m->i0 * e * m->rs / m->a - m->rs / m->rsh - 1.0f;
+        float step = f / df;
+        i -= step;
+        if (fabsf(step) < 1e-9f) {
+            break;
+        }
+    }
+    return i;
+}
+
+float AmuEmu_voc(AmuEmuModel const *m) {
+    float lo = 0.0f;
+    float hi = m->a * logf(m->iph / m->i0 + 1.0f) * 1.5f;
+    uint8_t k;
+
+    for (k = 0U; k < 40U; ++k) {            /* bisection on I(V) = 0 */
+        float mid = 0.5f * (lo + hi);
+        if (diodeCurrent(m, mid) > 0.0f) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return 0.5f * (lo + hi);
+}
+
+float AmuEmu_pmax(AmuEmuModel const *m) {
+    float lo = 0.0f;
+    float hi = AmuEmu_voc(m);
+    uint8_t k;
+
+    for (k = 0U; k < 60U; ++k) {            /* ternary search on V I(V) */
+        float v1 = lo + (hi - lo) / 3.0f;
+        float v2 = hi - (hi - lo) / 3.0f;
+        if (v1 * diodeCurrent(m, v1) < v2 * diodeCurrent(m, v2)) {
+            lo = v1;
+        }
+        else {
+            hi = v2;
+        }
+    }
+    return 0.5f * (lo + hi) * diodeCurrent(m, 0.5f * (lo + hi));
+}
+
+static void generateSweep(AmuEmu *d) {
+    AmuEmuModel const *m = &d->model;
+    ivsweep_meta_t *meta = &d->regs.meta;
+    float vEnd = AmuEmu_voc(m) * 1.02f;
+    uint32_t crc = CRC32_INIT;
+    uint8_t k;
+
+    memset(meta, 0, sizeof(*meta));
+    for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+        float v = (d->sweepType == AMU_SWEEP_TYPE_USER1) ? d->userTable[k]
+                  : vEnd * k / (IVSWEEP_POINTS - 1U);
+        float i = diodeCurrent(m, v) + m->noiseA * (2.0f * rndUnit() - 1.0f);
+        d->regs.timestamp[k] = (uint32_t)((uint64_t)l_cfg.sweepUs * k / IVSWEEP_POINTS);
+        d->regs.voltage[k] = v;
+        d->regs.current[k] = i;
+        if (v * i > meta->pmax) {
+            meta->pmax = v * i;
+            meta->vmax = v;
+            meta->imax = i;
+        }
+    }
+    meta->voc = AmuEmu_voc(m);
+    meta->isc = diodeCurrent(m, 0.0f);
+    meta->ff = meta->pmax / (meta->voc * meta->isc);
+    meta->tsensor_start = m->tempC;
+    meta->tsensor_end = m->tempC + 0.1f;
+    meta->timestamp = d->triggerMs;
+    crc = crc32_update(crc, (uint8_t const *)d->regs.timestamp, sizeof(d->regs.timestamp));
+    crc = crc32_update(crc, (uint8_t const *)d->regs.voltage, sizeof(d->regs.voltage));
+    crc = crc32_update(crc, (uint8_t const *)d->regs.current, sizeof(d->regs.current));
+    meta->crc = crc32_final(crc);
+    ++d->sweeps;
+}
+
+/* Lazily complete whatever the device was doing by now */
+static void update(AmuEmu *d) {
+    if (!d->sweeping || (int32_t)(g_emuUs - d->doneUs) < 0) {
+        return;
+    }
+    d->sweeping = false;
+    switch (d->pendingCmd) {
+        case (uint16_t)CMD_SWEEP_TRIG_SWEEP:
+            generateSweep(d);
+            break;
+        case (uint16_t)CMD_SWEEP_TRIG_ISC:
+            d->transfer.measurement = diodeCurrent(&d->model, 0.0f);
+            d->transfer.temperature = d->model.tempC;
+            break;
+        case (uint16_t)CMD_SWEEP_TRIG_VOC:
+            d->transfer.measurement = AmuEmu_voc(&d->model);
+            d->transfer.temperature = d->model.tempC;
+            break;
+        default:
+            break;
+    }
+}
+
+void AmuEmu_init(AmuEmuConfig const *cfg) {
+    l_cfg = *cfg;
+    l_rng = (cfg->seed != 0U) ? cfg->seed : 1U;
+    l_nDev = 0U;
+    l_flips = 0U;
+    l_nacks = 0U;
+}
+
+AmuEmu *AmuEmu_add(uint8_t addr, AmuEmuModel const *model) {
+    AmuEmu *d;
+
+    if (l_nDev == AMU_EMU_MAX) {
+        return (AmuEmu *)0;
+    }
+    d = &l_dev[l_nDev++];
+    memset(d, 0, sizeof(*d));
+    d->addr = addr;
+    d->model = *model;
+    return d;
+}
+
+AmuEmu *AmuEmu_find(uint8_t addr) {
+    uint8_t k;
+
+    for (k = 0U; k < l_nDev; ++k) {
+        if (l_dev[k].addr == addr) {
+            update(&l_dev[k]);
+            return &l_dev[k];
+        }
+    }
+    return (AmuEmu *)0;
+}
+
+bool AmuEmu_write(uint8_t addr, uint8_t reg, uint8_t const *buf, uint16_t len) {
+    AmuEmu *d = AmuEmu_find(addr);
+    uint16_t cmd;
+
+    if (d == (AmuEmu *)0) {
+        return false;
+    }
+    if (reg == AMU_REG_TRANSFER_PTR) {
+        memcpy(&d->transfer, buf, (len < sizeof(d->transfer)) ? len : sizeof(d->transfer));
+        return true;
+    }
+    if (reg == AMU_REG_DATA_PTR_USER_SWEEP) {
+        memcpy(d->userTable, buf, (len < sizeof(d->userTable)) ? len : sizeof(d->userTable));
+        return true;
+    }
+    if ((reg != AMU_REG_CMD) || (len < 2U)) {
+        return true;                        /* pointer set, or half a command */
+    }
+    if ((l_cfg.nack > 0.0f) && (rndUnit() < l_cfg.nack)) {
+        ++l_nacks;
+        return false;
+    }
+    cmd = (uint16_t)((buf[0] | (buf[1] << 8)) & ~CMD_READ);
+    if (cmd == (uint16_t)CMD_SWEEP_CONF_TYPE) {
+        d->sweepType = *(uint8_t const *)&d->transfer;
+        return true;
+    }
+    if ((cmd == (uint16_t)CMD_SWEEP_TRIG_SWEEP) || (cmd == (uint16_t)CMD_SWEEP_TRIG_ISC)
+        || (cmd == (uint16_t)CMD_SWEEP_TRIG_VOC)) {
+        d->pendingCmd = cmd;
+        d->sweeping = true;
+        d->earlyRead = false;
+        d->triggerMs = g_emuUs / 1000U;
+        d->doneUs = g_emuUs + ((cmd == (uint16_t)CMD_SWEEP_TRIG_SWEEP)
+                               ? l_cfg.sweepUs : l_cfg.queryUs);
+    }
+    return true;
+}
+
+bool AmuEmu_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len) {
+    AmuEmu *d = AmuEmu_find(addr);
+    uint8_t const *src;
+    uint16_t size;
+    uint16_t k;
+
+    if (d == (AmuEmu *)0) {
+        return false;
+    }
+    switch (reg) {
+        case AMU_REG_DATA_PTR_TIMESTAMP:
+            src = (uint8_t const *)d->regs.timestamp;
+            size = sizeof(d->regs.timestamp);
+            break;
+        case AMU_REG_DATA_PTR_VOLTAGE:
+            src = (uint8_t const *)d->regs.voltage;
+            size = sizeof(d->regs.voltage);
+            break;
+        case AMU_REG_DATA_PTR_CURRENT:
+            src = (uint8_t const *)d->regs.current;
+            size = sizeof(d->regs.current);
+            break;
+        case AMU_REG_DATA_PTR_SWEEP_META:
+            src = (uint8_t const *)&d->regs.meta;
+            size = sizeof(d->regs.meta);
+            if (d->sweeping && (d->pendingCmd == (uint16_t)CMD_SWEEP_TRIG_SWEEP)) {
+                d->earlyRead = true;
+            }
+            break;
+        case AMU_REG_TRANSFER_PTR:
+            src = (uint8_t const *)&d->transfer;
+            size = sizeof(d->transfer);
+            break;
+        default:
+            src = (uint8_t const *)0;
+            size = 0U;
+            break;
+    }
+    for (k = 0U; k < len; ++k) {
+        buf[k] = (k < size) ? src[k] : 0xFFU;   /* past the end reads 0xFF */
+        if ((l_cfg.ber > 0.0f) && (rndUnit() < l_cfg.ber * 8.0f)) {
+            buf[k] ^= (uint8_t)(1U << (rnd() & 7U));
+            ++l_flips;
+        }
+    }
+    return true;
+}
+
+uint32_t AmuEmu_bitFlips(void) {
+    return l_flips;
+}
+
+uint32_t AmuEmu_nacks(void) {
+    return l_nacks;
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include "Arduino.h"
+
+uint32_t g_emuUs;
+HostSerial Serial;
+
+unsigned long micros(void) {
+    return g_emuUs;
+}
+
+unsigned long millis(void) {
+    return g_emuUs / 1000UL;
+}
+
+void delay(unsigned long ms) {
+    g_emuUs += (uint32_t)(ms * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us) {
+    g_emuUs += us;
+}
+
+size_t HostSerial::write(uint8_t b) {
+    return verbose ? (size_t)(putchar(b) != EOF) : 1U;
+}
+
+/* nothing is ever received */
+int HostSerial::available() {
+    return 0;
+}
+
+int HostSerial::read() {
+    return -1;
+}
+
+size_t HostSerial::print(char const *s) {
+    return verbose ? (size_t)printf("%s", s) : strlen(s);
+}
+
+size_t HostSerial::print(char c) {
+    return verbose ? (size_t)printf("%c", c) : 1U;
+}
+
+size_t HostSerial::print(long n, int base) {
+    if (!verbose) {
+        return 0U;
+    }
+    return (size_t)((base == HEX) ? printf("%lX", (unsigned long)n) : printf("%ld", n));
+}
+
+size_t HostSerial::print(unsigned long n, int base) {
+    if (!verbose) {
+        return 0U;
+    }
+    return (size_t)((base == HEX) ? printf("%lX", n) : printf("%lu", n));
+}
+
+size_t HostSerial::print(double x, int digits) {
+    return verbose ? (size_t)printf("%.*f", digits, x) : 0U;
+}
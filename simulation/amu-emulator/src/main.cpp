@@ -0,0 +1,323 @@
+/* AMU driver bench ----------------------------------------------------------*/
+/*
+* Runs the flight AMU driver (firmware/src/peripherals/amu.cpp) against
+* emulated AMUs in virtual time: discovery, the parallel sweep trigger, the
+* timed harvest, CRC checks and retries. Every delivered sweep is compared
+* byte for byte with the emulator's registers and its extracted Voc with the
+* diode model. Rounds start at a random phase of the system tick. Exits
+* non-zero when a corrupted or stale sweep gets through, or when sweeps are
+* lost on a clean bus.
+*
+* With -k some command writes are NACKed: a cell whose configure or trigger
+* fails must be left out of that sweep, not harvested with its last data.
+*
+* With -t some asynchronous transfers never complete, as after a lost
+* interrupt: the tick must expire them and the round must still finish.
+*
+* With -g every cell is that many times the area of the default ones, its
+* currents scaled up and its resistances down; -g 100 gives cells of about
+* 3.5 W, past the int32_t range of Pmax in nW.
+*
+* With -a every round is an adaptive two-pass sweep; the Pmax error of the
+* best sampled point against the model shows what the knee placement buys.
+*
+* usage: amu-emulator [-n rounds] [-d devices] [-l sweep_ms] [-e bit_error_rate]
+*                     [-i noise_uA] [-k nack_rate] [-t lost_rate] [-g area]
+*                     [-s seed] [-a] [-v]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+#include "amu.h"
+#include "evt_pool.h"
+#include "iv_params.h"
+#include "twi.h"
+#include "amu_emu.h"
+#include "twi_emu.h"
+#include "bench.h"
+
+#define TICK_US (1000000UL / BSP_TICKS_PER_SEC)
+
+/* The bench active object plays the CubeSat's part towards the driver */
+typedef struct Bench {
+    QActive super;
+} Bench;
+
+static Bench l_bench;
+
+/* Local-scope objects -----------------------------------------------------*/
+static QEvt l_benchQSto[10];
+static ivsweep_t l_sweepPoolSto[1];
+
+static struct {
+    uint32_t rounds;
+    uint32_t refused;           /* driver still busy at the start of a round */
+    uint32_t delivered;
+    uint32_t corrupt;
+    uint32_t stale;
+    uint32_t metaErrors;
+    uint32_t pmaxMismatch;      /* Pmax off the AMU's best sample */
+    uint64_t busUs;
+    int32_t maxVocErrMv;
+    double pmaxErrSum;          /* relative */
+    uint32_t lastMs[AMU_EMU_MAX]; /* meta.timestamp last delivered per cell */
+} l_res;
+
+static bool l_adaptive;
+
+QActiveCB const Q_ROM QF_active[] = {
+    { (QActive *)0,        (QEvt *)0,   0U                 },
+    { (QActive *)&l_bench, l_benchQSto, Q_DIM(l_benchQSto) }
+};
+
+static void checkSweep(ivsweep_t const *sweep) {
+    AmuEmu *d = AmuEmu_find(sweep->address);
+    IvParams p;
+    int32_t err;
+
+    ++l_res.delivered;
+    l_res.busUs += sweep->bus_us;
+    if (d == (AmuEmu *)0) {
+        ++l_res.corrupt;
+        return;
+    }
+    /* the device had not finished: the driver read the previous sweep */
+    if (d->earlyRead) {
+        ++l_res.stale;
+        return;
+    }
+    /* the device was not triggered: the driver read the same sweep again */
+    if ((l_res.delivered > 1U) && (d->regs.meta.timestamp == l_res.lastMs[sweep->cell])) {
+        ++l_res.stale;
+        return;
+    }
+    l_res.lastMs[sweep->cell] = d->regs.meta.timestamp;
+    /* the CRC covers the arrays only, meta errors are counted apart */
+    if ((memcmp(sweep->timestamp, d->regs.timestamp, sizeof(sweep->timestamp)) != 0)
+        || (memcmp(sweep->voltage, d->regs.voltage, sizeof(sweep->voltage)) != 0)
+        || (memcmp(sweep->current, d->regs.current, sizeof(sweep->current)) != 0)) {
+        ++l_res.corrupt;
+        return;
+    }
+    if (memcmp(&sweep->meta, &d->regs.meta, sizeof(sweep->meta)) != 0) {
+        ++l_res.metaErrors;
+    }
+    IvParams_extract(sweep, &p);
+    if ((IvParams_check(&p, &d->regs.meta) & IV_MISMATCH_PMAX) != 0U) {
+        ++l_res.pmaxMismatch;
+    }
+    l_res.pmaxErrSum += 1.0 - p.pmax_uW / (AmuEmu_pmax(&d->model) * 1e6);
+    err = p.voc_mV - (int32_t)(AmuEmu_voc(&d->model) * 1000.0f + 0.5f);
+    if (err < 0) {
+        err = -err;
+    }
+    if (err > l_res.maxVocErrMv) {
+        l_res.maxVocErrMv = err;
+    }
+}
+
+static QState Bench_run(Bench * const me) {
+    QState status_;
+    switch (Q_SIG(me)) {
+        case DUMMY_SIG: {
+            /* start of a round */
+            if (l_adaptive ? amu_sweep_adaptive(&me->super) : amu_sweep_all(&me->super)) {
+                ++l_res.rounds;
+            }
+            else {
+                ++l_res.refused;
+            }
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_TIMEOUT_SIG: {
+            amu_on_timeout();
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_TWI_DONE_SIG: {
+            amu_on_twi_done(Q_PAR(me));
+            status_ = Q_HANDLED();
+            break;
+        }
+        case Q_SWEEP_SIG: {
+            ivsweep_t const *sweep = (ivsweep_t const *)EvtPool_data(&g_sweepPool, (EvtHandle)Q_PAR(me));
+            if (sweep != (ivsweep_t const *)0) {
+                checkSweep(sweep);
+            }
+            EvtPool_unref(&g_sweepPool, (EvtHandle)Q_PAR(me));
+            amu_on_sweep_released();
+            status_ = Q_HANDLED();
+            break;
+        }
+        default: {
+            status_ = Q_SUPER(&QHsm_top);
+            break;
+        }
+    }
+    return status_;
+}
+
+static QState Bench_initial(Bench * const me) {
+    (void)me;
+    return Q_TRAN(&Bench_run);
+}
+
+/* One pass of the QV-nano event loop: run every queued event to completion */
+static void drainQueue(void) {
+    QActive * const a = &l_bench.super;
+    QActiveCB const Q_ROM *acb = &QF_active[a->prio];
+
+    while (a->nUsed > 0U) {
+        --a->nUsed;
+        Q_SIG(a) = QF_ROM_QUEUE_AT_(acb, a->tail).sig;
+        Q_PAR(a) = QF_ROM_QUEUE_AT_(acb, a->tail).par;
+        if (a->tail == 0U) { /* wrap around? */
+            a->tail = Q_ROM_BYTE(acb->qlen);
+        }
+        --a->tail;
+        QHSM_DISPATCH(&a->super);
+    }
+    QF_readySet_ &= (uint_fast8_t)~(1U << (a->prio - 1U));
+}
+
+static void addDevices(uint8_t n, uint32_t seed, float noiseA, float area) {
+    uint8_t k;
+
+    srand(seed);
+    for (k = 0U; k < n; ++k) {
+        AmuEmuModel m;
+        m.iph = 0.015f + 0.005f * (float)rand() / RAND_MAX;
+        m.i0 = 1e-13f * (1.0f + 9.0f * (float)rand() / RAND_MAX);
+        m.a = 0.09f + 0.03f * (float)rand() / RAND_MAX;
+        m.rs = 0.5f + 2.5f * (float)rand() / RAND_MAX;
+        m.rsh = 500.0f + 4500.0f * (float)rand() / RAND_MAX;
+        m.tempC = 20.0f + 10.0f * (float)rand() / RAND_MAX;
+        m.noiseA = noiseA;
+        m.iph *= area;
+        m.i0 *= area;
+        m.rs /= area;
+        m.rsh /= area;
+        AmuEmu_add((uint8_t)(AMU_TWI_ADDR_FIRST + k), &m);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    AmuEmuConfig cfg = { 1500000UL, 100000UL, 0.0f, 0.0f, 1U };
+    uint32_t nRounds = 100U;
+    uint8_t nDev = 1U;
+    float noiseA = 20e-6f;
+    float lost = 0.0f;
+    float area = 1.0f;
+    uint32_t nextTickUs = TICK_US;
+    uint32_t jitterUs;
+    clock_t wall;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:l:e:i:k:t:g:s:av")) != -1) {
+        switch (opt) {
+            case 'n': nRounds = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'd': nDev = (uint8_t)strtoul(optarg, 0, 0); break;
+            case 'l': cfg.sweepUs = (uint32_t)(strtod(optarg, 0) * 1000.0); break;
+            case 'e': cfg.ber = (float)strtod(optarg, 0); break;
+            case 'i': noiseA = (float)(strtod(optarg, 0) * 1e-6); break;
+            case 'k': cfg.nack = (float)strtod(optarg, 0); break;
+            case 't': lost = (float)strtod(optarg, 0); break;
+            case 'g': area = (float)strtod(optarg, 0); break;
+            case 's': cfg.seed = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'a': l_adaptive = true; break;
+            case 'v': Serial.verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-d devices] [-l sweep_ms] "
+                        "[-e bit_error_rate] [-i noise_uA] [-k nack_rate] [-t lost_rate] "
+                        "[-g area] [-s seed] [-a] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    AmuEmu_init(&cfg);
+    addDevices(nDev, cfg.seed, noiseA, area);
+    TwiEmu_setLoss(lost);
+
+    QF_init(Q_DIM(QF_active));
+    EvtPool_init(&g_sweepPool, l_sweepPoolSto, sizeof(l_sweepPoolSto), sizeof(l_sweepPoolSto[0]));
+    amu_init();
+    printf("AMU bench: %u of %u emulated AMUs found, sweep %lu ms, BER %g, NACK %g, "
+           "lost %g\n", amu_discover(), nDev, (unsigned long)(cfg.sweepUs / 1000U),
+           cfg.ber, cfg.nack, lost);
+
+    QActive_ctor(&l_bench.super, Q_STATE_CAST(&Bench_initial));
+    l_bench.super.prio = 1U;  /* normally assigned by QF_run() */
+    QHsm_init_(&l_bench.super.super);
+
+    wall = clock();
+    for (;;) {
+        drainQueue();
+        if (!TWI_isBusy() && (l_bench.super.tickCtr[0].nTicks == 0U)) {
+            if ((l_res.rounds == nRounds) || (l_res.refused != 0U)) {
+                break;
+            }
+            /* start the next round at a random phase of the tick */
+            jitterUs = g_emuUs + (uint32_t)rand() % TICK_US;
+            while ((int32_t)(jitterUs - nextTickUs) >= 0) {
+                g_emuUs = nextTickUs;
+                nextTickUs += TICK_US;
+                TWI_tickISR();
+                QueueStats_tickXISR(0U);
+            }
+            g_emuUs = jitterUs;
+            QueueStats_post(&l_bench.super, DUMMY_SIG, 0U);
+            continue;
+        }
+        /* jump the virtual clock to whatever happens next */
+        if ((TwiEmu_nextUs() != 0U) && ((int32_t)(TwiEmu_nextUs() - nextTickUs) < 0)) {
+            g_emuUs = TwiEmu_nextUs();
+            TwiEmu_poll();
+        }
+        else {
+            g_emuUs = nextTickUs;
+            nextTickUs += TICK_US;
+            TWI_tickISR();
+            QueueStats_tickXISR(0U);
+        }
+    }
+    wall = clock() - wall;
+
+    printf("%lu rounds, %lu sweeps in %.1f s virtual, %.3f s host\n",
+           (unsigned long)l_res.rounds, (unsigned long)l_res.delivered,
+           g_emuUs / 1e6, (double)wall / CLOCKS_PER_SEC);
+    printf("TWI %lu bytes, %.1f ms bus total, %.2f ms per delivered sweep\n",
+           (unsigned long)TwiEmu_bytes(), TwiEmu_busUs() / 1e3,
+           l_res.delivered ? l_res.busUs / 1e3 / l_res.delivered : 0.0);
+    printf("Corrupt %lu, stale %lu, meta errors %lu, bit flips %lu, NACKs %lu, "
+           "timeouts %lu, max Voc error %ld mV\n",
+           (unsigned long)l_res.corrupt, (unsigned long)l_res.stale,
+           (unsigned long)l_res.metaErrors, (unsigned long)AmuEmu_bitFlips(),
+           (unsigned long)AmuEmu_nacks(), (unsigned long)TwiEmu_timeouts(),
+           (long)l_res.maxVocErrMv);
+    printf("Mean Pmax shortfall of the best sample %.3f%%, %lu Pmax mismatches\n",
+           l_res.delivered ? 100.0 * l_res.pmaxErrSum / l_res.delivered : 0.0,
+           (unsigned long)l_res.pmaxMismatch);
+    Serial.verbose = true;
+    amu_report();
+
+    Bench_check(l_res.corrupt == 0U, "no corrupted sweep delivered");
+    Bench_check(l_res.stale == 0U, "no stale sweep delivered");
+    Bench_check(l_res.pmaxMismatch == 0U, "Pmax of every sweep matches the AMU's");
+    Bench_check(l_res.refused == 0U, "no round refused by a driver still busy");
+    Bench_check((cfg.ber != 0.0f) || (cfg.nack != 0.0f) || (lost != 0.0f)
+                || (l_res.delivered == l_res.rounds * nDev),
+                "every sweep delivered on a clean bus");
+    return Bench_finish();
+}
+
+extern "C" Q_NORETURN Q_onAssert(char_t const Q_ROM * const module, int_t const location) {
+    fprintf(stderr, "Assertion failed in %s:%d\n", module, (int)location);
+    exit(3);
+}
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+
+#include "Arduino.h"
+#include "qpn.h"            /* QP-nano framework API */
+#include "bsp.h"            /* Board Support Package interface */
+#include "queue_stats.h"
+#include "amu.h"
+#include "twi.h"
+#include "amu_emu.h"
+#include "twi_emu.h"
+
+/* Local-scope objects -----------------------------------------------------*/
+static bool l_busy;
+static uint32_t l_doneUs;
+static uint32_t l_lastUs;
+static QParam l_par;
+static QActive *l_owner;
+static enum_t l_sig;
+static uint32_t l_bytes;
+static uint32_t l_busTotalUs;
+static float l_loss;
+static bool l_lost;             /* completion interrupt will never come */
+static uint8_t l_ticksLeft;
+static uint32_t l_timeouts;
+
+static uint32_t clocksToUs(uint32_t clocks) {
+    return (uint32_t)(((uint64_t)clocks * 1000000UL + TWI_FREQ_HZ - 1U) / TWI_FREQ_HZ);
+}
+
+/* START SLA+W reg, then for reads REPEATED START SLA+R and the data */
+static uint32_t segClocks(bool read, uint16_t len) {
+    return 1U + 9U + 9U + (read ? (1U + 9U) : 0U) + 9U * len;
+}
+
+static TwiStatus readSeq(uint8_t addr, TwiSeg const *seg, uint8_t nSeg,
+                         uint16_t *total, uint32_t *clocks) {
+    uint8_t k;
+
+    *total = 0U;
+    *clocks = 1U;                               /* STOP */
+    for (k = 0U; k < nSeg; ++k) {
+        if (!AmuEmu_read(addr, seg[k].reg, seg[k].buf, seg[k].len)) {
+            *clocks += 10U;                     /* START + NACKed SLA */
+            return TWI_NACK_ADDR;
+        }
+        *total += seg[k].len;
+        *clocks += segClocks(true, seg[k].len);
+    }
+    return TWI_OK;
+}
+
+static void account(uint16_t total, uint32_t clocks) {
+    l_lastUs = clocksToUs(clocks);
+    l_bytes += total;
+    l_busTotalUs += l_lastUs;
+}
+
+static bool startAsync(TwiStatus status, uint16_t total, uint32_t clocks,
+                       QActive * const owner, enum_t sig) {
+    account(total, clocks);
+    l_busy = true;
+    l_doneUs = g_emuUs + l_lastUs;
+    l_par = (QParam)status | ((QParam)total << 16);
+    l_owner = owner;
+    l_sig = sig;
+    l_ticksLeft = TWI_ASYNC_TIMEOUT_TICKS;
+    l_lost = (l_loss > 0.0f) && ((float)rand() < l_loss * (float)RAND_MAX);
+    return true;
+}
+
+void TWI_init(uint32_t freq) {
+    (void)freq;
+    l_busy = false;
+}
+
+bool TWI_startRead(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len,
+                   QActive * const owner, enum_t sig) {
+    TwiSeg seg = { reg, buf, len };
+
+    return TWI_startReadSeq(addr, &seg, 1U, owner, sig);
+}
+
+bool TWI_startReadSeq(uint8_t addr, TwiSeg const *seg, uint8_t nSeg,
+                      QActive * const owner, enum_t sig) {
+    uint16_t total;
+    uint32_t clocks;
+    TwiStatus status;
+
+    if (l_busy || (nSeg == 0U)) {
+        return false;
+    }
+    status = readSeq(addr, seg, nSeg, &total, &clocks);
+    return startAsync(status, total, clocks, owner, sig);
+}
+
+bool TWI_startWrite(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len, QActive * const owner, enum_t sig) {
+    bool ack;
+
+    if (l_busy) {
+        return false;
+    }
+    ack = AmuEmu_write(addr, reg, buf, len);
+    return startAsync(ack ? TWI_OK : TWI_NACK_ADDR, ack ? len : 0U,
+                      ack ? segClocks(false, len) + 1U : 11U, owner, sig);
+}
+
+bool TWI_isBusy(void) {
+    return l_busy;
+}
+
+uint32_t TWI_lastTransferUs(void) {
+    return l_lastUs;
+}
+
+void TWI_abort(void) {
+    l_busy = false;
+}
+
+void TWI_tickISR(void) {
+    if (l_busy && (--l_ticksLeft == 0U)) {
+        l_busy = false;
+        ++l_timeouts;
+        if (l_owner != (QActive *)0) {
+            QueueStats_postISR(l_owner, l_sig, (QParam)TWI_TIMEOUT | (l_par & 0xFFFF0000UL));
+        }
+    }
+}
+
+TwiStatus TWI_probe(uint8_t addr) {
+    if (l_busy) {
+        return TWI_BUS_ERROR;
+    }
+    account(0U, 11U);                           /* START SLA+W STOP */
+    g_emuUs += l_lastUs;
+    return (AmuEmu_find(addr) != (AmuEmu *)0) ? TWI_OK : TWI_NACK_ADDR;
+}
+
+TwiStatus TWI_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len) {
+    TwiSeg seg = { reg, buf, len };
+    uint16_t total;
+    uint32_t clocks;
+    TwiStatus status;
+
+    if (l_busy) {
+        return TWI_BUS_ERROR;
+    }
+    status = readSeq(addr, &seg, 1U, &total, &clocks);
+    account(total, clocks);
+    g_emuUs += l_lastUs;
+    return status;
+}
+
+TwiStatus TWI_write(uint8_t addr, uint8_t reg, uint8_t const *buf,
+                    uint16_t len) {
+    bool ack;
+
+    if (l_busy) {
+        return TWI_BUS_ERROR;
+    }
+    ack = AmuEmu_write(addr, reg, buf, len);
+    account(ack ? len : 0U, ack ? segClocks(false, len) + 1U : 11U);
+    g_emuUs += l_lastUs;
+    return ack ? TWI_OK : TWI_NACK_ADDR;
+}
+
+void TwiEmu_setLoss(float rate) {
+    l_loss = rate;
+}
+
+uint32_t TwiEmu_nextUs(void) {
+    return (l_busy && !l_lost) ? l_doneUs : 0U;
+}
+
+void TwiEmu_poll(void) {
+    if (l_busy && !l_lost && (int32_t)(g_emuUs - l_doneUs) >= 0) {
+        l_busy = false;
+        if (l_owner != (QActive *)0) {
+            QueueStats_postISR(l_owner, l_sig, l_par);
+        }
+    }
+}
+
+uint32_t TwiEmu_bytes(void) {
+    return l_bytes;
+}
+
+uint32_t TwiEmu_busUs(void) {
+    return l_busTotalUs;
+}
+
+uint32_t TwiEmu_timeouts(void) {
+    return l_timeouts;
+}
@@ -0,0 +1,339 @@
+/* AX.25 framing bench ------------------------------------------------------*/
+/*
+* Runs the flight framing (firmware/src/messages.cpp) and the RADIO_AX25
+* build of firmware/src/peripherals/radio.cpp against a ground deframer:
+*
+*   - the FCS and the header match the AX.25 references;
+*   - frames gathered from random segment lists come out of the HDLC
+*     encoder as flags, stuffed bits and FCS that deframe to the same bytes,
+*     and every single-bit error on air is caught;
+*   - frames written through Radio_begin/writev/end come out of the serial
+*     capture as KISS frames carrying the same header and info;
+*   - stuffing overhead, encoder speed and the encoder state, which is all
+*     the RAM a frame takes whatever its length.
+*
+* Exits non-zero when a check fails.
+*
+* usage: ax25-bench [-n frames] [-s seed]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "qpn.h"
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "radio.h"
+#include "host_serial.h"
+#include "bench.h"
+
+#define FRAME_MAX       (AX25_HEADER_LEN + AX25_INFO_MAX + 2)
+#define FRAME_BUF       (FRAME_MAX + 1) /* and the flag bits taken as data */
+#define AIR_MAX         (2 * FRAME_MAX + 16)
+#define SEGMENTS_MAX    8U
+
+
+/* Air side ----------------------------------------------------------------*/
+static uint8_t l_air[AIR_MAX];
+static uint16_t l_airLen;
+
+static void airOut(uint8_t b) {
+    if (l_airLen < sizeof(l_air)) {
+        l_air[l_airLen++] = b;
+    }
+}
+
+/* Ground HDLC receiver: bits first-in-bit-0, flags delimit frames; returns
+* the length of the first frame with a good FCS (FCS included), 0 if none */
+static uint16_t deframe(uint8_t const *air, uint16_t len, uint8_t *frame) {
+    uint32_t bits = 0U;                 /* frame bits collected */
+    uint8_t ones = 0U;
+    bool open = false;
+    uint32_t i;
+
+    memset(frame, 0, FRAME_BUF);
+    for (i = 0U; i < 8U * len; ++i) {
+        uint8_t b = (uint8_t)((air[i >> 3] >> (i & 7U)) & 1U);
+
+        if (ones == 6U) {
+            if (b == 0U) {              /* flag: 0 111111 0 */
+                /* its leading 0 and five 1s went in as data */
+                uint32_t n = (bits >= 6U) ? bits - 6U : 0U;
+                if (open && (n >= 16U) && ((n & 7U) == 0U)
+                    && (Ax25_fcs(AX25_FCS_INIT, frame, (uint16_t)(n / 8U)) == AX25_FCS_GOOD)) {
+                    return (uint16_t)(n / 8U);
+                }
+                open = true;
+            }
+            else {
+                open = false;           /* seven 1s: abort */
+            }
+            memset(frame, 0, FRAME_BUF);
+            bits = 0U;
+            ones = 0U;
+            continue;
+        }
+        if (ones == 5U) {
+            if (b == 0U) {
+                ones = 0U;              /* stuffed */
+                continue;
+            }
+            ones = 6U;
+            continue;
+        }
+        if (bits < 8U * FRAME_BUF) {
+            frame[bits >> 3] |= (uint8_t)(b << (bits & 7U));
+            ++bits;
+        }
+        ones = (b != 0U) ? (uint8_t)(ones + 1U) : 0U;
+    }
+    return 0U;
+}
+
+static uint8_t l_info[AX25_INFO_MAX];
+static MsgSegment l_seg[SEGMENTS_MAX + 1U];
+
+/* Random info split into random segments after the header */
+static uint8_t randomFrame(uint8_t const *hdr, uint16_t len) {
+    uint8_t n = 1U;
+    uint16_t at = 0U;
+    uint16_t i;
+
+    for (i = 0U; i < len; ++i) {
+        l_info[i] = (uint8_t)Bench_rng();
+        if ((Bench_rng() & 7U) == 0U) {
+            l_info[i] = (Bench_rng() & 1U) ? KISS_FEND : HDLC_FLAG;
+        }
+    }
+    l_seg[0].data = hdr;
+    l_seg[0].len = AX25_HEADER_LEN;
+    while ((at < len) && (n < SEGMENTS_MAX + 1U)) {
+        uint16_t piece = (n == SEGMENTS_MAX) ? (uint16_t)(len - at)
+                                             : (uint16_t)(1U + Bench_rng() % (len - at));
+        l_seg[n].data = &l_info[at];
+        l_seg[n].len = piece;
+        at = (uint16_t)(at + piece);
+        ++n;
+    }
+    return n;
+}
+
+static uint16_t sendHdlc(MsgSegment const *seg, uint8_t n, uint8_t flags) {
+    Hdlc hdlc;
+
+    l_airLen = 0U;
+    Hdlc_begin(&hdlc, &airOut, flags);
+    Hdlc_writev(&hdlc, seg, n);
+    Hdlc_end(&hdlc);
+    return l_airLen;
+}
+
+static void references(uint8_t const *hdr) {
+    static uint8_t const expect[AX25_HEADER_LEN] = {
+        'C' << 1, 'Q' << 1, ' ' << 1, ' ' << 1, ' ' << 1, ' ' << 1, 0xE0,
+        'N' << 1, '0' << 1, 'C' << 1, 'A' << 1, 'L' << 1, 'L' << 1, 0x61,
+        AX25_CONTROL_UI, AX25_PID_NONE
+    };
+    uint8_t check9[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9', 0x6E, 0x90 };
+
+    Bench_check(Ax25_fcsFinal(Ax25_fcs(AX25_FCS_INIT, check9, 9U)) == 0x906EU,
+          "CRC-16/X.25 check value");
+    Bench_check(Ax25_fcs(AX25_FCS_INIT, check9, sizeof(check9)) == AX25_FCS_GOOD,
+          "FCS residue");
+    Bench_check(memcmp(hdr, expect, sizeof(expect)) == 0, "UI header CQ <- N0CALL");
+}
+
+static void hdlcRoundTrip(uint8_t const *hdr, uint32_t frames) {
+    static uint8_t frame[FRAME_BUF];
+    uint32_t missed = 0U;
+    uint32_t flips = 0U;
+    uint32_t f;
+
+    for (f = 0U; f < frames; ++f) {
+        uint16_t len = (uint16_t)(Bench_rng() % (AX25_INFO_MAX + 1U));
+        uint8_t n = randomFrame(hdr, len);
+        uint16_t air = sendHdlc(l_seg, n, (uint8_t)(1U + f % 3U));
+        uint16_t got = deframe(l_air, air, frame);
+        uint32_t bit;
+
+        Bench_check(got == AX25_HEADER_LEN + len + 2U, "deframed length");
+        Bench_check((memcmp(frame, hdr, AX25_HEADER_LEN) == 0)
+              && (memcmp(&frame[AX25_HEADER_LEN], l_info, len) == 0), "deframed bytes");
+
+        /* one bit error between the opening flags and the closing flag */
+        bit = 8U * (1U + f % 3U) + (uint32_t)(Bench_rng() % (8U * air - 8U * (3U + f % 3U)));
+        l_air[bit >> 3] ^= (uint8_t)(1U << (bit & 7U));
+        if (deframe(l_air, air, frame) == AX25_HEADER_LEN + len + 2U) {
+            ++missed;
+        }
+        ++flips;
+    }
+    Bench_check(missed == 0U, "single-bit errors detected");
+    printf("HDLC: %lu frames of 0..%u info bytes in up to %u segments deframed; "
+           "%lu of %lu single-bit errors detected\n", (unsigned long)frames,
+           AX25_INFO_MAX, SEGMENTS_MAX, (unsigned long)(flips - missed), (unsigned long)flips);
+}
+
+/* Flight KISS output ------------------------------------------------------*/
+static uint16_t unkiss(uint8_t const *p, size_t len, size_t *at, uint8_t *frame) {
+    uint16_t n = 0U;
+    bool esc = false;
+    bool inFrame = false;
+
+    for (; *at < len; ++*at) {
+        uint8_t b = p[*at];
+
+        if (b == KISS_FEND) {
+            if (inFrame && (n > 1U)) {
+                ++*at;
+                return n;
+            }
+            inFrame = true;
+            n = 0U;
+            continue;
+        }
+        if (!inFrame) {
+            continue;                   /* debug text */
+        }
+        if (esc) {
+            b = (b == KISS_TFEND) ? KISS_FEND : (b == KISS_TFESC) ? KISS_FESC : b;
+            esc = false;
+        }
+        else if (b == KISS_FESC) {
+            esc = true;
+            continue;
+        }
+        if (n < FRAME_MAX + 1U) {
+            frame[n++] = b;
+        }
+    }
+    return 0U;
+}
+
+static void kissRoundTrip(uint8_t const *hdr, uint32_t frames) {
+    static uint8_t frame[FRAME_MAX + 1U];
+    static uint8_t air[FRAME_BUF];
+    uint8_t const *cap;
+    size_t capLen;
+    size_t at = 0U;
+    uint32_t f;
+
+    for (f = 0U; f < frames; ++f) {
+        uint16_t len = (uint16_t)(Bench_rng() % (AX25_INFO_MAX + 1U));
+        uint8_t n = randomFrame(hdr, len);
+        uint16_t got;
+
+        HostSerial_clear();
+        Radio_begin();
+        Radio_writev(&l_seg[1], (uint8_t)(n - 1U));
+        Radio_end();
+        cap = HostSerial_capture(&capLen);
+        at = 0U;
+        got = unkiss(cap, capLen, &at, frame);
+        Bench_check(got == 1U + AX25_HEADER_LEN + len, "KISS frame length");
+        Bench_check((frame[0] == KISS_DATA) && (memcmp(&frame[1], hdr, AX25_HEADER_LEN) == 0)
+              && (memcmp(&frame[1 + AX25_HEADER_LEN], l_info, len) == 0), "KISS frame bytes");
+
+        /* what the TNC puts on air is what Hdlc_* makes of the same bytes */
+        got = deframe(l_air, sendHdlc(l_seg, n, 1U), air);
+        Bench_check((got == AX25_HEADER_LEN + len + 2U)
+              && (memcmp(air, &frame[1], AX25_HEADER_LEN + len) == 0), "KISS matches HDLC");
+    }
+    HostSerial_clear();
+    printf("KISS: %lu frames through Radio_writev() match the HDLC frames\n",
+           (unsigned long)frames);
+}
+
+/* Cost --------------------------------------------------------------------*/
+static void overhead(uint8_t const *hdr, uint32_t frames) {
+    uint64_t payloadBits = 0U;
+    uint64_t airBits = 0U;
+    uint16_t len;
+    uint32_t f;
+    uint8_t n;
+
+    for (f = 0U; f < frames; ++f) {
+        n = randomFrame(hdr, 200U);
+        for (len = 0U; len < 200U; ++len) {
+            l_info[len] = (uint8_t)Bench_rng();   /* plain random data */
+        }
+        payloadBits += 8U * (AX25_HEADER_LEN + 200U + 2U);
+        airBits += 8U * sendHdlc(l_seg, n, 1U) - 16U;       /* less the flags */
+    }
+    memset(l_info, 0xFF, sizeof(l_info));
+    l_seg[1].data = l_info;
+    l_seg[1].len = sizeof(l_info);
+    len = sendHdlc(l_seg, 2U, 1U);
+    printf("Stuffing: %.2f%% on random data, %.1f%% on %u bytes of 0xFF; "
+           "RADIO_AIR_BYTES(200) = %u\n",
+           100.0 * ((double)airBits / payloadBits - 1.0),
+           100.0 * ((8.0 * len - 16.0) / (8.0 * (AX25_HEADER_LEN + AX25_INFO_MAX + 2U)) - 1.0),
+           AX25_INFO_MAX, (unsigned)RADIO_AIR_BYTES(200U));
+}
+
+static void speed(uint8_t const *hdr, uint32_t frames) {
+    Kiss kiss;
+    double hdlcTime;
+    double kissTime;
+    double t0;
+    uint32_t f;
+    uint8_t n = randomFrame(hdr, 200U);
+
+    t0 = Bench_seconds();
+    for (f = 0U; f < frames; ++f) {
+        sendHdlc(l_seg, n, 1U);
+    }
+    hdlcTime = Bench_seconds() - t0;
+    t0 = Bench_seconds();
+    for (f = 0U; f < frames; ++f) {
+        l_airLen = 0U;
+        Kiss_begin(&kiss, &airOut);
+        Kiss_writev(&kiss, l_seg, n);
+        Kiss_end(&kiss);
+    }
+    kissTime = Bench_seconds() - t0;
+    printf("Host speed, per 200-byte frame: HDLC %.2f us, KISS %.2f us\n",
+           1e6 * hdlcTime / frames, 1e6 * kissTime / frames);
+    printf("RAM per frame, any length: Hdlc %u bytes, Kiss %u, and one MsgSegment "
+           "(%u) per part\n", (unsigned)sizeof(Hdlc), (unsigned)sizeof(Kiss),
+           (unsigned)sizeof(MsgSegment));
+}
+
+int main(int argc, char *argv[]) {
+    uint8_t hdr[AX25_HEADER_LEN];
+    uint32_t frames = 2000U;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': frames = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': Bench_seed(strtoull(optarg, 0, 0)); break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (frames == 0U) {
+        fprintf(stderr, "need a nonzero number of frames\n");
+        return 2;
+    }
+
+    Radio_init();
+    HostSerial_clear();
+    Ax25_header(hdr, AX25_DEST, AX25_CALLSIGN, AX25_SSID);
+
+    references(hdr);
+    hdlcRoundTrip(hdr, frames);
+    kissRoundTrip(hdr, frames);
+    overhead(hdr, frames);
+    speed(hdr, frames);
+
+    return Bench_finish();
+}
@@ -0,0 +1,255 @@
+/* Beacon bench --------------------------------------------------------------*/
+/*
+* Runs the flight beacon (firmware/src/beacon.cpp) on the radio build it is
+* compiled for (see the makefile: RS codewords, RS + convolutional, AX.25):
+*
+*   - after every one of -n Beacon_send() calls with random field changes,
+*     the patched check equals Radio_check() over the whole frame (not
+*     under AX.25, which keeps no check), the frame holds the fields, and
+*     the serial output is byte for byte what Radio_begin/write/end send
+*     for the same frame;
+*   - the cost of a beacon, patched, against building the record and
+*     encoding it through Radio_begin/write/end every time.
+*
+* Exits non-zero when a check fails.
+*
+* usage: beacon-bench [-n beacons] [-s seed]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "qpn.h"
+#include "log_store.h"
+#include "messages.h"
+#include "radio.h"
+#include "beacon.h"
+#include "host_serial.h"
+#include "bench.h"
+
+#if defined(RADIO_AX25)
+#define BUILD "AX.25"
+#elif defined(RADIO_CONVOLUTIONAL)
+#define BUILD "RS + convolutional"
+#else
+#define BUILD "RS"
+#endif
+
+static uint8_t l_sent[1024];
+
+static uint32_t getLe(uint8_t const *p, uint8_t n) {
+    uint32_t v = 0U;
+
+    while (n-- != 0U) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+/* The fields as Beacon_send() should have left them */
+static bool holds(Beacon const *b, BeaconFields const *f) {
+    uint8_t const *p = &b->frame[BEACON_LEN - BEACON_TAIL];
+
+    return (getLe(&b->frame[0], 2U) == BEACON_SEQ) && (b->frame[2] == LOG_REC_BEACON)
+           && (getLe(&b->frame[4], 4U) == 0U) && (b->frame[8] == BEACON_PAYLOAD)
+           && (b->frame[BEACON_HEAD] == BEACON_VERSION)
+           && (getLe(&p[0], 2U) == f->battery) && (p[2] == f->state)
+           && (getLe(&p[3], 2U) == f->commands) && (getLe(&p[5], 2U) == f->lost)
+           && (getLe(&p[7], 2U) == f->unsent) && (getLe(&p[9], 4U) == f->uptime)
+           && (getLe(&p[13], 2U) == b->count);
+}
+
+/* As a beacon would be sent without the template */
+static void serialize(uint8_t *frame, BeaconFields const *f, uint16_t count) {
+    uint8_t *p = frame;
+    uint8_t i;
+
+    memset(frame, 0, BEACON_LEN);
+    p[0] = (uint8_t)BEACON_SEQ;
+    p[1] = (uint8_t)(BEACON_SEQ >> 8);
+    p[2] = LOG_REC_BEACON;
+    p[3] = LOG_TAG_NONE;
+    p[8] = BEACON_PAYLOAD;
+    p += BEACON_HEAD;
+    *p++ = BEACON_VERSION;
+    for (i = 0U; i < BEACON_CALL_LEN; ++i) {
+        *p++ = (i < sizeof(AX25_CALLSIGN) - 1U) ? (uint8_t)AX25_CALLSIGN[i] : (uint8_t)' ';
+    }
+    *p++ = (uint8_t)f->battery;
+    *p++ = (uint8_t)(f->battery >> 8);
+    *p++ = f->state;
+    *p++ = (uint8_t)f->commands;
+    *p++ = (uint8_t)(f->commands >> 8);
+    *p++ = (uint8_t)f->lost;
+    *p++ = (uint8_t)(f->lost >> 8);
+    *p++ = (uint8_t)f->unsent;
+    *p++ = (uint8_t)(f->unsent >> 8);
+    for (i = 0U; i < 4U; ++i) {
+        *p++ = (uint8_t)(f->uptime >> (8U * i));
+    }
+    *p++ = (uint8_t)count;
+    *p++ = (uint8_t)(count >> 8);
+}
+
+/* A second of mission: uptime always moves, the rest now and then */
+static void step(BeaconFields *f) {
+    f->uptime += BEACON_PERIOD_S;
+    if ((rand() % 4) == 0) {
+        f->battery = (uint16_t)(f->battery + rand() % 21 - 10);
+    }
+    if ((rand() % 8) == 0) {
+        f->state = (uint8_t)(rand() % (BEACON_ST_RECEIVE + 1));
+    }
+    if ((rand() % 16) == 0) {
+        f->commands = (uint16_t)(f->commands + 1U);
+    }
+    if ((rand() % 2) == 0) {
+        f->unsent = (uint16_t)(f->unsent + rand() % 5);
+    }
+    if ((rand() % 64) == 0) {
+        f->lost = (uint16_t)(f->lost + 1U);
+    }
+    if ((rand() % 256) == 0) {
+        f->uptime = (uint32_t)rand();   /* a reset, or a time fix */
+    }
+}
+
+static void roundTrip(uint32_t beacons) {
+    BeaconFields f;
+#ifndef RADIO_AX25
+    uint8_t check_[RADIO_CHECK_LEN];
+#endif
+    uint8_t frame[BEACON_LEN];
+    uint8_t const *cap;
+    size_t sentLen;
+    size_t capLen;
+    uint32_t i;
+    bool same = true;
+    bool checks = true;
+    bool fields = true;
+
+    memset(&f, 0, sizeof(f));
+    f.battery = 2400U;
+    Beacon_init(&g_beacon);
+    for (i = 0U; i < beacons; ++i) {
+        step(&f);
+        HostSerial_clear();
+        Beacon_send(&g_beacon, &f);
+        cap = HostSerial_capture(&sentLen);
+        if (sentLen > sizeof(l_sent)) {
+            sentLen = sizeof(l_sent);
+        }
+        memcpy(l_sent, cap, sentLen);
+
+#ifndef RADIO_AX25
+        Radio_check(check_, g_beacon.frame, BEACON_LEN);
+        checks = checks && (memcmp(check_, g_beacon.check, RADIO_CHECK_LEN) == 0);
+#endif
+        fields = fields && holds(&g_beacon, &f);
+
+        serialize(frame, &f, g_beacon.count);
+        HostSerial_clear();
+        Radio_begin();
+        Radio_write(frame, BEACON_LEN);
+        Radio_end();
+        cap = HostSerial_capture(&capLen);
+        same = same && (capLen == sentLen) && (memcmp(cap, l_sent, capLen) == 0);
+    }
+    HostSerial_clear();
+    printf("%lu beacons of %u bytes, %u patched\n", (unsigned long)beacons,
+           (unsigned)BEACON_LEN, (unsigned)BEACON_TAIL);
+    Bench_check(checks, "patched check = check over the frame");
+    Bench_check(fields, "frame holds the fields");
+    Bench_check(same, "output = Radio_begin/write/end of the same frame");
+}
+
+static void speed(uint32_t beacons) {
+    BeaconFields f;
+    uint8_t frame[BEACON_LEN];
+    uint32_t i;
+    double t0;
+    double tPatch;
+    double tFull;
+
+    memset(&f, 0, sizeof(f));
+    srand(7U);
+    Beacon_init(&g_beacon);
+    t0 = Bench_seconds();
+    for (i = 0U; i < beacons; ++i) {
+        step(&f);
+        Beacon_send(&g_beacon, &f);
+        HostSerial_clear();
+    }
+    tPatch = Bench_seconds() - t0;
+
+    memset(&f, 0, sizeof(f));
+    srand(7U);
+    t0 = Bench_seconds();
+    for (i = 0U; i < beacons; ++i) {
+        step(&f);
+        serialize(frame, &f, (uint16_t)i);
+        Radio_begin();
+        Radio_write(frame, BEACON_LEN);
+        Radio_end();
+        HostSerial_clear();
+    }
+    tFull = Bench_seconds() - t0;
+
+    printf("Per beacon on this host: %.0f ns patched, %.0f ns serialized and encoded\n",
+           1e9 * tPatch / beacons, 1e9 * tFull / beacons);
+
+#ifndef RADIO_AX25
+    /* the check alone: a typical change (uptime and count) against all */
+    uint8_t check_[RADIO_CHECK_LEN];
+    double tCheck;
+    double tFullCheck;
+
+    memset(frame, 0x5A, sizeof(frame));
+    t0 = Bench_seconds();
+    for (i = 0U; i < beacons; ++i) {
+        frame[0] = (uint8_t)i;
+        Radio_checkDelta(check_, frame, 6U);
+    }
+    tCheck = Bench_seconds() - t0;
+    t0 = Bench_seconds();
+    for (i = 0U; i < beacons; ++i) {
+        frame[0] = (uint8_t)i;
+        Radio_check(check_, frame, BEACON_LEN);
+    }
+    tFullCheck = Bench_seconds() - t0;
+
+    printf("Check on this host: %.0f ns for 6 changed bytes, %.0f ns over the frame\n",
+           1e9 * tCheck / beacons, 1e9 * tFullCheck / beacons);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t beacons = 100000UL;
+    unsigned seed = 1U;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': beacons = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n beacons] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (beacons == 0U) {
+        fprintf(stderr, "need a beacon\n");
+        return 2;
+    }
+    srand(seed);
+
+    printf("Beacon bench, %s build\n", BUILD);
+    roundTrip(beacons);
+    speed(beacons);
+
+    return Bench_finish();
+}
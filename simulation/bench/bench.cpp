@@ -0,0 +1,55 @@
+/* Checks and report shared by the host benches (see bench.h) --------------*/
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "bench.h"
+
+static uint32_t l_failures;
+static uint64_t l_rng = 0x9E3779B97F4A7C15ULL;
+
+bool Bench_check(bool ok, char const *what, ...) {
+    va_list ap;
+
+    if (!ok) {
+        ++l_failures;
+        printf("  FAILED: ");
+        va_start(ap, what);
+        vprintf(what, ap);
+        va_end(ap);
+        printf("\n");
+    }
+    return ok;
+}
+
+uint32_t Bench_failures(void) {
+    return l_failures;
+}
+
+int Bench_finish(void) {
+    if (l_failures != 0U) {
+        printf("FAIL: %lu checks\n", (unsigned long)l_failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+double Bench_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+uint64_t Bench_rng(void) {
+    /* xorshift64* */
+    l_rng ^= l_rng >> 12;
+    l_rng ^= l_rng << 25;
+    l_rng ^= l_rng >> 27;
+    return l_rng * 2685821657736338717ULL;
+}
+
+void Bench_seed(uint64_t seed) {
+    l_rng ^= seed * 0x2545F4914F6CDD1DULL;
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Checks and report shared by the host benches ----------------------------*/
+/*
+* A bench counts failed checks with Bench_check() and ends main() with
+* 'return Bench_finish();', which prints PASS, or FAIL and the count, and
+* gives the exit status. Bench_seconds() times the speed figures on this
+* host; Bench_rng() is a xorshift64* with a fixed seed unless Bench_seed()
+* changes it, so every run with the same options is the same.
+*/
+#include <stdint.h>
+
+/* Counts a failure and prints the printf-style message unless 'ok' */
+bool Bench_check(bool ok, char const *what, ...)
+    __attribute__((format(printf, 2, 3)));
+uint32_t Bench_failures(void);
+int Bench_finish(void);
+
+double Bench_seconds(void);
+uint64_t Bench_rng(void);
+void Bench_seed(uint64_t seed);
+
+#endif /* BENCH_H */
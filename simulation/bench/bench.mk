@@ -0,0 +1,81 @@
+# Shared host build of the simulation benches
+#
+# A bench makefile names its binary and the flight sources it needs, then
+# includes this file:
+#
+#   OUTPUT = my-bench
+#   FW_FILES = $(FW_DIR)/src/log_store.cpp
+#   include ../bench/bench.mk
+#
+# The bench's own sources are src/*.cpp, linked with bench/bench.cpp (the
+# checks and the PASS/FAIL report, see bench.h). Optional settings:
+#
+#   BENCH_CPPFLAGS  -D and -I flags, ahead of the firmware headers
+#   BENCH_CFLAGS    extra compiler flags, e.g. the sanitizers
+#   BENCH_LDFLAGS   extra linker flags
+#   OPT             optimization, -O2 by default
+#   VARIANTS        one build per name, each adding its FLAGS_<name>; the
+#                   first is $(OUTPUT), the others $(OUTPUT)-<name>
+
+CC = gcc
+CXX = g++
+
+SIM_DIR = ..
+FW_DIR = $(SIM_DIR)/../firmware
+QPN_DIR = $(SIM_DIR)/qpn-base-sim/lib/qpn_avr
+BENCH_DIR = $(SIM_DIR)/bench
+
+# the host Arduino.h comes from the AMU emulator, the Serial capture from fec-bench
+HOST_ARDUINO_INC = -I$(SIM_DIR)/amu-emulator/include
+HOST_SERIAL_INC = -I$(SIM_DIR)/fec-bench/lib
+HOST_SERIAL = $(SIM_DIR)/fec-bench/src/host_serial.cpp
+
+OPT ?= -O2
+CPPFLAGS = -MMD -MP $(BENCH_CPPFLAGS) -I$(BENCH_DIR) -I$(FW_DIR)/lib -I$(FW_DIR)/include -I$(QPN_DIR)
+CFLAGS = -Wall -Wextra -g $(OPT) $(BENCH_CFLAGS)
+CXXFLAGS = $(CFLAGS) -Wno-unused-parameter
+LDFLAGS = $(BENCH_LDFLAGS)
+LDLIBS = -lm
+
+SRC_DIR = src
+OBJ_DIR = obj
+VARIANTS ?= host
+
+SRC_FILES = $(wildcard $(SRC_DIR)/*.cpp)
+LIB_FILES = $(BENCH_DIR)/bench.cpp $(FW_FILES)
+
+vpath %.cpp $(SRC_DIR) $(sort $(dir $(filter %.cpp, $(LIB_FILES))))
+vpath %.c $(sort $(dir $(filter %.c, $(LIB_FILES))))
+
+output = $(if $(filter $(firstword $(VARIANTS)), $(1)), $(OUTPUT), $(OUTPUT)-$(1))
+objs = $(patsubst $(SRC_DIR)/%.cpp, $(OBJ_DIR)/$(1)/%.o, $(SRC_FILES)) \
+       $(patsubst %, $(OBJ_DIR)/$(1)/lib_%.o, $(basename $(notdir $(LIB_FILES))))
+OUTPUTS = $(foreach v, $(VARIANTS), $(strip $(call output,$(v))))
+
+all: $(OUTPUTS)
+
+define variant_rules
+$(strip $(call output,$(1))): $(call objs,$(1))
+	$$(CXX) $$(LDFLAGS) $$^ $$(LDLIBS) -o $$@
+
+$(OBJ_DIR)/$(1)/lib_%.o: %.cpp
+	@mkdir -p $$(dir $$@)
+	$$(CXX) $$(CPPFLAGS) $$(FLAGS_$(1)) $$(CXXFLAGS) -c $$< -o $$@
+
+$(OBJ_DIR)/$(1)/lib_%.o: %.c
+	@mkdir -p $$(dir $$@)
+	$$(CC) $$(CPPFLAGS) $$(FLAGS_$(1)) $$(CFLAGS) -c $$< -o $$@
+
+$(OBJ_DIR)/$(1)/%.o: %.cpp
+	@mkdir -p $$(dir $$@)
+	$$(CXX) $$(CPPFLAGS) $$(FLAGS_$(1)) $$(CXXFLAGS) -c $$< -o $$@
+endef
+
+$(foreach v, $(VARIANTS), $(eval $(call variant_rules,$(v))))
+
+-include $(wildcard $(OBJ_DIR)/*/*.d)
+
+clean:
+	rm -rf $(OBJ_DIR) $(OUTPUTS)
+
+.PHONY: all clean
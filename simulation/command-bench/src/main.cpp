@@ -0,0 +1,306 @@
+/* Uplink command bench ------------------------------------------------------*/
+/*
+* Runs the flight command decoder (Command_parse() and SipHash24() in
+* firmware/src/messages.cpp), built with the address and undefined
+* behaviour sanitizers:
+*
+*   - SipHash-2-4 against the reference vectors;
+*   - every opcode, signed with the bench key, comes out as its signal and
+*     parameter; signed frames with a bad opcode, argument length or
+*     argument are turned away for that;
+*   - a frame seen before, or an older counter, is a replay, but only once
+*     the command was accepted: one turned away for a full queue can be
+*     sent again;
+*   - no single bit flip and no truncation or extension of a good frame
+*     is accepted;
+*   - -n random frames of 0..SF_RX_MAX bytes, and as many good frames
+*     with random bytes overwritten, are all rejected.
+*
+* With -f file it parses the file as one frame instead and only checks
+* that nothing breaks, so a file-driven fuzzer can run it as its target
+* (e.g. afl-fuzz -i in -o out -- ./command-bench -f @@).
+*
+* usage: command-bench [-n frames] [-s seed] [-f frame_file]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qpn.h"
+#include "bsp.h"
+#include "log_store.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "bench.h"
+
+static uint8_t const l_key[CMD_KEY_LEN] = { CMD_KEY };
+static void fail(char const *what, uint8_t const *frame, uint8_t len) {
+    char hex[3U * 255U + 1U];
+    uint16_t n = 0U;
+    uint8_t i;
+
+    hex[0] = '\0';
+    for (i = 0U; i < len; ++i) {
+        n += (uint16_t)snprintf(&hex[n], sizeof(hex) - n, " %02X", frame[i]);
+    }
+    Bench_check(false, "%s:%s", what, hex);
+}
+
+/* A signed command frame, as the ground builds it; returns its length */
+static uint8_t sign(uint8_t *frame, uint8_t opcode, uint16_t counter,
+                    uint8_t const *args, uint8_t nArgs) {
+    uint8_t len = (uint8_t)(CMD_HEADER_LEN + nArgs);
+
+    frame[0] = SF_COMMAND;
+    frame[1] = opcode;
+    frame[2] = (uint8_t)counter;
+    frame[3] = (uint8_t)(counter >> 8);
+    memcpy(&frame[CMD_HEADER_LEN], args, nArgs);
+    SipHash24(&frame[len], l_key, frame, len);
+    return (uint8_t)(len + CMD_TAG_LEN);
+}
+
+/* Parses as Communication_receive() does, accepting a good command */
+static void expect(CommandAuth *auth, uint8_t const *frame, uint8_t len, CmdResult want,
+                   char const *what) {
+    Command cmd;
+    CmdResult r = Command_parse(auth, frame, len, &cmd);
+
+    if (r == CMD_OK) {
+        Command_accept(auth, &cmd);
+    }
+    if (r != want) {
+        char buf[80];
+        snprintf(buf, sizeof(buf), "%s gave %d, not %d", what, (int)r, (int)want);
+        fail(buf, frame, len);
+    }
+}
+
+/* Reference vectors: key 00..0F, message 00..len-1 */
+static void vectors(void) {
+    static uint8_t const empty[8] = { 0x31, 0x0E, 0x0E, 0xDD, 0x47, 0xDB, 0x6F, 0x72 };
+    static uint8_t const fifteen[8] = { 0xE5, 0x45, 0xBE, 0x49, 0x61, 0xCA, 0x29, 0xA1 };
+    uint8_t key[CMD_KEY_LEN];
+    uint8_t msg[15];
+    uint8_t out[8];
+    uint8_t i;
+
+    for (i = 0U; i < sizeof(key); ++i) {
+        key[i] = i;
+    }
+    for (i = 0U; i < sizeof(msg); ++i) {
+        msg[i] = i;
+    }
+    SipHash24(out, key, msg, 0U);
+    if (memcmp(out, empty, sizeof(out)) != 0) {
+        fail("SipHash of the empty message", out, sizeof(out));
+    }
+    SipHash24(out, key, msg, sizeof(msg));
+    if (memcmp(out, fifteen, sizeof(out)) != 0) {
+        fail("SipHash of 15 bytes", out, sizeof(out));
+    }
+}
+
+static void commands(void) {
+    static struct {
+        uint8_t opcode;
+        uint8_t nArgs;
+        uint8_t args[CMD_ARGS_MAX];
+        uint8_t sig;
+        uint32_t par;
+    } const good[] = {
+        { CMD_PING,      0U, { 0U },                   0U,              0UL },
+        { CMD_SWEEP,     0U, { 0U },                   Q_PAYLOAD_SIG,   0UL },
+        { CMD_TELEMETRY, 0U, { 0U },                   Q_TELEMETRY_SIG, 0UL },
+        { CMD_PROFILE,   0U, { 0U },                   Q_PROFILE_SIG,   0UL },
+        { CMD_QUERY,     4U, { LOG_REC_SWEEP, 2U, 24U, 0U }, Q_QUERY_SIG, 0x00180203UL },
+        { CMD_QUERY,     4U, { LOG_TYPE_ANY, LOG_TAG_NONE, 0xFFU, 0xFFU }, Q_QUERY_SIG,
+                                                                         0xFFFFFF00UL }
+    };
+    static uint8_t const args[CMD_ARGS_MAX + 1] = { LOG_REC_SWEEP + 1U, 0U, 1U, 0U, 0U };
+    CommandAuth auth;
+    uint8_t frame[SF_RX_MAX];
+    uint8_t len;
+    uint16_t counter = 1U;
+    Command cmd;
+    uint8_t i;
+
+    memset(&auth, 0, sizeof(auth));
+    for (i = 0U; i < sizeof(good) / sizeof(good[0]); ++i) {
+        len = sign(frame, good[i].opcode, counter++, good[i].args, good[i].nArgs);
+        if ((Command_parse(&auth, frame, len, &cmd) != CMD_OK)
+            || (cmd.opcode != good[i].opcode) || (cmd.sig != good[i].sig)
+            || (cmd.par != good[i].par)) {
+            fail("good command", frame, len);
+        }
+        Command_accept(&auth, &cmd);
+        expect(&auth, frame, len, CMD_REPLAYED, "the same again");
+    }
+    len = sign(frame, CMD_PING, (uint16_t)(counter - 2U), args, 0U);
+    expect(&auth, frame, len, CMD_REPLAYED, "an older counter");
+    len = sign(frame, CMD_PING, (uint16_t)(counter + 0x8000U), args, 0U);
+    expect(&auth, frame, len, CMD_REPLAYED, "a counter half the range ahead");
+
+    len = sign(frame, CMD_COUNT, counter++, args, 0U);
+    expect(&auth, frame, len, CMD_BAD_OPCODE, "an unknown opcode");
+    len = sign(frame, 0xFFU, counter++, args, 0U);
+    expect(&auth, frame, len, CMD_BAD_OPCODE, "opcode 0xFF");
+    len = sign(frame, CMD_SWEEP, counter++, args, 1U);
+    expect(&auth, frame, len, CMD_BAD_LENGTH, "an argument too many");
+    len = sign(frame, CMD_QUERY, counter++, args, 3U);
+    expect(&auth, frame, len, CMD_BAD_LENGTH, "an argument too few");
+    len = sign(frame, CMD_QUERY, counter++, args, 4U);
+    expect(&auth, frame, len, CMD_BAD_ARG, "a type out of range");
+    len = sign(frame, CMD_QUERY, counter++, args, CMD_ARGS_MAX + 1U);
+    expect(&auth, frame, len, CMD_BAD_LENGTH, "a frame too long");
+    /* none of them took a counter: the next one still works */
+    len = sign(frame, CMD_PING, (uint16_t)(auth.counter + 1U), args, 0U);
+    expect(&auth, frame, len, CMD_OK, "after the rejections");
+
+    /* a good command whose event found the queue full keeps its counter free */
+    len = sign(frame, CMD_SWEEP, (uint16_t)(auth.counter + 1U), args, 0U);
+    if (Command_parse(&auth, frame, len, &cmd) != CMD_OK) {
+        fail("a command for a full queue", frame, len);
+    }
+    Command_reject(&auth, CMD_QUEUE_FULL);
+    if (auth.lastError != CMD_QUEUE_FULL) {
+        fail("queue full not counted", frame, len);
+    }
+    expect(&auth, frame, len, CMD_OK, "a command sent again after a full queue");
+    expect(&auth, frame, len, CMD_REPLAYED, "that command once accepted");
+    if (auth.accepted != sizeof(good) / sizeof(good[0]) + 2U) {
+        fail("accepted count", (uint8_t const *)&auth.accepted, 2U);
+    }
+}
+
+static void flips(void) {
+    static uint8_t const args[CMD_ARGS_MAX] = { LOG_REC_PARAMS, 1U, 2U, 0U };
+    CommandAuth auth;
+    uint8_t good[SF_RX_MAX];
+    uint8_t frame[SF_RX_MAX];
+    uint8_t len;
+    uint16_t bit;
+    uint8_t n;
+
+    memset(&auth, 0, sizeof(auth));
+    len = sign(good, CMD_QUERY, 100U, args, CMD_ARGS_MAX);
+    for (bit = 0U; bit < 8U * len; ++bit) {
+        memcpy(frame, good, len);
+        frame[bit >> 3] ^= (uint8_t)(1U << (bit & 7U));
+        expect(&auth, frame, len, CMD_BAD_TAG, "a bit flip");
+    }
+    for (n = 0U; n < len; ++n) {
+        Command cmd;
+        if (Command_parse(&auth, good, n, &cmd) == CMD_OK) {
+            fail("a truncated frame", good, n);
+        }
+    }
+    memcpy(frame, good, len);
+    for (n = (uint8_t)(len + 1U); n <= SF_RX_MAX; ++n) {
+        Command cmd;
+        frame[n - 1U] = 0U;
+        if (Command_parse(&auth, frame, n, &cmd) == CMD_OK) {
+            fail("an extended frame", frame, n);
+        }
+    }
+    expect(&auth, good, len, CMD_OK, "the frame itself");
+}
+
+static void fuzz(uint32_t frames) {
+    static uint8_t const args[CMD_ARGS_MAX] = { LOG_REC_SWEEP, 0U, 1U, 0U };
+    uint32_t results[CMD_REPLAYED + 1];
+    CommandAuth auth;
+    uint8_t good[SF_RX_MAX];
+    uint8_t frame[SF_RX_MAX];
+    uint8_t goodLen;
+    uint8_t len;
+    uint32_t i;
+    uint8_t j;
+    Command cmd;
+    CmdResult r;
+
+    memset(results, 0, sizeof(results));
+    memset(&auth, 0, sizeof(auth));
+    goodLen = sign(good, CMD_QUERY, 7U, args, CMD_ARGS_MAX);
+    for (i = 0U; i < frames; ++i) {
+        len = (uint8_t)(rand() % (SF_RX_MAX + 1));
+        for (j = 0U; j < len; ++j) {
+            frame[j] = (uint8_t)rand();
+        }
+        r = Command_parse(&auth, frame, len, &cmd);
+        ++results[r];
+
+        memcpy(frame, good, goodLen);
+        len = goodLen;
+        for (j = (uint8_t)(1U + rand() % 3); j != 0U; --j) {
+            frame[rand() % goodLen] = (uint8_t)rand();
+        }
+        if (memcmp(frame, good, goodLen) == 0) {
+            continue;                   /* wrote the same bytes */
+        }
+        r = Command_parse(&auth, frame, len, &cmd);
+        ++results[r];
+    }
+    if (results[CMD_OK] != 0U) {
+        fail("a random frame was accepted", good, 0U);
+    }
+    printf("Fuzzed %lu frames: %lu bad length, %lu bad tag, %lu accepted\n",
+           (unsigned long)(results[CMD_BAD_LENGTH] + results[CMD_BAD_TAG] + results[CMD_OK]
+                           + results[CMD_BAD_OPCODE] + results[CMD_BAD_ARG]
+                           + results[CMD_REPLAYED]),
+           (unsigned long)results[CMD_BAD_LENGTH], (unsigned long)results[CMD_BAD_TAG],
+           (unsigned long)results[CMD_OK]);
+}
+
+static int parseFile(char const *path) {
+    uint8_t buf[256];
+    CommandAuth auth;
+    Command cmd;
+    size_t n;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL) {
+        perror(path);
+        return 2;
+    }
+    n = fread(buf, 1U, sizeof(buf), f);
+    fclose(f);
+    memset(&auth, 0, sizeof(auth));
+    /* SerialFrame_receive() never hands over more than SF_RX_MAX */
+    if (Command_parse(&auth, buf, (uint8_t)((n > SF_RX_MAX) ? (size_t)SF_RX_MAX : n), &cmd) == CMD_OK
+        && ((cmd.opcode >= CMD_COUNT) || (cmd.sig >= MAX_SIG))) {
+        abort();
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t frames = 1000000UL;
+    unsigned seed = 1U;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:f:")) != -1) {
+        switch (opt) {
+            case 'n': frames = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            case 'f': return parseFile(optarg);
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-s seed] [-f frame_file]\n", argv[0]);
+                return 2;
+        }
+    }
+    srand(seed);
+
+    printf("Command bench: %u opcodes, frames of %u..%u bytes, at most %u SipHash "
+           "compressions a frame\n", (unsigned)CMD_COUNT, (unsigned)CMD_LEN_MIN,
+           (unsigned)CMD_LEN_MAX, (unsigned)CMD_BLOCKS_MAX);
+    vectors();
+    commands();
+    flips();
+    fuzz(frames);
+
+    return Bench_finish();
+}
@@ -0,0 +1,379 @@
+/* Downlink scheduler bench -------------------------------------------------*/
+/*
+* Runs the flight downlink scheduler (firmware/src/subsystems/communication.cpp)
+* on a RAM-backed telemetry log over simulated orbits. Housekeeping and
+* sweep parameter records (and with -r raw sweep parts) are appended at
+* their usual rates; each orbit has a ground pass with probability -c, of a
+* random length between -d and -D seconds at -b bit/s. The Transmit state
+* is mimicked: one Downlink_tick() a second until it says the pass is over.
+*
+* The same orbits are then replayed with a FIFO downlink (oldest unsent
+* first, packed in order into the same frames) for comparison. For each
+* record class it reports how many came down, how many were overwritten
+* before they could, and their age at delivery; plus the scheduling value
+* delivered (Downlink_value() at send time) and how full the frames were.
+* Exits non-zero when a record comes down twice, a frame overflows, a raw
+* sweep part comes down ahead of an older one (a delta before its key) or
+* the scheduler delivers less value than FIFO.
+*
+* The defaults make the pass the limit: a 64 KB log (external flash rather
+* than the 1 KB EEPROM) and passes on 15% of orbits, 10 to 30 s at
+* 1200 bit/s, so every pass leaves records behind and the policy decides
+* which. With seed 1 the scheduler delivers a value of 3.54e6 against
+* FIFO's 0.42e6, at a mean age of 2.6 days against 4.5. The flight EEPROM
+* log (-m 1024 -c 0.3 -d 60 -D 480) is emptied by every pass, and both
+* policies then send the same records.
+*
+* usage: downlink-bench [-o orbits] [-t hk_per_orbit] [-p sweeps_per_orbit]
+*                       [-r] [-c pass_probability] [-d min_pass_s]
+*                       [-D max_pass_s] [-b rate_bps] [-m nvm_bytes] [-s seed]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qpn.h"
+#include "bsp.h"
+#include "queue_stats.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "messages.h"
+#include "radio.h"
+#include "communication.h"
+#include "bench.h"
+
+#define HOUSEKEEPING_LEN    14U         /* sizeof(LogHousekeeping) on AVR */
+#define PARAMS_LEN          40U         /* sweep_codec parameter packet */
+#define SWEEP_LEN           160U        /* typical sweep_codec sweep packet */
+#define ORBIT_S             5684U       /* seconds per orbit */
+#define CELLS               4U
+#define NVM_MAX             (1UL << 20)
+
+enum { FIFO, SCHEDULER };
+
+/* What was appended under each sequence number */
+typedef struct Shadow {
+    uint32_t time;
+    uint8_t type;
+    uint8_t sent;
+} Shadow;
+
+typedef struct ClassStats {
+    uint32_t appended;
+    uint32_t sent;
+    uint32_t lost;
+    double ageSum;                      /* at delivery [s] */
+    uint32_t ageMax;
+} ClassStats;
+
+static uint8_t l_nvm[NVM_MAX];
+static Shadow l_shadow[65536];
+static uint32_t l_now;
+
+static struct {
+    ClassStats cls[LOG_REC_SWEEP + 1];
+    uint32_t frames;
+    uint32_t passes;
+    uint32_t payload;                   /* record bytes sent */
+    double value;
+    uint32_t duplicates;
+    uint32_t overflows;
+    uint32_t reordered;                 /* sweep parts sent after a newer one */
+    uint32_t sweeps;                    /* sweep parts sent so far */
+    uint16_t lastSweep;
+} l_res;
+
+/* Glue the flight scheduler links against -----------------------------------*/
+LogStore g_telemetryLog;
+
+uint32_t DataCollection_now(void) {
+    return l_now;
+}
+
+uint16_t DataCollection_loadCounter(void) {
+    return 0U;
+}
+
+void DataCollection_saveCounter(uint16_t counter) {
+}
+
+/* Frames are not encoded here; fec-bench covers radio.cpp */
+void Radio_begin(void) {
+}
+
+void Radio_write(void const *data, uint16_t len) {
+}
+
+void Radio_writev(MsgSegment const *seg, uint8_t n) {
+}
+
+void Radio_end(void) {
+}
+
+uint8_t Radio_receive(uint8_t const **frame) {
+    return 0U;                          /* nothing uplinked */
+}
+
+/* No AO here; command-bench covers the commands */
+bool QueueStats_post(QActive * const ao, enum_t const sig, QParam const par) {
+    return true;
+}
+
+static void frameBegin(void) {
+}
+
+static void frameEnd(void) {
+}
+
+static void frameRecord(LogRecord const *rec) {
+    Shadow *s = &l_shadow[rec->seq];
+    ClassStats *c = &l_res.cls[rec->type];
+    uint32_t age = l_now - s->time;
+
+    if (s->sent++ != 0U) {
+        ++l_res.duplicates;
+        return;
+    }
+    if (rec->type == LOG_REC_SWEEP) {
+        if ((l_res.sweeps++ != 0U) && ((int16_t)(rec->seq - l_res.lastSweep) < 0)) {
+            ++l_res.reordered;
+        }
+        l_res.lastSweep = rec->seq;
+    }
+    ++c->sent;
+    c->ageSum += age;
+    if (age > c->ageMax) {
+        c->ageMax = age;
+    }
+    l_res.value += Downlink_value(rec->type, rec->time, l_now);
+    l_res.payload += rec->len + DL_RECORD_OVERHEAD;
+}
+
+static DownlinkSink const l_sink = { &frameBegin, &frameRecord, &frameEnd };
+
+/* RAM NVM with EEPROM semantics */
+static void nvmRead(uint32_t addr, void *buf, uint16_t len) {
+    memcpy(buf, &l_nvm[addr], len);
+}
+
+static void nvmWrite(uint32_t addr, void const *buf, uint16_t len) {
+    memcpy(&l_nvm[addr], buf, len);
+}
+
+static NvmDev l_dev = { &nvmRead, &nvmWrite, (void (*)(uint32_t))0, 1024U, 0U };
+
+static uint32_t appended(void) {
+    return l_res.cls[LOG_REC_PARAMS].appended + l_res.cls[LOG_REC_HOUSEKEEPING].appended
+           + l_res.cls[LOG_REC_SWEEP].appended;
+}
+
+/* Simulation ----------------------------------------------------------------*/
+static void append(uint8_t type, uint8_t tag, void const *data, uint8_t len) {
+    uint16_t seq = LogStore_append(&g_telemetryLog, type, tag, l_now, data, len);
+
+    l_shadow[seq].time = l_now;
+    l_shadow[seq].type = type;
+    l_shadow[seq].sent = 0U;
+    ++l_res.cls[type].appended;
+}
+
+static void sweep(uint8_t cell, bool raw) {
+    uint8_t buf[LOG_PAYLOAD_MAX];
+    uint16_t left = SWEEP_LEN;
+    uint8_t count = (uint8_t)((SWEEP_LEN + DC_SWEEP_CHUNK - 1U) / DC_SWEEP_CHUNK);
+    uint8_t i;
+
+    memset(buf, 0xA5, sizeof(buf));
+    if (raw) {
+        /* as DataCollection_logSweep() splits it */
+        for (i = 0U; i < count; ++i) {
+            uint8_t chunk = (left > DC_SWEEP_CHUNK) ? (uint8_t)DC_SWEEP_CHUNK : (uint8_t)left;
+            buf[0] = (uint8_t)((i << 4) | count);
+            append(LOG_REC_SWEEP, cell, buf, (uint8_t)(chunk + 1U));
+            left = (uint16_t)(left - chunk);
+        }
+    }
+    append(LOG_REC_PARAMS, cell, buf, PARAMS_LEN);
+}
+
+/* Oldest unsent first, in order, as many as fit each frame */
+static bool fifoTick(Downlink * const me) {
+    LogRecord rec;
+    uint16_t seq;
+    uint8_t bytes;
+
+    me->credit += me->airPerTick;
+    while ((me->framesLeft != 0U) && (me->credit >= DL_FRAME_AIR)) {
+        bytes = 0U;
+        while (LogStore_oldestUnsent(me->log, &seq)) {
+            if (!LogStore_read(me->log, seq, &rec)) {
+                LogStore_markSent(me->log, seq);
+                continue;
+            }
+            if (bytes + rec.len + DL_RECORD_OVERHEAD > DL_FRAME_PAYLOAD) {
+                break;
+            }
+            bytes = (uint8_t)(bytes + rec.len + DL_RECORD_OVERHEAD);
+            me->sink->record(&rec);
+            LogStore_markSent(me->log, seq);
+        }
+        if (bytes == 0U) {
+            me->framesLeft = 0U;
+            break;
+        }
+        ++me->frames;
+        me->payload += bytes;
+        me->credit -= DL_FRAME_AIR;
+        --me->framesLeft;
+    }
+    return me->framesLeft != 0U;
+}
+
+static void run(int policy, uint32_t orbits, uint8_t hk, uint8_t sweeps, bool raw,
+                double passP, uint16_t passMin, uint16_t passMax, uint16_t rate,
+                unsigned seed) {
+    uint8_t hkPayload[HOUSEKEEPING_LEN];
+    uint32_t orbit;
+    uint32_t t;
+    uint32_t i;
+    uint8_t nSweep = 0U;
+
+    memset(&l_res, 0, sizeof(l_res));
+    memset(l_nvm, 0xFF, l_dev.size);
+    memset(hkPayload, 0x5A, sizeof(hkPayload));
+    srand(seed);
+    l_now = 0U;
+    LogStore_init(&g_telemetryLog, &l_dev, 0U, l_dev.size);
+    Downlink_init(&g_downlink, &g_telemetryLog, &l_sink);
+
+    for (orbit = 0U; orbit < orbits; ++orbit) {
+        bool pass = ((double)rand() / RAND_MAX) < passP;
+        uint32_t start = (uint32_t)rand() % ORBIT_S;
+        uint32_t len = passMin + (uint32_t)rand() % (passMax - passMin + 1U);
+        bool inPass = false;
+
+        for (t = 0U; t < ORBIT_S; ++t, ++l_now) {
+            if ((hk != 0U) && ((t % (ORBIT_S / hk)) == 0U)) {
+                append(LOG_REC_HOUSEKEEPING, LOG_TAG_NONE, hkPayload, HOUSEKEEPING_LEN);
+            }
+            if ((sweeps != 0U) && ((t % (ORBIT_S / sweeps)) == 0U)) {
+                sweep((uint8_t)(nSweep++ % CELLS), raw);
+            }
+            if (pass && (t == start)) {
+                Downlink_beginPass(&g_downlink, (uint16_t)len, rate);
+                inPass = true;
+                ++l_res.passes;
+            }
+            if (inPass) {
+                inPass = (policy == SCHEDULER) ? Downlink_tick(&g_downlink, l_now)
+                                               : fifoTick(&g_downlink);
+                if (!inPass) {
+                    l_res.frames += g_downlink.frames;
+                    if (g_downlink.payload > (uint32_t)g_downlink.frames * DL_FRAME_PAYLOAD) {
+                        ++l_res.overflows;
+                    }
+                }
+            }
+        }
+        if (inPass) {
+            l_res.frames += g_downlink.frames;
+        }
+    }
+
+    /* whatever was neither sent nor is still stored got overwritten */
+    for (i = 1U; (i <= 65536UL) && (i <= appended()); ++i) {
+        uint16_t seq = (uint16_t)(g_telemetryLog.nextSeq - i);
+        Shadow const *s = &l_shadow[seq];
+        LogRecord rec;
+
+        if ((s->sent == 0U) && !LogStore_read(&g_telemetryLog, seq, &rec)) {
+            ++l_res.cls[s->type].lost;
+        }
+    }
+}
+
+static void report(char const *name) {
+    static char const * const names[] = { "", "params", "housekeeping", "raw sweep" };
+    uint8_t type;
+
+    printf("%s: %lu passes, %lu frames, %.1f%% full, value %.0f\n", name,
+           (unsigned long)l_res.passes, (unsigned long)l_res.frames,
+           l_res.frames ? 100.0 * l_res.payload / ((double)l_res.frames * DL_FRAME_PAYLOAD) : 0.0,
+           l_res.value);
+    for (type = LOG_REC_PARAMS; type <= LOG_REC_SWEEP; ++type) {
+        ClassStats const *c = &l_res.cls[type];
+        if (c->appended == 0U) {
+            continue;
+        }
+        printf("  %-12s %6lu logged %6lu sent %6lu lost, age %7.0f s mean %8lu s max\n",
+               names[type], (unsigned long)c->appended, (unsigned long)c->sent,
+               (unsigned long)c->lost, c->sent ? c->ageSum / c->sent : 0.0,
+               (unsigned long)c->ageMax);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t orbits = 500U;
+    uint8_t hk = 6U;
+    uint8_t sweeps = 4U;
+    bool raw = false;
+    double passP = 0.15;
+    uint16_t passMin = 10U;
+    uint16_t passMax = 30U;
+    uint16_t rate = 1200U;
+    unsigned seed = 1U;
+    uint32_t size = 65536U;             /* external flash; the EEPROM is 1024 */
+    double value;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:p:rc:d:D:b:m:s:")) != -1) {
+        switch (opt) {
+            case 'o': orbits = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 't': hk = (uint8_t)strtoul(optarg, 0, 0); break;
+            case 'p': sweeps = (uint8_t)strtoul(optarg, 0, 0); break;
+            case 'r': raw = true; break;
+            case 'c': passP = strtod(optarg, 0); break;
+            case 'd': passMin = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'D': passMax = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'b': rate = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'm': size = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-o orbits] [-t hk_per_orbit] "
+                        "[-p sweeps_per_orbit] [-r] [-c pass_probability] "
+                        "[-d min_pass_s] [-D max_pass_s] [-b rate_bps] "
+                        "[-m nvm_bytes] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((size < 2U * LOG_SLOT_SIZE) || (size > NVM_MAX) || (passMax < passMin)
+        || (rate < 8U)) {
+        fprintf(stderr, "need %u <= nvm_bytes <= %lu, min_pass_s <= max_pass_s "
+                "and a rate of at least 8 bit/s\n", 2U * LOG_SLOT_SIZE, NVM_MAX);
+        return 2;
+    }
+    l_dev.size = size;
+
+    printf("Downlink bench: %lu orbits, %u-byte log, passes %.0f%% of orbits, "
+           "%u..%u s at %u bit/s\n", (unsigned long)orbits, (unsigned)size,
+           100.0 * passP, passMin, passMax, rate);
+    run(SCHEDULER, orbits, hk, sweeps, raw, passP, passMin, passMax, rate, seed);
+    report("Scheduler");
+    Bench_check(l_res.duplicates + l_res.overflows == 0U,
+                "scheduler: %lu duplicates or overflowing frames",
+                (unsigned long)(l_res.duplicates + l_res.overflows));
+    Bench_check(l_res.reordered == 0U, "scheduler: %lu sweep parts out of log order",
+                (unsigned long)l_res.reordered);
+    value = l_res.value;
+    run(FIFO, orbits, hk, sweeps, raw, passP, passMin, passMax, rate, seed);
+    report("FIFO     ");
+    Bench_check(l_res.duplicates + l_res.overflows == 0U,
+                "FIFO: %lu duplicates or overflowing frames",
+                (unsigned long)(l_res.duplicates + l_res.overflows));
+    Bench_check(value >= l_res.value, "scheduler value %.0f below FIFO's %.0f",
+                value, l_res.value);
+    return Bench_finish();
+}
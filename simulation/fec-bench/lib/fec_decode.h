@@ -0,0 +1,28 @@
+#ifndef FEC_DECODE_H
+#define FEC_DECODE_H
+
+/* Ground-side decoders for the downlink FEC ---------------------------------*/
+/*
+* The inverse of firmware/src/peripherals/radio.cpp. FecRs_decode() is a
+* table-driven Berlekamp-Massey / Chien / Forney decoder for the shortened
+* CCSDS RS(255,223) codeword, correcting in place. FecConv_decode() is a
+* hard-decision Viterbi decoder for the K=7 rate 1/2 code, with the
+* survivor paths kept as one 64-bit decision word per bit.
+*/
+enum {
+    FEC_RS_PARITY = 32,
+    FEC_RS_N      = 255
+};
+
+void FecRs_init(void);
+
+/* Corrects a codeword of 'len' bytes (data then parity) in place; returns
+* the number of bytes corrected, or -1 when it is beyond repair */
+int FecRs_decode(uint8_t *codeword, uint16_t len);
+
+/* Decodes 'bits' information bits (the codeword, without the tail) from
+* 2 * (bits + 6) coded bits packed MSB first; returns the path metric, i.e.
+* the number of coded bits that disagree with the decoded sequence */
+uint32_t FecConv_decode(uint8_t const *coded, uint32_t bits, uint8_t *out);
+
+#endif /* FEC_DECODE_H */
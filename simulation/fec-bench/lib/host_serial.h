@@ -0,0 +1,11 @@
+#ifndef HOST_SERIAL_H
+#define HOST_SERIAL_H
+
+/* Bytes written to Serial so far, and forgetting them */
+uint8_t const *HostSerial_capture(size_t *len);
+void HostSerial_clear(void);
+
+/* Queues bytes for Serial.read(), as if the ground had sent them */
+void HostSerial_feed(uint8_t const *data, size_t len);
+
+#endif /* HOST_SERIAL_H */
@@ -0,0 +1,261 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "fec_decode.h"
+
+#define NN      255
+#define A0      NN                      /* log of zero */
+#define FCR     112
+#define PRIM    11
+#define IPRIM   116                     /* PRIM * IPRIM == 1 mod NN */
+#define NROOTS  FEC_RS_PARITY
+#define GFPOLY  0x187
+
+#define CONV_POLY_A 0x4FU
+#define CONV_POLY_B 0x6DU
+#define CONV_TAIL   6U
+
+static uint8_t l_alpha[NN + 1];
+static uint8_t l_index[NN + 1];
+static uint8_t l_convOut[128];          /* register -> two coded bits */
+
+static int modnn(int x) {
+    while (x >= NN) {
+        x -= NN;
+        x = (x >> 8) + (x & NN);
+    }
+    return x;
+}
+
+static uint8_t parityOf(uint8_t x) {
+    x ^= (uint8_t)(x >> 4);
+    x ^= (uint8_t)(x >> 2);
+    x ^= (uint8_t)(x >> 1);
+    return (uint8_t)(x & 1U);
+}
+
+void FecRs_init(void) {
+    int sr = 1;
+    int i;
+
+    l_index[0] = A0;
+    l_alpha[A0] = 0;
+    for (i = 0; i < NN; ++i) {
+        l_index[sr] = (uint8_t)i;
+        l_alpha[i] = (uint8_t)sr;
+        sr <<= 1;
+        if ((sr & 0x100) != 0) {
+            sr ^= GFPOLY;
+        }
+    }
+    for (i = 0; i < 128; ++i) {
+        l_convOut[i] = (uint8_t)((parityOf((uint8_t)(i & CONV_POLY_A)) << 1)
+                                 | parityOf((uint8_t)(i & CONV_POLY_B)));
+    }
+}
+
+/* Reed-Solomon --------------------------------------------------------------*/
+int FecRs_decode(uint8_t *data, uint16_t len) {
+    int pad = NN - (int)len;
+    int s[NROOTS];
+    int lambda[NROOTS + 1];
+    int b[NROOTS + 1];
+    int t[NROOTS + 1];
+    int omega[NROOTS + 1];
+    int reg[NROOTS + 1];
+    int root[NROOTS];
+    int loc[NROOTS];
+    int degLambda = 0;
+    int degOmega;
+    int el = 0;
+    int count = 0;
+    int r;
+    int i;
+    int j;
+    int k;
+    bool any = false;
+
+    if ((pad < 0) || (len <= NROOTS)) {
+        return -1;
+    }
+
+    /* syndromes, evaluated at alpha^((FCR + i) * PRIM) */
+    for (i = 0; i < NROOTS; ++i) {
+        s[i] = data[0];
+    }
+    for (j = 1; j < (int)len; ++j) {
+        for (i = 0; i < NROOTS; ++i) {
+            s[i] = (s[i] == 0) ? data[j]
+                 : data[j] ^ l_alpha[modnn(l_index[s[i]] + (FCR + i) * PRIM)];
+        }
+    }
+    for (i = 0; i < NROOTS; ++i) {
+        any = any || (s[i] != 0);
+        s[i] = l_index[s[i]];
+    }
+    if (!any) {
+        return 0;
+    }
+
+    /* Berlekamp-Massey: error locator lambda(x) */
+    memset(lambda, 0, sizeof(lambda));
+    lambda[0] = 1;
+    for (i = 0; i <= NROOTS; ++i) {
+        b[i] = l_index[lambda[i]];
+    }
+    for (r = 1; r <= NROOTS; ++r) {
+        int discr = 0;
+
+        for (i = 0; i < r; ++i) {
+            if ((lambda[i] != 0) && (s[r - i - 1] != A0)) {
+                discr ^= l_alpha[modnn(l_index[lambda[i]] + s[r - i - 1])];
+            }
+        }
+        discr = l_index[discr];
+        if (discr == A0) {
+            memmove(&b[1], b, NROOTS * sizeof(b[0]));
+            b[0] = A0;
+            continue;
+        }
+        t[0] = lambda[0];
+        for (i = 0; i < NROOTS; ++i) {
+            t[i + 1] = (b[i] != A0) ? lambda[i + 1] ^ l_alpha[modnn(discr + b[i])]
+                                    : lambda[i + 1];
+        }
+        if (2 * el <= r - 1) {
+            el = r - el;
+            for (i = 0; i <= NROOTS; ++i) {
+                b[i] = (lambda[i] == 0) ? A0 : modnn(l_index[lambda[i]] - discr + NN);
+            }
+        }
+        else {
+            memmove(&b[1], b, NROOTS * sizeof(b[0]));
+            b[0] = A0;
+        }
+        memcpy(lambda, t, sizeof(lambda));
+    }
+    for (i = 0; i <= NROOTS; ++i) {
+        lambda[i] = l_index[lambda[i]];
+        if (lambda[i] != A0) {
+            degLambda = i;
+        }
+    }
+
+    /* Chien search for the roots of lambda(x) */
+    memcpy(&reg[1], &lambda[1], NROOTS * sizeof(reg[0]));
+    for (i = 1, k = IPRIM - 1; i <= NN; ++i, k = modnn(k + IPRIM)) {
+        int q = 1;
+
+        for (j = degLambda; j > 0; --j) {
+            if (reg[j] != A0) {
+                reg[j] = modnn(reg[j] + j);
+                q ^= l_alpha[reg[j]];
+            }
+        }
+        if (q != 0) {
+            continue;
+        }
+        root[count] = i;
+        loc[count] = k;
+        if (++count == degLambda) {
+            break;
+        }
+    }
+    if (degLambda != count) {
+        return -1;
+    }
+
+    /* error evaluator omega(x) = s(x) lambda(x) mod x^NROOTS */
+    degOmega = degLambda - 1;
+    for (i = 0; i <= degOmega; ++i) {
+        int tmp = 0;
+
+        for (j = i; j >= 0; --j) {
+            if ((s[i - j] != A0) && (lambda[j] != A0)) {
+                tmp ^= l_alpha[modnn(s[i - j] + lambda[j])];
+            }
+        }
+        omega[i] = l_index[tmp];
+    }
+
+    /* Forney: the error values */
+    for (j = count - 1; j >= 0; --j) {
+        int num1 = 0;
+        int num2 = l_alpha[modnn(root[j] * (FCR - 1) + NN)];
+        int den = 0;
+
+        for (i = degOmega; i >= 0; --i) {
+            if (omega[i] != A0) {
+                num1 ^= l_alpha[modnn(omega[i] + i * root[j])];
+            }
+        }
+        for (i = ((degLambda < NROOTS - 1) ? degLambda : NROOTS - 1) & ~1; i >= 0; i -= 2) {
+            if (lambda[i + 1] != A0) {
+                den ^= l_alpha[modnn(lambda[i + 1] + i * root[j])];
+            }
+        }
+        if ((den == 0) || (loc[j] < pad)) {
+            return -1;                  /* no error can sit in the padding */
+        }
+        if (num1 != 0) {
+            data[loc[j] - pad] ^= l_alpha[modnn(l_index[num1] + l_index[num2] + NN
+                                                - l_index[den])];
+        }
+    }
+    return count;
+}
+
+/* Viterbi -------------------------------------------------------------------*/
+uint32_t FecConv_decode(uint8_t const *coded, uint32_t bits, uint8_t *out) {
+    static uint64_t decisions[8 * 256 + CONV_TAIL];
+    uint32_t metric[64];
+    uint32_t next[64];
+    uint32_t steps = bits + CONV_TAIL;
+    uint32_t n;
+    uint8_t st;
+    int i;
+
+    for (i = 0; i < 64; ++i) {
+        metric[i] = (i == 0) ? 0U : 0x10000000U;
+    }
+    for (n = 0U; n < steps; ++n) {
+        uint32_t pos = 2U * n;
+        uint8_t rx = (uint8_t)((((coded[pos >> 3] >> (7U - (pos & 7U))) & 1U) << 1)
+                               | ((coded[(pos + 1U) >> 3] >> (7U - ((pos + 1U) & 7U))) & 1U));
+        uint64_t d = 0U;
+
+        /* register m<<6 | ns: new state ns, from (ns >> 1) | m << 5 */
+        for (i = 0; i < 64; ++i) {
+            uint8_t p0 = (uint8_t)(i >> 1);
+            uint8_t p1 = (uint8_t)(p0 | 0x20U);
+            uint8_t e0 = l_convOut[i] ^ rx;
+            uint8_t e1 = l_convOut[0x40 | i] ^ rx;
+            uint32_t m0 = metric[p0] + (e0 & 1U) + (e0 >> 1);
+            uint32_t m1 = metric[p1] + (e1 & 1U) + (e1 >> 1);
+
+            if (m1 < m0) {
+                next[i] = m1;
+                d |= 1ULL << i;
+            }
+            else {
+                next[i] = m0;
+            }
+        }
+        decisions[n] = d;
+        memcpy(metric, next, sizeof(metric));
+    }
+
+    /* the tail brings the encoder back to state 0 */
+    memset(out, 0, (bits + 7U) / 8U);
+    st = 0U;
+    for (n = steps; n-- != 0U;) {
+        uint8_t m = (uint8_t)((decisions[n] >> st) & 1U);
+
+        if (n < bits) {
+            out[n >> 3] |= (uint8_t)((st & 1U) << (7U - (n & 7U)));
+        }
+        st = (uint8_t)((st >> 1) | (m << 5));
+    }
+    return metric[0];
+}
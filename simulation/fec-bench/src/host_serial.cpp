@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Arduino.h"
+#include "host_serial.h"
+
+/* Serial output is kept in memory, as a ground station would record it */
+HostSerial Serial;
+
+static uint8_t *l_buf;
+static size_t l_len;
+static size_t l_cap;
+
+static uint8_t l_in[4096];
+static size_t l_inHead;
+static size_t l_inTail;
+
+unsigned long micros(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)(ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL);
+}
+
+unsigned long millis(void) {
+    return micros() / 1000UL;
+}
+
+void delay(unsigned long ms) {
+    (void)ms;
+}
+
+void delayMicroseconds(unsigned int us) {
+    (void)us;
+}
+
+size_t HostSerial::write(uint8_t b) {
+    if (l_len == l_cap) {
+        l_cap = l_cap ? 2U * l_cap : 4096U;
+        l_buf = (uint8_t *)realloc(l_buf, l_cap);
+        if (l_buf == (uint8_t *)0) {
+            abort();
+        }
+    }
+    l_buf[l_len++] = b;
+    return 1U;
+}
+
+int HostSerial::available() {
+    return (int)(l_inTail - l_inHead);
+}
+
+int HostSerial::read() {
+    return (l_inHead != l_inTail) ? l_in[l_inHead++] : -1;
+}
+
+size_t HostSerial::print(char const *s) {
+    size_t n = 0U;
+
+    while (*s != '\0') {
+        n += write((uint8_t)*s++);
+    }
+    return n;
+}
+
+size_t HostSerial::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t HostSerial::print(long n, int base) {
+    char s[24];
+
+    snprintf(s, sizeof(s), (base == HEX) ? "%lX" : "%ld", n);
+    return print(s);
+}
+
+size_t HostSerial::print(unsigned long n, int base) {
+    char s[24];
+
+    snprintf(s, sizeof(s), (base == HEX) ? "%lX" : "%lu", n);
+    return print(s);
+}
+
+size_t HostSerial::print(double x, int digits) {
+    char s[48];
+
+    snprintf(s, sizeof(s), "%.*f", digits, x);
+    return print(s);
+}
+
+uint8_t const *HostSerial_capture(size_t *len) {
+    *len = l_len;
+    return l_buf;
+}
+
+void HostSerial_clear(void) {
+    l_len = 0U;
+}
+
+void HostSerial_feed(uint8_t const *data, size_t len) {
+    if (l_inHead == l_inTail) {
+        l_inHead = 0U;
+        l_inTail = 0U;
+    }
+    if (len > sizeof(l_in) - l_inTail) {
+        abort();
+    }
+    memcpy(&l_in[l_inTail], data, len);
+    l_inTail += len;
+}
@@ -0,0 +1,463 @@
+/* Downlink FEC bench and capture decoder ------------------------------------*/
+/*
+* Bench mode runs the flight encoder (firmware/src/peripherals/radio.cpp)
+* against the ground decoders in fec_decode.cpp:
+*
+*   - frames written through Radio_begin/write/end in random pieces come
+*     out of the serial capture as SF_CODEWORD frames that decode with no
+*     error and carry the frame unchanged;
+*   - any 16 byte errors in a codeword are corrected, and the Viterbi
+*     decoder undoes Conv_encode() exactly;
+*   - frame error rates for uncoded, RS and convolutional + RS frames over
+*     a hard-decision BPSK/AWGN channel, per Eb/N0 of the frame bits;
+*   - decoder speed, as a multiple of real time at -b bit/s on air.
+*
+* Exits non-zero when a check fails.
+*
+* Capture mode (-f) decodes a recording of the firmware's serial output:
+* every SF_CODEWORD frame is corrected (Viterbi first with -c, for a
+* RADIO_CONVOLUTIONAL build) and its records printed as the text build
+* prints them. Frames whose SLIP CRC fails are decoded all the same.
+*
+* usage: fec-bench [-n frames] [-k frame_bytes] [-b rate_bps] [-s seed]
+*        fec-bench -f capture [-c]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "qpn.h"
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "radio.h"
+#include "fec_decode.h"
+#include "host_serial.h"
+#include "bench.h"
+
+#define CODEWORD_MAX    (RS_DATA_MAX + RS_PARITY)
+#define CODED_MAX       (2 * CODEWORD_MAX + 2)
+#define RECORD_HEADER   9U              /* seq, type, tag, time, len */
+
+
+static double uniform(void) {
+    return (double)(Bench_rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Splits a serial capture on SLIP_END; calls 'fn' for each SF_CODEWORD */
+static uint32_t eachCodeword(uint8_t const *p, size_t len,
+                             void (*fn)(uint8_t const *cw, uint16_t n, bool crcOk)) {
+    static uint8_t frame[2 * CODED_MAX + 8];
+    uint32_t found = 0U;
+    uint16_t n = 0U;
+    bool esc = false;
+    bool overrun = false;
+    size_t i;
+
+    for (i = 0U; i < len; ++i) {
+        uint8_t b = p[i];
+
+        if (b == SLIP_END) {
+            if (!overrun && (n > 3U) && (frame[0] == SF_CODEWORD)) {
+                uint16_t crc = crc16_ccitt(0xFFFFU, frame, (uint16_t)(n - 2U));
+                bool crcOk = (crc == (uint16_t)(frame[n - 2U] | (frame[n - 1U] << 8)));
+
+                fn(&frame[1], (uint16_t)(n - 3U), crcOk);
+                ++found;
+            }
+            n = 0U;
+            esc = false;
+            overrun = false;
+            continue;
+        }
+        if (esc) {
+            b = (b == SLIP_ESC_END) ? SLIP_END : (b == SLIP_ESC_ESC) ? SLIP_ESC : b;
+            esc = false;
+        }
+        else if (b == SLIP_ESC) {
+            esc = true;
+            continue;
+        }
+        if (n < sizeof(frame)) {
+            frame[n++] = b;
+        }
+        else {
+            overrun = true;             /* text or garbage, not a codeword */
+        }
+    }
+    return found;
+}
+
+/* Round trip through the flight code --------------------------------------*/
+static uint8_t l_sent[64][RS_DATA_MAX];
+static uint16_t l_sentLen[64];
+static uint32_t l_got;
+
+static void checkFlightFrame(uint8_t const *cw, uint16_t n, bool crcOk) {
+    uint8_t buf[CODEWORD_MAX];
+    uint32_t i = l_got++ % 64U;
+
+    memcpy(buf, cw, n);
+    Bench_check(crcOk, "SLIP CRC of a flight codeword");
+    Bench_check(n == l_sentLen[i] + RS_PARITY, "codeword length");
+    Bench_check(FecRs_decode(buf, n) == 0, "flight codeword has a clean syndrome");
+    Bench_check(memcmp(buf, l_sent[i], l_sentLen[i]) == 0, "frame carried unchanged");
+}
+
+static void flightRoundTrip(uint32_t frames) {
+    uint8_t const *cap;
+    size_t capLen;
+    uint32_t f;
+
+    printf("Flight encoder: %lu frames through Radio_write()\n", (unsigned long)frames);
+    for (f = 0U; f < frames; ++f) {
+        uint32_t i = f % 64U;
+        uint16_t k = (uint16_t)(1U + Bench_rng() % RS_DATA_MAX);
+        uint16_t at = 0U;
+
+        for (at = 0U; at < k; ++at) {
+            l_sent[i][at] = (uint8_t)Bench_rng();
+        }
+        l_sentLen[i] = k;
+        Radio_begin();
+        for (at = 0U; at < k;) {
+            uint16_t piece = (uint16_t)(1U + Bench_rng() % 16U);
+            if (piece > k - at) {
+                piece = (uint16_t)(k - at);
+            }
+            Radio_write(&l_sent[i][at], piece);
+            at = (uint16_t)(at + piece);
+        }
+        Radio_end();
+        if (i == 63U || f + 1U == frames) {
+            cap = HostSerial_capture(&capLen);
+            eachCodeword(cap, capLen, &checkFlightFrame);
+            HostSerial_clear();
+        }
+    }
+    Bench_check(l_got == frames, "every frame came out");
+}
+
+/* Channel -----------------------------------------------------------------*/
+static uint32_t flipBits(uint8_t *p, uint32_t bits, double ber) {
+    uint32_t flips = 0U;
+    uint32_t i;
+
+    if (ber <= 0.0) {
+        return 0U;
+    }
+    /* geometric gaps between errors instead of a draw per bit */
+    for (i = (uint32_t)(log(1.0 - uniform()) / log(1.0 - ber)); i < bits;
+         i += 1U + (uint32_t)(log(1.0 - uniform()) / log(1.0 - ber))) {
+        p[i >> 3] ^= (uint8_t)(0x80U >> (i & 7U));
+        ++flips;
+    }
+    return flips;
+}
+
+static double ber(double ebn0dB, double rate) {
+    return 0.5 * erfc(sqrt(pow(10.0, ebn0dB / 10.0) * rate));
+}
+
+static uint16_t encode(uint8_t const *data, uint16_t k, uint8_t *cw) {
+    RsEncoder rs;
+
+    memcpy(cw, data, k);
+    Rs_begin(&rs);
+    Rs_update(&rs, data, k);
+    Rs_end(&rs, &cw[k]);
+    return (uint16_t)(k + RS_PARITY);
+}
+
+static uint16_t convEncode(uint8_t const *cw, uint16_t n, uint8_t *coded) {
+    uint8_t state = 0U;
+    uint16_t c;
+    uint16_t i;
+
+    for (i = 0U; i < n; ++i) {
+        c = Conv_encode(&state, cw[i]);
+        coded[2U * i] = (uint8_t)(c >> 8);
+        coded[2U * i + 1U] = (uint8_t)c;
+    }
+    c = Conv_flush(&state);
+    coded[2U * n] = (uint8_t)(c >> 8);
+    coded[2U * n + 1U] = (uint8_t)c;
+    return (uint16_t)(2U * n + 2U);
+}
+
+static void correction(uint32_t frames, uint16_t k) {
+    uint8_t data[RS_DATA_MAX];
+    uint8_t cw[CODEWORD_MAX];
+    uint8_t rx[CODEWORD_MAX];
+    uint8_t coded[CODED_MAX];
+    uint8_t back[CODEWORD_MAX];
+    uint32_t beyond = 0U;
+    uint32_t f;
+    uint16_t n;
+    uint16_t i;
+
+    for (f = 0U; f < frames; ++f) {
+        uint16_t errors = (uint16_t)(f % (RS_PARITY / 2U + 2U));
+
+        for (i = 0U; i < k; ++i) {
+            data[i] = (uint8_t)Bench_rng();
+        }
+        n = encode(data, k, cw);
+        memcpy(rx, cw, n);
+        for (i = 0U; i < errors; ++i) {
+            uint16_t at;
+            do {
+                at = (uint16_t)(Bench_rng() % n);
+            } while (rx[at] != cw[at]);
+            rx[at] ^= (uint8_t)(1U + Bench_rng() % 255U);
+        }
+        if (errors <= RS_PARITY / 2U) {
+            Bench_check(FecRs_decode(rx, n) == errors, "corrected count");
+            Bench_check(memcmp(rx, cw, n) == 0, "corrected codeword");
+        }
+        else if (FecRs_decode(rx, n) < 0) {
+            ++beyond;                   /* detected, as it should be */
+        }
+
+        convEncode(cw, n, coded);
+        FecConv_decode(coded, 8U * n, back);
+        Bench_check(memcmp(back, cw, n) == 0, "Viterbi decodes a clean stream");
+    }
+    printf("RS: up to %u byte errors corrected in %lu frames; %lu of %lu with %u "
+           "errors detected as uncorrectable\n", RS_PARITY / 2U, (unsigned long)frames,
+           (unsigned long)beyond, (unsigned long)(frames / (RS_PARITY / 2U + 2U)),
+           RS_PARITY / 2U + 1U);
+}
+
+static void errorRates(uint32_t frames, uint16_t k) {
+    uint8_t data[RS_DATA_MAX];
+    uint8_t cw[CODEWORD_MAX];
+    uint8_t rx[CODEWORD_MAX];
+    uint8_t coded[CODED_MAX];
+    double rsRate = (double)k / (k + RS_PARITY);
+    double ebn0;
+
+    printf("Frame error rate, %u-byte frames, hard decisions (%lu frames per point)\n"
+           "  Eb/N0 [dB]   uncoded     RS          conv + RS\n", k, (unsigned long)frames);
+    for (ebn0 = 1.0; ebn0 <= 9.01; ebn0 += 1.0) {
+        uint32_t bad[3] = { 0U, 0U, 0U };
+        double pu = ber(ebn0, 1.0);
+        double pr = ber(ebn0, rsRate);
+        double pc = ber(ebn0, rsRate / 2.0);
+        uint32_t f;
+        uint16_t n;
+        uint16_t i;
+
+        for (f = 0U; f < frames; ++f) {
+            for (i = 0U; i < k; ++i) {
+                data[i] = (uint8_t)Bench_rng();
+            }
+            memcpy(rx, data, k);
+            bad[0] += (flipBits(rx, 8U * k, pu) != 0U) ? 1U : 0U;
+
+            n = encode(data, k, cw);
+            memcpy(rx, cw, n);
+            flipBits(rx, 8U * n, pr);
+            bad[1] += ((FecRs_decode(rx, n) < 0) || (memcmp(rx, cw, n) != 0)) ? 1U : 0U;
+
+            flipBits(coded, 8U * convEncode(cw, n, coded), pc);
+            FecConv_decode(coded, 8U * n, rx);
+            bad[2] += ((FecRs_decode(rx, n) < 0) || (memcmp(rx, cw, n) != 0)) ? 1U : 0U;
+        }
+        printf("  %5.1f        %-10.2e  %-10.2e  %-10.2e\n", ebn0,
+               (double)bad[0] / frames, (double)bad[1] / frames, (double)bad[2] / frames);
+    }
+}
+
+static void speed(uint32_t frames, uint16_t k, uint32_t rate) {
+    uint8_t data[RS_DATA_MAX];
+    uint8_t cw[CODEWORD_MAX];
+    uint8_t rx[CODEWORD_MAX];
+    uint8_t coded[CODED_MAX];
+    uint8_t noisy[CODED_MAX];
+    double rsTime = 0.0;
+    double convTime = 0.0;
+    double encTime;
+    double t0;
+    uint32_t f;
+    uint16_t n;
+    uint16_t m = 0U;
+    uint16_t i;
+    RsEncoder rs;
+
+    for (i = 0U; i < k; ++i) {
+        data[i] = (uint8_t)Bench_rng();
+    }
+    t0 = Bench_seconds();
+    for (f = 0U; f < frames; ++f) {
+        Rs_begin(&rs);
+        Rs_update(&rs, data, k);
+        Rs_end(&rs, &cw[k]);
+    }
+    encTime = Bench_seconds() - t0;
+
+    n = encode(data, k, cw);
+    for (f = 0U; f < frames; ++f) {
+        /* eight byte errors, half of what RS can take */
+        memcpy(rx, cw, n);
+        for (i = 0U; i < 8U; ++i) {
+            rx[Bench_rng() % n] ^= (uint8_t)(1U + Bench_rng() % 255U);
+        }
+        t0 = Bench_seconds();
+        FecRs_decode(rx, n);
+        rsTime += Bench_seconds() - t0;
+
+        m = convEncode(cw, n, coded);
+        memcpy(noisy, coded, m);
+        flipBits(noisy, 8U * m, 0.01);
+        t0 = Bench_seconds();
+        FecConv_decode(noisy, 8U * n, rx);
+        FecRs_decode(rx, n);
+        convTime += Bench_seconds() - t0;
+    }
+    printf("Host speed, per %u-byte frame: RS encode %.2f us, RS decode %.1f us, "
+           "Viterbi + RS %.1f us\n", k, 1e6 * encTime / frames, 1e6 * rsTime / frames,
+           1e6 * convTime / frames);
+    printf("  a pass at %lu bit/s decodes %.0fx (RS) and %.0fx (conv + RS) faster "
+           "than real time\n", (unsigned long)rate,
+           (8.0 * n * frames / rate) / rsTime, (8.0 * m * frames / rate) / convTime);
+}
+
+/* Capture decoding --------------------------------------------------------*/
+static bool l_conv;
+static struct {
+    uint32_t frames;
+    uint32_t crcBad;
+    uint32_t corrected;
+    uint32_t failed;
+    uint32_t records;
+} l_cap;
+
+static void printRecords(uint8_t const *p, uint16_t len) {
+    uint16_t at = 0U;
+    uint8_t i;
+
+    while (at + RECORD_HEADER <= len) {
+        uint8_t n = p[at + 8U];
+
+        if (at + RECORD_HEADER + n > len) {
+            printf("Truncated record at byte %u\n", at);
+            return;
+        }
+        printf("Log record %u type %u tag %u at %lu: ",
+               (unsigned)(p[at] | (p[at + 1U] << 8)), p[at + 2U], p[at + 3U],
+               (unsigned long)(p[at + 4U] | (p[at + 5U] << 8) | ((uint32_t)p[at + 6U] << 16)
+                               | ((uint32_t)p[at + 7U] << 24)));
+        for (i = 0U; i < n; ++i) {
+            printf("%02X", p[at + RECORD_HEADER + i]);
+        }
+        printf("\n");
+        at = (uint16_t)(at + RECORD_HEADER + n);
+        ++l_cap.records;
+    }
+}
+
+static void decodeCaptured(uint8_t const *cw, uint16_t n, bool crcOk) {
+    uint8_t buf[CODED_MAX];
+    int fixed;
+
+    ++l_cap.frames;
+    l_cap.crcBad += crcOk ? 0U : 1U;
+    if (l_conv) {
+        if ((n < 4U) || ((n & 1U) != 0U) || ((n - 2U) / 2U > CODEWORD_MAX)) {
+            ++l_cap.failed;
+            return;
+        }
+        n = (uint16_t)((n - 2U) / 2U);
+        FecConv_decode(cw, 8U * n, buf);
+    }
+    else {
+        if (n > CODEWORD_MAX) {
+            ++l_cap.failed;
+            return;
+        }
+        memcpy(buf, cw, n);
+    }
+    fixed = FecRs_decode(buf, n);
+    if (fixed < 0) {
+        ++l_cap.failed;
+        printf("Frame %lu: uncorrectable\n", (unsigned long)l_cap.frames);
+        return;
+    }
+    l_cap.corrected += (uint32_t)fixed;
+    printRecords(buf, (uint16_t)(n - RS_PARITY));
+}
+
+static int decodeFile(char const *path) {
+    FILE *fp = fopen(path, "rb");
+    uint8_t *buf;
+    long size;
+
+    if (fp == (FILE *)0) {
+        perror(path);
+        return 2;
+    }
+    fseek(fp, 0L, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = (uint8_t *)malloc((size_t)size + 1U);
+    if ((buf == (uint8_t *)0) || (fread(buf, 1U, (size_t)size, fp) != (size_t)size)) {
+        perror(path);
+        fclose(fp);
+        return 2;
+    }
+    fclose(fp);
+    eachCodeword(buf, (size_t)size, &decodeCaptured);
+    free(buf);
+    fprintf(stderr, "%lu codewords (%lu failed the SLIP CRC): %lu bytes corrected, "
+            "%lu uncorrectable, %lu records\n", (unsigned long)l_cap.frames,
+            (unsigned long)l_cap.crcBad, (unsigned long)l_cap.corrected,
+            (unsigned long)l_cap.failed, (unsigned long)l_cap.records);
+    return (l_cap.failed != 0U) ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t frames = 1000U;
+    uint32_t k = 200U;
+    uint32_t rate = 9600U;
+    char const *capture = (char const *)0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:k:b:s:f:c")) != -1) {
+        switch (opt) {
+            case 'n': frames = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'k': k = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'b': rate = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': Bench_seed(strtoull(optarg, 0, 0)); break;
+            case 'f': capture = optarg; break;
+            case 'c': l_conv = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-k frame_bytes] [-b rate_bps] "
+                        "[-s seed]\n       %s -f capture [-c]\n", argv[0], argv[0]);
+                return 2;
+        }
+    }
+    FecRs_init();
+    if (capture != (char const *)0) {
+        return decodeFile(capture);
+    }
+    if ((k == 0U) || (k > RS_DATA_MAX) || (frames == 0U) || (rate == 0U)) {
+        fprintf(stderr, "need 1 <= frame_bytes <= %u and nonzero frames and rate\n",
+                RS_DATA_MAX);
+        return 2;
+    }
+
+    flightRoundTrip(frames);
+    correction(frames, (uint16_t)k);
+    errorRates(frames, (uint16_t)k);
+    speed(frames, (uint16_t)k, rate);
+
+    return Bench_finish();
+}
@@ -0,0 +1,31 @@
+#ifndef NVM_FILE_H
+#define NVM_FILE_H
+
+/* File-backed NvmDev for the host ------------------------------------------*/
+/*
+* Keeps the memory image in a file, so a store outlives the process the way
+* it outlives a reset. Writes are counted per byte with EEPROM update
+* semantics (unchanged bytes cost nothing); in flash mode writes may only
+* clear bits and erases are counted per sector. A power cut is modelled by
+* a byte budget: once it runs out further writes are dropped, leaving the
+* write in progress torn.
+*/
+typedef struct NvmFileStats {
+    uint32_t bytesWritten;
+    uint32_t bytesRead;
+    uint32_t reads;                     /* read calls */
+    uint32_t erases;
+    uint32_t maxWear;                   /* byte writes or sector erases */
+    uint32_t badWrites;                 /* flash: a 0 bit written to 1 */
+} NvmFileStats;
+
+NvmDev const *NvmFile_open(char const *path, uint32_t size, uint16_t eraseSize);
+void NvmFile_close(void);
+
+/* Drops writes after 'bytes' more; pass UINT32_MAX to power back up */
+void NvmFile_cutPowerAfter(uint32_t bytes);
+bool NvmFile_powerCut(void);
+
+void NvmFile_stats(NvmFileStats *out);
+
+#endif /* NVM_FILE_H */
@@ -0,0 +1,352 @@
+/* Telemetry log store bench ------------------------------------------------*/
+/*
+* Runs the flight LogStore (firmware/src/log_store.cpp) over simulated
+* orbits on a file-backed NVM: parameter and housekeeping records are
+* appended every orbit, a ground contact every few orbits downlinks the
+* oldest unsent ones, and random resets cut the power in the middle of an
+* append. Every downlinked record is checked against what was appended.
+* The default rates are the flight ones for CELLS cells, worked out from
+* DC_SWEEP_PERIOD_S and DC_PARAMS_EVERY (datacollection.h) plus a
+* housekeeping record and an orbit summary, and the log leaves the command
+* counter its four bytes at the top of the EEPROM. At that rate, 4
+* parameter and 2 housekeeping records an orbit, the worst byte lasts
+* 23 years and nothing is lost; at one parameter record per sweep and
+* housekeeping per Telemetry pass (-p 379 -t 437) it lasted 0.3.
+* Reports the wear of the most written byte (or sector), the lifetime that
+* implies, and the NVM traffic per append and per downlinked record.
+*
+* At the end it runs random time-range queries ("cell c, orbits a to a+20")
+* against the archive and compares each seek and each result with a linear
+* scan, reporting the reads both need. Exits non-zero when a record comes
+* down corrupted, twice or out of order, or a query differs from the scan.
+*
+* usage: log-store-bench [-o orbits] [-p params_per_orbit] [-t hk_per_orbit]
+*                        [-c orbits_per_contact] [-r records_per_contact]
+*                        [-x reset_probability] [-m nvm_bytes]
+*                        [-f erase_size] [-q queries] [-s seed] [image]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log_store.h"
+#include "datacollection.h"
+#include "orbit_stats.h"
+#include "nvm_file.h"
+#include "bench.h"
+
+#define ORBITS_PER_DAY      15.2
+#define EEPROM_ENDURANCE    100000.0
+#define EEPROM_BYTE_MS      3.4
+#define HOUSEKEEPING_LEN    14U         /* sizeof(LogHousekeeping) on AVR */
+#define PARAMS_LEN          40U         /* sweep_codec parameter packet */
+#define ORBIT_S             ((uint32_t)ORBIT_PERIOD_S)
+#define CELLS               4U
+#define QUERY_ORBITS        20U
+
+/* What was appended under each sequence number */
+typedef struct Shadow {
+    uint32_t sum;
+    uint8_t type;
+    uint8_t sent;
+} Shadow;
+
+static Shadow l_shadow[65536];
+static LogStore l_log;
+static uint32_t l_logSize;              /* the NVM, less the command counter on EEPROM */
+
+static struct {
+    uint32_t appended;
+    uint32_t sent;
+    uint32_t duplicates;
+    uint32_t corrupt;
+    uint32_t outOfOrder;
+    uint32_t resets;
+    uint32_t torn;
+    uint32_t downlinkRead;              /* NVM bytes read while downlinking */
+    uint32_t queries;
+    uint32_t seekReads;
+    uint32_t scanReads;                 /* linear scan for the same seek */
+    uint32_t matches;
+    uint32_t queryErrors;
+} l_res;
+
+static uint32_t checksum(uint8_t const *p, uint8_t len) {
+    uint32_t s = 0x811C9DC5UL;          /* FNV-1a */
+
+    while (len-- != 0U) {
+        s = (s ^ *p++) * 16777619UL;
+    }
+    return s;
+}
+
+static void append(uint8_t type, uint8_t tag, uint32_t time, uint8_t len) {
+    uint8_t buf[LOG_PAYLOAD_MAX];
+    uint16_t seq;
+    uint8_t i;
+
+    for (i = 0U; i < len; ++i) {
+        buf[i] = (uint8_t)rand();
+    }
+    seq = LogStore_append(&l_log, type, tag, time, buf, len);
+    l_shadow[seq].sum = checksum(buf, len);
+    l_shadow[seq].type = type;
+    l_shadow[seq].sent = 0U;
+    ++l_res.appended;
+}
+
+static void reset(NvmDev const *dev) {
+    uint16_t last = (uint16_t)(l_log.nextSeq - 1U);
+    LogRecord rec;
+
+    NvmFile_cutPowerAfter(UINT32_MAX);
+    LogStore_init(&l_log, dev, 0U, l_logSize);
+    if (!LogStore_read(&l_log, last, &rec)) {
+        ++l_res.torn;                   /* reused on EEPROM, skipped on flash */
+        --l_res.appended;
+    }
+    ++l_res.resets;
+}
+
+static void contact(uint16_t max) {
+    static uint16_t lastSent;
+    static bool any;
+    LogRecord rec;
+    NvmFileStats before;
+    NvmFileStats after;
+    uint16_t seq;
+
+    while ((max-- != 0U) && LogStore_oldestUnsent(&l_log, &seq)) {
+        NvmFile_stats(&before);
+        if (LogStore_read(&l_log, seq, &rec)) {
+            Shadow *s = &l_shadow[seq];
+            if ((rec.type != s->type) || (checksum(rec.payload, rec.len) != s->sum)) {
+                ++l_res.corrupt;
+            }
+            if (s->sent++ != 0U) {
+                ++l_res.duplicates;
+            }
+            if (any && ((int16_t)(seq - lastSent) <= 0)) {
+                ++l_res.outOfOrder;
+            }
+            lastSent = seq;
+            any = true;
+            ++l_res.sent;
+        }
+        LogStore_markSent(&l_log, seq);
+        NvmFile_stats(&after);
+        l_res.downlinkRead += after.bytesRead - before.bytesRead;
+    }
+}
+
+static uint32_t reads(void) {
+    NvmFileStats st;
+
+    NvmFile_stats(&st);
+    return st.reads;
+}
+
+/* One range query, checked against a scan of every stored record */
+static void query(uint32_t from, uint32_t until, uint8_t tag) {
+    LogRecord rec;
+    LogQuery q;
+    uint16_t seq;
+    uint16_t expectSeek = l_log.nextSeq;
+    uint32_t expectMatches = 0U;
+    uint32_t matches = 0U;
+    uint32_t r;
+
+    r = reads();
+    for (seq = LogStore_oldest(&l_log); seq != l_log.nextSeq; ++seq) {
+        if (!LogStore_read(&l_log, seq, &rec)) {
+            continue;
+        }
+        if ((rec.time >= from) && (expectSeek == l_log.nextSeq)) {
+            expectSeek = seq;
+            l_res.scanReads += reads() - r;
+        }
+        if ((rec.time >= from) && (rec.time <= until)
+            && (rec.type == LOG_REC_PARAMS) && (rec.tag == tag)) {
+            ++expectMatches;
+        }
+    }
+    if (expectSeek == l_log.nextSeq) {
+        l_res.scanReads += reads() - r;
+    }
+
+    r = reads();
+    if (LogStore_seek(&l_log, from) != expectSeek) {
+        ++l_res.queryErrors;
+    }
+    l_res.seekReads += reads() - r;
+
+    LogStore_queryStart(&l_log, &q, from, until, LOG_REC_PARAMS, tag);
+    while (!q.done) {
+        if (LogStore_queryNext(&l_log, &q, &rec)) {
+            if ((rec.time < from) || (rec.time > until) || (rec.tag != tag)) {
+                ++l_res.queryErrors;
+            }
+            ++matches;
+        }
+    }
+    if (matches != expectMatches) {
+        ++l_res.queryErrors;
+    }
+    l_res.matches += matches;
+    ++l_res.queries;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t orbits = 5475U;            /* about a year */
+    /* the flight rate, rounded up */
+    uint32_t params = (CELLS * ORBIT_S + DC_SWEEP_PERIOD_S * DC_PARAMS_EVERY - 1U)
+                      / (DC_SWEEP_PERIOD_S * DC_PARAMS_EVERY);
+    uint32_t hk = 2U;                   /* LogHousekeeping and LogOrbit */
+    uint32_t perContact = 2U;
+    uint16_t contactRecords = 32U;
+    double resetP = 0.02;
+    uint32_t size = 1024U;              /* ATmega32u4 EEPROM */
+    uint32_t nQueries = 200U;
+    uint16_t eraseSize = 0U;
+    unsigned seed = 1U;
+    char const *path = "log-store-bench.nvm";
+    NvmDev const *dev;
+    NvmFileStats st;
+    uint32_t orbit;
+    uint32_t unsent = 0U;
+    uint16_t seq;
+    uint32_t i;
+    double years;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:p:t:c:r:x:m:f:q:s:")) != -1) {
+        switch (opt) {
+            case 'o': orbits = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'p': params = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 't': hk = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'c': perContact = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'r': contactRecords = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'x': resetP = strtod(optarg, 0); break;
+            case 'm': size = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'f': eraseSize = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'q': nQueries = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-o orbits] [-p params_per_orbit] "
+                        "[-t hk_per_orbit] [-c orbits_per_contact] [-r records_per_contact] "
+                        "[-x reset_probability] [-m nvm_bytes] [-f erase_size] "
+                        "[-q queries] [-s seed] [image]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc) {
+        path = argv[optind];
+    }
+    if (((eraseSize % LOG_SLOT_SIZE) != 0U) || (size < 2U * (eraseSize + LOG_SLOT_SIZE))) {
+        fprintf(stderr, "erase size must be a multiple of %u, and fit twice\n",
+                LOG_SLOT_SIZE);
+        return 2;
+    }
+    if ((params + hk == 0U) || (params + hk > ORBIT_S)) {
+        fprintf(stderr, "need 1..%lu records per orbit\n", (unsigned long)ORBIT_S);
+        return 2;
+    }
+    l_logSize = (eraseSize != 0U) ? size : size - DC_COUNTER_SIZE;
+    srand(seed);
+    unlink(path);
+    dev = NvmFile_open(path, size, eraseSize);
+    if (dev == (NvmDev const *)0) {
+        perror(path);
+        return 2;
+    }
+    LogStore_init(&l_log, dev, 0U, l_logSize);
+    printf("Log bench: %u slots of %u bytes on %lu bytes of %s, %lu parameter and "
+           "%lu housekeeping records an orbit\n", l_log.nSlots, LOG_SLOT_SIZE,
+           (unsigned long)size, eraseSize ? "flash" : "EEPROM", (unsigned long)params,
+           (unsigned long)hk);
+
+    for (orbit = 1U; orbit <= orbits; ++orbit) {
+        uint32_t n = params + hk;
+        uint32_t cut = ((double)rand() / RAND_MAX < resetP) ? (uint32_t)rand() % n : n;
+        uint32_t i;
+
+        for (i = 0U; i < n; ++i) {
+            uint8_t len = (i < params) ? PARAMS_LEN : HOUSEKEEPING_LEN;
+            if (i == cut) {
+                NvmFile_cutPowerAfter((uint32_t)rand() % (len + LOG_HEADER_SIZE + 1U));
+            }
+            append((i < params) ? LOG_REC_PARAMS : LOG_REC_HOUSEKEEPING,
+                   (i < params) ? (uint8_t)(i % CELLS) : LOG_TAG_NONE,
+                   orbit * ORBIT_S + i * (ORBIT_S / n), len);
+            if (i == cut) {
+                reset(dev);
+            }
+        }
+        if ((orbit % perContact) == 0U) {
+            contact(contactRecords);
+        }
+    }
+
+    for (i = 0U; (i < nQueries) && (l_log.count != 0U); ++i) {
+        LogRecord first;
+        uint32_t from;
+
+        /* a window starting anywhere in the archive, or a little before it */
+        while (!LogStore_read(&l_log, (uint16_t)(LogStore_oldest(&l_log)
+                                                 + (uint16_t)rand() % l_log.count), &first)) {
+        }
+        from = first.time - (uint32_t)rand() % ORBIT_S;
+        query(from, from + QUERY_ORBITS * ORBIT_S, (uint8_t)(rand() % CELLS));
+    }
+
+    for (seq = l_log.unsentSeq; seq != l_log.nextSeq; ++seq) {
+        LogRecord rec;
+        unsent += (LogStore_read(&l_log, seq, &rec) && (l_shadow[seq].sent == 0U)) ? 1U : 0U;
+    }
+    NvmFile_stats(&st);
+    NvmFile_close();
+    years = orbits / ORBITS_PER_DAY / 365.0;
+
+    printf("%lu orbits (%.2f years): %lu appended, %lu sent, %lu still unsent, %lu lost\n",
+           (unsigned long)orbits, years, (unsigned long)l_res.appended,
+           (unsigned long)l_res.sent, (unsigned long)unsent,
+           (unsigned long)(l_res.appended - l_res.sent - unsent));
+    printf("%lu resets, %lu torn appends\n",
+           (unsigned long)l_res.resets, (unsigned long)l_res.torn);
+    printf("NVM: %.1f bytes written per append (%.0f ms on EEPROM), "
+           "%.1f bytes read per downlinked record\n",
+           (double)st.bytesWritten / l_res.appended,
+           EEPROM_BYTE_MS * st.bytesWritten / l_res.appended,
+           l_res.sent ? (double)l_res.downlinkRead / l_res.sent : 0.0);
+    if (eraseSize != 0U) {
+        printf("Wear: %lu erases, worst sector %lu\n",
+               (unsigned long)st.erases, (unsigned long)st.maxWear);
+    }
+    else {
+        printf("Wear: worst byte %lu writes, %.1f years to %.0f cycles\n",
+               (unsigned long)st.maxWear,
+               st.maxWear ? EEPROM_ENDURANCE / (st.maxWear / years) : 0.0,
+               EEPROM_ENDURANCE);
+    }
+    if (l_res.queries != 0U) {
+        printf("Queries: %lu, %.1f reads per seek (linear scan %.1f), %.1f matches each\n",
+               (unsigned long)l_res.queries, (double)l_res.seekReads / l_res.queries,
+               (double)l_res.scanReads / l_res.queries,
+               (double)l_res.matches / l_res.queries);
+    }
+    printf("Corrupt %lu, duplicates %lu, out of order %lu, bad flash writes %lu, "
+           "query errors %lu\n",
+           (unsigned long)l_res.corrupt, (unsigned long)l_res.duplicates,
+           (unsigned long)l_res.outOfOrder, (unsigned long)st.badWrites,
+           (unsigned long)l_res.queryErrors);
+
+    Bench_check(l_res.corrupt == 0U, "no corrupt record read back");
+    Bench_check(l_res.duplicates == 0U, "no record downlinked twice");
+    Bench_check(l_res.outOfOrder == 0U, "records read back in order");
+    Bench_check(st.badWrites == 0U, "no flash write without an erase");
+    Bench_check(l_res.queryErrors == 0U, "range queries match a linear scan");
+    return Bench_finish();
+}
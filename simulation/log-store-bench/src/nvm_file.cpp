@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "log_store.h"
+#include "nvm_file.h"
+
+/* Local-scope objects -----------------------------------------------------*/
+static int l_fd = -1;
+static uint8_t *l_image;
+static uint32_t *l_wear;                /* per byte, or per sector on flash */
+static uint32_t l_budget = UINT32_MAX;
+static NvmFileStats l_stats;
+static NvmDev l_dev;
+
+static void countWear(uint32_t *w) {
+    ++*w;
+    if (*w > l_stats.maxWear) {
+        l_stats.maxWear = *w;
+    }
+}
+
+static void fileRead(uint32_t addr, void *buf, uint16_t len) {
+    memcpy(buf, &l_image[addr], len);
+    l_stats.bytesRead += len;
+    ++l_stats.reads;
+}
+
+static void fileWrite(uint32_t addr, void const *buf, uint16_t len) {
+    uint8_t const *src = (uint8_t const *)buf;
+    uint16_t i;
+
+    for (i = 0U; i < len; ++i) {
+        uint8_t old = l_image[addr + i];
+        if ((src[i] == old) || (l_budget == 0U)) {
+            continue;
+        }
+        --l_budget;
+        if (l_dev.eraseSize != 0U) {
+            if ((src[i] & ~old) != 0U) {
+                ++l_stats.badWrites;
+            }
+            l_image[addr + i] = (uint8_t)(old & src[i]);
+        }
+        else {
+            l_image[addr + i] = src[i];
+            countWear(&l_wear[addr + i]);
+        }
+        ++l_stats.bytesWritten;
+    }
+    if (pwrite(l_fd, &l_image[addr], len, addr) != (ssize_t)len) {
+        abort();
+    }
+}
+
+static void fileErase(uint32_t addr) {
+    if (l_budget == 0U) {
+        return;
+    }
+    memset(&l_image[addr], 0xFF, l_dev.eraseSize);
+    countWear(&l_wear[addr / l_dev.eraseSize]);
+    ++l_stats.erases;
+    if (pwrite(l_fd, &l_image[addr], l_dev.eraseSize, addr) != (ssize_t)l_dev.eraseSize) {
+        abort();
+    }
+}
+
+NvmDev const *NvmFile_open(char const *path, uint32_t size, uint16_t eraseSize) {
+    l_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (l_fd < 0) {
+        return (NvmDev const *)0;
+    }
+    l_image = (uint8_t *)malloc(size);
+    l_wear = (uint32_t *)calloc(size, sizeof(uint32_t));
+    memset(l_image, 0xFF, size);        /* erased state of a new part */
+    if (pread(l_fd, l_image, size, 0) < (ssize_t)size) {
+        memset(l_image, 0xFF, size);
+        if (pwrite(l_fd, l_image, size, 0) != (ssize_t)size) {
+            abort();
+        }
+    }
+    memset(&l_stats, 0, sizeof(l_stats));
+    l_dev.read = &fileRead;
+    l_dev.write = &fileWrite;
+    l_dev.erase = (eraseSize != 0U) ? &fileErase : (void (*)(uint32_t))0;
+    l_dev.size = size;
+    l_dev.eraseSize = eraseSize;
+    return &l_dev;
+}
+
+void NvmFile_close(void) {
+    close(l_fd);
+    free(l_image);
+    free(l_wear);
+    l_fd = -1;
+}
+
+void NvmFile_cutPowerAfter(uint32_t bytes) {
+    l_budget = bytes;
+}
+
+bool NvmFile_powerCut(void) {
+    return l_budget == 0U;
+}
+
+void NvmFile_stats(NvmFileStats *out) {
+    *out = l_stats;
+}
@@ -0,0 +1,250 @@
+/* Orbit statistics bench ----------------------------------------------------*/
+/*
+* Runs the flight per-orbit statistics (firmware/src/orbit_stats.cpp) over
+* -o simulated orbits, second by second as DataCollection_second() does:
+* battery charging in the sun and draining in eclipse, a cell whose
+* temperature follows the sun and whose Isc follows the cosine of its
+* angle to it while the spacecraft tumbles, a sweep every -w seconds and
+* the occasional change of state. Mission time starts part way into an
+* orbit, as after a reset.
+*
+* Every orbit's LogOrbit is checked against two-pass statistics in double
+* over the raw samples: counts and residency exact, min, max and mean to
+* the rounding, the standard deviation to one unit. The float variance is
+* also compared with a float sum of squares to show what Welford's update
+* saves. Reports the bytes logged and downlinked per orbit, the summary
+* and its one housekeeping record, against the raw samples and against a
+* housekeeping record on every Telemetry pass (about every
+* TELEMETRY_PASS_S while Active), as the firmware logged before.
+*
+* Exits non-zero when a check fails.
+*
+* usage: orbit-stats-bench [-o orbits] [-w sweep_period_s] [-s seed]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+
+#include "qpn.h"
+#include "log_store.h"
+#include "orbit_stats.h"
+#include "bench.h"
+
+#define SUNLIT          0.62            /* of an orbit */
+#define SPIN_S          300.0           /* tumble period */
+#define BATTERY_WH      30.0
+#define CHARGE_WH_S     0.004
+#define DRAIN_WH_S      0.006
+#define DL_OVERHEAD     9U              /* record header on the downlink */
+#define RAW_SAMPLE      4U              /* a float per sample */
+#define HOUSEKEEPING    14U             /* sizeof(LogHousekeeping) on AVR */
+#define TELEMETRY_PASS_S 13U            /* Detumble, Telemetry, Transmit, Receive */
+
+static std::vector<double> l_raw[ORBIT_CHANNELS];
+static uint32_t l_residency[ORBIT_STATES];
+static double l_welfordErr[ORBIT_CHANNELS];
+static double l_naiveErr[ORBIT_CHANNELS];
+static double l_sdSum[ORBIT_CHANNELS];
+static double l_sdOrbits[ORBIT_CHANNELS];
+static float l_fSum[ORBIT_CHANNELS];
+static float l_fSq[ORBIT_CHANNELS];
+static uint64_t l_samples;
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static double gauss(double sd) {
+    double u = uniform() + 1e-12;
+    double v = uniform();
+
+    return sd * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* Feeds the flight statistics and the reference alike */
+static void add(uint8_t ch, double x) {
+    OrbitStats_add(&g_orbitStats, ch, (float)x);
+    l_raw[ch].push_back((double)(float)x);
+    l_fSum[ch] += (float)x;
+    l_fSq[ch] += (float)x * (float)x;
+    ++l_samples;
+}
+
+static void reset(void) {
+    uint8_t i;
+
+    for (i = 0U; i < ORBIT_CHANNELS; ++i) {
+        l_raw[i].clear();
+        l_fSum[i] = 0.0f;
+        l_fSq[i] = 0.0f;
+    }
+    memset(l_residency, 0, sizeof(l_residency));
+}
+
+static int32_t rounded(double x) {
+    return (int32_t)floor(x + 0.5);
+}
+
+/* Checks the summary of the orbit just ended against its raw samples */
+static void verify(uint32_t orbit) {
+    LogOrbit s;
+    uint8_t i;
+    size_t k;
+    bool counts = true;
+    bool extremes = true;
+    bool means = true;
+    bool sds = true;
+
+    OrbitStats_summarize(&g_orbitStats, &s);
+    counts = counts && (s.orbit == (uint16_t)orbit);
+    for (i = 0U; i < ORBIT_STATES; ++i) {
+        counts = counts && (s.residency[i] == l_residency[i]);
+    }
+    for (i = 0U; i < ORBIT_CHANNELS; ++i) {
+        std::vector<double> const &x = l_raw[i];
+        size_t n = x.size();
+        double mean = 0.0;
+        double m2 = 0.0;
+        double lo = n ? x[0] : 0.0;
+        double hi = n ? x[0] : 0.0;
+        double sd;
+        double fsd;
+
+        for (k = 0U; k < n; ++k) {
+            mean += x[k];
+            lo = (x[k] < lo) ? x[k] : lo;
+            hi = (x[k] > hi) ? x[k] : hi;
+        }
+        mean = n ? mean / n : 0.0;
+        for (k = 0U; k < n; ++k) {
+            m2 += (x[k] - mean) * (x[k] - mean);
+        }
+        sd = (n > 1U) ? sqrt(m2 / (n - 1U)) : 0.0;
+
+        counts = counts && (s.ch[i].n == n);
+        extremes = extremes && (s.ch[i].min == rounded(lo)) && (s.ch[i].max == rounded(hi));
+        means = means && (labs(s.ch[i].mean - rounded(mean)) <= 1L);
+        sds = sds && (fabs(s.ch[i].sd - sd) <= 1.0);
+        if (n > 1U) {
+            fsd = sqrt(g_orbitStats.ch[i].m2 / (n - 1U));
+            l_welfordErr[i] = fmax(l_welfordErr[i], fabs(fsd - sd));
+            fsd = ((double)l_fSq[i] - (double)l_fSum[i] * l_fSum[i] / n) / (n - 1U);
+            fsd = (fsd > 0.0) ? sqrt(fsd) : 0.0;
+            l_naiveErr[i] = fmax(l_naiveErr[i], fabs(fsd - sd));
+            l_sdSum[i] += sd;
+            l_sdOrbits[i] += 1.0;
+        }
+    }
+    Bench_check(counts, "sample counts and residency");
+    Bench_check(extremes, "min and max");
+    Bench_check(means, "mean");
+    Bench_check(sds, "standard deviation");
+}
+
+int main(int argc, char *argv[]) {
+    static char const *const names[ORBIT_CHANNELS] = {
+        "battery [cWh]", "temperature [0.01 C]", "sun, Isc [0.1 mA]"
+    };
+    uint32_t orbits = 200U;
+    uint32_t sweepS = 60U;
+    unsigned seed = 1U;
+    uint32_t t;
+    uint32_t t0;
+    uint32_t end;
+    uint32_t summaries = 0U;
+    unsigned perOrbit;
+    unsigned perPass;
+    uint8_t state = 0U;
+    double battery = BATTERY_WH;
+    double temp = 20.0;
+    double phase;
+    double c;
+    double tAdd;
+    int opt;
+    uint8_t i;
+
+    while ((opt = getopt(argc, argv, "o:w:s:")) != -1) {
+        switch (opt) {
+            case 'o': orbits = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'w': sweepS = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-o orbits] [-w sweep_period_s] [-s seed]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if ((orbits == 0U) || (sweepS == 0U)) {
+        fprintf(stderr, "need an orbit and a sweep period\n");
+        return 2;
+    }
+    srand(seed);
+
+    t0 = 1000U * ORBIT_PERIOD_S + (uint32_t)(uniform() * ORBIT_PERIOD_S);
+    end = t0 + orbits * ORBIT_PERIOD_S;
+    OrbitStats_start(&g_orbitStats, t0);
+    reset();
+    for (t = t0; t < end; ++t) {
+        if (OrbitStats_due(&g_orbitStats, t)) {
+            verify(g_orbitStats.orbit);
+            ++summaries;
+            OrbitStats_start(&g_orbitStats, t);
+            reset();
+        }
+        phase = (double)(t % ORBIT_PERIOD_S) / ORBIT_PERIOD_S;
+        if (phase < SUNLIT) {
+            battery = fmin(battery + CHARGE_WH_S, 48.0);
+            temp += (60.0 - temp) / 900.0;
+        }
+        else {
+            battery = fmax(battery - DRAIN_WH_S, 0.0);
+            temp += (-20.0 - temp) / 900.0;
+        }
+        add(ORBIT_BATTERY, battery * 100.0);
+        if ((t % sweepS) == 0U) {
+            c = cos(2.0 * M_PI * fmod((double)t, SPIN_S) / SPIN_S);
+            add(ORBIT_TEMPERATURE, (temp + gauss(0.3)) * 100.0);
+            add(ORBIT_SUN, ((phase < SUNLIT) && (c > 0.0))
+                           ? (0.45 * c + gauss(0.002)) * 1e4 : gauss(0.0005) * 1e4);
+        }
+        if (uniform() < 0.01) {
+            state = (uint8_t)(rand() % ORBIT_STATES);
+        }
+        OrbitStats_tick(&g_orbitStats, state);
+        ++l_residency[state];
+    }
+
+    printf("%lu orbits of %u s, a sweep every %lu s: %lu summaries\n",
+           (unsigned long)orbits, (unsigned)ORBIT_PERIOD_S, (unsigned long)sweepS,
+           (unsigned long)summaries);
+    printf("Largest error in the standard deviation (float Welford, float sum of squares):\n");
+    for (i = 0U; i < ORBIT_CHANNELS; ++i) {
+        printf("  %-22s %10.4f %12.4f   (typical sd %.1f)\n", names[i], l_welfordErr[i],
+               l_naiveErr[i], (l_sdOrbits[i] > 0.0) ? l_sdSum[i] / l_sdOrbits[i] : 0.0);
+    }
+    perOrbit = (unsigned)(sizeof(LogOrbit) + HOUSEKEEPING + 2U * DL_OVERHEAD);
+    perPass = (unsigned)(ORBIT_PERIOD_S / TELEMETRY_PASS_S) * (HOUSEKEEPING + DL_OVERHEAD);
+    printf("Downlink per orbit: %u bytes in two records, against %.0f bytes of raw samples "
+           "(%.0fx) or %u in a housekeeping record per Telemetry pass (%.0fx)\n", perOrbit,
+           (double)l_samples * RAW_SAMPLE / orbits,
+           (double)l_samples * RAW_SAMPLE / orbits / perOrbit, perPass,
+           (double)perPass / perOrbit);
+
+    OrbitStats_start(&g_orbitStats, 0U);
+    tAdd = Bench_seconds();
+    for (t = 0U; t < 10000000UL; ++t) {
+        OrbitStats_add(&g_orbitStats, ORBIT_BATTERY, (float)(t & 0xFFFU));
+        if (g_orbitStats.ch[ORBIT_BATTERY].n == 0xFFFFU) {
+            g_orbitStats.ch[ORBIT_BATTERY].n = 0U;
+        }
+    }
+    tAdd = Bench_seconds() - tAdd;
+    printf("OrbitStats_add: %.1f ns on this host\n", tAdd * 1e9 / 1e7);
+
+    return Bench_finish();
+}
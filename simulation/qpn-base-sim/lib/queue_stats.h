@@ -0,0 +1,38 @@
+#ifndef QUEUE_STATS_H
+#define QUEUE_STATS_H
+
+
+/* Event queue instrumentation ---------------------------------------------*/
+/*
+* Posting through QueueStats_post()/QueueStats_postISR() instead of the plain
+* QACTIVE_POST macros records the peak queue depth (nUsed) of every active
+* object and counts failed posts per signal. Critical signals may use every
+* free slot; non-critical (periodic) signals are dropped once fewer than
+* QSTATS_DROP_MARGIN slots are left. A full queue is counted, never asserted,
+* so an event burst no longer ends in Q_onAssert() and a CPU reset. Time
+* events go the same way when the tick ISR calls QueueStats_tickXISR()
+* instead of QF_tickXISR().
+*/
+enum {
+    QSTATS_MAX_ACTIVE  = 1,             /* number of instrumented AOs (prio 1..N) */
+    QSTATS_DROP_MARGIN = 2,             /* free slots kept for critical signals */
+    QSTATS_NUM_SIGS    = MAX_SIG - Q_TIMEOUT_SIG
+};
+
+typedef struct QueueStats {
+    uint8_t  qlen;                      /* capacity of the event queue */
+    uint8_t  peak;                      /* high-water mark of nUsed */
+    uint16_t posted;                    /* successful posts */
+    uint16_t failed[QSTATS_NUM_SIGS];   /* failed posts per signal from Q_TIMEOUT_SIG */
+} QueueStats;
+
+bool QueueStats_post(QActive * const ao, enum_t const sig, QParam const par);
+bool QueueStats_postISR(QActive * const ao, enum_t const sig, QParam const par);
+void QueueStats_tickXISR(uint_fast8_t const tickRate);
+
+/* Copies the counters of the AO with priority 'prio' (interrupt safe) */
+void QueueStats_get(uint8_t prio, QueueStats * const out);
+void QueueStats_clear(void);
+void QueueStats_report(void);
+
+#endif /* QUEUE_STATS_H */
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "qpn.h"    /* QP-nano framework API */
 #include "../lib/bsp.h"  /* Board Support Package interface */
+#include "../lib/queue_stats.h"
 
 // Q_DEFINE_THIS_FILE
 
@@ -21,6 +22,7 @@ QActiveCB const Q_ROM QF_active[] = {
 /* local objects -----------------------------------------------------------*/
 static FILE *l_outFile = (FILE *)0;
 static void dispatch(QSignal sig);
+static void drainQueue(void);
 static int outf;
 int simTime = 0;            /* TIME MINUTES */
 int seed;
@@ -52,6 +54,7 @@ int main(int argc, char *argv[]) {
     BSP_init();
 
     CubeSat_ctor();  // Initialize CubeSat AO
+    ((QActive *)&AO_CubeSat)->prio = 1U;  /* normally assigned by QF_run() */
     QHsm_init_((QHsm *)&AO_CubeSat);
 
     dispatch(Q_LEO_SIG);
@@ -68,12 +71,14 @@ int main(int argc, char *argv[]) {
         }
         printf("Total power in battery: %.2f\n", battery_watt_h);  // Debug print
 
-        dispatch(Q_TICK_SIG);
-        dispatch(Q_BATTERY_SIG);
+        QueueStats_post((QActive *)&AO_CubeSat, Q_TICK_SIG, 0U);
+        QueueStats_post((QActive *)&AO_CubeSat, Q_BATTERY_SIG, 0U);
+        drainQueue();
         simTime++;
 
         printf("Simulation time: %d minutes\n", simTime);  // Debug print
     }
+    QueueStats_report();
     printf("done");
     if (outf) fclose(l_outFile);
 
@@ -89,6 +94,24 @@ static void dispatch(QSignal sig) {
     QHsm_dispatch_((QHsm *)&AO_CubeSat);              /* dispatch the event */
 }
 
+/* One pass of the QV-nano event loop: run every queued event to completion */
+static void drainQueue(void) {
+    QActive * const a = (QActive *)&AO_CubeSat;
+    QActiveCB const Q_ROM *acb = &QF_active[a->prio];
+
+    while (a->nUsed > 0U) {
+        --a->nUsed;
+        Q_SIG(a) = QF_ROM_QUEUE_AT_(acb, a->tail).sig;
+        Q_PAR(a) = QF_ROM_QUEUE_AT_(acb, a->tail).par;
+        if (a->tail == 0U) { /* wrap around? */
+            a->tail = Q_ROM_BYTE(acb->qlen);
+        }
+        --a->tail;
+        QHSM_DISPATCH(&a->super);
+    }
+    QF_readySet_ &= (uint_fast8_t)~(1U << (a->prio - 1U));
+}
+
 void readCSV(const char *filename) {
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
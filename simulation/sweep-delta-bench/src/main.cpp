@@ -0,0 +1,522 @@
+/* Delta sweep codec bench ---------------------------------------------------*/
+/*
+* Runs the flight delta encoder (SweepCodec_encodeDelta() in
+* firmware/src/sweep_codec.cpp) over -n rounds of sweeps of -c cells, as
+* the AMU driver delivers them: every cell once per round, -w seconds
+* apart. Each cell is a single-diode model (as in the AMU emulator) whose
+* photocurrent follows the sun angle while the spacecraft turns once every
+* -t seconds and whose Voc follows its temperature, with +/- -i uA of
+* current noise.
+*
+* A ground decoder written here from the packet description keeps the
+* keys (full packets and unkeyed deltas) and decodes the stream; every sweep must come back as exactly the
+* values a full packet carries. Packets are dropped with probability -l
+* before the decoder, which then counts the sweeps lost with their key.
+* Reports bytes per sweep for full packets and for the stream, how much
+* of the current channel the reference saves, and the encoder time. With
+* -p the stream is written as "Sweep packet" lines for sweep_codec.py, and
+* with -f the full packets of the same sweeps, to compare it against.
+*
+* Exits non-zero when a sweep decodes wrong.
+*
+* usage: sweep-delta-bench [-n rounds] [-c cells] [-w sweep_period_s]
+*                          [-t turn_period_s] [-i noise_uA] [-l loss]
+*                          [-s seed] [-p packet_log] [-f full_log]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "qpn.h"
+#include "amu.h"
+#include "iv_params.h"
+#include "sweep_codec.h"
+#include "bench.h"
+
+#define SWEEP_US        1500000UL       /* AMU_SWEEP_TICKS worth */
+#define KEYS_PER_CELL   4U
+
+typedef struct {
+    float iph;                          /* at normal incidence */
+    float i0;
+    float a;
+    float rs;
+    float rsh;
+    float phase;                        /* of its face to the sun */
+} Cell;
+
+/* Values as a full packet carries them */
+typedef struct {
+    uint8_t cell;
+    uint32_t timestamp;
+    int32_t t[IVSWEEP_POINTS];
+    int32_t v[IVSWEEP_POINTS];
+    int32_t i[IVSWEEP_POINTS];
+} Quantized;
+
+typedef struct {
+    bool valid;
+    uint16_t time;
+    int32_t current[IVSWEEP_POINTS];
+} GroundKey;
+
+static Cell l_cells[AMU_MAX_DEVICES];
+static GroundKey l_keys[AMU_MAX_DEVICES][KEYS_PER_CELL];
+static uint8_t l_nextKey[AMU_MAX_DEVICES];
+
+static void logPacket(FILE *f, uint8_t const *pkt, uint16_t len) {
+    uint16_t k;
+
+    if (f == (FILE *)0) {
+        return;
+    }
+    fprintf(f, "Sweep packet (%u bytes): ", (unsigned)len);
+    for (k = 0U; k < len; ++k) {
+        fprintf(f, "%02X", pkt[k]);
+    }
+    fprintf(f, "\n");
+}
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+/* Model ---------------------------------------------------------------------*/
+static float diodeCurrent(Cell const *c, float iph, float a, float v) {
+    float i = iph;
+    uint8_t k;
+
+    for (k = 0U; k < 30U; ++k) {
+        float e = expf((v + i * c->rs) / a);
+        float f = iph - c->i0 * (e - 1.0f) - (v + i * c->rs) / c->rsh - i;
+        float df = -c->i0 * e * c->rs / a - c->rs / c->rsh - 1.0f;
+        float step = f / df;
+
+        i -= step;
+        if (fabsf(step) < 1e-9f) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void sweepCell(ivsweep_t *s, uint8_t cell, double t, double turnS, float noiseA) {
+    Cell const *c = &l_cells[cell];
+    double angle = (turnS > 0.0) ? 2.0 * M_PI * t / turnS + c->phase : c->phase;
+    float sun = (float)fmax(cos(angle), 0.05);      /* albedo when facing away */
+    float tempC = 20.0f + 15.0f * sun;
+    float a = c->a * (273.15f + tempC) / 298.15f;
+    float iph = c->iph * sun;
+    float voc = a * logf(iph / c->i0 + 1.0f);
+    float end = voc * 1.02f;
+    uint8_t k;
+
+    memset(s, 0, sizeof(*s));
+    s->cell = cell;
+    for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+        float v = end * k / (IVSWEEP_POINTS - 1U);
+
+        s->timestamp[k] = (uint32_t)((uint64_t)SWEEP_US * k / IVSWEEP_POINTS);
+        s->voltage[k] = v;
+        s->current[k] = diodeCurrent(c, iph, a, v) + noiseA * (float)(2.0 * uniform() - 1.0);
+    }
+    s->meta.voc = voc;
+    s->meta.isc = s->current[0];
+    s->meta.tsensor_start = tempC;
+    s->meta.tsensor_end = tempC + 0.1f;
+    s->meta.timestamp = (uint32_t)(t * 1000.0);
+}
+
+static void quantize(ivsweep_t const *s, Quantized *q) {
+    uint8_t k;
+
+    q->cell = s->cell;
+    q->timestamp = s->meta.timestamp;
+    for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+        q->t[k] = (int32_t)s->timestamp[k];
+        q->v[k] = compress_voltage(s->voltage[k]);
+        q->i[k] = compress_current(s->current[k]);
+    }
+}
+
+/* Ground decoder ------------------------------------------------------------*/
+typedef struct {
+    uint8_t const *p;
+    uint16_t len;
+    uint32_t pos;                       /* bits */
+    bool bad;
+} BitReader;
+
+static uint32_t getBit(BitReader *r) {
+    uint32_t b;
+
+    if ((r->pos >> 3) >= r->len) {
+        r->bad = true;
+        return 0U;
+    }
+    b = (r->p[r->pos >> 3] >> (7U - (r->pos & 7U))) & 1U;
+    ++r->pos;
+    return b;
+}
+
+static uint32_t getBits(BitReader *r, uint8_t n) {
+    uint32_t v = 0U;
+
+    while (n-- != 0U) {
+        v = (v << 1) | getBit(r);
+    }
+    return v;
+}
+
+static int32_t unzigzag(uint32_t z) {
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1U);
+}
+
+static int32_t getExpGolomb(BitReader *r, uint8_t k) {
+    uint8_t zeros = 0U;
+    uint32_t m;
+
+    while ((getBit(r) == 0U) && !r->bad) {
+        if (++zeros > 31U) {
+            r->bad = true;
+            return 0;
+        }
+    }
+    m = (1UL << zeros) | getBits(r, zeros);
+    return unzigzag(((m - 1U) << k) | getBits(r, k));
+}
+
+static bool getVarint(uint8_t const *p, uint16_t len, uint16_t *pos, int32_t *v) {
+    uint32_t z = 0U;
+    uint8_t shift = 0U;
+
+    do {
+        if ((*pos >= len) || (shift > 28U)) {
+            return false;
+        }
+        z |= (uint32_t)(p[*pos] & 0x7FU) << shift;
+        shift = (uint8_t)(shift + 7U);
+    } while (p[(*pos)++] >= 0x80U);
+    *v = unzigzag(z);
+    return true;
+}
+
+/* Codes back to values, in place */
+static void undiff(int32_t *x, uint8_t order) {
+    int32_t delta = 0;
+    uint8_t k;
+
+    for (k = 1U; k < IVSWEEP_POINTS; ++k) {
+        delta = ((order == 2U) && (k >= 2U)) ? delta + x[k] : x[k];
+        x[k] = x[k - 1] + delta;
+    }
+}
+
+static uint32_t getLe(uint8_t const *p, uint8_t n) {
+    uint32_t v = 0U;
+
+    while (n-- != 0U) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+static GroundKey *findKey(uint8_t cell, uint16_t time) {
+    uint8_t k;
+
+    for (k = 0U; k < KEYS_PER_CELL; ++k) {
+        if (l_keys[cell][k].valid && (l_keys[cell][k].time == time)) {
+            return &l_keys[cell][k];
+        }
+    }
+    return (GroundKey *)0;
+}
+
+static void storeKey(Quantized const *q) {
+    GroundKey *key = &l_keys[q->cell][l_nextKey[q->cell]];
+
+    l_nextKey[q->cell] = (uint8_t)((l_nextKey[q->cell] + 1U) % KEYS_PER_CELL);
+    key->valid = true;
+    key->time = (uint16_t)q->timestamp;
+    memcpy(key->current, q->i, sizeof(key->current));
+}
+
+/* 1 decoded, 0 no key, -1 malformed */
+static int decode(uint8_t const *pkt, uint16_t len, Quantized *q) {
+    int32_t *ch[3] = { q->t, q->v, q->i };
+    GroundKey *key = (GroundKey *)0;
+    bool unkeyed;
+    uint16_t pos;
+    uint8_t c;
+    uint8_t k;
+
+    if ((len < 18U) || (crc16_ccitt(0xFFFFU, pkt, (uint16_t)(len - 2U))
+                        != getLe(&pkt[len - 2U], 2U)) || (pkt[3] != IVSWEEP_POINTS)
+        || (pkt[2] >= AMU_MAX_DEVICES)) {
+        return -1;
+    }
+    q->cell = pkt[2];
+    len = (uint16_t)(len - 2U);
+    if (pkt[0] == SWEEP_PKT_TYPE) {
+        q->timestamp = getLe(&pkt[4], 4U);
+        pos = 16U;
+        for (c = 0U; c < 3U; ++c) {
+            for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+                if (!getVarint(pkt, len, &pos, &ch[c][k])) {
+                    return -1;
+                }
+            }
+            undiff(ch[c], (c == 2U) ? 1U : 2U);
+        }
+        storeKey(q);
+        return (pos == len) ? 1 : -1;
+    }
+    if ((pkt[0] != SWEEP_PKT_DELTA) || (len < SWEEP_DELTA_HEADER)) {
+        return -1;
+    }
+    unkeyed = ((pkt[19] & SWEEP_DELTA_UNKEYED) != 0U);
+    if (!unkeyed) {
+        key = findKey(q->cell, (uint16_t)getLe(&pkt[4], 2U));
+        if (key == (GroundKey *)0) {
+            return 0;
+        }
+    }
+    q->timestamp = getLe(&pkt[6], 4U);
+    BitReader r = { &pkt[SWEEP_DELTA_HEADER], (uint16_t)(len - SWEEP_DELTA_HEADER), 0U, false };
+    uint8_t kk[3] = { (uint8_t)(pkt[18] & 0x0FU), (uint8_t)(pkt[18] >> 4),
+                      (uint8_t)(pkt[19] & 0x0FU) };
+    for (c = 0U; c < 3U; ++c) {
+        for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+            ch[c][k] = getExpGolomb(&r, kk[c]);
+        }
+        undiff(ch[c], (c == 2U) ? 1U : 2U);
+    }
+    for (k = 0U; (key != (GroundKey *)0) && (k < IVSWEEP_POINTS); ++k) {
+        q->i[k] += key->current[k];
+    }
+    if (r.bad || ((uint32_t)r.len * 8U - r.pos >= 8U)
+        || (getBits(&r, (uint8_t)(r.len * 8U - r.pos)) != 0U)) {
+        return -1;
+    }
+    if (unkeyed) {
+        storeKey(q);
+    }
+    return 1;
+}
+
+/* Bits of the current channel coded as in a delta, but without a key */
+static uint32_t currentBitsUnkeyed(Quantized const *q) {
+    uint32_t best = 0xFFFFFFFFUL;
+    uint32_t bits;
+    int32_t d;
+    uint32_t z;
+    uint32_t m;
+    uint8_t k;
+    uint8_t i;
+    uint8_t n;
+
+    for (k = 0U; k <= 15U; ++k) {
+        bits = 0U;
+        for (i = 0U; i < IVSWEEP_POINTS; ++i) {
+            d = (i == 0U) ? q->i[0] : q->i[i] - q->i[i - 1];
+            z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            m = (z >> k) + 1U;
+            for (n = 0U; m != 0U; m >>= 1) {
+                ++n;
+            }
+            bits += 2U * n - 1U + k;
+        }
+        best = (bits < best) ? bits : best;
+    }
+    return best;
+}
+
+/* Bits the delta spends on the current, from its k and stream */
+static uint32_t currentBitsKeyed(uint8_t const *pkt, uint16_t len) {
+    BitReader r = { &pkt[SWEEP_DELTA_HEADER], (uint16_t)(len - 2U - SWEEP_DELTA_HEADER),
+                    0U, false };
+    uint8_t kk[3] = { (uint8_t)(pkt[18] & 0x0FU), (uint8_t)(pkt[18] >> 4), pkt[19] };
+    uint32_t start = 0U;
+    uint8_t c;
+    uint8_t k;
+
+    for (c = 0U; c < 3U; ++c) {
+        if (c == 2U) {
+            start = r.pos;
+        }
+        for (k = 0U; k < IVSWEEP_POINTS; ++k) {
+            (void)getExpGolomb(&r, kk[c]);
+        }
+    }
+    return r.pos - start;
+}
+
+int main(int argc, char *argv[]) {
+    static ivsweep_t sweep;
+    static uint8_t pkt[SWEEP_PKT_MAX];
+    static uint8_t full[SWEEP_PKT_MAX];
+    SweepRefs refs;
+    Quantized want;
+    Quantized got;
+    uint32_t rounds = 2000U;
+    uint8_t cells = 4U;
+    double sweepS = 60.0;
+    double turnS = 5684.0;
+    float noiseA = 20e-6f;
+    double loss = 0.0;
+    unsigned seed = 1U;
+    char const *logPath = (char const *)0;
+    char const *fullPath = (char const *)0;
+    FILE *log = (FILE *)0;
+    FILE *fullLog = (FILE *)0;
+    uint64_t fullBytes = 0U;
+    uint64_t streamBytes = 0U;
+    uint64_t deltaBytes = 0U;
+    uint64_t keyedBits = 0U;
+    uint64_t unkeyedBits = 0U;
+    uint32_t deltas = 0U;
+    uint32_t keys = 0U;
+    uint32_t fulls = 0U;
+    uint32_t sent = 0U;
+    uint32_t dropped = 0U;
+    uint32_t noKey = 0U;
+    uint32_t wrong = 0U;
+    uint32_t r;
+    uint16_t len;
+    uint16_t fullLen;
+    uint8_t c;
+    double tEnc;
+    double tFull;
+    double t0;
+    int opt;
+    int res;
+
+    while ((opt = getopt(argc, argv, "n:c:w:t:i:l:s:p:f:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 'c': cells = (uint8_t)strtoul(optarg, 0, 0); break;
+            case 'w': sweepS = strtod(optarg, 0); break;
+            case 't': turnS = strtod(optarg, 0); break;
+            case 'i': noiseA = (float)(strtod(optarg, 0) * 1e-6); break;
+            case 'l': loss = strtod(optarg, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            case 'p': logPath = optarg; break;
+            case 'f': fullPath = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-c cells] [-w sweep_period_s] "
+                        "[-t turn_period_s] [-i noise_uA] [-l loss] [-s seed] "
+                        "[-p packet_log] [-f full_log]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((rounds == 0U) || (cells == 0U) || (cells > AMU_MAX_DEVICES)) {
+        fprintf(stderr, "need a round and 1..%u cells\n", (unsigned)AMU_MAX_DEVICES);
+        return 2;
+    }
+    if ((logPath != (char const *)0) && ((log = fopen(logPath, "w")) == (FILE *)0)) {
+        perror(logPath);
+        return 2;
+    }
+    if ((fullPath != (char const *)0) && ((fullLog = fopen(fullPath, "w")) == (FILE *)0)) {
+        perror(fullPath);
+        return 2;
+    }
+    srand(seed);
+    for (c = 0U; c < cells; ++c) {                  /* as the AMU emulator */
+        l_cells[c].iph = 0.015f + 0.005f * (float)uniform();
+        l_cells[c].i0 = 1e-13f * (1.0f + 9.0f * (float)uniform());
+        l_cells[c].a = 0.09f + 0.03f * (float)uniform();
+        l_cells[c].rs = 0.5f + 2.5f * (float)uniform();
+        l_cells[c].rsh = 500.0f + 4500.0f * (float)uniform();
+        l_cells[c].phase = (float)(2.0 * M_PI * c / cells);
+    }
+
+    SweepCodec_initRefs(&refs);
+    tEnc = 0.0;
+    tFull = 0.0;
+    for (r = 0U; r < rounds; ++r) {
+        for (c = 0U; c < cells; ++c) {
+            sweepCell(&sweep, c, r * sweepS + c * 2.0, turnS, noiseA);
+            quantize(&sweep, &want);
+
+            t0 = Bench_seconds();
+            fullLen = SweepCodec_encode(&sweep, full, sizeof(full));
+            tFull += Bench_seconds() - t0;
+            t0 = Bench_seconds();
+            len = SweepCodec_encodeDelta(&refs, &sweep, pkt, sizeof(pkt));
+            tEnc += Bench_seconds() - t0;
+
+            fullBytes += fullLen;
+            streamBytes += len;
+            ++sent;
+            if (!SweepCodec_isKey(pkt)) {
+                ++deltas;
+                deltaBytes += len;
+                keyedBits += currentBitsKeyed(pkt, len);
+                unkeyedBits += currentBitsUnkeyed(&want);
+            }
+            else if (pkt[0] == SWEEP_PKT_TYPE) {
+                ++keys;
+                ++fulls;
+                Bench_check(memcmp(pkt, full, fullLen) == 0, "key = full packet");
+            }
+            else {
+                ++keys;
+            }
+            logPacket(log, pkt, len);
+            logPacket(fullLog, full, fullLen);
+
+            if (uniform() < loss) {
+                ++dropped;
+                continue;
+            }
+            memset(&got, 0, sizeof(got));
+            res = decode(pkt, len, &got);
+            if (res == 0) {
+                ++noKey;
+            }
+            else if ((res < 0) || (got.cell != want.cell) || (got.timestamp != want.timestamp)
+                     || (memcmp(got.t, want.t, sizeof(got.t)) != 0)
+                     || (memcmp(got.v, want.v, sizeof(got.v)) != 0)
+                     || (memcmp(got.i, want.i, sizeof(got.i)) != 0)) {
+                ++wrong;
+            }
+        }
+    }
+    if (log != (FILE *)0) {
+        fclose(log);
+    }
+    if (fullLog != (FILE *)0) {
+        fclose(fullLog);
+    }
+
+    printf("%lu sweeps of %u cells (%u reference slots, a key every %u), "
+           "%.0f s apart, turning every %.0f s\n",
+           (unsigned long)sent, (unsigned)cells, (unsigned)SWEEP_REF_SLOTS,
+           (unsigned)SWEEP_KEY_INTERVAL + 1U, sweepS, turnS);
+    printf("Full packets: %.1f bytes a sweep\n", (double)fullBytes / sent);
+    printf("Stream:       %.1f bytes a sweep (%.2fx), %lu keys (%lu full) and %lu deltas "
+           "of %.1f bytes\n", (double)streamBytes / sent, (double)fullBytes / streamBytes,
+           (unsigned long)keys, (unsigned long)fulls, (unsigned long)deltas,
+           deltas ? (double)deltaBytes / deltas : 0.0);
+    if (deltas != 0U) {
+        printf("Current channel of a delta: %.1f bytes against its key, %.1f without\n",
+               keyedBits / 8.0 / deltas, unkeyedBits / 8.0 / deltas);
+    }
+    printf("Encoding on this host: %.1f us a sweep, %.1f us for a full packet\n",
+           tEnc * 1e6 / sent, tFull * 1e6 / sent);
+    if (loss > 0.0) {
+        printf("Loss %.0f%%: %lu dropped, %lu more lost with their key (%.1f%% of the rest)\n",
+               loss * 100.0, (unsigned long)dropped, (unsigned long)noKey,
+               (sent > dropped) ? 100.0 * noKey / (sent - dropped) : 0.0);
+    }
+    Bench_check(wrong == 0U, "every decoded sweep = its full packet, %lu wrong",
+                (unsigned long)wrong);
+    Bench_check(keys + deltas == sent, "every sweep encoded");
+
+    return Bench_finish();
+}
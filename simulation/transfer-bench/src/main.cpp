@@ -0,0 +1,521 @@
+/* Selective-repeat transfer bench -------------------------------------------*/
+/*
+* Runs the flight transfer (Downlink_startTransfer(), Downlink_nack() and
+* Communication_receive() in firmware/src/subsystems/communication.cpp) on
+* a RAM-backed log holding a day of raw sweep parts, parameters and
+* housekeeping, all sent already. The ground asks for the day's sweep
+* parts, then after every pass uplinks which chunks it still lacks. Each
+* downlink frame is lost with probability p, each uplink frame with
+* probability -u. Passes are -d seconds at -b bit/s, one Downlink_tick()
+* a second as in the Transmit state.
+*
+* For comparison the same chunks are sent by
+*   - a carousel: the whole archive over and over, no uplink at all;
+*   - stop-and-wait: each frame waits for an ack, -w seconds of turnaround,
+*     and goes again until one comes.
+* It reports the mean number of passes until the ground holds every chunk,
+* for frame loss 0..50 %, over -n runs each; for the transfer also until
+* the spacecraft has closed it; a + marks runs that did not finish in
+* PASSES_MAX passes. Exits non-zero when a chunk arrives
+* corrupted, a frame overflows, or a transfer does not finish. A request
+* whose 'until' comes before its 'from' must be answered as empty and
+* closed in one pass.
+*
+* usage: transfer-bench [-d pass_s] [-b rate_bps] [-u uplink_loss]
+*                       [-w turnaround_s] [-n runs] [-s seed]
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qpn.h"
+#include "bsp.h"
+#include "queue_stats.h"
+#include "log_store.h"
+#include "datacollection.h"
+#include "serial_frame.h"
+#include "messages.h"
+#include "radio.h"
+#include "communication.h"
+#include "bench.h"
+
+#define HOUSEKEEPING_LEN    14U         /* sizeof(LogHousekeeping) on AVR */
+#define PARAMS_LEN          40U         /* sweep_codec parameter packet */
+#define SWEEP_LEN           160U        /* typical sweep_codec sweep packet */
+#define ORBIT_S             5684U       /* seconds per orbit */
+#define DAY_S               86400UL
+#define CELLS               4U
+#define NVM_SIZE            65536UL
+#define PASSES_MAX          200U
+#define UPLINK_MAX          8U          /* frames queued per listen window */
+#define NACK_BITS           (8U * (SF_RX_MAX - 4U))
+
+static uint8_t l_nvm[NVM_SIZE];
+static uint32_t l_now;
+
+/* What the ground has, and what it wanted */
+static struct {
+    bool known;                         /* a status came down */
+    uint16_t base;
+    uint16_t count;
+    uint8_t want[XFER_CHUNKS_MAX];      /* 1: a sweep part it asked for */
+    uint8_t have[XFER_CHUNKS_MAX];
+    uint16_t wanted;
+    uint16_t got;
+} l_gnd;
+
+/* One frame's records, delivered or dropped whole */
+static struct {
+    uint16_t seq[DL_FRAME_RECORDS + 1];
+    bool ok[DL_FRAME_RECORDS + 1];
+    bool status;
+    uint16_t count;
+    uint8_t n;
+} l_frame;
+
+static uint8_t l_up[UPLINK_MAX][SF_RX_MAX];
+static uint8_t l_upLen[UPLINK_MAX];
+static uint8_t l_upHead;
+static uint8_t l_upTail;
+
+static double l_loss;
+static double l_upLoss;
+static uint32_t l_overflows;
+static uint32_t l_corrupt;
+
+static bool chance(double p) {
+    return ((double)rand() / RAND_MAX) < p;
+}
+
+static uint8_t fill(uint16_t seq, uint8_t i) {
+    return (uint8_t)(seq * 7U + i);
+}
+
+/* Glue the flight transfer links against ------------------------------------*/
+LogStore g_telemetryLog;
+
+uint32_t DataCollection_now(void) {
+    return l_now;
+}
+
+uint16_t DataCollection_loadCounter(void) {
+    return 0U;
+}
+
+void DataCollection_saveCounter(uint16_t counter) {
+}
+
+/* Frames are not encoded here; fec-bench covers radio.cpp */
+void Radio_begin(void) {
+}
+
+void Radio_write(void const *data, uint16_t len) {
+}
+
+void Radio_writev(MsgSegment const *seg, uint8_t n) {
+}
+
+void Radio_end(void) {
+}
+
+uint8_t Radio_receive(uint8_t const **frame) {
+    uint8_t i;
+
+    if (l_upTail == l_upHead) {
+        return 0U;
+    }
+    i = l_upTail++;
+    *frame = l_up[i];
+    return l_upLen[i];
+}
+
+/* No AO here; command-bench covers the commands */
+bool QueueStats_post(QActive * const ao, enum_t const sig, QParam const par) {
+    return true;
+}
+
+static void frameBegin(void) {
+    l_frame.n = 0U;
+    l_frame.status = false;
+}
+
+static void frameRecord(LogRecord const *rec) {
+    uint8_t i;
+
+    if (rec->type == LOG_REC_XFER) {
+        l_frame.status = true;
+        l_frame.seq[DL_FRAME_RECORDS] = rec->seq;
+        l_frame.count = (uint16_t)(rec->payload[0] | (rec->payload[1] << 8));
+        return;
+    }
+    l_frame.seq[l_frame.n] = rec->seq;
+    l_frame.ok[l_frame.n] = true;
+    for (i = 0U; i < rec->len; ++i) {
+        if (rec->payload[i] != fill(rec->seq, i)) {
+            l_frame.ok[l_frame.n] = false;
+        }
+    }
+    ++l_frame.n;
+}
+
+static void deliver(uint16_t seq, bool ok) {
+    uint16_t i = (uint16_t)(seq - l_gnd.base);
+
+    if (!ok) {
+        ++l_corrupt;
+    }
+    else if ((i < XFER_CHUNKS_MAX) && l_gnd.want[i] && !l_gnd.have[i]) {
+        l_gnd.have[i] = 1U;
+        ++l_gnd.got;
+    }
+}
+
+static void frameEnd(void) {
+    uint8_t i;
+
+    if (chance(l_loss)) {
+        return;
+    }
+    if (l_frame.status) {
+        l_gnd.known = true;
+        if (l_frame.seq[DL_FRAME_RECORDS] != l_gnd.base) {
+            ++l_corrupt;            /* not the transfer asked for */
+        }
+        l_gnd.count = l_frame.count;
+    }
+    for (i = 0U; i < l_frame.n; ++i) {
+        deliver(l_frame.seq[i], l_frame.ok[i]);
+    }
+}
+
+static DownlinkSink const l_sink = { &frameBegin, &frameRecord, &frameEnd };
+
+/* RAM NVM with EEPROM semantics */
+static void nvmRead(uint32_t addr, void *buf, uint16_t len) {
+    memcpy(buf, &l_nvm[addr], len);
+}
+
+static void nvmWrite(uint32_t addr, void const *buf, uint16_t len) {
+    memcpy(&l_nvm[addr], buf, len);
+}
+
+static NvmDev const l_dev = { &nvmRead, &nvmWrite, (void (*)(uint32_t))0, NVM_SIZE, 0U };
+
+/* The archive ---------------------------------------------------------------*/
+static void append(uint8_t type, uint8_t tag, uint8_t len) {
+    uint8_t buf[LOG_PAYLOAD_MAX];
+    uint16_t seq = g_telemetryLog.nextSeq;
+    uint8_t i;
+
+    for (i = 0U; i < len; ++i) {
+        buf[i] = fill(seq, i);
+    }
+    LogStore_append(&g_telemetryLog, type, tag, l_now, buf, len);
+    LogStore_markSent(&g_telemetryLog, seq);
+    if (type == LOG_REC_SWEEP) {
+        l_gnd.want[seq - l_gnd.base] = 1U;
+        ++l_gnd.wanted;
+    }
+}
+
+/* A day, 6 housekeeping and 4 raw sweeps an orbit, from l_now = 1 */
+static void archive(void) {
+    uint8_t const parts = (uint8_t)((SWEEP_LEN + DC_SWEEP_CHUNK - 1U) / DC_SWEEP_CHUNK);
+    uint16_t left;
+    uint8_t cell = 0U;
+    uint8_t i;
+
+    memset(l_nvm, 0xFF, sizeof(l_nvm));
+    LogStore_init(&g_telemetryLog, &l_dev, 0U, NVM_SIZE);
+    for (l_now = 1U; l_now <= DAY_S; ++l_now) {
+        if ((l_now % (ORBIT_S / 6U)) == 0U) {
+            append(LOG_REC_HOUSEKEEPING, LOG_TAG_NONE, HOUSEKEEPING_LEN);
+        }
+        if ((l_now % (ORBIT_S / 4U)) == 0U) {
+            left = SWEEP_LEN;
+            for (i = 0U; i < parts; ++i) {
+                uint8_t chunk = (left > DC_SWEEP_CHUNK) ? (uint8_t)DC_SWEEP_CHUNK : (uint8_t)left;
+                append(LOG_REC_SWEEP, cell, (uint8_t)(chunk + 1U));
+                left = (uint16_t)(left - chunk);
+            }
+            append(LOG_REC_PARAMS, cell, PARAMS_LEN);
+            cell = (uint8_t)((cell + 1U) % CELLS);
+        }
+    }
+}
+
+static void reset(void) {
+    memset(&l_gnd, 0, sizeof(l_gnd));  /* base 0: archive() starts a fresh log */
+    archive();
+}
+
+/* The ground's uplink, each frame lost with probability -u */
+static void uplink(uint8_t const *frame, uint8_t len) {
+    if (!chance(l_upLoss) && (l_upHead < UPLINK_MAX)) {
+        memcpy(l_up[l_upHead], frame, len);
+        l_upLen[l_upHead++] = len;
+    }
+}
+
+static void listen(uint8_t id) {
+    uint8_t f[SF_RX_MAX];
+    uint16_t first;
+    uint16_t i;
+
+    l_upHead = 0U;
+    l_upTail = 0U;
+    if (!l_gnd.known) {
+        f[0] = SF_XFER_START;
+        f[1] = id;
+        memset(&f[2], 0, 4U);           /* from 0 */
+        memset(&f[6], 0xFF, 4U);        /* until the newest */
+        f[10] = LOG_REC_SWEEP;
+        f[11] = LOG_TAG_NONE;
+        uplink(f, 12U);
+    }
+    else {
+        for (first = 0U; first < l_gnd.count; first = (uint16_t)(first + NACK_BITS)) {
+            memset(f, 0, sizeof(f));
+            f[0] = SF_XFER_NACK;
+            f[1] = id;
+            f[2] = (uint8_t)first;
+            f[3] = (uint8_t)(first >> 8);
+            for (i = 0U; (i < NACK_BITS) && (first + i < l_gnd.count); ++i) {
+                if (!l_gnd.have[first + i]) {
+                    f[4U + (i >> 3)] |= (uint8_t)(1U << (i & 7U));
+                }
+            }
+            uplink(f, SF_RX_MAX);
+        }
+    }
+    Communication_receive((QActive *)0);
+}
+
+/* Runs ----------------------------------------------------------------------*/
+typedef struct Result {
+    uint32_t done;                      /* passes until the ground has it all */
+    uint32_t closed;                    /* ... and the transfer is closed */
+    bool ok;
+} Result;
+
+static Result selective(uint8_t id, uint16_t pass_s, uint16_t rate) {
+    Result r = { 0U, 0U, false };
+    uint32_t pass;
+    uint32_t t;
+
+    reset();
+    Downlink_init(&g_downlink, &g_telemetryLog, &l_sink);
+    listen(id);                         /* the request, in an earlier pass */
+    for (pass = 1U; pass <= PASSES_MAX; ++pass) {
+        Downlink_beginPass(&g_downlink, pass_s, rate);
+        for (t = 0U; (t < pass_s) && Downlink_tick(&g_downlink, l_now); ++t) {
+            ++l_now;
+        }
+        if (g_downlink.payload > (uint32_t)g_downlink.frames * DL_FRAME_PAYLOAD) {
+            ++l_overflows;
+        }
+        if ((r.done == 0U) && (l_gnd.wanted != 0U) && (l_gnd.got == l_gnd.wanted)) {
+            r.done = pass;
+        }
+        if (g_downlink.xfer.id == 0U) {
+            if (l_gnd.known) {
+                r.closed = pass;
+                r.ok = (r.done != 0U);
+                break;
+            }
+        }
+        listen(id);
+        l_now += ORBIT_S;
+    }
+    return r;
+}
+
+/* Until before from: no chunks, and closed by the first status */
+static bool emptyRange(uint8_t id, uint16_t pass_s, uint16_t rate) {
+    uint32_t t;
+
+    reset();
+    Downlink_init(&g_downlink, &g_telemetryLog, &l_sink);
+    Downlink_startTransfer(&g_downlink, id, DAY_S / 2U, DAY_S / 4U, LOG_REC_SWEEP, LOG_TAG_NONE);
+    if (g_downlink.xfer.count != 0U) {
+        return false;
+    }
+    Downlink_beginPass(&g_downlink, pass_s, rate);
+    for (t = 0U; (t < pass_s) && Downlink_tick(&g_downlink, l_now); ++t) {
+        ++l_now;
+    }
+    return g_downlink.xfer.id == 0U;
+}
+
+/* The wanted chunks in order, packed into frames as the flight code would */
+static uint16_t l_chunk[XFER_CHUNKS_MAX];
+static uint8_t l_chunkSize[XFER_CHUNKS_MAX];
+static uint16_t l_chunks;
+
+static void chunks(void) {
+    LogRecord rec;
+    uint16_t i;
+
+    l_chunks = 0U;
+    for (i = 0U; i < XFER_CHUNKS_MAX; ++i) {
+        if (l_gnd.want[i] && LogStore_read(&g_telemetryLog, (uint16_t)(l_gnd.base + i), &rec)) {
+            l_chunk[l_chunks] = i;
+            l_chunkSize[l_chunks++] = (uint8_t)(rec.len + DL_RECORD_OVERHEAD);
+        }
+    }
+}
+
+/* Chunks in the frame starting at chunk 'k' */
+static uint16_t frameOf(uint16_t k) {
+    uint16_t bytes = 0U;
+    uint16_t n = 0U;
+
+    while ((k + n < l_chunks) && (bytes + l_chunkSize[k + n] <= DL_FRAME_PAYLOAD)) {
+        bytes = (uint16_t)(bytes + l_chunkSize[k + n]);
+        ++n;
+    }
+    return n;
+}
+
+static void take(uint16_t k, uint16_t n) {
+    while (n-- != 0U) {
+        uint16_t i = l_chunk[k++];
+        if (!l_gnd.have[i]) {
+            l_gnd.have[i] = 1U;
+            ++l_gnd.got;
+        }
+    }
+}
+
+static uint32_t carousel(uint16_t pass_s, uint16_t rate) {
+    uint32_t frames = (uint32_t)pass_s * (rate / 8U) / DL_FRAME_AIR;
+    uint32_t pass;
+    uint32_t i;
+    uint16_t k = 0U;
+    uint16_t n;
+
+    reset();
+    chunks();
+    for (pass = 1U; pass <= PASSES_MAX; ++pass) {
+        for (i = 0U; i < frames; ++i) {
+            n = frameOf(k);
+            if (!chance(l_loss)) {
+                take(k, n);
+            }
+            k = (uint16_t)(k + n);
+            if (k >= l_chunks) {
+                k = 0U;
+            }
+        }
+        if (l_gnd.got == l_gnd.wanted) {
+            return pass;
+        }
+    }
+    return 0U;
+}
+
+static uint32_t stopAndWait(uint16_t pass_s, uint16_t rate, double turn_s) {
+    double frame_s = DL_FRAME_AIR * 8.0 / rate + turn_s;
+    uint32_t pass;
+    double t;
+    uint16_t k = 0U;
+    uint16_t n;
+
+    reset();
+    chunks();
+    for (pass = 1U; pass <= PASSES_MAX; ++pass) {
+        for (t = frame_s; (t <= pass_s) && (k < l_chunks); t += frame_s) {
+            n = frameOf(k);
+            if (!chance(l_loss) && !chance(l_upLoss)) {
+                take(k, n);
+                k = (uint16_t)(k + n);  /* acked: the next frame */
+            }
+        }
+        if (k >= l_chunks) {
+            return pass;
+        }
+    }
+    return 0U;
+}
+
+int main(int argc, char *argv[]) {
+    uint16_t pass_s = 60U;
+    uint16_t rate = 1200U;
+    double turn_s = 1.0;
+    uint32_t runs = 20U;
+    unsigned seed = 1U;
+    uint32_t unfinished = 0U;
+    uint8_t id = 0U;
+    int loss;
+    int opt;
+
+    l_upLoss = 0.1;
+    while ((opt = getopt(argc, argv, "d:b:u:w:n:s:")) != -1) {
+        switch (opt) {
+            case 'd': pass_s = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'b': rate = (uint16_t)strtoul(optarg, 0, 0); break;
+            case 'u': l_upLoss = strtod(optarg, 0); break;
+            case 'w': turn_s = strtod(optarg, 0); break;
+            case 'n': runs = (uint32_t)strtoul(optarg, 0, 0); break;
+            case 's': seed = (unsigned)strtoul(optarg, 0, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-d pass_s] [-b rate_bps] [-u uplink_loss] "
+                        "[-w turnaround_s] [-n runs] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((rate < 8U) || (pass_s == 0U) || (runs == 0U)) {
+        fprintf(stderr, "need a rate of at least 8 bit/s, a pass and a run\n");
+        return 2;
+    }
+    srand(seed);
+    reset();
+    chunks();
+
+    printf("Transfer bench: %u sweep parts in %u records, passes %u s at %u bit/s, "
+           "%.0f%% uplink loss, %.1f s turnaround, %lu runs\n",
+           (unsigned)l_gnd.wanted, (unsigned)g_telemetryLog.nextSeq, pass_s, rate,
+           100.0 * l_upLoss, turn_s, (unsigned long)runs);
+    printf("frame loss   selective (closed)   carousel   stop-and-wait   [mean passes]\n");
+    for (loss = 0; loss <= 50; loss += 10) {
+        double sel = 0.0;
+        double closed = 0.0;
+        double car = 0.0;
+        double saw = 0.0;
+        uint32_t carMiss = 0U;
+        uint32_t sawMiss = 0U;
+        uint32_t i;
+
+        l_loss = loss / 100.0;
+        for (i = 0U; i < runs; ++i) {
+            Result r;
+            uint32_t p;
+
+            id = (uint8_t)((id == 0xFFU) ? 1U : (id + 1U));
+            r = selective(id, pass_s, rate);
+            if (!r.ok) {
+                ++unfinished;
+            }
+            sel += r.done;
+            closed += r.closed;
+            p = carousel(pass_s, rate);
+            car += p;
+            carMiss += (p == 0U);
+            p = stopAndWait(pass_s, rate, turn_s);
+            saw += p;
+            sawMiss += (p == 0U);
+        }
+        printf("  %3d %%      %7.1f (%5.1f)     %7.1f%s     %7.1f%s\n", loss,
+               sel / runs, closed / runs, car / runs, carMiss ? "+" : " ",
+               saw / runs, sawMiss ? "+" : " ");
+    }
+    Bench_check(unfinished == 0U, "%lu transfers unfinished", (unsigned long)unfinished);
+    Bench_check(l_corrupt == 0U, "%lu corrupt chunks", (unsigned long)l_corrupt);
+    Bench_check(l_overflows == 0U, "%lu overflowing frames", (unsigned long)l_overflows);
+    Bench_check(emptyRange(1U, pass_s, rate),
+                "a request ending before it starts is sent as empty");
+    return Bench_finish();
+}
@@ -0,0 +1,206 @@
+"""
+Single-Diode IV Fit
+
+This module fits the single-diode solar cell model to IV sweeps decoded from
+the downlink (see sweep_codec.py). All sweeps of an archive are fitted at
+once: every array carries the sweep index as its first axis, so one
+Levenberg-Marquardt iteration is a handful of numpy operations over the
+whole batch rather than a Python loop per sweep.
+
+Model (explicit Lambert-W form, Jain & Kapoor):
+    I = (Rsh (Iph + I0) - V) / (Rs + Rsh)
+        - a / Rs * W( Rs I0 Rsh / (a (Rs + Rsh))
+                      * exp(Rsh (Rs (Iph + I0) + V) / (a (Rs + Rsh))) )
+    with a = n Ns kT/q, the modified ideality factor.
+
+Main components:
+    - DiodeFit: Data class holding the fitted parameters of a batch.
+    - lambertw_exp(): Vectorized W(exp(x)) that does not overflow.
+    - diode_current(): Model current for a batch of parameter sets.
+    - fit_single_diode(): Batched Levenberg-Marquardt fit.
+    - main(): Fit every sweep packet in a firmware serial log (stdin).
+
+Dependencies:
+    - Requires `numpy`.
+"""
+
+import argparse
+import logging
+import sys
+from dataclasses import dataclass
+from time import perf_counter
+
+import numpy as np
+
+from sweep_codec import SweepDecoder, SweepPacketError, _LOG_LINE
+
+logger = logging.getLogger(__name__)
+
+N_PARAMS = 5        # Iph, ln I0, ln a, ln Rs, ln Rsh
+MAX_ITERATIONS = 50
+# Box on theta; keeps a wandering fit (e.g. Rsh -> infinity) finite
+THETA_LOW = np.array([-1.0, -80.0, np.log(1e-3), np.log(1e-4), np.log(1.0)])
+THETA_HIGH = np.array([1.0, 0.0, np.log(10.0), np.log(1e3), np.log(1e7)])
+LAMBERTW_ITERATIONS = 6
+
+
+@dataclass
+class DiodeFit:
+    iph: np.ndarray     # photocurrent [A]
+    i0: np.ndarray      # saturation current [A]
+    a: np.ndarray       # modified ideality factor [V]
+    rs: np.ndarray      # series resistance [Ohm]
+    rsh: np.ndarray     # shunt resistance [Ohm]
+    rmse: np.ndarray    # residual [A]
+    iterations: int
+
+
+def lambertw_exp(x: np.ndarray) -> np.ndarray:
+    """W(exp(x)), i.e. the w solving w + ln w = x, for any real x."""
+    w = np.where(x < 1.0, np.exp(np.minimum(x, 1.0)), x - np.log(np.maximum(x, 1.0)))
+    w = np.maximum(w, 1e-300)
+    for _ in range(LAMBERTW_ITERATIONS):
+        # Newton on f(w) = w + ln w - x, quadratic from the start above
+        w = w - (w + np.log(w) - x) * w / (w + 1.0)
+        w = np.maximum(w, 1e-300)
+    return w
+
+
+def _unpack(theta: np.ndarray):
+    iph = theta[:, 0:1]
+    i0, a, rs, rsh = (np.exp(theta[:, k:k + 1]) for k in range(1, N_PARAMS))
+    return iph, i0, a, rs, rsh
+
+
+def diode_current(theta: np.ndarray, v: np.ndarray) -> np.ndarray:
+    """Model current, theta (N, 5) against voltages v (N, points)."""
+    iph, i0, a, rs, rsh = _unpack(theta)
+    rsum = rs + rsh
+    x = (np.log(rs * i0 * rsh / (a * rsum))
+         + rsh * (rs * (iph + i0) + v) / (a * rsum))
+    return (rsh * (iph + i0) - v) / rsum - a / rs * lambertw_exp(x)
+
+
+def _initial_guess(v: np.ndarray, i: np.ndarray) -> np.ndarray:
+    """Start from the curve itself: Isc, both end slopes and Voc."""
+    isc = np.maximum(i[:, 0], 1e-6)
+    rsh = np.clip(-(v[:, 3] - v[:, 0]) / np.minimum(i[:, 3] - i[:, 0], -1e-9), 10.0, 1e6)
+    below = np.where(i > 0.0, v, 0.0)
+    voc = np.maximum(below.max(axis=1), 0.1)
+    a = 0.045 * voc
+    i0 = isc * np.exp(-voc / a)
+    rs = np.full_like(isc, 0.5)
+    theta = np.stack([isc, np.log(i0), np.log(a), np.log(rs), np.log(rsh)], axis=1)
+    return np.clip(theta, THETA_LOW, THETA_HIGH)
+
+
+def fit_single_diode(v: np.ndarray, i: np.ndarray,
+                     max_iterations: int = MAX_ITERATIONS) -> DiodeFit:
+    """Fit every row of v, i (N, points) with Levenberg-Marquardt.
+
+    Currents are taken positive in the power quadrant. The Jacobian is a
+    forward difference, so each iteration costs N_PARAMS + 1 model
+    evaluations of the whole batch.
+    """
+    with np.errstate(all="ignore"):
+        return _fit(np.atleast_2d(np.asarray(v, dtype=float)),
+                    np.atleast_2d(np.asarray(i, dtype=float)), max_iterations)
+
+
+def _fit(v: np.ndarray, i: np.ndarray, max_iterations: int) -> DiodeFit:
+    i = np.where(i[:, :1] < 0.0, -i, i)
+    theta = _initial_guess(v, i)
+    lam = np.full(len(v), 1e-2)
+    residual = diode_current(theta, v) - i
+    cost = np.sum(residual ** 2, axis=1)
+    eye = np.eye(N_PARAMS)
+    done = np.zeros(len(v), dtype=bool)
+
+    for iteration in range(1, max_iterations + 1):
+        # converged sweeps drop out, so late iterations only touch stragglers
+        act = np.flatnonzero(~done)
+        if act.size == 0:
+            break
+        th, va, ia, res, la = theta[act], v[act], i[act], residual[act], lam[act]
+
+        jac = np.empty(va.shape + (N_PARAMS,))
+        for k in range(N_PARAMS):
+            step = 1e-6 * np.maximum(np.abs(th[:, k]), 1.0)
+            shifted = th.copy()
+            shifted[:, k] += step
+            jac[:, :, k] = (diode_current(shifted, va) - ia - res) / step[:, None]
+
+        jtj = np.einsum("npk,npl->nkl", jac, jac)
+        jtr = np.einsum("npk,np->nk", jac, res)
+        damped = jtj + la[:, None, None] * (jtj * eye + 1e-12 * eye)
+        delta = np.linalg.solve(damped, -jtr[:, :, None])[:, :, 0]
+
+        trial = np.clip(th + delta, THETA_LOW, THETA_HIGH)
+        trial_residual = diode_current(trial, va) - ia
+        trial_cost = np.sum(trial_residual ** 2, axis=1)
+        better = np.isfinite(trial_cost) & (trial_cost < cost[act])
+
+        theta[act] = np.where(better[:, None], trial, th)
+        residual[act] = np.where(better[:, None], trial_residual, res)
+        small = better & (cost[act] - trial_cost < 1e-8 * cost[act])
+        cost[act] = np.where(better, trial_cost, cost[act])
+        lam[act] = np.where(better, la * 0.3, la * 10.0)
+        done[act] = small | (lam[act] > 1e8)
+
+    iph, i0, a, rs, rsh = (p[:, 0] for p in _unpack(theta))
+    return DiodeFit(iph=iph, i0=i0, a=a, rs=rs, rsh=rsh,
+                    rmse=np.sqrt(cost / v.shape[1]), iterations=iteration)
+
+
+def _synthetic(n: int, points: int = 40):
+    rng = np.random.default_rng(1)
+    theta = np.stack([
+        rng.uniform(0.015, 0.020, n),
+        np.log(rng.uniform(1e-14, 1e-12, n)),
+        np.log(rng.uniform(0.09, 0.12, n)),
+        np.log(rng.uniform(0.5, 3.0, n)),
+        np.log(rng.uniform(500.0, 5000.0, n)),
+    ], axis=1)
+    v = np.tile(np.linspace(0.0, 2.7, points), (n, 1))
+    return v, diode_current(theta, v) + rng.normal(0.0, 1e-5, v.shape)
+
+
+def main():
+    """Fit the sweep packets of a serial log on stdin, or time a synthetic batch."""
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--bench", type=int, metavar="N",
+                        help="fit N synthetic sweeps and report the rate")
+    args = parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    if args.bench:
+        v, i = _synthetic(args.bench)
+        start = perf_counter()
+        fit = fit_single_diode(v, i)
+        elapsed = perf_counter() - start
+        logger.info(f"{args.bench} sweeps in {elapsed:.2f} s, {fit.iterations} iterations, "
+                    f"median RMSE {np.median(fit.rmse) * 1e6:.1f} uA")
+        return
+
+    sweeps = []
+    decoder = SweepDecoder()
+    for line in sys.stdin:
+        match = _LOG_LINE.search(line)
+        if match is None or match.group(1) != "Sweep":
+            continue
+        try:
+            sweeps.append(decoder.decode(bytes.fromhex(match.group(3))))
+        except (SweepPacketError, ValueError) as e:
+            logger.warning(f"Dropped packet: {e}")
+    if not sweeps:
+        return
+
+    fit = fit_single_diode([s.voltage for s in sweeps], [s.current for s in sweeps])
+    print("cell\ttimestamp\tIph[mA]\tI0[A]\ta[V]\tRs[Ohm]\tRsh[Ohm]\tRMSE[uA]")
+    for k, s in enumerate(sweeps):
+        print(f"{s.cell}\t{s.timestamp}\t{fit.iph[k] * 1e3:.3f}\t{fit.i0[k]:.3e}\t"
+              f"{fit.a[k]:.4f}\t{fit.rs[k]:.3f}\t{fit.rsh[k]:.0f}\t{fit.rmse[k] * 1e6:.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,417 @@
+"""
+Framed Serial Output Decoder
+
+This module decodes the SLIP-framed binary serial output of the flight
+firmware (firmware/src/serial_frame.cpp), which replaces the text dumps of
+sweeps and measurements unless the firmware is built with SERIAL_TEXT_OUTPUT.
+
+Frame layout:
+    - 0xC0, u8 type, payload, u16 CRC-16/CCITT-FALSE (LE) over type and
+      payload, 0xC0; 0xC0 and 0xDB inside the frame escaped as in RFC 1055
+    - SF_SWEEP  (0x10): u8 cell, u8 address, u32 timestamp[40],
+      f32 voltage[40], f32 current[40]
+    - SF_META   (0x11): u8 cell, u8 address, u32 bus_us, ivsweep_meta_t
+    - SF_MEAS   (0x12): u8 kind (0 Voc, 1 Isc), f32 measurement, f32 temperature
+    - SF_PACKET (0x13): a sweep_codec packet
+    - SF_CODEWORD (0x15): a downlink frame as the radio sends it: log
+      records back to back, then 32 Reed-Solomon parity bytes
+      (firmware/lib/radio.h). Each record is u16 seq, u8 type, u8 tag
+      (cell), u32 mission time [s], u8 length, payload;
+      type 1 is a sweep_codec parameter packet, type 2 housekeeping
+      (u32 uptime [s], f32 battery [Wh], u16 stack peak, u16 records lost,
+      u16 peak IV parameter extraction time [us]),
+      type 3 part of a sweep_codec sweep packet (u8 part index << 4 | part
+      count, then the bytes of that part), type 4 the status of a log
+      transfer (seq = its first record, tag = transfer id; u16 records,
+      u16 still to come), type 5 the beacon (seq 0xFFFF, its own frame;
+      u8 version, char callsign[6], u16 battery [cWh], u8 state, u16
+      commands accepted, u16 records lost, u16 records unsent, u32 uptime
+      [s], u16 beacons sent, see firmware/lib/beacon.h), type 6 an orbit
+      summary (u16 orbit; battery [cWh], cell temperature [0.01 C] and
+      Isc [0.1 mA] each as u16 count, i16 min, max, mean, sd; u16
+      seconds in each of the 10 beacon states, see orbit_stats.h)
+
+A firmware built with RADIO_AX25 sends each downlink frame as an AX.25 UI
+frame instead, KISS-encapsulated (firmware/lib/messages.h): 0xC0, 0x00,
+16-byte AX.25 header, the same records back to back, 0xC0, escaped as
+SLIP. KISS carries no CRC; the frame is recognised by its header.
+
+Anything between frames that fails the CRC is debug text and is passed
+through unchanged, so the rendered output reads like the old text log. Codec
+packets are rendered as the "Sweep packet (N bytes): ..." lines that
+sweep_codec.py and iv_fit.py read. Codewords are only checked against their
+parity here; a noisy radio capture needs the decoder in
+simulation/fec-bench (fec-bench -f), which corrects them.
+
+Main components:
+    - SweepFrame, MetaFrame, MeasFrame, RecordFrame, CodewordFrame,
+      Ax25Frame: Data classes for the frame payloads.
+    - rs_parity(): The CCSDS Reed-Solomon parity the firmware appends.
+    - FrameDecoder: Streaming SLIP splitter and CRC check.
+    - parse_frame(): Turn one checked frame into its data class.
+    - render(): Text form of a parsed frame.
+    - main(): Decode a serial port or a binary capture on stdin.
+
+Dependencies:
+    - Requires `pyserial` for reading a port directly.
+"""
+
+import argparse
+import logging
+import struct
+import sys
+from dataclasses import dataclass, field
+from typing import Iterator, List, Tuple, Union
+
+from sweep_codec import SWEEP_PKT_PARAMS, crc16_ccitt
+
+logger = logging.getLogger(__name__)
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+SF_SWEEP = 0x10
+SF_META = 0x11
+SF_MEAS = 0x12
+SF_PACKET = 0x13
+SF_CODEWORD = 0x15
+KISS_DATA = 0x00
+
+AX25_HEADER_LEN = 16
+AX25_CONTROL_UI = 0x03
+AX25_PID_NONE = 0xF0
+
+LOG_REC_PARAMS = 1
+LOG_REC_HOUSEKEEPING = 2
+LOG_REC_SWEEP = 3
+LOG_REC_XFER = 4
+LOG_REC_BEACON = 5
+LOG_REC_ORBIT = 6
+
+RS_PARITY = 32
+RS_GFPOLY = 0x187
+RS_FCR = 112
+RS_PRIM = 11
+
+IVSWEEP_POINTS = 40
+
+_SWEEP = struct.Struct(f"<BB{IVSWEEP_POINTS}I{IVSWEEP_POINTS}f{IVSWEEP_POINTS}f")
+_META = struct.Struct("<BBI10fII")
+_MEAS = struct.Struct("<Bff")
+_RECORD = struct.Struct("<HBBIB")
+_HOUSEKEEPING = struct.Struct("<IfHHH")
+_XFER = struct.Struct("<HH")
+_BEACON = struct.Struct("<B6sHBHHHIH")
+_BEACON_STATES = ("launch", "leo", "charge", "active", "payload", "detumble",
+                  "telemetry", "radio", "transmit", "receive")
+_ORBIT = struct.Struct("<H" + "Hhhhh" * 3 + f"{len(_BEACON_STATES)}H")
+_ORBIT_CHANNELS = (("battery", 100.0, "Wh"), ("temperature", 100.0, "C"),
+                   ("Isc", 10.0, "mA"))
+_META_FIELDS = ("voc", "isc", "tsensor_start", "tsensor_end", "ff", "eff",
+                "vmax", "imax", "pmax", "adc")
+
+
+@dataclass
+class SweepFrame:
+    cell: int
+    address: int
+    timestamps: List[int] = field(default_factory=list)
+    voltage: List[float] = field(default_factory=list)
+    current: List[float] = field(default_factory=list)
+
+
+@dataclass
+class MetaFrame:
+    cell: int
+    address: int
+    bus_us: int
+    meta: dict
+    timestamp: int
+    crc: int
+
+
+@dataclass
+class MeasFrame:
+    kind: str
+    measurement: float
+    temperature: float
+
+
+@dataclass
+class RecordFrame:
+    seq: int
+    type: int
+    tag: int
+    time: int
+    payload: bytes
+
+
+@dataclass
+class CodewordFrame:
+    data: bytes
+    parity_ok: bool
+    records: List[RecordFrame] = field(default_factory=list)
+
+
+@dataclass
+class Ax25Frame:
+    dest: str
+    src: str
+    records: List[RecordFrame] = field(default_factory=list)
+
+
+Frame = Union[SweepFrame, MetaFrame, MeasFrame, CodewordFrame, Ax25Frame, bytes]
+
+
+def _rs_tables():
+    alpha, index = [0] * 256, [255] * 256
+    sr = 1
+    for i in range(255):
+        alpha[i], index[sr] = sr, i
+        sr <<= 1
+        if sr & 0x100:
+            sr ^= RS_GFPOLY
+    gen = [1] + [0] * RS_PARITY
+    for i in range(RS_PARITY):
+        root = (RS_FCR + i) * RS_PRIM
+        gen[i + 1] = 1
+        for j in range(i, 0, -1):
+            gen[j] = gen[j - 1] ^ (alpha[(index[gen[j]] + root) % 255] if gen[j] else 0)
+        gen[0] = alpha[(index[gen[0]] + root) % 255]
+    return alpha, index, [index[g] for g in gen]
+
+
+_RS_ALPHA, _RS_INDEX, _RS_GEN = _rs_tables()
+
+
+def rs_parity(data: bytes) -> bytes:
+    """Parity of the shortened RS(255,223) codeword, as radio.cpp computes it."""
+    parity = [0] * RS_PARITY
+    for byte in data:
+        feedback = _RS_INDEX[byte ^ parity[0]]
+        if feedback != 255:
+            for j in range(1, RS_PARITY):
+                parity[j] ^= _RS_ALPHA[(feedback + _RS_GEN[RS_PARITY - j]) % 255]
+            parity = parity[1:] + [_RS_ALPHA[(feedback + _RS_GEN[0]) % 255]]
+        else:
+            parity = parity[1:] + [0]
+    return bytes(parity)
+
+
+def _records(data: bytes) -> List[RecordFrame]:
+    records, at = [], 0
+    while at + _RECORD.size <= len(data):
+        seq, rec_type, tag, time, length = _RECORD.unpack_from(data, at)
+        at += _RECORD.size
+        if at + length > len(data):
+            raise ValueError(f"record {seq} overruns its frame")
+        records.append(RecordFrame(seq=seq, type=rec_type, tag=tag, time=time,
+                                   payload=data[at:at + length]))
+        at += length
+    return records
+
+
+def _ax25_address(data: bytes) -> str:
+    call = bytes(b >> 1 for b in data[:6]).decode("ascii", errors="replace").rstrip()
+    ssid = (data[6] >> 1) & 0x0F
+    return f"{call}-{ssid}" if ssid else call
+
+
+def _is_ax25_ui(frame: bytes) -> bool:
+    return (len(frame) >= AX25_HEADER_LEN
+            and (frame[6] & 1) == 0 and (frame[13] & 1) == 1
+            and frame[14] == AX25_CONTROL_UI and frame[15] == AX25_PID_NONE)
+
+
+class FrameDecoder:
+    """Splits a byte stream on SLIP_END; yields (type, payload) or text."""
+
+    def __init__(self):
+        self._chunk = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data: bytes) -> Iterator[Tuple[int, bytes]]:
+        """Yields (frame type, payload) for frames, (-1, raw bytes) for text."""
+        for byte in data:
+            if byte != SLIP_END:
+                self._chunk.append(byte)
+                continue
+            if self._chunk:
+                yield self._close(bytes(self._chunk))
+                self._chunk.clear()
+
+    def flush(self) -> Iterator[Tuple[int, bytes]]:
+        if self._chunk:
+            yield -1, bytes(self._chunk)
+            self._chunk.clear()
+
+    def _close(self, chunk: bytes) -> Tuple[int, bytes]:
+        if len(chunk) >= 3:
+            frame = _unescape(chunk)
+            if frame is not None and frame[0] == KISS_DATA and _is_ax25_ui(frame[1:]):
+                return KISS_DATA, frame[1:]
+            if frame is not None and len(frame) >= 3:
+                body, (crc,) = frame[:-2], struct.unpack("<H", frame[-2:])
+                if crc16_ccitt(body) == crc:
+                    return body[0], body[1:]
+        if any(b >= 0x80 for b in chunk):
+            # text is 7-bit; a high byte means a frame was corrupted
+            self.crc_errors += 1
+        return -1, chunk
+
+
+def _unescape(chunk: bytes):
+    out = bytearray()
+    it = iter(chunk)
+    for byte in it:
+        if byte == SLIP_ESC:
+            nxt = next(it, None)
+            if nxt == SLIP_ESC_END:
+                out.append(SLIP_END)
+            elif nxt == SLIP_ESC_ESC:
+                out.append(SLIP_ESC)
+            else:
+                return None
+        else:
+            out.append(byte)
+    return bytes(out)
+
+
+def parse_frame(frame_type: int, payload: bytes) -> Frame:
+    """Data class for a checked frame; codec packets come back as bytes."""
+    if frame_type == SF_SWEEP and len(payload) == _SWEEP.size:
+        values = _SWEEP.unpack(payload)
+        n = IVSWEEP_POINTS
+        return SweepFrame(cell=values[0], address=values[1],
+                          timestamps=list(values[2:2 + n]),
+                          voltage=list(values[2 + n:2 + 2 * n]),
+                          current=list(values[2 + 2 * n:]))
+    if frame_type == SF_META and len(payload) == _META.size:
+        values = _META.unpack(payload)
+        return MetaFrame(cell=values[0], address=values[1], bus_us=values[2],
+                         meta=dict(zip(_META_FIELDS, values[3:13])),
+                         timestamp=values[13], crc=values[14])
+    if frame_type == SF_MEAS and len(payload) == _MEAS.size:
+        kind, measurement, temperature = _MEAS.unpack(payload)
+        return MeasFrame(kind="Isc" if kind else "Voc",
+                         measurement=measurement, temperature=temperature)
+    if frame_type == SF_CODEWORD and len(payload) > RS_PARITY:
+        data, parity = payload[:-RS_PARITY], payload[-RS_PARITY:]
+        if rs_parity(data) != parity:
+            return CodewordFrame(data=data, parity_ok=False)
+        return CodewordFrame(data=data, parity_ok=True, records=_records(data))
+    if frame_type == KISS_DATA:
+        return Ax25Frame(dest=_ax25_address(payload[0:7]), src=_ax25_address(payload[7:14]),
+                         records=_records(payload[AX25_HEADER_LEN:]))
+    if frame_type == SF_PACKET:
+        return payload
+    raise ValueError(f"unknown frame 0x{frame_type:02X} ({len(payload)} bytes)")
+
+
+def render(frame: Frame) -> str:
+    """The text the firmware prints for the same data with SERIAL_TEXT_OUTPUT."""
+    if isinstance(frame, SweepFrame):
+        rows = (f"{t}\t{v:.12f}\t{i:.12f}"
+                for t, v, i in zip(frame.timestamps, frame.voltage, frame.current))
+        return f"Cell {frame.cell} (0x{frame.address:02X}) IV Curve:\n" + "\n".join(rows) + "\n"
+    if isinstance(frame, MetaFrame):
+        lines = [f"{name}: {value:.6g}" for name, value in frame.meta.items()]
+        lines += [f"timestamp: {frame.timestamp}", f"crc: 0x{frame.crc:08X}",
+                  f"Bus time [us]: {frame.bus_us}"]
+        return f"Cell {frame.cell} metadata:\n" + "\n".join(lines) + "\n"
+    if isinstance(frame, MeasFrame):
+        return f"{frame.kind}: {frame.measurement:.6f}\nTemperature: {frame.temperature:.6f}\n"
+    if isinstance(frame, RecordFrame):
+        head = (f"Log record {frame.seq} type {frame.type} tag {frame.tag} "
+                f"at {frame.time}: {frame.payload.hex().upper()}\n")
+        if frame.type == LOG_REC_PARAMS:
+            return head + render(frame.payload)
+        if frame.type == LOG_REC_HOUSEKEEPING and len(frame.payload) == _HOUSEKEEPING.size:
+            uptime, battery, stack_peak, lost, extract_us = _HOUSEKEEPING.unpack(frame.payload)
+            return head + (f"Housekeeping: uptime {uptime} s, battery {battery:.2f} Wh, "
+                           f"stack peak {stack_peak} B, {lost} records lost, "
+                           f"IV extract peak {extract_us} us\n")
+        if frame.type == LOG_REC_SWEEP and frame.payload:
+            part = frame.payload[0]
+            return head + f"Sweep part {(part >> 4) + 1} of {part & 0x0F}\n"
+        if frame.type == LOG_REC_XFER and len(frame.payload) == _XFER.size:
+            count, flagged = _XFER.unpack(frame.payload)
+            return head + (f"Transfer {frame.tag}: records {frame.seq}.."
+                           f"{frame.seq + count - 1}, {flagged} still to come\n")
+        if frame.type == LOG_REC_BEACON and len(frame.payload) == _BEACON.size:
+            (_, call, battery, state, commands, lost, unsent, uptime,
+             count) = _BEACON.unpack(frame.payload)
+            name = _BEACON_STATES[state] if state < len(_BEACON_STATES) else str(state)
+            return head + (f"Beacon {count} from {call.decode('ascii', 'replace').strip()}: "
+                           f"uptime {uptime} s, battery {battery / 100:.2f} Wh, {name}, "
+                           f"{commands} commands, {unsent} records unsent, {lost} lost\n")
+        if frame.type == LOG_REC_ORBIT and len(frame.payload) == _ORBIT.size:
+            fields = _ORBIT.unpack(frame.payload)
+            lines = [f"Orbit {fields[0]}:"]
+            for i, (name, scale, unit) in enumerate(_ORBIT_CHANNELS):
+                n, lo, hi, mean, sd = fields[1 + 5 * i:6 + 5 * i]
+                lines.append(f"  {name}: {n} samples, {lo / scale:.2f}..{hi / scale:.2f} "
+                             f"{unit}, mean {mean / scale:.2f}, sd {sd / scale:.2f}")
+            residency = fields[1 + 5 * len(_ORBIT_CHANNELS):]
+            lines.append("  " + ", ".join(f"{name} {sec} s"
+                                          for name, sec in zip(_BEACON_STATES, residency)
+                                          if sec))
+            return head + "\n".join(lines) + "\n"
+        return head
+    if isinstance(frame, CodewordFrame):
+        if not frame.parity_ok:
+            return (f"Codeword ({len(frame.data)} bytes) fails its parity: "
+                    f"{frame.data.hex().upper()}\n")
+        return "".join(render(record) for record in frame.records)
+    if isinstance(frame, Ax25Frame):
+        return "".join(render(record) for record in frame.records)
+    name = "Params" if frame[:1] == bytes([SWEEP_PKT_PARAMS]) else "Sweep"
+    return f"{name} packet ({len(frame)} bytes): {frame.hex().upper()}\n"
+
+
+def _source(args) -> Iterator[bytes]:
+    if args.port is None:
+        while True:
+            data = sys.stdin.buffer.read1(4096)
+            if not data:
+                return
+            yield data
+    import serial
+    with serial.Serial(args.port, args.baudrate, timeout=1.0) as port:
+        while True:
+            yield port.read(port.in_waiting or 1)
+
+
+def main():
+    """Render framed firmware output as text, from a serial port or stdin."""
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", nargs="?", help="serial port; stdin when omitted")
+    parser.add_argument("-b", "--baudrate", type=int, default=115200)
+    args = parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    decoder = FrameDecoder()
+    out = sys.stdout
+    try:
+        for data in _source(args):
+            for frame_type, payload in decoder.feed(data):
+                if frame_type < 0:
+                    out.write(payload.decode("ascii", errors="replace"))
+                    continue
+                try:
+                    out.write(render(parse_frame(frame_type, payload)))
+                except ValueError as e:
+                    logger.warning(f"Dropped frame: {e}")
+            out.flush()
+        for _, payload in decoder.flush():
+            out.write(payload.decode("ascii", errors="replace"))
+    except KeyboardInterrupt:
+        pass
+    if decoder.crc_errors:
+        logger.warning(f"{decoder.crc_errors} corrupted frames")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,370 @@
+"""
+IV Sweep Packet Decoder
+
+This module decodes the compact binary IV-sweep packets produced by the flight
+firmware (firmware/src/sweep_codec.cpp) back into engineering units.
+
+Packet layout (little-endian):
+    - u8 type, u8 version, u8 cell, u8 points
+    - u32 sweep timestamp
+    - u16 Voc [mV], i16 Isc [0.1 mA], i16 Tstart [0.01 C], i16 Tend [0.01 C]
+    - timestamps and voltage: zigzag varints, first value, first delta,
+      then second differences
+    - current: zigzag varints, first value then first differences
+    - u16 CRC-16/CCITT-FALSE over every preceding byte
+
+Parameter packets (type 0x02) carry the on-board IvParams instead of the
+curve: u8 type, u8 version, u8 cell, u8 mismatch bits, u32 timestamp,
+i16 Voc, i16 Vmp [mV], i32 Isc, i32 Imp [uA], i32 Pmax [uW], u16 FF [1/10000],
+i32 Rs [mOhm], i32 Rsh [Ohm], i16 Tstart, i16 Tend [0.01 C], u16 CRC.
+
+Delta packets (type 0x03) code a sweep against the last key of its cell:
+u8 type, u8 version, u8 cell, u8 points, u16 key timestamp (low bits),
+u32 timestamp, the Voc, Isc and temperatures as above, u8 k timestamps |
+k voltage << 4, u8 k current | 0x10 if unkeyed, then a bit stream (MSB
+first) of order-k Exp-Golomb zigzag codes: timestamps and voltage as above,
+the current as first differences of its residual from the key's, and a CRC.
+An unkeyed delta codes the current itself, decodes on its own and is a key,
+as is every full packet. Deltas decode to exactly what a full packet would
+carry, given the key.
+
+Main components:
+    - DecodedSweep: Data class holding one decoded sweep.
+    - DecodedParams: Data class holding one set of on-board IV parameters.
+    - SweepDecoder: Keeps the keys and decodes full and delta packets.
+    - decode_sweep(): Parse and CRC-check one full sweep packet.
+    - decode_delta(): Parse and CRC-check one delta packet, given its key.
+    - decode_params(): Parse and CRC-check one parameter packet.
+    - encode_sweep(): Reference encoder, the inverse of decode_sweep().
+    - main(): Decode hex packets from the firmware serial log.
+"""
+
+import logging
+import re
+import struct
+import sys
+from dataclasses import dataclass, field
+from typing import List
+
+logger = logging.getLogger(__name__)
+
+SWEEP_PKT_TYPE = 0x01
+SWEEP_PKT_PARAMS = 0x02
+SWEEP_PKT_DELTA = 0x03
+SWEEP_PKT_VERSION = 1
+SWEEP_DELTA_UNKEYED = 0x10  # in the k current byte
+KEYS_PER_CELL = 4        # keys kept per cell; the firmware sends one per 17 sweeps
+
+VOLTAGE_SCALE = 1e3      # V -> mV
+CURRENT_SCALE = 1e4      # A -> 0.1 mA
+TEMPERATURE_SCALE = 1e2  # C -> 0.01 C
+
+_HEADER = struct.Struct("<BBBBIHhhh")
+_PARAMS = struct.Struct("<BBBBIhhiiiHiihh")
+_DELTA = struct.Struct("<BBBBHIHhhhBB")
+_LOG_LINE = re.compile(r"(Sweep|Params) packet \((\d+) bytes\): ([0-9A-Fa-f]*)")
+
+
+class SweepPacketError(ValueError):
+    pass
+
+
+@dataclass
+class DecodedSweep:
+    cell: int
+    timestamp: int
+    voc: float
+    isc: float
+    tsensor_start: float
+    tsensor_end: float
+    timestamps: List[int] = field(default_factory=list)
+    voltage: List[float] = field(default_factory=list)
+    current: List[float] = field(default_factory=list)
+
+
+@dataclass
+class DecodedParams:
+    cell: int
+    timestamp: int
+    mismatch: int
+    voc: float
+    vmp: float
+    isc: float
+    imp: float
+    pmax: float
+    ff: float
+    rs: float
+    rsh: float
+    tsensor_start: float
+    tsensor_end: float
+
+
+def crc16_ccitt(data: bytes, crc: int = 0xFFFF) -> int:
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def _read_varint(data: bytes, pos: int):
+    z = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise SweepPacketError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        z |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            break
+        shift += 7
+    return (z >> 1) ^ -(z & 1), pos
+
+
+def _write_varint(out: bytearray, v: int):
+    z = ((v << 1) ^ (v >> 31)) & 0xFFFFFFFF
+    while z >= 0x80:
+        out.append((z & 0x7F) | 0x80)
+        z >>= 7
+    out.append(z)
+
+
+def _undiff(codes: List[int], order: int) -> List[int]:
+    values = []
+    delta = 0
+    for i, code in enumerate(codes):
+        if i == 0:
+            values.append(code)
+            continue
+        delta = delta + code if (order == 2 and i >= 2) else code
+        values.append(values[-1] + delta)
+    return values
+
+
+def _diff(values: List[int], order: int) -> List[int]:
+    codes = []
+    last_delta = 0
+    for i, v in enumerate(values):
+        if i == 0:
+            codes.append(v)
+            continue
+        delta = v - values[i - 1]
+        codes.append(delta - last_delta if (order == 2 and i >= 2) else delta)
+        last_delta = delta
+    return codes
+
+
+def _scale(x: float, k: float) -> int:
+    y = x * k
+    return int(y - 0.5) if y < 0 else int(y + 0.5)
+
+
+def _check(packet: bytes, min_size: int) -> bytes:
+    if len(packet) < min_size + 2:
+        raise SweepPacketError("packet too short")
+    body, (crc,) = packet[:-2], struct.unpack("<H", packet[-2:])
+    if crc16_ccitt(body) != crc:
+        raise SweepPacketError("CRC mismatch")
+    return body
+
+
+def decode_params(packet: bytes) -> DecodedParams:
+    body = _check(packet, _PARAMS.size)
+    if len(body) != _PARAMS.size:
+        raise SweepPacketError("bad parameter packet length")
+    (pkt_type, version, cell, mismatch, timestamp, voc, vmp, isc, imp, pmax,
+     ff, rs, rsh, t_start, t_end) = _PARAMS.unpack(body)
+    if pkt_type != SWEEP_PKT_PARAMS or version != SWEEP_PKT_VERSION:
+        raise SweepPacketError(f"unsupported packet {pkt_type}/{version}")
+    return DecodedParams(
+        cell=cell, timestamp=timestamp, mismatch=mismatch,
+        voc=voc * 1e-3, vmp=vmp * 1e-3, isc=isc * 1e-6, imp=imp * 1e-6,
+        pmax=pmax * 1e-6, ff=ff * 1e-4, rs=rs * 1e-3, rsh=float(rsh),
+        tsensor_start=t_start / TEMPERATURE_SCALE,
+        tsensor_end=t_end / TEMPERATURE_SCALE)
+
+
+def decode_sweep(packet: bytes) -> DecodedSweep:
+    body = _check(packet, _HEADER.size)
+
+    pkt_type, version, cell, points, timestamp, voc, isc, t_start, t_end = \
+        _HEADER.unpack_from(body)
+    if pkt_type != SWEEP_PKT_TYPE or version != SWEEP_PKT_VERSION:
+        raise SweepPacketError(f"unsupported packet {pkt_type}/{version}")
+
+    pos = _HEADER.size
+    channels = []
+    for _ in range(3):
+        codes = []
+        for _ in range(points):
+            code, pos = _read_varint(body, pos)
+            codes.append(code)
+        channels.append(codes)
+    if pos != len(body):
+        raise SweepPacketError("trailing bytes")
+
+    return DecodedSweep(
+        cell=cell,
+        timestamp=timestamp,
+        voc=voc / VOLTAGE_SCALE,
+        isc=isc / CURRENT_SCALE,
+        tsensor_start=t_start / TEMPERATURE_SCALE,
+        tsensor_end=t_end / TEMPERATURE_SCALE,
+        timestamps=[t & 0xFFFFFFFF for t in _undiff(channels[0], 2)],
+        voltage=[v / VOLTAGE_SCALE for v in _undiff(channels[1], 2)],
+        current=[i / CURRENT_SCALE for i in _undiff(channels[2], 1)],
+    )
+
+
+class _BitReader:
+    def __init__(self, data: bytes):
+        self._data = data
+        self._pos = 0
+
+    def bit(self) -> int:
+        byte = self._pos >> 3
+        if byte >= len(self._data):
+            raise SweepPacketError("truncated bit stream")
+        b = (self._data[byte] >> (7 - (self._pos & 7))) & 1
+        self._pos += 1
+        return b
+
+    def bits(self, n: int) -> int:
+        v = 0
+        for _ in range(n):
+            v = (v << 1) | self.bit()
+        return v
+
+    def exp_golomb(self, k: int) -> int:
+        zeros = 0
+        while self.bit() == 0:
+            zeros += 1
+            if zeros > 32:
+                raise SweepPacketError("bad Exp-Golomb code")
+        m = (1 << zeros) | self.bits(zeros)
+        z = ((m - 1) << k) | self.bits(k)
+        return (z >> 1) ^ -(z & 1)
+
+    def padding_ok(self) -> bool:
+        return (len(self._data) * 8 - self._pos < 8
+                and self.bits(len(self._data) * 8 - self._pos) == 0)
+
+
+def delta_key(packet: bytes) -> int:
+    """The low bits of the key timestamp a delta packet refers to."""
+    return _DELTA.unpack_from(packet)[4]
+
+
+def decode_delta(packet: bytes, key_current: List[int]) -> DecodedSweep:
+    """Decode a delta packet against the current of its key, in 0.1 mA."""
+    body = _check(packet, _DELTA.size)
+    (pkt_type, version, cell, points, _, timestamp, voc, isc, t_start, t_end,
+     k_tv, k_i) = _DELTA.unpack_from(body)
+    if pkt_type != SWEEP_PKT_DELTA or version != SWEEP_PKT_VERSION:
+        raise SweepPacketError(f"unsupported packet {pkt_type}/{version}")
+    if points != len(key_current):
+        raise SweepPacketError("key has a different number of points")
+
+    reader = _BitReader(body[_DELTA.size:])
+    channels = [[reader.exp_golomb(k) for _ in range(points)]
+                for k in (k_tv & 0x0F, k_tv >> 4, k_i & 0x0F)]
+    if not reader.padding_ok():
+        raise SweepPacketError("trailing bytes")
+    residual = _undiff(channels[2], 1)
+
+    return DecodedSweep(
+        cell=cell,
+        timestamp=timestamp,
+        voc=voc / VOLTAGE_SCALE,
+        isc=isc / CURRENT_SCALE,
+        tsensor_start=t_start / TEMPERATURE_SCALE,
+        tsensor_end=t_end / TEMPERATURE_SCALE,
+        timestamps=[t & 0xFFFFFFFF for t in _undiff(channels[0], 2)],
+        voltage=[v / VOLTAGE_SCALE for v in _undiff(channels[1], 2)],
+        current=[(r + c) / CURRENT_SCALE for r, c in zip(residual, key_current)],
+    )
+
+
+class SweepDecoder:
+    """Decodes the sweep packets of a downlink in order, keeping the keys.
+
+    A delta whose key never arrived raises SweepPacketError; the next key
+    of its cell makes the following deltas decodable again.
+    """
+
+    def __init__(self):
+        self._keys = {}
+
+    def decode(self, packet: bytes) -> DecodedSweep:
+        if packet[:1] != bytes([SWEEP_PKT_DELTA]):
+            return self._key(decode_sweep(packet))
+        body = _check(packet, _DELTA.size)
+        if body[19] & SWEEP_DELTA_UNKEYED:
+            return self._key(decode_delta(packet, [0] * body[3]))
+        key = self._keys.get(body[2], {}).get(delta_key(body))
+        if key is None:
+            raise SweepPacketError(f"no key {delta_key(body)} for cell {body[2]}")
+        return decode_delta(packet, key)
+
+    def _key(self, sweep: DecodedSweep) -> DecodedSweep:
+        keys = self._keys.setdefault(sweep.cell, {})
+        keys[sweep.timestamp & 0xFFFF] = [_scale(i, CURRENT_SCALE) for i in sweep.current]
+        while len(keys) > KEYS_PER_CELL:
+            del keys[next(iter(keys))]
+        return sweep
+
+
+def encode_sweep(sweep: DecodedSweep) -> bytes:
+    out = bytearray(_HEADER.pack(
+        SWEEP_PKT_TYPE, SWEEP_PKT_VERSION, sweep.cell, len(sweep.voltage),
+        sweep.timestamp,
+        _scale(sweep.voc, VOLTAGE_SCALE) & 0xFFFF,
+        _scale(sweep.isc, CURRENT_SCALE),
+        _scale(sweep.tsensor_start, TEMPERATURE_SCALE),
+        _scale(sweep.tsensor_end, TEMPERATURE_SCALE)))
+    channels = [
+        (list(sweep.timestamps), 2),
+        ([_scale(v, VOLTAGE_SCALE) for v in sweep.voltage], 2),
+        ([_scale(i, CURRENT_SCALE) for i in sweep.current], 1),
+    ]
+    for values, order in channels:
+        for code in _diff(values, order):
+            _write_varint(out, code)
+    out += struct.pack("<H", crc16_ccitt(out))
+    return bytes(out)
+
+
+def main():
+    """Decode every sweep and parameter packet in a firmware serial log (stdin)."""
+    logging.basicConfig(level=logging.INFO)
+    decoder = SweepDecoder()
+    for line in sys.stdin:
+        match = _LOG_LINE.search(line)
+        if match is None:
+            continue
+        try:
+            packet = bytes.fromhex(match.group(3))
+            if match.group(1) == "Params":
+                params = decode_params(packet)
+            else:
+                sweep = decoder.decode(packet)
+        except (SweepPacketError, ValueError) as e:
+            logger.warning(f"Dropped packet: {e}")
+            continue
+        if match.group(1) == "Params":
+            logger.info(f"Cell {params.cell} @ {params.timestamp}: "
+                        f"Voc {params.voc:.3f} V, Isc {params.isc * 1e3:.2f} mA, "
+                        f"Pmax {params.pmax * 1e3:.2f} mW, FF {params.ff:.3f}, "
+                        f"Rs {params.rs:.2f} Ohm, Rsh {params.rsh:.0f} Ohm, "
+                        f"mismatch 0x{params.mismatch:02X}")
+            continue
+        logger.info(f"Cell {sweep.cell} @ {sweep.timestamp}: "
+                    f"Voc {sweep.voc:.3f} V, Isc {sweep.isc * 1e3:.1f} mA")
+        for t, v, i in zip(sweep.timestamps, sweep.voltage, sweep.current):
+            print(f"{t}\t{v:.3f}\t{i:.6f}")
+
+
+if __name__ == "__main__":
+    main()
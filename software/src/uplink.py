@@ -0,0 +1,182 @@
+"""
+Uplink Frame Encoder
+
+This module builds the uplink frames the flight firmware takes in its
+Receive state (firmware/src/subsystems/communication.cpp) and sends them
+to a serial port, or writes them to stdout.
+
+Frame layout (SLIP and CRC as the downlink, see serial_frames.py):
+    - SF_XFER_START (0x20): u8 id, u32 from, u32 until, u8 type, u8 tag;
+      the log records from..until as selective-repeat transfer 'id'
+    - SF_XFER_NACK  (0x21): u8 id, u16 first chunk, bitmap of the chunks
+      still missing from there on, LSB first, at most 36 bytes
+    - SF_COMMAND    (0x22): u8 opcode, u16 counter, arguments, then an
+      8-byte SipHash-2-4 tag over everything before it under the 16-byte
+      command key (firmware/lib/messages.h). The counter must be ahead of
+      the last one the spacecraft accepted.
+
+Main components:
+    - siphash24(): The tag the firmware checks.
+    - slip_frame(): Type and payload as they go on the serial link.
+    - command(), transfer_start(), transfer_nack(): Frame payloads.
+    - main(): Send one frame from the command line.
+
+Dependencies:
+    - Requires `pyserial` for writing to a port directly.
+"""
+
+import argparse
+import struct
+import sys
+
+from sweep_codec import crc16_ccitt
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+SF_XFER_START = 0x20
+SF_XFER_NACK = 0x21
+SF_COMMAND = 0x22
+
+SF_RX_MAX = 40
+NACK_BITMAP_MAX = SF_RX_MAX - 4
+
+CMD_PING = 0
+CMD_SWEEP = 1
+CMD_TELEMETRY = 2
+CMD_PROFILE = 3
+CMD_QUERY = 4
+
+# The firmware's default CMD_KEY; flight builds set their own
+BENCH_KEY = bytes(range(16))
+
+_MASK = (1 << 64) - 1
+
+
+def _rotl(x: int, b: int) -> int:
+    return ((x << b) | (x >> (64 - b))) & _MASK
+
+
+def _sip_rounds(v: list, n: int) -> None:
+    for _ in range(n):
+        v[0] = (v[0] + v[1]) & _MASK
+        v[1] = _rotl(v[1], 13) ^ v[0]
+        v[0] = _rotl(v[0], 32)
+        v[2] = (v[2] + v[3]) & _MASK
+        v[3] = _rotl(v[3], 16) ^ v[2]
+        v[0] = (v[0] + v[3]) & _MASK
+        v[3] = _rotl(v[3], 21) ^ v[0]
+        v[2] = (v[2] + v[1]) & _MASK
+        v[1] = _rotl(v[1], 17) ^ v[2]
+        v[2] = _rotl(v[2], 32)
+
+
+def siphash24(key: bytes, data: bytes) -> bytes:
+    """SipHash-2-4 of data under a 16-byte key, low byte first."""
+    k0, k1 = struct.unpack("<QQ", key)
+    v = [k0 ^ 0x736F6D6570736575, k1 ^ 0x646F72616E646F6D,
+         k0 ^ 0x6C7967656E657261, k1 ^ 0x7465646279746573]
+    tail = len(data) & ~7
+    blocks = [struct.unpack_from("<Q", data, i)[0] for i in range(0, tail, 8)]
+    blocks.append(int.from_bytes(data[tail:] + bytes(7 - len(data) % 8)
+                                 + bytes([len(data) & 0xFF]), "little"))
+    for m in blocks:
+        v[3] ^= m
+        _sip_rounds(v, 2)
+        v[0] ^= m
+    v[2] ^= 0xFF
+    _sip_rounds(v, 4)
+    return struct.pack("<Q", v[0] ^ v[1] ^ v[2] ^ v[3])
+
+
+def slip_frame(frame_type: int, payload: bytes) -> bytes:
+    """END, type, payload, CRC-16 (LE), END, escaped as in RFC 1055."""
+    body = bytes([frame_type]) + payload
+    body += struct.pack("<H", crc16_ccitt(body))
+    out = bytearray([SLIP_END])
+    for b in body:
+        if b == SLIP_END:
+            out += bytes([SLIP_ESC, SLIP_ESC_END])
+        elif b == SLIP_ESC:
+            out += bytes([SLIP_ESC, SLIP_ESC_ESC])
+        else:
+            out.append(b)
+    out.append(SLIP_END)
+    return bytes(out)
+
+
+def command(key: bytes, opcode: int, counter: int, args: bytes = b"") -> bytes:
+    """SF_COMMAND payload, tag included."""
+    body = bytes([SF_COMMAND, opcode]) + struct.pack("<H", counter & 0xFFFF) + args
+    return body[1:] + siphash24(key, body)
+
+
+def query_args(rec_type: int, tag: int, hours: int) -> bytes:
+    return struct.pack("<BBH", rec_type, tag, hours)
+
+
+def transfer_start(xfer_id: int, start: int, until: int, rec_type: int, tag: int) -> bytes:
+    return struct.pack("<BIIBB", xfer_id, start, until, rec_type, tag)
+
+
+def transfer_nack(xfer_id: int, first: int, missing: bytes) -> bytes:
+    if len(missing) > NACK_BITMAP_MAX:
+        raise ValueError(f"at most {NACK_BITMAP_MAX} bytes of bitmap a frame")
+    return struct.pack("<BH", xfer_id, first) + missing
+
+
+def _frame(args) -> bytes:
+    if args.frame == "start":
+        return slip_frame(SF_XFER_START, transfer_start(args.id, args.start, args.until,
+                                                        args.type, args.tag))
+    if args.frame == "nack":
+        return slip_frame(SF_XFER_NACK, transfer_nack(args.id, args.first,
+                                                      bytes.fromhex(args.missing)))
+    key = bytes.fromhex(args.key) if args.key else BENCH_KEY
+    opcodes = {"ping": CMD_PING, "sweep": CMD_SWEEP, "telemetry": CMD_TELEMETRY,
+               "profile": CMD_PROFILE, "query": CMD_QUERY}
+    cmd_args = b""
+    if args.frame == "query":
+        cmd_args = query_args(args.type, args.tag, args.hours)
+    return slip_frame(SF_COMMAND, command(key, opcodes[args.frame], args.counter, cmd_args))
+
+
+def main():
+    """Send one uplink frame to a serial port, or write it to stdout."""
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("-p", "--port", help="serial port; stdout when omitted")
+    parser.add_argument("-b", "--baudrate", type=int, default=115200)
+    parser.add_argument("-k", "--key", help="command key, 32 hex digits")
+    sub = parser.add_subparsers(dest="frame", required=True)
+    for name in ("ping", "sweep", "telemetry", "profile", "query"):
+        p = sub.add_parser(name)
+        p.add_argument("counter", type=int)
+        if name == "query":
+            p.add_argument("type", type=int, help="record type, 0 for any")
+            p.add_argument("tag", type=int, help="tag, 255 for any")
+            p.add_argument("hours", type=int, help="how far back")
+    p = sub.add_parser("start")
+    p.add_argument("id", type=int)
+    p.add_argument("start", type=int, help="from mission time [s]")
+    p.add_argument("until", type=int, help="mission time [s], 4294967295 for the newest")
+    p.add_argument("type", type=int)
+    p.add_argument("tag", type=int)
+    p = sub.add_parser("nack")
+    p.add_argument("id", type=int)
+    p.add_argument("first", type=int)
+    p.add_argument("missing", help="bitmap in hex")
+    args = parser.parse_args()
+
+    data = _frame(args)
+    if args.port is None:
+        sys.stdout.buffer.write(data)
+        return
+    import serial
+    with serial.Serial(args.port, args.baudrate, timeout=1.0) as port:
+        port.write(data)
+
+
+if __name__ == "__main__":
+    main()